@@ -0,0 +1,330 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+
+#ifndef AcceptanceTestAdaptiveComposite_H
+#define AcceptanceTestAdaptiveComposite_H
+
+// ITK
+#include "itkImageRegion.h"
+
+// Custom
+#include "AcceptanceTestStaticComposite.h"
+
+// Submodules
+#include <PatchMatch/AcceptanceTest.h>
+#include <PatchMatch/Match.h>
+
+// STL
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+/** An acceptance test that accepts a match only if all of TTests accept it (like
+  * AcceptanceTestStaticComposite), and that learns the order in which to run them. It measures the
+  * rejection rate and (on a sample of calls) the time of each test, and every ReorderInterval
+  * candidates sorts the tests by cost / rejection rate, which minimizes the expected cost per
+  * candidate of a short-circuiting chain. The measurements are halved at each reorder so that the
+  * order follows changes in the thresholds, the image and the ring.
+  *
+  * By default the last test listed stays last, so that an expensive test listed last only sees the
+  * candidates that every other test accepted. With SetAdaptive(false) the tests are run in the
+  * order they are listed, through an AcceptanceTestStaticComposite, and nothing is measured. The
+  * tests are not owned. */
+template <typename... TTests>
+class AcceptanceTestAdaptiveComposite : public AcceptanceTest
+{
+  static_assert(sizeof...(TTests) <= 4, "CallTest() dispatches to at most 4 tests.");
+
+public:
+
+  /** The measurements of one test since the last reorder (halved at each reorder). */
+  struct TestStatistics
+  {
+    double Calls = 0.0;
+    double Rejections = 0.0;
+    double TimedCalls = 0.0;
+    double TimedNanoseconds = 0.0;
+
+    /** The fraction of its calls that the test rejected. */
+    double GetRejectionRate() const
+    {
+      return this->Calls > 0.0 ? this->Rejections / this->Calls : 0.0;
+    }
+
+    /** The mean time of a call in nanoseconds, or 0 if it has not been timed. */
+    double GetMeanCost() const
+    {
+      return this->TimedCalls > 0.0 ? this->TimedNanoseconds / this->TimedCalls : 0.0;
+    }
+  };
+
+  AcceptanceTestAdaptiveComposite(TTests* const... tests) : Tests(tests...), FixedOrderComposite(tests...)
+  {
+    for(unsigned int testId = 0; testId < sizeof...(TTests); ++testId)
+    {
+      this->Order[testId] = testId;
+    }
+  }
+
+  bool IsBetterWithScore(const itk::ImageRegion<2>& queryRegion, const Match& currentMatch,
+                         const Match& potentialBetterMatch, float& score)
+  {
+    if(!this->Adaptive)
+    {
+      return this->FixedOrderComposite.IsBetterWithScore(queryRegion, currentMatch, potentialBetterMatch, score);
+    }
+
+    score = 0.0f;
+
+    const bool timeThisCall = (this->CandidatesSinceReorder % this->TimingInterval) == 0;
+
+    bool better = true;
+    for(unsigned int position = 0; position < sizeof...(TTests) && better; ++position)
+    {
+      const unsigned int testId = this->Order[position];
+      TestStatistics& statistics = this->Statistics[testId];
+
+      float testScore = 0.0f;
+      bool includeInScore = false;
+      if(timeThisCall)
+      {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        better = CallTest(testId, queryRegion, currentMatch, potentialBetterMatch, testScore, includeInScore);
+        statistics.TimedNanoseconds +=
+            std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        statistics.TimedCalls += 1.0;
+      }
+      else
+      {
+        better = CallTest(testId, queryRegion, currentMatch, potentialBetterMatch, testScore, includeInScore);
+      }
+
+      statistics.Calls += 1.0;
+      if(!better)
+      {
+        statistics.Rejections += 1.0;
+      }
+      else if(includeInScore)
+      {
+        score += testScore;
+      }
+    }
+
+    if(++this->CandidatesSinceReorder >= this->ReorderInterval)
+    {
+      Reorder();
+    }
+
+    return better;
+  }
+
+  /** Learn the order (the default), or run the tests in the order they are listed. */
+  void SetAdaptive(const bool adaptive)
+  {
+    this->Adaptive = adaptive;
+  }
+
+  /** Reconsider the order after this many candidates. */
+  void SetReorderInterval(const unsigned int reorderInterval)
+  {
+    this->ReorderInterval = std::max(1u, reorderInterval);
+  }
+
+  /** Time one in this many candidates. */
+  void SetTimingInterval(const unsigned int timingInterval)
+  {
+    this->TimingInterval = std::max(1u, timingInterval);
+  }
+
+  /** Keep the last test listed at the end of the chain (the default), or let it move too. */
+  void SetLastTestFixed(const bool lastTestFixed)
+  {
+    this->LastTestFixed = lastTestFixed;
+  }
+
+  /** Name the tests (in the order they were listed) for GetOrderDescription(). */
+  void SetTestNames(const std::vector<std::string>& testNames)
+  {
+    this->TestNames = testNames;
+  }
+
+  /** The ids (positions in the template argument list) of the tests in the order they are run. */
+  std::vector<unsigned int> GetOrder() const
+  {
+    return std::vector<unsigned int>(this->Order, this->Order + sizeof...(TTests));
+  }
+
+  /** The current order as "name > name > ...", using the test ids where no names were set. */
+  std::string GetOrderDescription() const
+  {
+    std::stringstream description;
+    for(unsigned int position = 0; position < sizeof...(TTests); ++position)
+    {
+      const unsigned int testId = this->Order[position];
+      if(position > 0)
+      {
+        description << " > ";
+      }
+      if(testId < this->TestNames.size())
+      {
+        description << this->TestNames[testId];
+      }
+      else
+      {
+        description << testId;
+      }
+    }
+    return description.str();
+  }
+
+  /** The number of times the order has changed. */
+  unsigned int GetNumberOfReorders() const
+  {
+    return this->NumberOfReorders;
+  }
+
+  const TestStatistics& GetTestStatistics(const unsigned int testId) const
+  {
+    return this->Statistics[testId];
+  }
+
+private:
+
+  typedef std::tuple<TTests*...> TestsType;
+
+  /** Run test 'testId' (its position in the template argument list). The switch over the
+    * permuted ids replaces a table of function pointers, so every call is direct. */
+  bool CallTest(const unsigned int testId, const itk::ImageRegion<2>& queryRegion, const Match& currentMatch,
+                const Match& potentialBetterMatch, float& score, bool& includeInScore)
+  {
+    switch(testId)
+    {
+      case 0:
+        return CallTestAt<0>(queryRegion, currentMatch, potentialBetterMatch, score, includeInScore);
+      case 1:
+        return CallTestAt<1>(queryRegion, currentMatch, potentialBetterMatch, score, includeInScore);
+      case 2:
+        return CallTestAt<2>(queryRegion, currentMatch, potentialBetterMatch, score, includeInScore);
+      case 3:
+        return CallTestAt<3>(queryRegion, currentMatch, potentialBetterMatch, score, includeInScore);
+      default:
+        assert(false);
+        return false;
+    }
+  }
+
+  /** Call test TTestId through its concrete type, so that the call is not virtual. */
+  template <size_t TTestId>
+  typename std::enable_if<(TTestId < sizeof...(TTests)), bool>::type
+  CallTestAt(const itk::ImageRegion<2>& queryRegion, const Match& currentMatch,
+             const Match& potentialBetterMatch, float& score, bool& includeInScore)
+  {
+    typedef typename std::tuple_element<TTestId, TestsType>::type TestPointerType;
+    typedef typename std::remove_pointer<TestPointerType>::type TestType;
+    TestType* const test = std::get<TTestId>(this->Tests);
+    includeInScore = test->GetIncludeInScore();
+    return test->TestType::IsBetterWithScore(queryRegion, currentMatch, potentialBetterMatch, score);
+  }
+
+  /** The cases of CallTest() beyond the number of tests are never reached. */
+  template <size_t TTestId>
+  typename std::enable_if<(TTestId >= sizeof...(TTests)), bool>::type
+  CallTestAt(const itk::ImageRegion<2>&, const Match&, const Match&, float&, bool&)
+  {
+    return false;
+  }
+
+  /** Sort the (movable) tests by cost per rejection, and age the measurements. */
+  void Reorder()
+  {
+    this->CandidatesSinceReorder = 0;
+
+    // A test that has not been timed yet goes first, so that it gets measured.
+    double ranks[sizeof...(TTests)];
+    for(unsigned int testId = 0; testId < sizeof...(TTests); ++testId)
+    {
+      const TestStatistics& statistics = this->Statistics[testId];
+      if(statistics.TimedCalls == 0.0)
+      {
+        ranks[testId] = 0.0;
+      }
+      else
+      {
+        ranks[testId] = statistics.GetMeanCost() /
+                        std::max(statistics.GetRejectionRate(), std::numeric_limits<double>::epsilon());
+      }
+    }
+
+    const unsigned int numberOfMovableTests =
+        (this->LastTestFixed && sizeof...(TTests) > 0) ? sizeof...(TTests) - 1 : sizeof...(TTests);
+    unsigned int newOrder[sizeof...(TTests)];
+    std::copy(this->Order, this->Order + sizeof...(TTests), newOrder);
+    std::stable_sort(newOrder, newOrder + numberOfMovableTests,
+                     [&ranks](const unsigned int a, const unsigned int b) {return ranks[a] < ranks[b];});
+
+    if(!std::equal(newOrder, newOrder + sizeof...(TTests), this->Order))
+    {
+      std::copy(newOrder, newOrder + sizeof...(TTests), this->Order);
+      this->NumberOfReorders++;
+    }
+
+    for(unsigned int testId = 0; testId < sizeof...(TTests); ++testId)
+    {
+      TestStatistics& statistics = this->Statistics[testId];
+      statistics.Calls /= 2.0;
+      statistics.Rejections /= 2.0;
+      statistics.TimedCalls /= 2.0;
+      statistics.TimedNanoseconds /= 2.0;
+    }
+  }
+
+  TestsType Tests;
+
+  /** Runs the tests in the order they are listed when the order is not adaptive. */
+  AcceptanceTestStaticComposite<TTests...> FixedOrderComposite;
+
+  /** Order[position] is the id of the test run at 'position'. */
+  unsigned int Order[sizeof...(TTests)];
+
+  TestStatistics Statistics[sizeof...(TTests)];
+
+  std::vector<std::string> TestNames;
+
+  unsigned int ReorderInterval = 1024;
+
+  unsigned int TimingInterval = 16;
+
+  unsigned int CandidatesSinceReorder = 0;
+
+  unsigned int NumberOfReorders = 0;
+
+  bool LastTestFixed = true;
+
+  bool Adaptive = true;
+};
+
+#endif
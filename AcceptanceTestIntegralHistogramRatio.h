@@ -0,0 +1,164 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef AcceptanceTestIntegralHistogramRatio_H
+#define AcceptanceTestIntegralHistogramRatio_H
+
+// ITK
+#include "itkImageRegion.h"
+
+// Submodules
+#include <PatchMatch/AcceptanceTest.h>
+#include <PatchMatch/Match.h>
+
+// STL
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/** Accept a match if the histogram difference between the query patch and the match is at most
+  * MaxNeighborHistogramRatio times the largest histogram difference between the query patch and
+  * the 8 patches shifted by one pixel from it. The histograms are the concatenated per-component
+  * histograms of the (e.g. HSV) image, quantized to NumberOfBinsPerDimension bins over
+  * [RangeMin, RangeMax], and the difference is the L1 distance of the normalized histograms.
+  *
+  * This is a drop in replacement for AcceptanceTestNeighborHistogramRatio that precomputes the
+  * quantized image and, if it fits in the memory budget, an integral histogram of the region set
+  * with SetIntegralHistogramRegion(), so that the histogram of any patch in that region costs
+  * O(bins) instead of O(patch pixels). The neighbor difference depends only on the query patch, so
+  * it is cached per query and reused across calls to SetMaxNeighborHistogramRatio().
+  *
+  * Copies share these tables and the cache, so each thread can cheaply have its own copy with its
+  * own MaxNeighborHistogramRatio. A single copy must not be used by several threads at once. */
+template <typename TImage>
+class AcceptanceTestIntegralHistogramRatio : public AcceptanceTest
+{
+public:
+  typedef uint32_t CountType;
+
+  /** Set the image to compute histograms of. */
+  void SetImage(TImage* const image);
+
+  /** Set the range of the values of every component of the image. */
+  void SetRangeMin(const float rangeMin);
+  void SetRangeMax(const float rangeMax);
+
+  /** Set the patch radius, which must match the regions that are tested. */
+  void SetPatchRadius(const unsigned int patchRadius);
+
+  /** Set the number of histogram bins for each component of the image. */
+  void SetNumberOfBinsPerDimension(const unsigned int numberOfBinsPerDimension);
+
+  /** Set the largest accepted ratio of the match difference to the neighbor difference. */
+  void SetMaxNeighborHistogramRatio(const float maxNeighborHistogramRatio);
+
+  /** Set the largest integral histogram (in bytes) to build. Larger regions fall back to counting
+    * the quantized patch pixels. */
+  void SetMemoryBudget(const size_t memoryBudget);
+
+  /** Only build the integral histogram over 'region' (cropped to the image), e.g. the hole and the
+    * source patches near it; the histograms of patches that are not entirely inside it are counted.
+    * An empty region (the default) covers the whole image, which needs
+    * 4 * (width + 1) * (height + 1) * bins bytes. */
+  void SetIntegralHistogramRegion(const itk::ImageRegion<2>& region);
+
+  /** Quantize the image and build the integral histogram. Call this after the setters and
+    * before the first test. */
+  void Initialize();
+
+  /** True if Initialize() built an integral histogram (rather than falling back). */
+  bool UsesIntegralHistogram() const;
+
+  bool IsBetterWithScore(const itk::ImageRegion<2>& queryRegion, const Match& currentMatch,
+                         const Match& potentialBetterMatch, float& score);
+
+  /** The L1 distance between the normalized histograms of two regions. */
+  float ComputeHistogramDifference(const itk::ImageRegion<2>& region1, const itk::ImageRegion<2>& region2) const;
+
+private:
+
+  /** Write the histogram of 'region' (cropped to the image) into 'histogram' (TotalBins long)
+    * and return the number of pixels counted. */
+  unsigned int ComputeHistogram(const itk::ImageRegion<2>& region, CountType* const histogram) const;
+
+  /** The L1 distance between two histograms normalized by their pixel counts. */
+  float HistogramDifference(const CountType* const histogram1, const unsigned int pixels1,
+                            const CountType* const histogram2, const unsigned int pixels2) const;
+
+  /** Get (computing and caching it if needed) the largest difference between the query patch and
+    * its 8 one-pixel-shifted neighbors. */
+  float GetMaxNeighborDifference(const itk::ImageRegion<2>& queryRegion, const CountType* const queryHistogram,
+                                 const unsigned int queryPixels);
+
+  TImage* Image = nullptr;
+
+  float RangeMin = 0.0f;
+
+  float RangeMax = 1.0f;
+
+  unsigned int PatchRadius = 0;
+
+  unsigned int NumberOfBinsPerDimension = 30;
+
+  float MaxNeighborHistogramRatio = 2.0f;
+
+  size_t MemoryBudget = 256 * 1024 * 1024;
+
+  itk::ImageRegion<2> IntegralHistogramRegion;
+
+  /** The number of components of the image. */
+  unsigned int NumberOfComponents = 0;
+
+  /** NumberOfComponents * NumberOfBinsPerDimension. */
+  unsigned int TotalBins = 0;
+
+  itk::ImageRegion<2> FullRegion;
+
+  /** The tables built by Initialize(). They are read only afterwards (apart from the atomic
+    * cache), which is what allows copies to share them. */
+  struct TablesType
+  {
+    /** The bin of every component of every pixel, offset so that component c uses bins
+      * [c * NumberOfBinsPerDimension, (c + 1) * NumberOfBinsPerDimension). */
+    std::vector<uint16_t> QuantizedImage;
+
+    /** The region the integral histogram covers. */
+    itk::ImageRegion<2> IntegralRegion;
+
+    /** IntegralHistogram[(y * (width + 1) + x) * TotalBins + bin] is the count of 'bin' over the
+      * pixels [0, x) x [0, y) of IntegralRegion. Empty if it does not fit in the memory budget. */
+    std::vector<CountType> IntegralHistogram;
+
+    /** The cached neighbor difference of each query patch center, negative if not computed yet.
+      * Atomic so that several threads may test queries concurrently. */
+    std::unique_ptr<std::atomic<float>[]> NeighborDifferenceCache;
+  };
+
+  std::shared_ptr<TablesType> Tables = std::make_shared<TablesType>();
+
+  /** The histograms of the current test (TotalBins long), kept so that testing does not allocate.
+    * Each copy has its own. */
+  mutable std::vector<CountType> QueryHistogram;
+  mutable std::vector<CountType> MatchHistogram;
+  std::vector<CountType> NeighborHistogram;
+};
+
+#include "AcceptanceTestIntegralHistogramRatio.hpp"
+
+#endif
@@ -0,0 +1,378 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef AcceptanceTestIntegralHistogramRatio_HPP
+#define AcceptanceTestIntegralHistogramRatio_HPP
+
+#include "AcceptanceTestIntegralHistogramRatio.h"
+
+// ITK
+#include "itkImageRegionConstIterator.h"
+
+// STL
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+template <typename TImage>
+void AcceptanceTestIntegralHistogramRatio<TImage>::SetImage(TImage* const image)
+{
+  this->Image = image;
+}
+
+template <typename TImage>
+void AcceptanceTestIntegralHistogramRatio<TImage>::SetRangeMin(const float rangeMin)
+{
+  this->RangeMin = rangeMin;
+}
+
+template <typename TImage>
+void AcceptanceTestIntegralHistogramRatio<TImage>::SetRangeMax(const float rangeMax)
+{
+  this->RangeMax = rangeMax;
+}
+
+template <typename TImage>
+void AcceptanceTestIntegralHistogramRatio<TImage>::SetPatchRadius(const unsigned int patchRadius)
+{
+  this->PatchRadius = patchRadius;
+}
+
+template <typename TImage>
+void AcceptanceTestIntegralHistogramRatio<TImage>::SetNumberOfBinsPerDimension(const unsigned int numberOfBinsPerDimension)
+{
+  this->NumberOfBinsPerDimension = numberOfBinsPerDimension;
+}
+
+template <typename TImage>
+void AcceptanceTestIntegralHistogramRatio<TImage>::SetMaxNeighborHistogramRatio(const float maxNeighborHistogramRatio)
+{
+  this->MaxNeighborHistogramRatio = maxNeighborHistogramRatio;
+}
+
+template <typename TImage>
+void AcceptanceTestIntegralHistogramRatio<TImage>::SetMemoryBudget(const size_t memoryBudget)
+{
+  this->MemoryBudget = memoryBudget;
+}
+
+template <typename TImage>
+void AcceptanceTestIntegralHistogramRatio<TImage>::SetIntegralHistogramRegion(const itk::ImageRegion<2>& region)
+{
+  this->IntegralHistogramRegion = region;
+}
+
+template <typename TImage>
+bool AcceptanceTestIntegralHistogramRatio<TImage>::UsesIntegralHistogram() const
+{
+  return !this->Tables->IntegralHistogram.empty();
+}
+
+template <typename TImage>
+void AcceptanceTestIntegralHistogramRatio<TImage>::Initialize()
+{
+  assert(this->Image);
+
+  if(this->RangeMax <= this->RangeMin || this->NumberOfBinsPerDimension == 0)
+  {
+    throw std::runtime_error("AcceptanceTestIntegralHistogramRatio: invalid range or number of bins!");
+  }
+
+  this->FullRegion = this->Image->GetLargestPossibleRegion();
+  this->NumberOfComponents = this->Image->GetNumberOfComponentsPerPixel();
+  this->TotalBins = this->NumberOfComponents * this->NumberOfBinsPerDimension;
+
+  if(this->TotalBins > std::numeric_limits<uint16_t>::max())
+  {
+    throw std::runtime_error("AcceptanceTestIntegralHistogramRatio: too many bins!");
+  }
+
+  const size_t width = this->FullRegion.GetSize()[0];
+  const size_t height = this->FullRegion.GetSize()[1];
+  const size_t numberOfPixels = width * height;
+
+  // New tables, so that copies made before this call keep the ones they share.
+  this->Tables = std::make_shared<TablesType>();
+
+  // Quantize every component of every pixel once.
+  this->Tables->QuantizedImage.resize(numberOfPixels * this->NumberOfComponents);
+  const float binsPerUnit = static_cast<float>(this->NumberOfBinsPerDimension) / (this->RangeMax - this->RangeMin);
+  const int lastBin = static_cast<int>(this->NumberOfBinsPerDimension) - 1;
+
+  itk::ImageRegionConstIterator<TImage> imageIterator(this->Image, this->FullRegion);
+  size_t pixelId = 0;
+  while(!imageIterator.IsAtEnd())
+  {
+    typename TImage::PixelType pixel = imageIterator.Get();
+    for(unsigned int component = 0; component < this->NumberOfComponents; ++component)
+    {
+      int bin = static_cast<int>((pixel[component] - this->RangeMin) * binsPerUnit);
+      bin = std::max(0, std::min(lastBin, bin));
+      this->Tables->QuantizedImage[pixelId * this->NumberOfComponents + component] =
+          static_cast<uint16_t>(component * this->NumberOfBinsPerDimension + bin);
+    }
+    ++pixelId;
+    ++imageIterator;
+  }
+
+  // Build the integral histogram of the requested region if it fits. A region outside of the
+  // image leaves it empty, so every histogram is counted.
+  this->Tables->IntegralRegion = this->FullRegion;
+  if(this->IntegralHistogramRegion.GetNumberOfPixels() > 0)
+  {
+    this->Tables->IntegralRegion = this->IntegralHistogramRegion;
+    if(!this->Tables->IntegralRegion.Crop(this->FullRegion))
+    {
+      this->Tables->IntegralRegion = itk::ImageRegion<2>();
+    }
+  }
+
+  const size_t integralWidth = this->Tables->IntegralRegion.GetSize()[0];
+  const size_t integralHeight = this->Tables->IntegralRegion.GetSize()[1];
+  const size_t integralX0 = this->Tables->IntegralRegion.GetIndex()[0] - this->FullRegion.GetIndex()[0];
+  const size_t integralY0 = this->Tables->IntegralRegion.GetIndex()[1] - this->FullRegion.GetIndex()[1];
+
+  this->Tables->IntegralHistogram.clear();
+  const size_t integralEntries = (integralWidth + 1) * (integralHeight + 1) * this->TotalBins;
+  const bool integralRegionEmpty = integralWidth == 0 || integralHeight == 0;
+  if(!integralRegionEmpty && integralEntries * sizeof(CountType) <= this->MemoryBudget)
+  {
+    this->Tables->IntegralHistogram.assign(integralEntries, 0);
+
+    std::vector<CountType> rowHistogram(this->TotalBins);
+    for(size_t y = 0; y < integralHeight; ++y)
+    {
+      std::fill(rowHistogram.begin(), rowHistogram.end(), 0);
+      const CountType* above = &this->Tables->IntegralHistogram[(y * (integralWidth + 1) + 1) * this->TotalBins];
+      CountType* current = &this->Tables->IntegralHistogram[((y + 1) * (integralWidth + 1) + 1) * this->TotalBins];
+
+      for(size_t x = 0; x < integralWidth; ++x)
+      {
+        const uint16_t* bins =
+          &this->Tables->QuantizedImage[((integralY0 + y) * width + integralX0 + x) * this->NumberOfComponents];
+        for(unsigned int component = 0; component < this->NumberOfComponents; ++component)
+        {
+          rowHistogram[bins[component]]++;
+        }
+
+        for(unsigned int bin = 0; bin < this->TotalBins; ++bin)
+        {
+          current[bin] = above[bin] + rowHistogram[bin];
+        }
+
+        above += this->TotalBins;
+        current += this->TotalBins;
+      }
+    }
+  }
+  else if(!integralRegionEmpty)
+  {
+    std::cout << "AcceptanceTestIntegralHistogramRatio: the integral histogram would need "
+              << integralEntries * sizeof(CountType) << " bytes (budget " << this->MemoryBudget
+              << "); counting patch pixels instead." << std::endl;
+  }
+
+  this->QueryHistogram.assign(this->TotalBins, 0);
+  this->MatchHistogram.assign(this->TotalBins, 0);
+  this->NeighborHistogram.assign(this->TotalBins, 0);
+
+  this->Tables->NeighborDifferenceCache.reset(new std::atomic<float>[numberOfPixels]);
+  for(size_t cacheId = 0; cacheId < numberOfPixels; ++cacheId)
+  {
+    this->Tables->NeighborDifferenceCache[cacheId].store(-1.0f, std::memory_order_relaxed);
+  }
+}
+
+template <typename TImage>
+unsigned int AcceptanceTestIntegralHistogramRatio<TImage>::ComputeHistogram(const itk::ImageRegion<2>& region,
+                                                                          CountType* const histogram) const
+{
+  itk::ImageRegion<2> croppedRegion = region;
+  if(!croppedRegion.Crop(this->FullRegion))
+  {
+    std::fill(histogram, histogram + this->TotalBins, 0);
+    return 0;
+  }
+
+  const size_t width = this->FullRegion.GetSize()[0];
+  const size_t x0 = croppedRegion.GetIndex()[0] - this->FullRegion.GetIndex()[0];
+  const size_t y0 = croppedRegion.GetIndex()[1] - this->FullRegion.GetIndex()[1];
+  const size_t x1 = x0 + croppedRegion.GetSize()[0];
+  const size_t y1 = y0 + croppedRegion.GetSize()[1];
+
+  if(!this->Tables->IntegralHistogram.empty() && this->Tables->IntegralRegion.IsInside(croppedRegion))
+  {
+    // Corners relative to the integral region
+    const itk::ImageRegion<2>& integralRegion = this->Tables->IntegralRegion;
+    const size_t stride = integralRegion.GetSize()[0] + 1;
+    const size_t ix0 = croppedRegion.GetIndex()[0] - integralRegion.GetIndex()[0];
+    const size_t iy0 = croppedRegion.GetIndex()[1] - integralRegion.GetIndex()[1];
+    const size_t ix1 = ix0 + croppedRegion.GetSize()[0];
+    const size_t iy1 = iy0 + croppedRegion.GetSize()[1];
+
+    const CountType* bottomRight = &this->Tables->IntegralHistogram[(iy1 * stride + ix1) * this->TotalBins];
+    const CountType* bottomLeft = &this->Tables->IntegralHistogram[(iy1 * stride + ix0) * this->TotalBins];
+    const CountType* topRight = &this->Tables->IntegralHistogram[(iy0 * stride + ix1) * this->TotalBins];
+    const CountType* topLeft = &this->Tables->IntegralHistogram[(iy0 * stride + ix0) * this->TotalBins];
+
+    for(unsigned int bin = 0; bin < this->TotalBins; ++bin)
+    {
+      histogram[bin] = bottomRight[bin] - bottomLeft[bin] - topRight[bin] + topLeft[bin];
+    }
+  }
+  else
+  {
+    std::fill(histogram, histogram + this->TotalBins, 0);
+    for(size_t y = y0; y < y1; ++y)
+    {
+      const uint16_t* bins = &this->Tables->QuantizedImage[(y * width + x0) * this->NumberOfComponents];
+      const size_t numberOfValues = (x1 - x0) * this->NumberOfComponents;
+      for(size_t valueId = 0; valueId < numberOfValues; ++valueId)
+      {
+        histogram[bins[valueId]]++;
+      }
+    }
+  }
+
+  return static_cast<unsigned int>((x1 - x0) * (y1 - y0));
+}
+
+template <typename TImage>
+float AcceptanceTestIntegralHistogramRatio<TImage>::HistogramDifference(const CountType* const histogram1,
+                                                                        const unsigned int pixels1,
+                                                                        const CountType* const histogram2,
+                                                                        const unsigned int pixels2) const
+{
+  if(pixels1 == 0 || pixels2 == 0)
+  {
+    return 0.0f;
+  }
+
+  // Normalize so that each component's histogram sums to 1.
+  const float weight1 = 1.0f / static_cast<float>(pixels1);
+  const float weight2 = 1.0f / static_cast<float>(pixels2);
+
+  float difference = 0.0f;
+  for(unsigned int bin = 0; bin < this->TotalBins; ++bin)
+  {
+    difference += std::fabs(weight1 * histogram1[bin] - weight2 * histogram2[bin]);
+  }
+  return difference;
+}
+
+template <typename TImage>
+float AcceptanceTestIntegralHistogramRatio<TImage>::ComputeHistogramDifference(const itk::ImageRegion<2>& region1,
+                                                                               const itk::ImageRegion<2>& region2) const
+{
+  assert(this->QueryHistogram.size() == this->TotalBins); // Initialize() must be called first
+
+  unsigned int pixels1 = ComputeHistogram(region1, this->QueryHistogram.data());
+  unsigned int pixels2 = ComputeHistogram(region2, this->MatchHistogram.data());
+  return HistogramDifference(this->QueryHistogram.data(), pixels1, this->MatchHistogram.data(), pixels2);
+}
+
+template <typename TImage>
+float AcceptanceTestIntegralHistogramRatio<TImage>::GetMaxNeighborDifference(const itk::ImageRegion<2>& queryRegion,
+                                                                             const CountType* const queryHistogram,
+                                                                             const unsigned int queryPixels)
+{
+  itk::Index<2> queryCenter = queryRegion.GetIndex();
+  queryCenter[0] += this->PatchRadius;
+  queryCenter[1] += this->PatchRadius;
+
+  const bool cacheable = this->FullRegion.IsInside(queryCenter);
+  size_t cacheId = 0;
+  if(cacheable)
+  {
+    cacheId = (queryCenter[1] - this->FullRegion.GetIndex()[1]) * this->FullRegion.GetSize()[0] +
+              (queryCenter[0] - this->FullRegion.GetIndex()[0]);
+    float cachedDifference = this->Tables->NeighborDifferenceCache[cacheId].load(std::memory_order_relaxed);
+    if(cachedDifference >= 0.0f)
+    {
+      return cachedDifference;
+    }
+  }
+
+  float maxNeighborDifference = 0.0f;
+  for(int yOffset = -1; yOffset <= 1; ++yOffset)
+  {
+    for(int xOffset = -1; xOffset <= 1; ++xOffset)
+    {
+      if(xOffset == 0 && yOffset == 0)
+      {
+        continue;
+      }
+
+      itk::ImageRegion<2> neighborRegion = queryRegion;
+      itk::Index<2> neighborCorner = queryRegion.GetIndex();
+      neighborCorner[0] += xOffset;
+      neighborCorner[1] += yOffset;
+      neighborRegion.SetIndex(neighborCorner);
+
+      if(!this->FullRegion.IsInside(neighborRegion))
+      {
+        continue;
+      }
+
+      unsigned int neighborPixels = ComputeHistogram(neighborRegion, this->NeighborHistogram.data());
+      maxNeighborDifference = std::max(maxNeighborDifference,
+                                       HistogramDifference(queryHistogram, queryPixels,
+                                                           this->NeighborHistogram.data(), neighborPixels));
+    }
+  }
+
+  if(cacheable)
+  {
+    this->Tables->NeighborDifferenceCache[cacheId].store(maxNeighborDifference, std::memory_order_relaxed);
+  }
+
+  return maxNeighborDifference;
+}
+
+template <typename TImage>
+bool AcceptanceTestIntegralHistogramRatio<TImage>::IsBetterWithScore(const itk::ImageRegion<2>& queryRegion,
+                                                                     const Match& currentMatch,
+                                                                     const Match& potentialBetterMatch, float& score)
+{
+  assert(this->QueryHistogram.size() == this->TotalBins); // Initialize() must be called first
+
+  unsigned int queryPixels = ComputeHistogram(queryRegion, this->QueryHistogram.data());
+  unsigned int matchPixels = ComputeHistogram(potentialBetterMatch.GetRegion(), this->MatchHistogram.data());
+
+  float matchDifference = HistogramDifference(this->QueryHistogram.data(), queryPixels,
+                                              this->MatchHistogram.data(), matchPixels);
+
+  float maxNeighborDifference = GetMaxNeighborDifference(queryRegion, this->QueryHistogram.data(), queryPixels);
+
+  // In a flat region every neighbor has the same histogram, so no difference is within a finite
+  // ratio of it: only a match with the same histogram is accepted.
+  if(maxNeighborDifference <= 0.0f)
+  {
+    score = (matchDifference <= 0.0f) ? 0.0f : std::numeric_limits<float>::max();
+    return matchDifference <= 0.0f;
+  }
+
+  float ratio = matchDifference / maxNeighborDifference;
+  score = ratio;
+
+  return ratio <= this->MaxNeighborHistogramRatio;
+}
+
+#endif
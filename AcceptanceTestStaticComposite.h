@@ -0,0 +1,105 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+
+#ifndef AcceptanceTestStaticComposite_H
+#define AcceptanceTestStaticComposite_H
+
+// ITK
+#include "itkImageRegion.h"
+
+// Submodules
+#include <PatchMatch/AcceptanceTest.h>
+#include <PatchMatch/Match.h>
+
+// STL
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+
+/** An acceptance test that accepts a match only if all of TTests accept it, like
+  * AcceptanceTestComposite, but with the tests fixed at compile time. The tests are called in the
+  * order they are listed and the first rejection stops the chain, so list the cheap, selective tests
+  * first. Each test is called through its concrete type, so the chain has no virtual calls and
+  * can be inlined. The score is the sum of the scores of the tests with IncludeInScore set.
+  *
+  * The tests are not owned. Use AcceptanceTestComposite when the tests are only known at run time. */
+template <typename... TTests>
+class AcceptanceTestStaticComposite : public AcceptanceTest
+{
+public:
+
+  AcceptanceTestStaticComposite(TTests* const... tests) : Tests(tests...) {}
+
+  bool IsBetterWithScore(const itk::ImageRegion<2>& queryRegion, const Match& currentMatch,
+                         const Match& potentialBetterMatch, float& score)
+  {
+    score = 0.0f;
+    return TestFrom<0>(queryRegion, currentMatch, potentialBetterMatch, score);
+  }
+
+  /** Get the test at position TTestId. */
+  template <size_t TTestId>
+  typename std::tuple_element<TTestId, std::tuple<TTests...> >::type* GetAcceptanceTest() const
+  {
+    return std::get<TTestId>(this->Tests);
+  }
+
+  static constexpr size_t GetNumberOfAcceptanceTests()
+  {
+    return sizeof...(TTests);
+  }
+
+private:
+
+  /** Run the tests from TTestId on. */
+  template <size_t TTestId>
+  typename std::enable_if<(TTestId < sizeof...(TTests)), bool>::type
+  TestFrom(const itk::ImageRegion<2>& queryRegion, const Match& currentMatch,
+           const Match& potentialBetterMatch, float& score)
+  {
+    typedef typename std::tuple_element<TTestId, std::tuple<TTests...> >::type TestType;
+    TestType* const test = std::get<TTestId>(this->Tests);
+
+    float testScore = 0.0f;
+    // Qualified, so that the call is not virtual
+    if(!test->TestType::IsBetterWithScore(queryRegion, currentMatch, potentialBetterMatch, testScore))
+    {
+      return false;
+    }
+
+    if(test->GetIncludeInScore())
+    {
+      score += testScore;
+    }
+
+    return TestFrom<TTestId + 1>(queryRegion, currentMatch, potentialBetterMatch, score);
+  }
+
+  /** Every test accepted the match. */
+  template <size_t TTestId>
+  typename std::enable_if<(TTestId == sizeof...(TTests)), bool>::type
+  TestFrom(const itk::ImageRegion<2>&, const Match&, const Match&, float&)
+  {
+    return true;
+  }
+
+  std::tuple<TTests*...> Tests;
+};
+
+#endif
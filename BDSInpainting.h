@@ -21,6 +21,10 @@
 
 #include "InpaintingAlgorithm.h"
 
+// Custom
+#include "CountingFunctors.h"
+#include "PatchDistanceSearchWindow.h"
+
 // ITK
 #include "itkCovariantVector.h"
 #include "itkImage.h"
@@ -30,6 +34,7 @@
 // Submodules
 #include <Mask/Mask.h>
 #include <PatchMatch/PatchMatch.h>
+#include <PatchComparison/SSD.h>
 #include <Compositor.h>
 
 /** This class takes a nearest neighbor field and a target mask and
@@ -42,14 +47,106 @@ public:
 
   typedef InpaintingAlgorithm<TImage> Superclass;
 
+  /** The patch distance functor Inpaint() gives to propagation and random search. Their functors
+    * must be declared with this type (e.g. Propagator<PatchDistanceFunctorType>), since
+    * PatchDistanceCounting::Distance() and PatchDistanceSearchWindow::Distance() are not virtual
+    * and would not count evaluations or restrict the random search through a pointer to SSD. */
+  typedef PatchDistanceSearchWindow<PatchDistanceCounting<SSD<TImage> > > PatchDistanceFunctorType;
+
   /** Compute the nn-field for the target pixels and then composite the patches.*/
   template <typename TPatchMatchFunctor, typename TCompositor>
   void Inpaint(TPatchMatchFunctor* const patchMatchFunctor, TCompositor* const compositor);
 
+  /** Set a field whose matches initialize the target pixels before the first iteration, e.g. one
+    * upsampled from a coarser resolution, so that PatchMatch refines them instead of starting from
+    * scratch. Each match is moved to the nearest valid patch center and rescored on the image.
+    * Target pixels without a match in the field are left to PatchMatch. nullptr (the default)
+    * leaves the whole field to PatchMatch. */
+  void SetInitialNNField(NNFieldType* const nnField);
+
+  /** Only use source patches that are entirely in the valid region of 'mask' (as well as outside
+    * of the hole). Every pixel of 'mask' must be either the hole value or the valid value.
+    * nullptr (the default) allows the whole image. */
+  void SetSourceMask(Mask* const mask);
+
+  /** Only use source patches whose centers are within 'sourceBandRadius' pixels of the hole. This
+    * bounds how far a match can be from the pixels it fills, and only the bounding box of the band
+    * is scanned for source patches. Zero (the default) allows the whole image. */
+  void SetSourceBandRadius(const unsigned int sourceBandRadius);
+
+  /** Only let the random search of each target pixel use source patches within
+    * 'randomSearchRadius' pixels of that pixel's match in the initial field (see
+    * SetInitialNNField()), so that PatchMatch refines it locally. Sources outside of the window
+    * get the largest patch distance, and patch centers outside of every window are not valid, so
+    * they are not sampled at all. Propagation is not restricted. Zero (the default) searches the
+    * whole image. This has no effect without an initial field. */
+  void SetRandomSearchRadius(const unsigned int randomSearchRadius);
+
+  /** Stop iterating once an iteration changes the hole pixels by less than 'tolerance' on
+    * average (per component). Zero (the default) always runs all of the iterations. */
+  void SetConvergenceTolerance(const float tolerance);
+
+  /** Get the number of iterations the last Inpaint() ran. */
+  unsigned int GetNumberOfIterationsRun() const;
+
+  /** Get the mean absolute change (per component) of the hole pixels in the last iteration of
+    * the last Inpaint(). */
+  float GetLastChange() const;
+
 protected:
   typedef itk::Image<bool, 2> BoolImageType;
+
+  /** Mark the centers of the patches that may be used as sources: entirely outside of the hole,
+    * inside the source mask and within the source band, if they are set. */
   void ConstructValidPatchCentersImage();
   BoolImageType::Pointer ValidPatchCentersImage = BoolImageType::New();
+
+  /** Copy the matches of InitialNNField at 'targetPixels' into 'nnField', moved to valid patch
+    * centers and scored on 'image'. */
+  void ApplyInitialNNField(TImage* const image, const std::vector<itk::Index<2> >& targetPixels,
+                           NNFieldType* const nnField);
+
+  typedef itk::Image<itk::Index<2>, 2> IndexImageType;
+
+  /** Set the random search window center of each of 'targetPixels' that got a match from
+    * InitialNNField in 'nnField' to the center of that match, and of every other pixel to
+    * {-1, -1}, in 'windowCenters'. Make the patch centers farther than RandomSearchRadius from
+    * all of the window centers invalid. */
+  void RestrictValidPatchCentersToInitialMatches(const std::vector<itk::Index<2> >& targetPixels,
+                                                 const NNFieldType* const nnField,
+                                                 IndexImageType* const windowCenters);
+
+  /** Find the nearest pixel of every pixel that is true in 'seeds', or {-1, -1} if there is none.
+    * This is a two pass (approximate) Euclidean distance transform. */
+  static void ComputeNearestPixels(const BoolImageType* const seeds, IndexImageType* const nearestPixels);
+
+  /** Get the mean absolute difference (per component) of 'image1' and 'image2' at 'pixels'. */
+  static float ComputeMeanChange(const TImage* const image1, const TImage* const image2,
+                                 const std::vector<itk::Index<2> >& pixels);
+
+  /** The field set with SetInitialNNField(), if any. */
+  NNFieldType::Pointer InitialNNField;
+
+  /** The mask set with SetSourceMask(), if any. */
+  Mask::Pointer SourceMask;
+
+  /** The SourceMask packed into bits. */
+  PackedMask PackedSourceMask;
+
+  /** How far from the hole source patch centers may be. Zero means anywhere. */
+  unsigned int SourceBandRadius = 0;
+
+  /** How far from the initial matches to search. Zero means the whole image. */
+  unsigned int RandomSearchRadius = 0;
+
+  /** The mean change below which the iterations stop. */
+  float ConvergenceTolerance = 0.0f;
+
+  /** The number of iterations the last Inpaint() ran. */
+  unsigned int NumberOfIterationsRun = 0;
+
+  /** The mean change of the hole pixels in the last iteration. */
+  float LastChange = 0.0f;
 };
 
 #include "BDSInpainting.hpp"
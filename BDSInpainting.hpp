@@ -21,6 +21,12 @@
 
 #include "BDSInpainting.h"
 
+// Custom
+#include "CountingFunctors.h"
+#include "DebugSink.h"
+#include "PerformanceCounters.h"
+#include "Trace.h"
+
 // Submodules
 #include <ITKHelpers/ITKHelpers.h>
 
@@ -36,16 +42,28 @@
 #include "itkImageRegionReverseIterator.h"
 
 // STL
+#include <algorithm>
+#include <cmath>
 #include <ctime>
 
+// Boost
+#include <boost/signals2.hpp>
+
 template <typename TImage>
 template <typename TPatchMatchFunctor, typename TCompositor>
 void BDSInpainting<TImage>::Inpaint(TPatchMatchFunctor* const patchMatchFunctor,
                                     TCompositor* const compositor)
 {
+  BDS_TRACE_SCOPE("BDSInpainting::Inpaint");
+
   assert(this->Image);
   assert(this->InpaintingMask);
 
+  this->Counters.Reset();
+  this->StartRun();
+  this->NumberOfIterationsRun = 0;
+  this->LastChange = 0.0f;
+
   ConstructValidPatchCentersImage();
 
   // Initialize the output with the input
@@ -58,49 +76,398 @@ void BDSInpainting<TImage>::Inpaint(TPatchMatchFunctor* const patchMatchFunctor,
   nnField->SetRegions(currentImage->GetLargestPossibleRegion());
   nnField->Allocate();
 
-  // Initialize the NNField in the target region
-  typedef SSD<TImage> PatchDistanceFunctorType;
-  PatchDistanceFunctorType patchDistanceFunctor;
-  patchDistanceFunctor.SetImage(currentImage);
+  // Initialize the NNField in the target region. Propagation and random search get their own
+  // (counting) distance functors so that their attempts can be told apart.
+  PatchDistanceFunctorType propagationPatchDistanceFunctor;
+  propagationPatchDistanceFunctor.SetImage(currentImage);
+  propagationPatchDistanceFunctor.SetStatisticsCollector(&this->Counters,
+                                                         &InpaintingStatistics::PropagationAttempts);
+
+  PatchDistanceFunctorType randomSearchPatchDistanceFunctor;
+  randomSearchPatchDistanceFunctor.SetImage(currentImage);
+  randomSearchPatchDistanceFunctor.SetStatisticsCollector(&this->Counters,
+                                                          &InpaintingStatistics::RandomSearchAttempts);
 
   patchMatchFunctor->SetValidPatchCentersImage(this->ValidPatchCentersImage);
 
-  std::vector<itk::Index<2> > pixelsToProcess = this->InpaintingMask->GetHolePixels();
+  std::vector<itk::Index<2> > pixelsToProcess = this->PackedInpaintingMask.GetHolePixels();
   patchMatchFunctor->SetTargetPixels(pixelsToProcess);
   patchMatchFunctor->SetPatchRadius(this->PatchRadius);
 
-  patchMatchFunctor->GetPropagationFunctor()->SetPatchDistanceFunctor(&patchDistanceFunctor);
+  // The random search window of each target pixel, if RandomSearchRadius restricts it
+  IndexImageType::Pointer searchWindowCenters = IndexImageType::New();
+
+  if(this->InitialNNField)
+  {
+    ApplyInitialNNField(currentImage, pixelsToProcess, patchMatchFunctor->GetNNField());
+
+    if(this->RandomSearchRadius > 0)
+    {
+      RestrictValidPatchCentersToInitialMatches(pixelsToProcess, patchMatchFunctor->GetNNField(),
+                                                searchWindowCenters);
+      randomSearchPatchDistanceFunctor.SetSearchWindows(searchWindowCenters, this->RandomSearchRadius);
+    }
+  }
+
+  patchMatchFunctor->GetPropagationFunctor()->SetPatchDistanceFunctor(&propagationPatchDistanceFunctor);
   patchMatchFunctor->GetPropagationFunctor()->SetPatchRadius(this->PatchRadius);
 
   patchMatchFunctor->GetRandomSearchFunctor()->SetImage(this->Image);
   patchMatchFunctor->GetRandomSearchFunctor()->SetPatchRadius(this->PatchRadius);
-  patchMatchFunctor->GetRandomSearchFunctor()->SetPatchDistanceFunctor(&patchDistanceFunctor);
+  patchMatchFunctor->GetRandomSearchFunctor()->SetPatchDistanceFunctor(&randomSearchPatchDistanceFunctor);
+
+  // Count the accepted candidates. The connections are released when Inpaint() returns.
+  boost::signals2::scoped_connection propagationAcceptedConnection(
+    patchMatchFunctor->GetPropagationFunctor()->AcceptedSignal.connect(
+      [this](const itk::Index<2>&, const itk::Index<2>&, const float)
+      {this->Counters.Increment(&InpaintingStatistics::PropagationAcceptances);}));
+
+  boost::signals2::scoped_connection randomSearchAcceptedConnection(
+    patchMatchFunctor->GetRandomSearchFunctor()->AcceptedSignal.connect(
+      [this](const itk::Index<2>&, const itk::Index<2>&, const float)
+      {this->Counters.Increment(&InpaintingStatistics::RandomSearchAcceptances);}));
 
   compositor->SetPatchRadius(this->PatchRadius);
   compositor->SetTargetMask(this->InpaintingMask);
   compositor->SetImage(currentImage);
   compositor->SetNearestNeighborField(patchMatchFunctor->GetNNField());
+  compositor->SetStatisticsCollector(&this->Counters);
 
   for(unsigned int iteration = 0; iteration < this->Iterations; ++iteration)
   {
+    // Each iteration leaves a complete image in currentImage, so stopping here keeps the best result so far.
+    if(this->ShouldStop("BDSInpainting::Iteration",
+                        static_cast<float>(iteration) / static_cast<float>(this->Iterations)))
+    {
+      break;
+    }
+
+    BDS_TRACE_SCOPE_ITERATION("BDSInpainting::Iteration", iteration);
+
     // Run PatchMatch to compute the NNField
-    patchMatchFunctor->Compute();
+    {
+      BDS_TRACE_SCOPE_ITERATION("PatchMatch::Compute", iteration);
+      BDS_PERF_SCOPE_ITERATION("PatchMatch::Compute", iteration);
+      patchMatchFunctor->Compute();
+    }
 
-    std::stringstream ssNNFieldFileName;
-    ssNNFieldFileName << "BDS_" << iteration << "_NNField.mha";
-    PatchMatchHelpers::WriteNNField(patchMatchFunctor->GetNNField(), ssNNFieldFileName.str());
+    if(DebugSink::Instance().IsEnabled(DebugSink::ITERATIONS))
+    {
+      std::stringstream ssNNFieldFileName;
+      ssNNFieldFileName << "BDS_" << iteration << "_NNField.mha";
+      DebugSink::Instance().WriteNNField(DebugSink::ITERATIONS, patchMatchFunctor->GetNNField(),
+                                         ssNNFieldFileName.str());
+    }
 
     // Update the target pixels
-    compositor->Composite();
-    ITKHelpers::DeepCopy(compositor->GetOutput(), currentImage.GetPointer());
+    {
+      BDS_TRACE_SCOPE_ITERATION("BDSInpainting::Composite", iteration);
+      BDS_PERF_SCOPE_ITERATION("BDSInpainting::Composite", iteration);
+      compositor->Composite();
+      this->LastChange = ComputeMeanChange(compositor->GetOutput(), currentImage, pixelsToProcess);
+      ITKHelpers::DeepCopy(compositor->GetOutput(), currentImage.GetPointer());
+    }
+
+    this->NumberOfIterationsRun = iteration + 1;
+    this->Completeness = static_cast<float>(iteration + 1) / static_cast<float>(this->Iterations);
+
+    if(this->LastChange < this->ConvergenceTolerance)
+    {
+      std::cout << "BDSInpainting converged after " << iteration + 1 << " iterations (mean change "
+                << this->LastChange << ")." << std::endl;
+      break;
+    }
+  }
+
+  if(this->StopReason == Superclass::COMPLETED)
+  {
+    this->Completeness = 1.0f;
   }
 
   ITKHelpers::DeepCopy(currentImage.GetPointer(), this->Output.GetPointer());
 }
 
+template <typename TImage>
+void BDSInpainting<TImage>::SetInitialNNField(NNFieldType* const nnField)
+{
+  this->InitialNNField = nnField;
+}
+
+template <typename TImage>
+void BDSInpainting<TImage>::ApplyInitialNNField(TImage* const image,
+                                                const std::vector<itk::Index<2> >& targetPixels,
+                                                NNFieldType* const nnField)
+{
+  BDS_TRACE_SCOPE("BDSInpainting::ApplyInitialNNField");
+
+  assert(this->InitialNNField->GetLargestPossibleRegion() == nnField->GetLargestPossibleRegion());
+
+  SSD<TImage> patchDistanceFunctor;
+  patchDistanceFunctor.SetImage(image);
+
+  // Only computed if a match has to be moved
+  IndexImageType::Pointer nearestValidPatchCenters;
+
+  for(size_t pixelId = 0; pixelId < targetPixels.size(); ++pixelId)
+  {
+    const MatchSet& initialMatches = this->InitialNNField->GetPixel(targetPixels[pixelId]);
+    if(initialMatches.GetNumberOfMatches() == 0)
+    {
+      continue;
+    }
+
+    itk::Index<2> sourceCenter = ITKHelpers::GetRegionCenter(initialMatches.GetMatch(0).GetRegion());
+    if(!this->ValidPatchCentersImage->GetLargestPossibleRegion().IsInside(sourceCenter) ||
+       !this->ValidPatchCentersImage->GetPixel(sourceCenter))
+    {
+      if(!nearestValidPatchCenters)
+      {
+        nearestValidPatchCenters = IndexImageType::New();
+        ComputeNearestPixels(this->ValidPatchCentersImage, nearestValidPatchCenters);
+      }
+
+      // Clamp the center into the image before looking up its nearest valid center
+      const itk::ImageRegion<2> region = nearestValidPatchCenters->GetLargestPossibleRegion();
+      for(unsigned int dimension = 0; dimension < 2; ++dimension)
+      {
+        sourceCenter[dimension] = std::max(sourceCenter[dimension], region.GetIndex()[dimension]);
+        sourceCenter[dimension] = std::min(sourceCenter[dimension], region.GetUpperIndex()[dimension]);
+      }
+
+      sourceCenter = nearestValidPatchCenters->GetPixel(sourceCenter);
+      if(sourceCenter[0] < 0)
+      {
+        // There are no valid patch centers at all
+        return;
+      }
+    }
+
+    const itk::ImageRegion<2> queryRegion =
+      ITKHelpers::GetRegionInRadiusAroundPixel(targetPixels[pixelId], this->PatchRadius);
+    const itk::ImageRegion<2> sourceRegion = ITKHelpers::GetRegionInRadiusAroundPixel(sourceCenter, this->PatchRadius);
+
+    Match initialMatch;
+    initialMatch.SetRegion(sourceRegion);
+    initialMatch.SetScore(patchDistanceFunctor.Distance(sourceRegion, queryRegion));
+    initialMatch.SetVerified(false);
+
+    MatchSet matchSet = nnField->GetPixel(targetPixels[pixelId]);
+    matchSet.Clear();
+    matchSet.AddMatch(initialMatch);
+    nnField->SetPixel(targetPixels[pixelId], matchSet);
+  }
+}
+
+template <typename TImage>
+void BDSInpainting<TImage>::ComputeNearestPixels(const BoolImageType* const seeds,
+                                                 IndexImageType* const nearestPixels)
+{
+  BDS_TRACE_SCOPE("BDSInpainting::ComputeNearestPixels");
+
+  const itk::ImageRegion<2> region = seeds->GetLargestPossibleRegion();
+  nearestPixels->SetRegions(region);
+  nearestPixels->Allocate();
+
+  const itk::Index<2> noPixel = {{-1, -1}};
+
+  itk::ImageRegionIteratorWithIndex<IndexImageType> iterator(nearestPixels, region);
+  while(!iterator.IsAtEnd())
+  {
+    iterator.Set(seeds->GetPixel(iterator.GetIndex()) ? iterator.GetIndex() : noPixel);
+    ++iterator;
+  }
+
+  // Take the nearest seed of a neighbor if it is nearer than the current one
+  auto relax = [nearestPixels, &region](const itk::Index<2>& pixel, const itk::Offset<2>& offset)
+  {
+    const itk::Index<2> neighbor = pixel + offset;
+    if(!region.IsInside(neighbor))
+    {
+      return;
+    }
+
+    const itk::Index<2> candidate = nearestPixels->GetPixel(neighbor);
+    if(candidate[0] < 0)
+    {
+      return;
+    }
+
+    const itk::Index<2> current = nearestPixels->GetPixel(pixel);
+    const itk::Offset<2> candidateOffset = candidate - pixel;
+    const itk::Offset<2> currentOffset = current - pixel;
+    if(current[0] < 0 ||
+       candidateOffset[0] * candidateOffset[0] + candidateOffset[1] * candidateOffset[1] <
+       currentOffset[0] * currentOffset[0] + currentOffset[1] * currentOffset[1])
+    {
+      nearestPixels->SetPixel(pixel, candidate);
+    }
+  };
+
+  const itk::Offset<2> forwardOffsets[4] = {{{-1, -1}}, {{0, -1}}, {{1, -1}}, {{-1, 0}}};
+  const itk::Offset<2> backwardOffsets[4] = {{{1, 1}}, {{0, 1}}, {{-1, 1}}, {{1, 0}}};
+
+  const itk::Index<2> first = region.GetIndex();
+  const itk::Index<2> last = region.GetUpperIndex();
+
+  for(itk::IndexValueType y = first[1]; y <= last[1]; ++y)
+  {
+    for(itk::IndexValueType x = first[0]; x <= last[0]; ++x)
+    {
+      const itk::Index<2> pixel = {{x, y}};
+      for(unsigned int offsetId = 0; offsetId < 4; ++offsetId)
+      {
+        relax(pixel, forwardOffsets[offsetId]);
+      }
+    }
+  }
+
+  for(itk::IndexValueType y = last[1]; y >= first[1]; --y)
+  {
+    for(itk::IndexValueType x = last[0]; x >= first[0]; --x)
+    {
+      const itk::Index<2> pixel = {{x, y}};
+      for(unsigned int offsetId = 0; offsetId < 4; ++offsetId)
+      {
+        relax(pixel, backwardOffsets[offsetId]);
+      }
+    }
+  }
+}
+
+template <typename TImage>
+void BDSInpainting<TImage>::RestrictValidPatchCentersToInitialMatches(const std::vector<itk::Index<2> >& targetPixels,
+                                                                      const NNFieldType* const nnField,
+                                                                      IndexImageType* const windowCenters)
+{
+  BDS_TRACE_SCOPE("BDSInpainting::RestrictValidPatchCentersToInitialMatches");
+
+  const itk::Index<2> noWindowCenter = {{-1, -1}};
+  windowCenters->SetRegions(this->ValidPatchCentersImage->GetLargestPossibleRegion());
+  windowCenters->Allocate();
+  ITKHelpers::SetImageToConstant(windowCenters, noWindowCenter);
+
+  BoolImageType::Pointer matchCenters = BoolImageType::New();
+  matchCenters->SetRegions(this->ValidPatchCentersImage->GetLargestPossibleRegion());
+  matchCenters->Allocate();
+  ITKHelpers::SetImageToConstant(matchCenters.GetPointer(), false);
+
+  bool hasMatchCenters = false;
+  for(size_t pixelId = 0; pixelId < targetPixels.size(); ++pixelId)
+  {
+    if(this->InitialNNField->GetPixel(targetPixels[pixelId]).GetNumberOfMatches() == 0 ||
+       nnField->GetPixel(targetPixels[pixelId]).GetNumberOfMatches() == 0)
+    {
+      continue;
+    }
+
+    const itk::Index<2> matchCenter =
+      ITKHelpers::GetRegionCenter(nnField->GetPixel(targetPixels[pixelId]).GetMatch(0).GetRegion());
+    windowCenters->SetPixel(targetPixels[pixelId], matchCenter);
+    matchCenters->SetPixel(matchCenter, true);
+    hasMatchCenters = true;
+  }
+
+  if(!hasMatchCenters)
+  {
+    return;
+  }
+
+  IndexImageType::Pointer nearestMatchCenters = IndexImageType::New();
+  ComputeNearestPixels(matchCenters, nearestMatchCenters);
+
+  const itk::OffsetValueType squaredRadius =
+    static_cast<itk::OffsetValueType>(this->RandomSearchRadius) * this->RandomSearchRadius;
+
+  itk::ImageRegionIteratorWithIndex<BoolImageType> iterator(this->ValidPatchCentersImage.GetPointer(),
+                                                            this->ValidPatchCentersImage->GetLargestPossibleRegion());
+  while(!iterator.IsAtEnd())
+  {
+    if(iterator.Get())
+    {
+      const itk::Offset<2> offset = nearestMatchCenters->GetPixel(iterator.GetIndex()) - iterator.GetIndex();
+      if(offset[0] * offset[0] + offset[1] * offset[1] > squaredRadius)
+      {
+        iterator.Set(false);
+      }
+    }
+    ++iterator;
+  }
+}
+
+template <typename TImage>
+float BDSInpainting<TImage>::ComputeMeanChange(const TImage* const image1, const TImage* const image2,
+                                               const std::vector<itk::Index<2> >& pixels)
+{
+  const unsigned int numberOfComponents = image1->GetNumberOfComponentsPerPixel();
+  if(pixels.empty() || numberOfComponents == 0)
+  {
+    return 0.0f;
+  }
+
+  double sum = 0.0;
+  for(size_t pixelId = 0; pixelId < pixels.size(); ++pixelId)
+  {
+    const typename TImage::PixelType pixel1 = image1->GetPixel(pixels[pixelId]);
+    const typename TImage::PixelType pixel2 = image2->GetPixel(pixels[pixelId]);
+    for(unsigned int component = 0; component < numberOfComponents; ++component)
+    {
+      sum += std::abs(static_cast<double>(pixel1[component]) - static_cast<double>(pixel2[component]));
+    }
+  }
+
+  return static_cast<float>(sum / (static_cast<double>(pixels.size()) * numberOfComponents));
+}
+
+template <typename TImage>
+void BDSInpainting<TImage>::SetSourceMask(Mask* const mask)
+{
+  if(!mask)
+  {
+    this->SourceMask = nullptr;
+    this->PackedSourceMask = PackedMask();
+    return;
+  }
+
+  this->SourceMask = Mask::New();
+  this->SourceMask->DeepCopyFrom(mask);
+  this->PackedSourceMask.SetFromMask(this->SourceMask);
+}
+
+template <typename TImage>
+void BDSInpainting<TImage>::SetSourceBandRadius(const unsigned int sourceBandRadius)
+{
+  this->SourceBandRadius = sourceBandRadius;
+}
+
+template <typename TImage>
+void BDSInpainting<TImage>::SetRandomSearchRadius(const unsigned int randomSearchRadius)
+{
+  this->RandomSearchRadius = randomSearchRadius;
+}
+
+template <typename TImage>
+void BDSInpainting<TImage>::SetConvergenceTolerance(const float tolerance)
+{
+  this->ConvergenceTolerance = tolerance;
+}
+
+template <typename TImage>
+unsigned int BDSInpainting<TImage>::GetNumberOfIterationsRun() const
+{
+  return this->NumberOfIterationsRun;
+}
+
+template <typename TImage>
+float BDSInpainting<TImage>::GetLastChange() const
+{
+  return this->LastChange;
+}
+
 template <typename TImage>
 void BDSInpainting<TImage>::ConstructValidPatchCentersImage()
 {
+    BDS_TRACE_SCOPE("BDSInpainting::ConstructValidPatchCentersImage");
+
     this->ValidPatchCentersImage->SetRegions(this->Image->GetLargestPossibleRegion());
     this->ValidPatchCentersImage->Allocate();
 
@@ -109,22 +476,77 @@ void BDSInpainting<TImage>::ConstructValidPatchCentersImage()
     itk::ImageRegion<2> internalRegion = ITKHelpers::GetInternalRegion(this->InpaintingMask->GetLargestPossibleRegion(),
                                               this->PatchRadius);
 
+    assert(!this->SourceMask ||
+           this->SourceMask->GetLargestPossibleRegion() == this->InpaintingMask->GetLargestPossibleRegion());
+
+    // With a band radius only the patch centers near the hole are sources, so only the bounding
+    // box of the band has to be scanned.
+    itk::ImageRegion<2> searchRegion = internalRegion;
+    bool searchRegionIsEmpty = false;
+    IndexImageType::Pointer nearestHolePixels;
+    if(this->SourceBandRadius > 0)
+    {
+      std::vector<itk::Index<2> > holePixels = this->PackedInpaintingMask.GetHolePixels();
+      searchRegionIsEmpty = holePixels.empty();
+
+      if(!searchRegionIsEmpty)
+      {
+        itk::ImageRegion<2> bandRegion = this->PackedInpaintingMask.GetHoleBoundingBox();
+        bandRegion.PadByRadius(this->SourceBandRadius);
+        bandRegion.Crop(this->InpaintingMask->GetLargestPossibleRegion());
+
+        searchRegionIsEmpty = !searchRegion.Crop(bandRegion);
+
+        BoolImageType::Pointer holeImage = BoolImageType::New();
+        holeImage->SetRegions(bandRegion);
+        holeImage->Allocate();
+        ITKHelpers::SetImageToConstant(holeImage.GetPointer(), false);
+        for(size_t pixelId = 0; pixelId < holePixels.size(); ++pixelId)
+        {
+          holeImage->SetPixel(holePixels[pixelId], true);
+        }
+
+        nearestHolePixels = IndexImageType::New();
+        ComputeNearestPixels(holeImage, nearestHolePixels);
+      }
+    }
+
+    const itk::OffsetValueType squaredBandRadius =
+      static_cast<itk::OffsetValueType>(this->SourceBandRadius) * this->SourceBandRadius;
+
+    uint64_t numberOfSourcePatchCenters = 0;
+
 //    itk::ImageRegionIteratorWithIndex<Mask> maskIterator(this->InpaintingMask.GetPointer(), internalRegion);
-    itk::ImageRegionIteratorWithIndex<BoolImageType> iterator(this->ValidPatchCentersImage.GetPointer(), internalRegion);
+    itk::ImageRegionIteratorWithIndex<BoolImageType> iterator(this->ValidPatchCentersImage.GetPointer(), searchRegion);
 
-    while(!iterator.IsAtEnd())
+    while(!searchRegionIsEmpty && !iterator.IsAtEnd())
     {
+      if(nearestHolePixels)
+      {
+        const itk::Offset<2> offset = nearestHolePixels->GetPixel(iterator.GetIndex()) - iterator.GetIndex();
+        if(offset[0] * offset[0] + offset[1] * offset[1] > squaredBandRadius)
+        {
+          ++iterator;
+          continue;
+        }
+      }
+
       itk::ImageRegion<2> targetRegion = ITKHelpers::GetRegionInRadiusAroundPixel(iterator.GetIndex(), this->PatchRadius);
 
-      if(this->InpaintingMask->IsValid(targetRegion))
+      if(this->PackedInpaintingMask.IsValid(targetRegion) &&
+         (!this->SourceMask || this->PackedSourceMask.IsValid(targetRegion)))
       {
           iterator.Set(true);
+          numberOfSourcePatchCenters++;
       }
 
       ++iterator;
     }
 
-    ITKHelpers::WriteBoolImage(this->ValidPatchCentersImage.GetPointer(), "ValidPatchCentersImage.png");
+    this->Counters.Increment(&InpaintingStatistics::SourcePatchCenters, numberOfSourcePatchCenters);
+
+    DebugSink::Instance().Write<BoolImageType>(DebugSink::SUMMARY, this->ValidPatchCentersImage.GetPointer(),
+      [](const BoolImageType* image) {ITKHelpers::WriteBoolImage(image, "ValidPatchCentersImage.png");});
 }
 
 #endif
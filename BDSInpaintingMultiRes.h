@@ -16,12 +16,23 @@
  *
  *=========================================================================*/
 
+
 #ifndef BDSInpaintingMultiRes_H
 #define BDSInpaintingMultiRes_H
 
 #include "BDSInpainting.h"
+#include "ImagePyramid.h"
+
+// STL
+#include <map>
+#include <vector>
 
-/** This class uses a BDSInpainting object to inpaint an image over multiple resolutions. */
+/** This class uses a BDSInpainting object to inpaint an image over multiple resolutions.
+  * The image and mask are downsampled ResolutionLevels-1 times by DownsampleFactor (see
+  * ImagePyramid). The coarsest level is inpainted first, and the result of each level (image
+  * and nearest neighbor field) is upsampled to initialize the next finer level, which then
+  * only has to refine it. The source mask and the source band (see BDSInpainting) are scaled to
+  * each level. */
 template <typename TImage>
 class BDSInpaintingMultiRes : public BDSInpainting<TImage>
 {
@@ -29,29 +40,147 @@ public:
 
   typedef BDSInpainting<TImage> Superclass;
 
-  // Inherited typedefs
-  typedef typename Superclass::PatchMatchFunctorType PatchMatchFunctorType;
+  /** The work done at one level. */
+  struct LevelSchedule
+  {
+    /** The largest number of BDS iterations (PatchMatch, then compositing). */
+    unsigned int Iterations = 1;
+
+    /** The number of PatchMatch iterations in each BDS iteration. */
+    unsigned int PatchMatchIterations = 5;
+
+    /** How far from the upsampled matches source patches are searched for. Zero means the whole
+      * image. This has no effect at the coarsest level, which has no upsampled matches. */
+    unsigned int RandomSearchRadius = 0;
+  };
+
+  /** What one level of the last Inpaint() did. */
+  struct LevelReport
+  {
+    /** The level, 0 being the original resolution. */
+    unsigned int Level = 0;
+
+    /** The schedule the level ran with. */
+    LevelSchedule Schedule;
+
+    /** The number of BDS iterations that were run before the level converged or stopped. */
+    unsigned int IterationsRun = 0;
+
+    /** The fraction of the upsampled matches that PatchMatch moved by more than the upsampling
+      * error, or -1 at the coarsest level. */
+    float ChangedMatchFraction = -1.0f;
 
-  /** This function does the actual work of inpainting a single level.
-    * It is called from Compute() at multiple resolutions. */
-  void Compute(TImage* const image, Mask* const sourceMask, Mask* const targetMask,
-               typename PatchMatch<TImage>::PMImageType* previousNNField, TImage* const output);
+    /** The wall clock time of the level. */
+    double Seconds = 0.0;
+  };
 
+  /** FIXED_SCHEDULE runs Iterations BDS iterations at every level, SetPatchMatchIterations()
+    * PatchMatch iterations over the whole image at the coarsest level, and
+    * SetRefinementPatchMatchIterations() PatchMatch iterations within SetRefinementSearchRadius()
+    * of the upsampled matches at the finer levels. AUTOMATIC_SCHEDULE stops each level when it
+    * converges (see SetConvergenceTolerance()) and picks the schedule of each finer level from
+    * how the level below it converged: half of its iterations, and the more of the upsampled
+    * matches it moved, the more PatchMatch iterations and (past one half) the whole image to search. */
+  enum ScheduleModeEnum {FIXED_SCHEDULE, AUTOMATIC_SCHEDULE};
 
-  /** Set the number of resolution levels to use. */
+  /** Inpaint every level, from the coarsest to the original resolution. The same functors
+    * are used at every level; they are given the image of each level in turn. */
+  template <typename TPatchMatchFunctor, typename TCompositor>
+  void Inpaint(TPatchMatchFunctor* const patchMatchFunctor, TCompositor* const compositor);
+
+  /** Set the image to fill. Its pyramid is built by the next Inpaint() and reused by the
+    * following ones, e.g. to fill other masks of the same image. */
+  void SetImage(TImage* const image);
+
+  /** Set the number of resolution levels to use, including the original resolution. */
   void SetResolutionLevels(const unsigned int resolutionLevels);
 
   /** Set the amount to downsample the image to construct the different resolutions. */
   void SetDownsampleFactor(const float downsampleFactor);
 
+  /** Set the number of PatchMatch iterations at the coarsest level, which starts from scratch. */
+  void SetPatchMatchIterations(const unsigned int patchMatchIterations);
+
+  /** Set the number of PatchMatch iterations at the finer levels, which start from the
+    * upsampled field of the level below. */
+  void SetRefinementPatchMatchIterations(const unsigned int refinementPatchMatchIterations);
+
+  /** Set how far from the upsampled matches the finer levels search for source patches. */
+  void SetRefinementSearchRadius(const unsigned int refinementSearchRadius);
+
+  /** Set how the schedule of the levels is chosen. The default is FIXED_SCHEDULE. */
+  void SetScheduleMode(const ScheduleModeEnum scheduleMode);
+
+  /** Set the schedule of 'level' (0 being the original resolution) explicitly, in either mode. */
+  void SetLevelSchedule(const unsigned int level, const LevelSchedule& schedule);
+
+  /** Forget the schedules set with SetLevelSchedule(). */
+  void ClearLevelSchedules();
+
+  /** Get what each level of the last Inpaint() did, coarsest first. */
+  const std::vector<LevelReport>& GetLevelReports() const;
+
+  /** Get the number of levels the last Inpaint() used. Levels that would be too small to
+    * hold a few patches are not used. */
+  unsigned int GetNumberOfLevelsUsed() const;
+
 private:
 
+  /** Get the schedule of 'level'. 'coarserReport' is the report of the level below it, or
+    * nullptr at the coarsest level. */
+  LevelSchedule ComputeLevelSchedule(const unsigned int level, const LevelReport* const coarserReport) const;
+
+  /** Get the fraction of the hole pixels of 'mask' whose match in 'nnField' is more than the
+    * upsampling error away from their match in 'initialNNField'. */
+  float ComputeChangedMatchFraction(const NNFieldType* const initialNNField, const NNFieldType* const nnField,
+                                    const Mask* const mask) const;
+
+  /** Resample 'image' to the size of 'destination' and copy the result into the hole of 'destination'. */
+  void UpsampleIntoHole(const TImage* const image, TImage* const destination,
+                        const Mask* const destinationMask) const;
+
+  /** Scale the matches of the hole pixels of 'coarseNNField' up to the resolution of 'fineMask'.
+    * The offset of each match is scaled by 1/DownsampleFactor and the match is clamped into the
+    * image; BDSInpainting moves it to the nearest valid patch center. */
+  void UpsampleNNField(const NNFieldType* const coarseNNField, const Mask* const fineMask,
+                       NNFieldType* const fineNNField) const;
+
   /** The number of resolutions to use. */
   unsigned int ResolutionLevels = 3;
 
   /** How much to downsample the image at each level. */
   float DownsampleFactor = 0.5;
 
+  /** The number of PatchMatch iterations at the coarsest level. */
+  unsigned int PatchMatchIterations = 5;
+
+  /** The number of PatchMatch iterations at the finer levels. */
+  unsigned int RefinementPatchMatchIterations = 2;
+
+  /** How far from the upsampled matches the finer levels search. */
+  unsigned int RefinementSearchRadius = 8;
+
+  /** How the schedule of the levels is chosen. */
+  ScheduleModeEnum ScheduleMode = FIXED_SCHEDULE;
+
+  /** The schedules set with SetLevelSchedule(), by level. */
+  std::map<unsigned int, LevelSchedule> LevelSchedules;
+
+  /** The iteration limit of the coarsest level in AUTOMATIC_SCHEDULE mode. */
+  unsigned int MaximumAutomaticIterations = 10;
+
+  /** The convergence tolerance of AUTOMATIC_SCHEDULE mode if none is set. */
+  float DefaultAutomaticConvergenceTolerance = 0.5f;
+
+  /** What each level of the last Inpaint() did. */
+  std::vector<LevelReport> LevelReports;
+
+  /** The number of levels the last Inpaint() used. */
+  unsigned int NumberOfLevelsUsed = 0;
+
+  /** The downsampled images and masks. */
+  ImagePyramid<TImage> Pyramid;
+
 };
 
 #include "BDSInpaintingMultiRes.hpp"
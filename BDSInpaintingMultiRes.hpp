@@ -16,517 +16,424 @@
  *
  *=========================================================================*/
 
-#ifndef BDSInpainting_HPP
-#define BDSInpainting_HPP
 
-#include "BDSInpainting.h"
+#ifndef BDSInpaintingMultiRes_HPP
+#define BDSInpaintingMultiRes_HPP
+
+#include "BDSInpaintingMultiRes.h"
+
+// Custom
+#include "DebugSink.h"
+#include "Trace.h"
 
 // Submodules
 #include <ITKHelpers/ITKHelpers.h>
 #include <Mask/MaskOperations.h>
-#include <PatchMatch/PatchMatch.h>
-#include <PatchComparison/SSD.h>
-#include <PoissonEditing/PoissonEditing.h>
-
-// ITK
-#include "itkImageRegionReverseIterator.h"
 
 // STL
-#include <ctime>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
 
 template <typename TImage>
-void BDSInpainting<TImage>::Inpaint()
+template <typename TPatchMatchFunctor, typename TCompositor>
+void BDSInpaintingMultiRes<TImage>::Inpaint(TPatchMatchFunctor* const patchMatchFunctor,
+                                            TCompositor* const compositor)
 {
-
-  // The finest scale masks and image are simply the user inputs.
-  Mask::Pointer level0sourceMask = Mask::New();
-  level0sourceMask->DeepCopyFrom(this->SourceMask);
-
-  Mask::Pointer level0targetMask = Mask::New();
-  level0targetMask->DeepCopyFrom(this->TargetMask);
-
-  typename TImage::Pointer level0Image = TImage::New();
-  ITKHelpers::DeepCopy(this->Image.GetPointer(), level0Image.GetPointer());
-
-  std::vector<typename TImage::Pointer> imageLevels(this->ResolutionLevels);
-  std::vector<Mask::Pointer> sourceMaskLevels(this->ResolutionLevels);
-  std::vector<Mask::Pointer> targetMaskLevels(this->ResolutionLevels);
-
-  imageLevels[0] = level0Image;
-  sourceMaskLevels[0] = level0sourceMask;
-  targetMaskLevels[0] = level0targetMask;
-
-  // Downsample the image and mask to the number of specified resolutions.
-  // Start at level 1 because 0 is the full resolution (provided directly by the user)
-  for(unsigned int level = 1; level < this->ResolutionLevels; ++level)
+  BDS_TRACE_SCOPE("BDSInpaintingMultiRes::Inpaint");
+
+  assert(this->Image);
+  assert(this->InpaintingMask);
+
+  this->Counters.Reset();
+  this->StartRun();
+
+  // The image levels are only rebuilt if the image or the parameters have changed
+  this->Pyramid.SetDownsampleFactor(this->DownsampleFactor);
+  this->Pyramid.SetMaximumNumberOfLevels(this->ResolutionLevels);
+  // A level must be able to hold a few patches
+  this->Pyramid.SetMinimumSize(4 * this->PatchRadius + 1);
+  this->Pyramid.Update();
+  this->Pyramid.SetMask(this->InpaintingMask);
+  this->Pyramid.SetSourceMask(this->SourceMask);
+
+  const unsigned int numberOfLevels = this->Pyramid.GetNumberOfLevels();
+  this->NumberOfLevelsUsed = numberOfLevels;
+  this->LevelReports.clear();
+
+  // In AUTOMATIC_SCHEDULE mode every level stops when it converges
+  float convergenceTolerance = this->ConvergenceTolerance;
+  if(this->ScheduleMode == AUTOMATIC_SCHEDULE && convergenceTolerance <= 0.0f)
   {
-    // At each level we want the image to be the previous level size modified by the downsample factor
-    itk::Size<2> destinationSize;
-    destinationSize[0] = imageLevels[level-1]->GetLargestPossibleRegion().GetSize()[0] *
-                         this->DownsampleFactor;
-    destinationSize[1] = imageLevels[level-1]->GetLargestPossibleRegion().GetSize()[1] *
-                         this->DownsampleFactor;
-
-    // Downsample the image
-    typename TImage::Pointer downsampledImage = TImage::New();
-    ITKHelpers::ScaleImage(imageLevels[level - 1].GetPointer(), destinationSize,
-                           downsampledImage.GetPointer());
-    imageLevels[level] = downsampledImage;
-
-    // Downsample the source mask
-    Mask::Pointer downsampledSourceMask = Mask::New();
-    ITKHelpers::ScaleImage(sourceMaskLevels[level - 1].GetPointer(), destinationSize,
-                           downsampledSourceMask.GetPointer());
-    downsampledSourceMask->CopyInformationFrom(this->SourceMask);
-    sourceMaskLevels[level] = downsampledSourceMask;
-
-    // Downsample the target mask
-    Mask::Pointer downsampledTargetMask = Mask::New();
-    ITKHelpers::ScaleImage(targetMaskLevels[level - 1].GetPointer(), destinationSize,
-                           downsampledTargetMask.GetPointer());
-    downsampledTargetMask->CopyInformationFrom(this->TargetMask);
-    targetMaskLevels[level] = downsampledTargetMask;
+    convergenceTolerance = this->DefaultAutomaticConvergenceTolerance;
   }
 
-  // Debug only - write the images at every level
-  for(unsigned int level = 0; level < this->ResolutionLevels; ++level)
-  {
-    std::cout << "Level " << level << " image resolution "
-              << imageLevels[level]->GetLargestPossibleRegion().GetSize() << std::endl;
-
-    std::cout << "Level " << level << " source mask resolution "
-              << sourceMaskLevels[level]->GetLargestPossibleRegion().GetSize() << std::endl;
-
-    std::stringstream ssImage;
-    ssImage << "Input_Level_" << Helpers::ZeroPad(level, 2) << ".png";
-    ITKHelpers::WriteRGBImage(imageLevels[level].GetPointer(), ssImage.str());
+  // The result of the finest level that has been inpainted so far
+  typename TImage::Pointer levelOutput;
+  unsigned int levelOutputLevel = numberOfLevels;
 
-    std::stringstream ssMask;
-    ssMask << "SourceMask_Level_" << Helpers::ZeroPad(level, 2) << ".png";
-    ITKHelpers::WriteImage(sourceMaskLevels[level].GetPointer(), ssMask.str());
-  }
+  // The nearest neighbor field of that level
+  NNFieldType::Pointer levelNNField;
 
   // Compute the filling, starting at the lowest resolution and working back to the original resolution.
-  // At each level, use the output of the previous level as initialization to the next level.
-  for(unsigned int level = this->ResolutionLevels - 1; level >= 0; --level)
+  // The level is signed so that the loop ends after level 0.
+  for(int level = static_cast<int>(numberOfLevels) - 1; level >= 0; --level)
   {
-    std::cout << "BDS level " << level << " (resolution "
-              << imageLevels[level]->GetLargestPossibleRegion().GetSize() << ")" << std::endl;
-    typename TImage::Pointer output = TImage::New();
-    Compute(imageLevels[level].GetPointer(), sourceMaskLevels[level].GetPointer(),
-            targetMaskLevels[level].GetPointer(), NULL, output);
-
-    { // Debug only
-    std::stringstream ss;
-    ss << "Output_Level_" << Helpers::ZeroPad(level, 2) << ".png";
-    ITKHelpers::WriteRGBImage(output.GetPointer(), ss.str());
-    }
+    const unsigned int levelsDone = numberOfLevels - 1 - level;
 
-    // If this is the finest resolution, we are done
-    if(level == 0)
+    // Each level leaves a complete (coarser) image in levelOutput, so stopping here keeps the best result so far.
+    if(this->ShouldStop("BDSInpaintingMultiRes::Level",
+                        static_cast<float>(levelsDone) / static_cast<float>(numberOfLevels)))
     {
-      ITKHelpers::DeepCopy(output.GetPointer(), this->Output.GetPointer());
       break;
     }
 
-    // Upsample result and copy it to the next level.
-    typename TImage::Pointer upsampled = TImage::New();
-    ITKHelpers::ScaleImage(output.GetPointer(), imageLevels[level-1]->GetLargestPossibleRegion().GetSize(),
-                           upsampled.GetPointer());
-
-    { // Debug only
-//     std::cout << "Upsampled from " << output->GetLargestPossibleRegion().GetSize() << " to "
-//               << upsampled->GetLargestPossibleRegion().GetSize() << std::endl;
-//
-//     std::cout << "Upsampled size: " << upsampled->GetLargestPossibleRegion().GetSize() << std::endl;
-//     std::cout << "Next level size: " << imageLevels[level - 1]->GetLargestPossibleRegion().GetSize()
-//               << std::endl;
-    }
-
-    // Only keep the computed pixels in the hole - the rest of the pixels are simply from one level up.
-    MaskOperations::CopyInHoleRegion(upsampled.GetPointer(),
-                                     imageLevels[level - 1].GetPointer(),
-                                     targetMaskLevels[level - 1].GetPointer());
+    BDS_TRACE_SCOPE_ITERATION("BDSInpaintingMultiRes::Level", level);
 
-    std::stringstream ssUpdated;
-    ssUpdated << "UpdatedInput_Level_" << Helpers::ZeroPad(level - 1, 2) << ".png";
-    ITKHelpers::WriteRGBImage(imageLevels[level - 1].GetPointer(), ssUpdated.str());
-  }
+    const std::chrono::steady_clock::time_point levelStartTime = std::chrono::steady_clock::now();
 
-}
+    LevelReport report;
+    report.Level = level;
+    report.Schedule = ComputeLevelSchedule(level, this->LevelReports.empty() ? nullptr : &this->LevelReports.back());
 
-template <typename TImage>
-void BDSInpainting<TImage>::Compute(TImage* const image, Mask* const sourceMask, Mask* const targetMask,
-                                    typename PatchMatch<TImage>::PMImageType* previousNNField,
-                                    TImage* const output)
-{
-  ITKHelpers::WriteRGBImage(image, "ComputeInput.png");
+    Mask* const levelMask = this->Pyramid.GetMask(level);
 
-  // Initialize the output with the input
-  ITKHelpers::DeepCopy(image, output);
+    std::cout << "BDSInpaintingMultiRes: level " << level << " (resolution "
+              << levelMask->GetLargestPossibleRegion().GetSize() << "): at most " << report.Schedule.Iterations
+              << " iterations of " << report.Schedule.PatchMatchIterations << " PatchMatch iterations, search radius "
+              << report.Schedule.RandomSearchRadius << std::endl;
 
-  // Initialize the image to operate on
-  typename TImage::Pointer currentImage = TImage::New();
-  ITKHelpers::DeepCopy(image, currentImage.GetPointer());
+    // The pyramid is kept for the next run, so fill the hole of a copy of this level with the
+    // result of the coarser level.
+    typename TImage::Pointer levelImage = TImage::New();
+    ITKHelpers::DeepCopy(this->Pyramid.GetImage(level), levelImage.GetPointer());
+    if(levelOutput)
+    {
+      UpsampleIntoHole(levelOutput.GetPointer(), levelImage.GetPointer(), levelMask);
+    }
 
-  itk::ImageRegion<2> fullRegion = image->GetLargestPossibleRegion();
+    BDSInpainting<TImage> levelInpainting;
+    levelInpainting.SetPatchRadius(this->PatchRadius);
+    levelInpainting.SetIterations(report.Schedule.Iterations);
+    levelInpainting.SetConvergenceTolerance(convergenceTolerance);
+    levelInpainting.SetImage(levelImage.GetPointer());
+    levelInpainting.SetInpaintingMask(levelMask);
+    levelInpainting.SetSourceMask(this->Pyramid.GetSourceMask(level));
+    // The band shrinks with the image, but never to nothing
+    if(this->SourceBandRadius > 0)
+    {
+      levelInpainting.SetSourceBandRadius(static_cast<unsigned int>(
+        std::ceil(this->SourceBandRadius * std::pow(this->DownsampleFactor, static_cast<float>(level)))));
+    }
 
-  std::cout << "Computing BDS on resolution " << fullRegion.GetSize() << std::endl;
+    // Report the progress of the level as progress of the whole run, so that the callback and the
+    // time budget of this object apply across the levels.
+    levelInpainting.SetProgressCallback([this, levelsDone, numberOfLevels](const InpaintingProgress& progress)
+      {
+        return !this->ShouldStop(progress.Phase, (static_cast<float>(levelsDone) + progress.FractionComplete) /
+                                                 static_cast<float>(numberOfLevels));
+      });
 
-  for(unsigned int iteration = 0; iteration < this->Iterations; ++iteration)
-  {
-    std::cout << "BDSInpainting Iteration " << iteration << std::endl;
+    // Start from the field of the coarser level, so that a few iterations refine it
+    NNFieldType::Pointer initialNNField;
+    if(levelNNField)
+    {
+      initialNNField = NNFieldType::New();
+      UpsampleNNField(levelNNField.GetPointer(), levelMask, initialNNField.GetPointer());
+      levelInpainting.SetInitialNNField(initialNNField);
+      levelInpainting.SetRandomSearchRadius(report.Schedule.RandomSearchRadius);
+    }
 
-    // Give the PatchMatch functor the data
-    this->PatchMatchFunctor->SetImage(currentImage);
-    this->PatchMatchFunctor->SetSourceMask(sourceMask);
-    this->PatchMatchFunctor->SetTargetMask(targetMask);
-    this->PatchMatchFunctor->Initialize();
+    patchMatchFunctor->SetIterations(report.Schedule.PatchMatchIterations);
+    patchMatchFunctor->SetImage(levelImage.GetPointer());
+    levelInpainting.Inpaint(patchMatchFunctor, compositor);
 
-    try
+    report.IterationsRun = levelInpainting.GetNumberOfIterationsRun();
+    if(initialNNField)
     {
-      if(iteration == 0)
-      {
-        this->PatchMatchFunctor->Compute(NULL);
-      }
-      else
-      {
-        // For now don't initialize with the previous NN field - though this
-        // might work and be a huge speed up.
-        this->PatchMatchFunctor->Compute(NULL);
-        //this->PatchMatchFunctor.Compute(init);
-      }
+      report.ChangedMatchFraction = ComputeChangedMatchFraction(initialNNField.GetPointer(),
+                                                                patchMatchFunctor->GetNNField(), levelMask);
     }
-    catch (std::runtime_error &e)
+
+    if(level > 0)
     {
-      std::cout << e.what() << std::endl;
-      return;
+      levelNNField = NNFieldType::New();
+      ITKHelpers::DeepCopy(patchMatchFunctor->GetNNField(), levelNNField.GetPointer());
     }
 
-    typename PatchMatch<TImage>::PMImageType* nnField = this->PatchMatchFunctor->GetOutput();
+    this->Counters.Local() += levelInpainting.GetStatistics();
+
+    levelOutput = levelInpainting.GetOutput();
+    levelOutputLevel = level;
 
-    ITKHelpers::WriteRGBImage(currentImage.GetPointer(), "BeforeUpdate.png");
+    this->Completeness = (static_cast<float>(levelsDone) + levelInpainting.GetCompleteness()) /
+                         static_cast<float>(numberOfLevels);
 
-    // Update the target pixels
-    typename TImage::Pointer updatedImage = TImage::New();
-    //std::cout << "Updating pixels..." << std::endl;
-    UpdatePixels(currentImage, targetMask, nnField, updatedImage);
-    //std::cout << "Done updating pixels." << std::endl;
-    ITKHelpers::WriteRGBImage(updatedImage.GetPointer(), "Updated.png");
-    ITKHelpers::WriteRGBImage(currentImage.GetPointer(), "Current.png");
+    DebugSink::Instance().WriteSequentialImage(DebugSink::ITERATIONS, levelOutput.GetPointer(),
+                                               "BDSInpaintingMultiRes_Level", level, 2, "png");
 
-    MaskOperations::CopyInValidRegion(updatedImage.GetPointer(), currentImage.GetPointer(), targetMask);
+    report.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - levelStartTime).count();
+    this->LevelReports.push_back(report);
+  }
 
-    std::stringstream ssPNG;
-    ssPNG << "BDS_Iteration_" << Helpers::ZeroPad(iteration, 2) << ".png";
-    ITKHelpers::WriteRGBImage(currentImage.GetPointer(), ssPNG.str());
-  } // end iterations loop
+  ITKHelpers::DeepCopy(this->Image.GetPointer(), this->Output.GetPointer());
 
-  ITKHelpers::DeepCopy(currentImage.GetPointer(), output);
+  if(levelOutputLevel == 0)
+  {
+    ITKHelpers::DeepCopy(levelOutput.GetPointer(), this->Output.GetPointer());
+  }
+  else if(levelOutput)
+  {
+    // The run stopped before the original resolution; upsample the finest result there is.
+    UpsampleIntoHole(levelOutput.GetPointer(), this->Output.GetPointer(), this->InpaintingMask.GetPointer());
+  }
 
-  ITKHelpers::WriteRGBImage(output, "ComputeOutput.png");
+  if(this->StopReason == Superclass::COMPLETED)
+  {
+    this->Completeness = 1.0f;
+  }
 }
 
 template <typename TImage>
-TImage* BDSInpainting<TImage>::GetOutput()
+typename BDSInpaintingMultiRes<TImage>::LevelSchedule
+BDSInpaintingMultiRes<TImage>::ComputeLevelSchedule(const unsigned int level,
+                                                    const LevelReport* const coarserReport) const
 {
-  return this->Output;
-}
+  typename std::map<unsigned int, LevelSchedule>::const_iterator explicitSchedule = this->LevelSchedules.find(level);
+  if(explicitSchedule != this->LevelSchedules.end())
+  {
+    return explicitSchedule->second;
+  }
 
-template <typename TImage>
-void BDSInpainting<TImage>::SetIterations(const unsigned int iterations)
-{
-  this->Iterations = iterations;
-}
+  LevelSchedule schedule;
 
-template <typename TImage>
-void BDSInpainting<TImage>::SetPatchRadius(const unsigned int patchRadius)
-{
-  this->PatchRadius = patchRadius;
-}
+  if(!coarserReport)
+  {
+    // The coarsest level searches the whole image from scratch. It is cheap.
+    schedule.Iterations = this->ScheduleMode == AUTOMATIC_SCHEDULE ?
+          std::max(this->Iterations, this->MaximumAutomaticIterations) : this->Iterations;
+    schedule.PatchMatchIterations = this->PatchMatchIterations;
+    schedule.RandomSearchRadius = 0;
+    return schedule;
+  }
 
-template <typename TImage>
-void BDSInpainting<TImage>::SetImage(TImage* const image)
-{
-  ITKHelpers::DeepCopy(image, this->Image.GetPointer());
-}
+  if(this->ScheduleMode == FIXED_SCHEDULE)
+  {
+    schedule.Iterations = this->Iterations;
+    schedule.PatchMatchIterations = this->RefinementPatchMatchIterations;
+    schedule.RandomSearchRadius = this->RefinementSearchRadius;
+    return schedule;
+  }
 
-template <typename TImage>
-void BDSInpainting<TImage>::SetSourceMask(Mask* const mask)
-{
-  this->SourceMask->DeepCopyFrom(mask);
-}
+  // A finer level starts closer to convergence than the level below it did
+  schedule.Iterations = std::max(1u, (coarserReport->IterationsRun + 1) / 2);
 
-template <typename TImage>
-void BDSInpainting<TImage>::SetTargetMask(Mask* const mask)
-{
-  this->TargetMask->DeepCopyFrom(mask);
+  if(coarserReport->ChangedMatchFraction < 0.0f)
+  {
+    // The level below was the coarsest, so there is nothing to tell how good upsampled matches are yet
+    schedule.PatchMatchIterations = this->RefinementPatchMatchIterations;
+    schedule.RandomSearchRadius = this->RefinementSearchRadius;
+    return schedule;
+  }
+
+  // The more of its upsampled matches the level below moved, the less they can be trusted here
+  const float changedMatchFraction = coarserReport->ChangedMatchFraction;
+  schedule.PatchMatchIterations = 1 + static_cast<unsigned int>(
+        std::round(changedMatchFraction * (std::max(this->PatchMatchIterations, 1u) - 1)));
+  schedule.RandomSearchRadius = changedMatchFraction > 0.5f ? 0 : this->RefinementSearchRadius;
+  return schedule;
 }
 
 template <typename TImage>
-void BDSInpainting<TImage>::SetResolutionLevels(const unsigned int resolutionLevels)
+float BDSInpaintingMultiRes<TImage>::ComputeChangedMatchFraction(const NNFieldType* const initialNNField,
+                                                                 const NNFieldType* const nnField,
+                                                                 const Mask* const mask) const
 {
-  if(resolutionLevels < 1)
+  // A match within one coarse pixel of its upsampled match has only been refined
+  const itk::OffsetValueType upsamplingError =
+    static_cast<itk::OffsetValueType>(std::ceil(1.0f / this->DownsampleFactor));
+
+  size_t numberOfMatches = 0;
+  size_t numberOfChangedMatches = 0;
+
+  std::vector<itk::Index<2> > holePixels = mask->GetHolePixels();
+  for(size_t pixelId = 0; pixelId < holePixels.size(); ++pixelId)
   {
-    std::cerr << "ResolutionLevels: " << resolutionLevels << std::endl;
-    throw std::runtime_error("ResolutionLevels must be >= 1!");
+    const MatchSet& initialMatches = initialNNField->GetPixel(holePixels[pixelId]);
+    const MatchSet& matches = nnField->GetPixel(holePixels[pixelId]);
+    if(initialMatches.GetNumberOfMatches() == 0 || matches.GetNumberOfMatches() == 0)
+    {
+      continue;
+    }
+
+    const itk::Offset<2> offset = ITKHelpers::GetRegionCenter(matches.GetMatch(0).GetRegion()) -
+                                  ITKHelpers::GetRegionCenter(initialMatches.GetMatch(0).GetRegion());
+    numberOfMatches++;
+    if(std::abs(offset[0]) > upsamplingError || std::abs(offset[1]) > upsamplingError)
+    {
+      numberOfChangedMatches++;
+    }
   }
-  this->ResolutionLevels = resolutionLevels;
+
+  return numberOfMatches > 0 ? static_cast<float>(numberOfChangedMatches) / static_cast<float>(numberOfMatches) : 0.0f;
 }
 
 template <typename TImage>
-void BDSInpainting<TImage>::SetPatchMatchFunctor(PatchMatch<TImage>* patchMatchFunctor)
+void BDSInpaintingMultiRes<TImage>::SetImage(TImage* const image)
 {
-  this->PatchMatchFunctor = patchMatchFunctor;
+  Superclass::SetImage(image);
+  this->Pyramid.SetImage(this->Image);
 }
 
 template <typename TImage>
-void BDSInpainting<TImage>::SetDownsampleFactor(const float downsampleFactor)
+void BDSInpaintingMultiRes<TImage>::UpsampleIntoHole(const TImage* const image, TImage* const destination,
+                                                     const Mask* const destinationMask) const
 {
-  this->DownsampleFactor = downsampleFactor;
+  typename TImage::Pointer upsampled = TImage::New();
+  ITKHelpers::ScaleImage(image, destination->GetLargestPossibleRegion().GetSize(), upsampled.GetPointer());
+
+  // Only keep the computed pixels in the hole - the rest of the pixels are from this resolution.
+  MaskOperations::CopyInHoleRegion(upsampled.GetPointer(), destination, destinationMask);
 }
 
 template <typename TImage>
-void BDSInpainting<TImage>::UpdatePixels(const TImage* const oldImage,
-                                         const Mask* const targetMask,
-                                         const typename PatchMatch<TImage>::PMImageType* const nnField,
-                                         TImage* const updatedImage)
+void BDSInpaintingMultiRes<TImage>::UpsampleNNField(const NNFieldType* const coarseNNField, const Mask* const fineMask,
+                                                    NNFieldType* const fineNNField) const
 {
-  // The contribution of each pixel q to the error term (d_cohere) = 1/N_T \sum_{i=1}^m (S(p_i) - T(q))^2
-  // To find the best color T(q) (iterative update rule), differentiate with respect to T(q),
-  // set to 0, and solve for T(q):
-  // T(q) = \frac{1}{m} \sum_{i=1}^m S(p_i)
-
-//   std::cout << "UpdatePixels()..." << std::endl;
-//   ITKHelpers::WriteRGBImage(oldImage, "UpdatePixels_OldImage.png");
-//   ITKHelpers::WriteImage(targetMask, "UpdatePixels_TargetMask.png");
-
-  // This is done so in the algorithm we can use 'fullRegion', since it refers
-  // to the same region for the image and mask.
-  // (So there is no confusion such as "why is the mask's region used here instead of the image's?")
-  itk::ImageRegion<2> fullRegion = oldImage->GetLargestPossibleRegion();
-
-  // We don't want to change pixels directly on the
-  // output image during the iteration, but rather compute them all and then update them all simultaneously.
-  ITKHelpers::DeepCopy(oldImage, updatedImage);
+  BDS_TRACE_SCOPE("BDSInpaintingMultiRes::UpsampleNNField");
 
-  // We must get a dummy pixel from the image and then fill it with zero to make sure the number
-  // of components of the pixel is correct.
-  itk::Index<2> zeroIndex = {{0,0}};
-  typename TImage::PixelType zeroPixel = oldImage->GetPixel(zeroIndex);
-  zeroPixel.Fill(0);
+  const itk::ImageRegion<2> fineRegion = fineMask->GetLargestPossibleRegion();
+  fineNNField->SetRegions(fineRegion);
+  fineNNField->Allocate();
 
-  std::vector<itk::Index<2> > targetPixels = targetMask->GetValidPixels();
-  std::cout << "UpdatePixels: There are : " << targetPixels.size() << " target pixels." << std::endl;
+  MatchSet emptyMatchSet;
+  ITKHelpers::SetImageToConstant(fineNNField, emptyMatchSet);
 
-  this->PatchMatchFunctor->WriteValidPixels("ValidNNPixels.png");
+  const itk::ImageRegion<2> coarseRegion = coarseNNField->GetLargestPossibleRegion();
 
-  for(size_t targetPixelId = 0; targetPixelId < targetPixels.size(); ++targetPixelId)
+  // The centers of patches that are entirely inside the image
+  const itk::ImageRegion<2> internalRegion = ITKHelpers::GetInternalRegion(fineRegion, this->PatchRadius);
+  if(internalRegion.GetNumberOfPixels() == 0)
   {
-    //std::cout << "Processing " << targetPixelId << " of " << targetPixels.size() << std::endl;
-    itk::Index<2> currentPixel = targetPixels[targetPixelId];
+    return;
+  }
 
-    { // debug only
-    itk::ImageRegion<2> currentRegion =
-          ITKHelpers::GetRegionInRadiusAroundPixel(currentPixel, this->PatchRadius);
+  std::vector<itk::Index<2> > holePixels = fineMask->GetHolePixels();
+  for(size_t pixelId = 0; pixelId < holePixels.size(); ++pixelId)
+  {
+    const itk::Index<2>& finePixel = holePixels[pixelId];
 
-    //ITKHelpers::WriteRegion(oldImage, currentRegion, "CurrentRegion.png");
+    itk::Index<2> coarsePixel;
+    for(unsigned int dimension = 0; dimension < 2; ++dimension)
+    {
+      coarsePixel[dimension] = static_cast<itk::IndexValueType>(
+            std::floor((finePixel[dimension] - fineRegion.GetIndex()[dimension]) * this->DownsampleFactor)) +
+          coarseRegion.GetIndex()[dimension];
+      coarsePixel[dimension] = std::min(coarsePixel[dimension], coarseRegion.GetUpperIndex()[dimension]);
     }
 
-    // Get all patches containing the currentPixel
-    std::vector<itk::ImageRegion<2> > patchesContainingPixel = ITKHelpers::GetAllPatchesContainingPixel(currentPixel,
-                                                    this->PatchRadius,
-                                                    fullRegion);
-
-    // Remove patches from the set if they have invalid NNField values
-    patchesContainingPixel.erase(std::remove_if(patchesContainingPixel.begin(), patchesContainingPixel.end(),
-                                                [PatchMatchFunctor](const itk::ImageRegion<2>& testRegion)
-                                                {
-                                                  itk::Index<2> index = ITKHelpers::GetRegionCenter(testRegion);
-                                                  bool valid = PatchMatchFunctor->GetOutput()->GetPixel(index).IsValid();
-//                                                   if(!valid)
-//                                                   {
-//                                                     std::cout << "Removed " << index << " " << testRegion << " because it was invalid." << std::endl;
-//                                                   }
-                                                  return !valid;
-                                                }),
-                                 patchesContainingPixel.end());
-
-    //std::cout << patchesContainingPixel.size() << " patchesContainingPixel remain." << std::endl;
-//     ITKHelpers::HighlightAndWriteRegions(targetMask->GetLargestPossibleRegion().GetSize(), patchesContainingPixel,
-//                                          "PatchesContainingPixel.png");
-
-    assert(patchesContainingPixel.size() > 0);
-
-    // Compute the list of pixels contributing to this patch and their associated patch scores
-    std::vector<typename TImage::PixelType> contributingPixels(patchesContainingPixel.size());
-    std::vector<float> contributingScores(patchesContainingPixel.size());
-
-    for(unsigned int containingPatchId = 0;
-        containingPatchId < patchesContainingPixel.size(); ++containingPatchId)
+    const MatchSet& coarseMatches = coarseNNField->GetPixel(coarsePixel);
+    if(coarseMatches.GetNumberOfMatches() == 0)
     {
-      itk::Index<2> containingRegionCenter =
-                  ITKHelpers::GetRegionCenter(patchesContainingPixel[containingPatchId]);
-      Match bestMatch = nnField->GetPixel(containingRegionCenter);
-      assert(bestMatch.IsValid());
-
-      itk::ImageRegion<2> bestMatchRegion = bestMatch.Region;
-
-      //assert(fullRegion.IsInside(bestMatchRegion));
-
-      itk::Index<2> bestMatchRegionCenter = ITKHelpers::GetRegionCenter(bestMatchRegion);
-
-      assert(this->SourceMask->IsValid(bestMatchRegion));
-
-      // Compute the offset of the pixel in question relative to the center of
-      // the current patch that contains the pixel
-      itk::Offset<2> offset = currentPixel - containingRegionCenter;
-
-      // Compute the location of the pixel in the best matching patch that is the
-      // same position of the pixel in question relative to the containing patch
-      itk::Index<2> correspondingPixel = bestMatchRegionCenter + offset;
-
-      contributingPixels[containingPatchId] = oldImage->GetPixel(correspondingPixel);
-
-      contributingScores[containingPatchId] = bestMatch.Score;
-
-    } // end loop over containing patches
-
-    //std::cout << "Collected contributing pixels and scores." << std::endl;
-    // Compute new pixel value
-
-    // Select a method to construct new pixel
-    //std::cout << "Compositing..." << std::endl;
-    typename TImage::PixelType newValue = Composite(contributingPixels, contributingScores);
-    //std::cout << "Done compositing." << std::endl;
+      continue;
+    }
 
-    updatedImage->SetPixel(currentPixel, newValue);
+    const itk::Index<2> coarseCenter = ITKHelpers::GetRegionCenter(coarseMatches.GetMatch(0).GetRegion());
 
-//         std::cout << "Pixel was " << currentImage->GetPixel(currentPixel)
-//                   << " and is now " << updateImage->GetPixel(currentPixel) << std::endl;
+    itk::Index<2> fineCenter;
+    for(unsigned int dimension = 0; dimension < 2; ++dimension)
+    {
+      const float offset = static_cast<float>(coarseCenter[dimension] - coarsePixel[dimension]) / this->DownsampleFactor;
+      fineCenter[dimension] = finePixel[dimension] + static_cast<itk::IndexValueType>(std::round(offset));
+      fineCenter[dimension] = std::max(fineCenter[dimension], internalRegion.GetIndex()[dimension]);
+      fineCenter[dimension] = std::min(fineCenter[dimension], internalRegion.GetUpperIndex()[dimension]);
+    }
 
-  } // end loop over all target pixels
+    // The score is computed at the fine resolution by BDSInpainting
+    Match upsampledMatch;
+    upsampledMatch.SetRegion(ITKHelpers::GetRegionInRadiusAroundPixel(fineCenter, this->PatchRadius));
+    upsampledMatch.SetScore(std::numeric_limits<float>::max());
+    upsampledMatch.SetVerified(false);
 
-  std::cout << "Finished UpdatePixels." << std::endl;
+    MatchSet matchSet = fineNNField->GetPixel(finePixel);
+    matchSet.Clear();
+    matchSet.AddMatch(upsampledMatch);
+    fineNNField->SetPixel(finePixel, matchSet);
+  }
 }
 
 template <typename TImage>
-void BDSInpainting<TImage>::SetCompositingMethod(const CompositingMethodEnum& compositingMethod)
+void BDSInpaintingMultiRes<TImage>::SetPatchMatchIterations(const unsigned int patchMatchIterations)
 {
-  this->CompositingMethod = compositingMethod;
+  this->PatchMatchIterations = patchMatchIterations;
 }
 
-/** Composite using the specified CompositingMethod. */
 template <typename TImage>
-typename TImage::PixelType BDSInpainting<TImage>::Composite(
-    const std::vector<typename TImage::PixelType>& contributingPixels,
-    const std::vector<float>& contributingScores)
+void BDSInpaintingMultiRes<TImage>::SetRefinementPatchMatchIterations(const unsigned int refinementPatchMatchIterations)
 {
-  assert(contributingPixels.size() == contributingScores.size());
-  assert(contributingPixels.size() > 0);
+  this->RefinementPatchMatchIterations = refinementPatchMatchIterations;
+}
 
-  if(this->CompositingMethod == AVERAGE)
-  {
-    return CompositeAverage(contributingPixels);
-  }
-  else if(this->CompositingMethod == WEIGHTED_AVERAGE)
-  {
-    return CompositeWeightedAverage(contributingPixels, contributingScores);
-  }
-  else if(this->CompositingMethod == CLOSEST_TO_AVERAGE)
-  {
-    return CompositeClosestToAverage(contributingPixels, contributingScores);
-  }
-  else if(this->CompositingMethod == BEST_PATCH)
+template <typename TImage>
+void BDSInpaintingMultiRes<TImage>::SetResolutionLevels(const unsigned int resolutionLevels)
+{
+  if(resolutionLevels < 1)
   {
-    return CompositeBestPatch(contributingPixels, contributingScores);
+    std::cerr << "ResolutionLevels: " << resolutionLevels << std::endl;
+    throw std::runtime_error("ResolutionLevels must be >= 1!");
   }
-  else
+  this->ResolutionLevels = resolutionLevels;
+}
+
+template <typename TImage>
+void BDSInpaintingMultiRes<TImage>::SetDownsampleFactor(const float downsampleFactor)
+{
+  if(downsampleFactor <= 0.0f || downsampleFactor >= 1.0f)
   {
-    throw std::runtime_error("An invalid CompositingMethod was selected!");
+    std::cerr << "DownsampleFactor: " << downsampleFactor << std::endl;
+    throw std::runtime_error("DownsampleFactor must be in (0, 1)!");
   }
+  this->DownsampleFactor = downsampleFactor;
 }
 
-/** Composite by averaging pixels. */
 template <typename TImage>
-typename TImage::PixelType BDSInpainting<TImage>::CompositeAverage(
-  const std::vector<typename TImage::PixelType>& contributingPixels)
+void BDSInpaintingMultiRes<TImage>::SetRefinementSearchRadius(const unsigned int refinementSearchRadius)
 {
-  typename TImage::PixelType newValue = Statistics::Average(contributingPixels);
-  return newValue;
+  this->RefinementSearchRadius = refinementSearchRadius;
 }
 
-/** Composite by weighted averaging. */
 template <typename TImage>
-typename TImage::PixelType BDSInpainting<TImage>::CompositeWeightedAverage(
-    const std::vector<typename TImage::PixelType>& contributingPixels,
-    const std::vector<float>& contributingScores)
+void BDSInpaintingMultiRes<TImage>::SetScheduleMode(const ScheduleModeEnum scheduleMode)
 {
-  // If there is only one element, simply return it.
-  if(contributingScores.size() == 1)
-  {
-    return contributingPixels[0];
-  }
-
-  // The weights should be inversely proportional to the patch errors/scores.
-  // That is, a patch with a high error should get a low weight. We accomplish this by
-  // making the weight equal to 1 - (value - min) / |range|
-
-  float minValue = *std::min_element(contributingScores.begin(), contributingScores.end());
-  float maxValue = *std::max_element(contributingScores.begin(), contributingScores.end());
-  float range = maxValue - minValue;
-  // If the range is zero, all elements are the same so just return the first one
-  if(range == 0.0f)
-  {
-    return contributingPixels[0];
-  }
-
-  std::vector<float> weights(contributingScores.size());
-  for(unsigned int i = 0; i < contributingScores.size(); ++i)
-  {
-    weights[i] = 1.0f - (contributingScores[i] - minValue) / range;
-  }
-
-  // Make the weights sum to 1
-  Helpers::NormalizeVectorInPlace(weights);
-
-  typename TImage::PixelType newValue = Helpers::WeightedAverage(contributingPixels, weights);
-  return newValue;
+  this->ScheduleMode = scheduleMode;
 }
 
 template <typename TImage>
-typename TImage::PixelType BDSInpainting<TImage>::CompositeClosestToAverage(
-    const std::vector<typename TImage::PixelType>& contributingPixels,
-    const std::vector<float>& contributingScores)
+void BDSInpaintingMultiRes<TImage>::SetLevelSchedule(const unsigned int level, const LevelSchedule& schedule)
 {
-  // Use the pixel closest to the average pixel
-  typename TImage::PixelType averagePixel = Statistics::Average(contributingPixels);
-  unsigned int patchId = ITKHelpers::ClosestValueIndex(contributingPixels, averagePixel);
-  typename TImage::PixelType newValue = contributingPixels[patchId];
-  return newValue;
+  this->LevelSchedules[level] = schedule;
 }
 
 template <typename TImage>
-typename TImage::PixelType BDSInpainting<TImage>::CompositeBestPatch(
-    const std::vector<typename TImage::PixelType>& contributingPixels,
-    const std::vector<float>& contributingScores)
+void BDSInpaintingMultiRes<TImage>::ClearLevelSchedules()
 {
-  // Take the pixel from the best matching patch
-  unsigned int patchId = Helpers::argmin(contributingScores);
-  typename TImage::PixelType newValue = contributingPixels[patchId];
-  return newValue;
+  this->LevelSchedules.clear();
 }
 
 template <typename TImage>
-void BDSInpainting<TImage>::SetTrustAllPixels(const bool trustAllPixels)
+const std::vector<typename BDSInpaintingMultiRes<TImage>::LevelReport>&
+BDSInpaintingMultiRes<TImage>::GetLevelReports() const
 {
-  this->TrustAllPixels = trustAllPixels;
+  return this->LevelReports;
 }
 
 template <typename TImage>
-void BDSInpainting<TImage>::SetNearestNeighborField(const NNFieldType* const nnField)
+unsigned int BDSInpaintingMultiRes<TImage>::GetNumberOfLevelsUsed() const
 {
-  this->NearestNeighborField = nnField;
+  return this->NumberOfLevelsUsed;
 }
 
 #endif
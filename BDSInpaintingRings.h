@@ -21,6 +21,30 @@
 
 #include "BDSInpainting.h"
 
+// Custom
+#include "AcceptanceTestAdaptiveComposite.h"
+#include "AcceptanceTestIntegralHistogramRatio.h"
+#include "CandidateCache.h"
+#include "CountingFunctors.h"
+#include "HSVConversion.h"
+#include "OnionLayers.h"
+#include "ThreadPool.h"
+#include "UnverifiedPixelWorklist.h"
+
+// Submodules
+#include <PatchMatch/AcceptanceTestSourceRegion.h>
+#include <PatchMatch/AcceptanceTestSSD.h>
+#include <PatchMatch/PatchMatchHelpers.h>
+
+#include <PatchComparison/SSD.h>
+
+// STL
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
 /** This class uses composition (uses BDSInpainting objects internally)
  *  to compute the nearest neighbor field one ring at a time, from the outside
  *  in, compositing as it goes along.. */
@@ -32,12 +56,126 @@ public:
 
   BDSInpaintingRings();
 
+  /** How the hole is filled after the NNField of the surrounding ring is computed. */
+  enum RingModeEnum {PATCH_RADIUS_THICK_RINGS, SINGLE_PIXEL_RINGS};
+
+  /** The order in which SINGLE_PIXEL_RINGS fills the pixels of its front. FRONT_DISTANCE fills
+    * the outermost pixels first (one-pixel rings); FRONT_CONFIDENCE fills the pixels whose
+    * patches contain the largest fraction of known pixels first. */
+  enum FrontOrderEnum {FRONT_DISTANCE, FRONT_CONFIDENCE};
+
   /** Perform the NNField computation and compositing for the entire hole
     * (and the boundary around it, as prescribed by ExpandMask() ) */
   void Inpaint();
 
+  /** Choose how the hole is filled. The default is PATCH_RADIUS_THICK_RINGS. */
+  void SetRingMode(const RingModeEnum ringMode);
+
+  /** Choose the fill order of SINGLE_PIXEL_RINGS. The default is FRONT_DISTANCE. */
+  void SetFrontOrder(const FrontOrderEnum frontOrder);
+
+  /** Learn the order of the source region and SSD tests from their cost and rejection rate (the
+    * default), or always run them in that order. The neighbor histogram test is always last. */
+  void SetAdaptiveTestOrder(const bool adaptiveTestOrder);
+
+  /** Set the most relaxed neighbor histogram ratio of the first ComputeNNField() iteration (each
+    * further iteration relaxes it by 1). SINGLE_PIXEL_RINGS uses it for every pixel. The default
+    * is 3.2. */
+  void SetMaxHistogramRatio(const float maxHistogramRatio);
+
+  /** Set how many random source patches SINGLE_PIXEL_RINGS tries when no filled neighbor gives
+    * an acceptable patch. The default is 64. */
+  void SetGlobalSearchSamples(const unsigned int globalSearchSamples);
+
+  /** Set how many centers the random search draws in each window before giving up on finding
+    * one in the source region. The default is 16. */
+  void SetRandomSearchDrawsPerRadius(const unsigned int randomSearchDrawsPerRadius);
+
+  /** Set the number of threads that compute the NNField of independent segments of a ring.
+    * 0 (the default) uses one per hardware thread; 1 does everything on the calling thread. */
+  void SetNumberOfThreads(const unsigned int numberOfThreads);
+
+  /** Set the mask of the pixels that may be used as the source of patches. */
+  void SetSourceMask(Mask* const mask);
+
+  /** Only use source patches whose centers are within 'sourceBandRadius' pixels of the hole, as
+    * well as in the source mask. This shrinks the source patch centers that random matches and
+    * the random search are drawn from. Zero (the default) uses the whole source mask. */
+  void SetSourceBandRadius(const unsigned int sourceBandRadius);
+
+  /** Set the mask of the pixels to fill. Pixels in the Valid region should be filled. */
+  void SetTargetMask(Mask* const mask);
+
+  /** Get the order the acceptance tests of each thread settled on in the last Inpaint(), as
+    * "Propagation: ...; RandomSearch: ..." (one entry per thread). */
+  std::vector<std::string> GetAcceptanceTestOrders() const;
+
 private:
 
+  typedef HSVConversion::HSVImageType HSVImageType;
+
+  typedef PatchDistanceCounting<SSD<TImage> > PatchDistanceFunctorType;
+
+  typedef AcceptanceTestCounting<AcceptanceTestSSD> AcceptanceTestSSDType;
+
+  typedef AcceptanceTestCounting<AcceptanceTestSourceRegion> AcceptanceTestSourceRegionType;
+
+  /** Candidates rejected only by the neighbor histogram test are recorded, so that they can be
+    * tested again when the ratio is relaxed. (The composite tests run it last.) */
+  typedef AcceptanceTestCounting<AcceptanceTestRecordingCandidates<
+    AcceptanceTestIntegralHistogramRatio<HSVImageType> > > NeighborHistogramRatioAcceptanceTestType;
+
+  /** The tests of propagation and random search. The source region and SSD tests are run in the
+    * order measured to be cheapest (see SetAdaptiveTestOrder()); the neighbor histogram test is
+    * always run last. */
+  typedef AcceptanceTestCounting<AcceptanceTestAdaptiveComposite<AcceptanceTestSourceRegionType,
+                                                                 AcceptanceTestSSDType,
+                                                                 NeighborHistogramRatioAcceptanceTestType> >
+    AcceptanceTestType;
+
+  /** The patch distance and acceptance functors of one thread. Each thread needs its own since
+    * the neighbor histogram ratio is relaxed independently in each segment. */
+  struct Worker
+  {
+    std::unique_ptr<PatchDistanceFunctorType> PatchDistanceFunctor;
+    std::unique_ptr<PatchDistanceFunctorType> PropagationPatchDistanceFunctor;
+    std::unique_ptr<PatchDistanceFunctorType> RandomSearchPatchDistanceFunctor;
+    std::unique_ptr<AcceptanceTestSSDType> SSDAcceptanceTest;
+    std::unique_ptr<AcceptanceTestSourceRegionType> SourceRegionAcceptanceTest;
+    std::unique_ptr<NeighborHistogramRatioAcceptanceTestType> NeighborHistogramRatioAcceptanceTest;
+
+    /** Propagation and random search get their own (identical) composite tests so that
+      * their acceptances are counted separately. */
+    std::unique_ptr<AcceptanceTestType> PropagationAcceptanceTest;
+    std::unique_ptr<AcceptanceTestType> RandomSearchAcceptanceTest;
+
+    /** Draws the random initial matches and the random search samples. It is reseeded for every
+      * segment, so the result does not depend on which thread computes which segment. */
+    std::mt19937 RandomGenerator;
+
+    /** The best candidates rejected by the neighbor histogram test in the current ComputeNNField(). */
+    CandidateCache Candidates;
+  };
+
+  /** Create the HSV image and one Worker per thread. Patches are always compared in the input
+    * Image (compositing only writes to Output) and drawn from the final SourceMask, so these
+    * are created once per Inpaint() rather than once per ring. The (expensive) tables of the
+    * neighbor histogram test are built once and shared by all of the Workers. */
+  void CreateMatchingFunctors();
+
+  /** Set up the functors of 'worker'. If 'histogramTest' is given its tables are shared rather
+    * than built again. */
+  void CreateWorker(Worker* const worker, const NeighborHistogramRatioAcceptanceTestType* const histogramTest);
+
+  /** Get the region that the neighbor histogram test builds its integral histogram over: the
+    * bounding box of the hole, padded to hold the query patches, their one-pixel-shifted
+    * neighbors and the sources of the band (see SetSourceBandRadius()). */
+  itk::ImageRegion<2> ComputeHistogramRegion() const;
+
+  /** Find the pixels whose patch is entirely in the SourceMask, from which random initial
+    * matches are drawn. */
+  void ComputeSourcePatchCenters();
+
   /** Get the "patch-radius-thick ring" around the original hole. We do not
     * need to composite in this region,
     * but we do need to compute the NNField here (as it is non-trivial
@@ -55,29 +193,151 @@ private:
   void ProducePropagationBuffer();
 
   /** Run several iterations of the PatchMatch algorithm with neighbor-histogram difference
-    * verification */
-  void ConstrainedPatchMatch(Mask* const targetMask, const float histogramRatioStart,
+    * verification. Only the pixels of 'worklist' are processed, and 'worklist' is updated
+    * as pixels are verified. */
+  void ConstrainedPatchMatch(Worker* const worker, Mask* const targetMask,
+                             UnverifiedPixelWorklist* const worklist, const float histogramRatioStart,
                              const float histogramRatioStep, const float maxHistogramRatio);
 
   /** Run forced propagation until either the target region is filled or the
     * propagation has been completely restricted by hole geometry and patch
-    * selection location. */
-  void ForcePropagation(Mask* const targetMask);
+    * selection location. Only the pixels of 'worklist' are processed, and 'worklist' is
+    * updated as pixels are verified. */
+  void ForcePropagation(Worker* const worker, Mask* const targetMask, UnverifiedPixelWorklist* const worklist);
+
+  /** Give every pixel of 'worklist' that has no match yet a random (unverified) match from
+    * SourcePatchCenters. Pixels that already have one keep it, so that the search of an earlier
+    * ComputeNNField() iteration is not thrown away. This visits only the worklist, where
+    * InitializerRandom scans the whole target mask. */
+  void InitializeRandomMatches(Worker* const worker, const UnverifiedPixelWorklist& worklist);
 
-  /** Perform a combination of propagation and random search steps, and composite the result. */
-  void FillHole(Mask* const targetMask);
+  /** Test the cached candidates of each pixel of 'worklist' (best first) with the tests of
+    * 'worker' against the current match and neighbor histogram ratio, and accept the first that
+    * passes as a verified match. */
+  void RetestCandidates(Worker* const worker, const UnverifiedPixelWorklist& worklist);
 
-  /** Remove all matches from the MatchSet at pixels which do not have a verified match. */
+  /** Composite 'ringPixels' of the Output in place from the NNField. Chunks of the ring are
+    * composited concurrently, and every value is staged before any is written, so only the
+    * ring is copied rather than the whole image. */
+  void FillHole(const std::vector<itk::Index<2> >& ringPixels);
+
+  /** Remove all matches from the MatchSet at hole pixels which do not have a verified match. */
   void ClearUnverifiedPixels();
 
-  /** Fill the hole one one-pixel-thick ring at a time (from outside in) */
+  /** Fill the hole one pixel at a time from a priority-ordered front (see FrontOrderEnum).
+    * Each pixel gets the best of its filled neighbors' (shifted) matches, refined by a
+    * windowed random search, and is composited immediately from the matches of the filled
+    * pixels around it. Only the neighbors of each filled pixel are visited, so the cost is
+    * proportional to the hole area. */
   void SinglePixelRings();
 
+  /** An entry of the SinglePixelRings front. Higher priorities are filled first; equal
+    * priorities are filled in the order they were added. */
+  struct FrontEntry
+  {
+    float Priority;
+    uint64_t Sequence;
+    itk::Index<2> Pixel;
+
+    bool operator<(const FrontEntry& other) const
+    {
+      if(this->Priority != other.Priority)
+      {
+        return this->Priority < other.Priority;
+      }
+      return this->Sequence > other.Sequence;
+    }
+  };
+
+  /** The priority of 'pixel' in the SinglePixelRings front. */
+  float ComputeFrontPriority(const itk::Index<2>& pixel) const;
+
+  /** True if 'pixel' is not in the hole or has already been filled. */
+  bool IsKnown(const itk::Index<2>& pixel) const;
+
+  /** Find a source patch for 'queryPixel' from its filled neighbors and a random search. The
+    * candidates go through the acceptance tests of the first Worker (without its candidate cache);
+    * if none passes, the best (by patch distance) in the source region is used. Returns false if no
+    * patch in the source region was found. */
+  bool FindSinglePixelMatch(const itk::Index<2>& queryPixel, Match& bestMatch);
+
+  /** Composite 'pixel' of the Output from the matches of the filled pixels whose patches cover it. */
+  void CompositeSinglePixel(const itk::Index<2>& pixel);
+
   /** Fill the hole one patch-radius-thick ring at a time (from outside in) */
   void PatchRadiusThickRings();
 
-  /** Compute the NNField using a combination of verified propagation, random search, and forced propagation steps. */
-  void ComputeNNField(Mask* const targetMask);
+  /** Compute the NNField at 'targetPixels' using a combination of verified propagation, random search,
+    * and forced propagation steps. 'seed' seeds the random initialization. */
+  void ComputeNNField(Worker* const worker, const std::vector<itk::Index<2> >& targetPixels,
+                      const unsigned int seed);
+
+  /** Compute the NNField at 'targetPixels' in parallel. The pixels are split into square tiles,
+    * and the pixels at least PatchRadius + 1 from the edges of their tile form one segment per
+    * tile. The patches (and the propagation neighbors) of different segments never overlap, so the
+    * segments are computed concurrently. The remaining (seam) pixels are then computed on the
+    * calling thread, propagating from the finished segments. */
+  void ComputeNNFieldInSegments(const std::vector<itk::Index<2> >& targetPixels);
+
+  RingModeEnum RingMode = PATCH_RADIUS_THICK_RINGS;
+
+  FrontOrderEnum FrontOrder = FRONT_DISTANCE;
+
+  bool AdaptiveTestOrder = true;
+
+  /** The most relaxed neighbor histogram ratio of the first ComputeNNField() iteration. */
+  float MaxHistogramRatio = 3.2f;
+
+  /** The number of random source patches SINGLE_PIXEL_RINGS tries before its random search. */
+  unsigned int GlobalSearchSamples = 64;
+
+  /** The number of centers drawn in each random search window. */
+  unsigned int RandomSearchDrawsPerRadius = 16;
+
+  /** The random search of SinglePixelRings. It is reseeded by every Inpaint() so runs are repeatable. */
+  std::mt19937 RandomGenerator;
+
+  /** The fraction of the hole that has been filled by the rings so far. Used to report progress. */
+  float FractionFilled = 0.0f;
+
+  /** The pixels that may be used as the source of patches. */
+  Mask::Pointer SourceMask = Mask::New();
+
+  /** How far from the hole source patch centers may be. Zero means anywhere in the SourceMask. */
+  unsigned int SourceBandRadius = 0;
+
+  /** The pixels to fill. */
+  Mask::Pointer TargetMask = Mask::New();
+
+  /** The hole peeled into layers, from which every ring is taken. */
+  OnionLayers HoleLayers;
+
+  /** A mask with only the pixels currently being worked on Valid. It is allocated once per
+    * Inpaint() and every user sets its pixels back to Hole, so that preparing it for a ring
+    * costs O(ring) rather than O(image). Concurrent segments each write only their own pixels
+    * and read only the pixels next to them, so they share it. */
+  Mask::Pointer WorkingTargetMask = Mask::New();
+
+  /** The nearest neighbor field, which is filled in one ring at a time. */
+  PatchMatchHelpers::NNFieldType::Pointer NNField;
+
+  /** The input image in HSV, used by the neighbor histogram test. */
+  HSVImageType::Pointer HSVImage = HSVImageType::New();
+
+  /** The functors of each thread, created by CreateMatchingFunctors(). */
+  std::vector<std::unique_ptr<Worker> > Workers;
+
+  /** The threads that compute the segments of a ring. It is created by the first Inpaint(). */
+  std::unique_ptr<ThreadPool> Pool;
+
+  /** The number of threads requested with SetNumberOfThreads(). */
+  unsigned int NumberOfThreads = 0;
+
+  /** The centers of the patches that are entirely in the SourceMask. */
+  std::vector<itk::Index<2> > SourcePatchCenters;
+
+  /** Counts the calls to ComputeNNFieldInSegments() in this Inpaint(), to seed its segments. */
+  unsigned int NNFieldComputations = 0;
 
 };
 
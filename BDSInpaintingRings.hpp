@@ -23,19 +23,58 @@
 #include "BDSInpainting.h" // Composition
 
 // Custom
+#include "CountingFunctors.h"
+#include "DebugSink.h"
+#include "FrontierPropagator.h"
 #include "Slots.h"
 #include "PixelCompositors.h"
+#include "PerformanceCounters.h"
+#include "SeededRandomSearch.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+
+// ITK
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkImageRegionIterator.h"
 
 // Submodules
 #include <PatchMatch/PropagatorForwardBackward.h>
-#include <PatchMatch/RandomSearch.h>
 #include <PatchMatch/AcceptanceTestSSD.h>
 #include <PatchMatch/AcceptanceTestSourceRegion.h>
-#include <PatchMatch/AcceptanceTestComposite.h>
 #include <PatchMatch/Process.h>
 
 #include <Helpers/Helpers.h>
 
+// STL
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <memory>
+#include <queue>
+#include <string>
+
+// Boost
+#include <boost/signals2.hpp>
+
+/** Adapts a WritePatchPair to an AcceptedSignal slot that queues the write on the DebugSink. */
+template <typename TImage>
+struct PatchPairDebugSlot
+{
+  PatchPairDebugSlot(const std::shared_ptr<WritePatchPair<TImage> >& writer) : Writer(writer) {}
+
+  void operator()(const itk::Index<2>& queryCenter, const itk::Index<2>& matchCenter, const float score) const
+  {
+    std::shared_ptr<WritePatchPair<TImage> > writer = this->Writer;
+    DebugSink::Instance().Enqueue(DebugSink::CANDIDATES,
+                                  [writer, queryCenter, matchCenter, score]()
+                                  {writer->Write(queryCenter, matchCenter, score);});
+  }
+
+  /** Shared with the queued jobs, so it outlives the function that connected the slot. */
+  std::shared_ptr<WritePatchPair<TImage> > Writer;
+};
+
 template <typename TImage>
 BDSInpaintingRings<TImage>::BDSInpaintingRings() : InpaintingAlgorithm<TImage>()
 {
@@ -45,9 +84,17 @@ BDSInpaintingRings<TImage>::BDSInpaintingRings() : InpaintingAlgorithm<TImage>()
 template <typename TImage>
 void BDSInpaintingRings<TImage>::Inpaint()
 {
+  BDS_TRACE_SCOPE("BDSInpaintingRings::Inpaint");
+
+  this->Counters.Reset();
+  this->StartRun();
+  this->FractionFilled = 0.0f;
+  this->RandomGenerator.seed(0);
+  this->NNFieldComputations = 0;
+
   { // Debug only
-  ITKHelpers::WriteImage(this->TargetMask.GetPointer(), "BDS_TargetMask.png");
-  ITKHelpers::WriteImage(this->SourceMask.GetPointer(), "BDS_SourceMask.png");
+  DebugSink::Instance().WriteImage(DebugSink::SUMMARY, this->TargetMask.GetPointer(), "BDS_TargetMask.png");
+  DebugSink::Instance().WriteImage(DebugSink::SUMMARY, this->SourceMask.GetPointer(), "BDS_SourceMask.png");
   }
 
   // Allocate the initial NNField
@@ -60,67 +107,360 @@ void BDSInpaintingRings<TImage>::Inpaint()
   emptyMatchSet.SetMaximumMatches(10);
   ITKHelpers::SetImageToConstant(this->NNField.GetPointer(), emptyMatchSet);
 
-  PatchMatchHelpers::WriteNNField(this->NNField.GetPointer(), "BDS_OriginalInitialized.mha");
+  DebugSink::Instance().WriteNNField(DebugSink::SUMMARY, this->NNField.GetPointer(), "BDS_OriginalInitialized.mha");
 
   InitializeKnownRegion();
 
-  PatchMatchHelpers::WriteNNField(this->NNField.GetPointer(), "BDS_InitializeKnownRegion.mha");
+  DebugSink::Instance().WriteNNField(DebugSink::SUMMARY, this->NNField.GetPointer(), "BDS_InitializeKnownRegion.mha");
 
   ProducePropagationBuffer();
 
-  ITKHelpers::WriteImage(this->SourceMask.GetPointer(), "BDS_SourceMaskWithBuffer.png");
+  DebugSink::Instance().WriteImage(DebugSink::SUMMARY, this->SourceMask.GetPointer(), "BDS_SourceMaskWithBuffer.png");
+
+  CreateMatchingFunctors();
+
+  this->WorkingTargetMask->DeepCopyFrom(this->TargetMask);
+  this->WorkingTargetMask->FillBuffer(this->WorkingTargetMask->GetHoleValue());
 
   // Get the region where we need to compute the NNField but not composite
   Mask::Pointer surroundingRingMask = Mask::New();
   GetSurroundingRingMask(surroundingRingMask);
 
-  ITKHelpers::WriteImage(surroundingRingMask.GetPointer(), "BDS_SurroundingRingMask.png");
+  DebugSink::Instance().WriteImage(DebugSink::SUMMARY, surroundingRingMask.GetPointer(), "BDS_SurroundingRingMask.png");
 
   // This is the only step that is separate from the ring-at-a-time filling.
-  ComputeNNField(surroundingRingMask);
+  ComputeNNFieldInSegments(surroundingRingMask->GetValidPixels());
 
-  PatchMatchHelpers::WriteNNField(this->NNField.GetPointer(), "BDS_SurroundingRing.mha");
+  DebugSink::Instance().WriteNNField(DebugSink::SUMMARY, this->NNField.GetPointer(), "BDS_SurroundingRing.mha");
 
   // Initialize the output from the original image
   ITKHelpers::DeepCopy(this->Image.GetPointer(), this->Output.GetPointer());
 
-  PatchRadiusThickRings();
+  if(this->RingMode == SINGLE_PIXEL_RINGS)
+  {
+    SinglePixelRings();
+  }
+  else
+  {
+    PatchRadiusThickRings();
+  }
+
+  // If the run was stopped early, the remaining rings were composited from unverified
+  // (randomly initialized) matches.
+  unsigned int numberOfHolePixels = this->TargetMask->CountValidPixels();
+  unsigned int numberOfUnverifiedPixels =
+      PatchMatchHelpers::CountUnverifiedPixels(this->NNField.GetPointer(), this->TargetMask.GetPointer());
+  this->Completeness = (numberOfHolePixels == 0) ? 1.0f :
+      1.0f - static_cast<float>(numberOfUnverifiedPixels) / static_cast<float>(numberOfHolePixels);
+
+  // Count how often the acceptance tests changed their order (see GetAcceptanceTestOrders())
+  InpaintingStatistics& statistics = this->Counters.Local();
+  for(size_t workerId = 0; workerId < this->Workers.size(); ++workerId)
+  {
+    statistics.AcceptanceTestReorders += this->Workers[workerId]->PropagationAcceptanceTest->GetNumberOfReorders() +
+                                         this->Workers[workerId]->RandomSearchAcceptanceTest->GetNumberOfReorders();
+  }
+}
+
+template <typename TImage>
+std::vector<std::string> BDSInpaintingRings<TImage>::GetAcceptanceTestOrders() const
+{
+  std::vector<std::string> orders;
+  for(size_t workerId = 0; workerId < this->Workers.size(); ++workerId)
+  {
+    orders.push_back("Propagation: " + this->Workers[workerId]->PropagationAcceptanceTest->GetOrderDescription() +
+                     "; RandomSearch: " + this->Workers[workerId]->RandomSearchAcceptanceTest->GetOrderDescription());
+  }
+  return orders;
+}
+
+template <typename TImage>
+void BDSInpaintingRings<TImage>::SetSourceMask(Mask* const mask)
+{
+  this->SourceMask->DeepCopyFrom(mask);
+}
+
+template <typename TImage>
+void BDSInpaintingRings<TImage>::SetSourceBandRadius(const unsigned int sourceBandRadius)
+{
+  this->SourceBandRadius = sourceBandRadius;
+}
+
+template <typename TImage>
+void BDSInpaintingRings<TImage>::SetTargetMask(Mask* const mask)
+{
+  this->TargetMask->DeepCopyFrom(mask);
+}
+
+template <typename TImage>
+void BDSInpaintingRings<TImage>::SetAdaptiveTestOrder(const bool adaptiveTestOrder)
+{
+  this->AdaptiveTestOrder = adaptiveTestOrder;
+}
+
+template <typename TImage>
+void BDSInpaintingRings<TImage>::SetMaxHistogramRatio(const float maxHistogramRatio)
+{
+  this->MaxHistogramRatio = maxHistogramRatio;
+}
+
+template <typename TImage>
+void BDSInpaintingRings<TImage>::SetGlobalSearchSamples(const unsigned int globalSearchSamples)
+{
+  this->GlobalSearchSamples = globalSearchSamples;
+}
+
+template <typename TImage>
+void BDSInpaintingRings<TImage>::SetRandomSearchDrawsPerRadius(const unsigned int randomSearchDrawsPerRadius)
+{
+  this->RandomSearchDrawsPerRadius = randomSearchDrawsPerRadius;
+}
+
+template <typename TImage>
+void BDSInpaintingRings<TImage>::SetNumberOfThreads(const unsigned int numberOfThreads)
+{
+  this->NumberOfThreads = numberOfThreads;
+  this->Pool.reset();
+}
+
+template <typename TImage>
+void BDSInpaintingRings<TImage>::SetRingMode(const RingModeEnum ringMode)
+{
+  this->RingMode = ringMode;
+}
+
+template <typename TImage>
+void BDSInpaintingRings<TImage>::SetFrontOrder(const FrontOrderEnum frontOrder)
+{
+  this->FrontOrder = frontOrder;
+}
+
+template <typename TImage>
+void BDSInpaintingRings<TImage>::CreateMatchingFunctors()
+{
+  BDS_TRACE_SCOPE("BDSInpaintingRings::CreateMatchingFunctors");
+
+  // Create the HSV image
+  HSVConversion::ConvertRGBToHSV(this->Image.GetPointer(), this->HSVImage.GetPointer());
+  DebugSink::Instance().WriteImage(DebugSink::SUMMARY, this->HSVImage.GetPointer(), "HSV.mha");
+
+  if(!this->Pool)
+  {
+    this->Pool.reset(new ThreadPool(this->NumberOfThreads));
+  }
+
+  // The first Worker builds the neighbor histogram tables, which the others share
+  this->Workers.clear();
+  for(unsigned int threadId = 0; threadId < this->Pool->GetNumberOfThreads(); ++threadId)
+  {
+    this->Workers.push_back(std::unique_ptr<Worker>(new Worker));
+    CreateWorker(this->Workers.back().get(),
+                 (threadId == 0) ? nullptr : this->Workers[0]->NeighborHistogramRatioAcceptanceTest.get());
+  }
+
+  ComputeSourcePatchCenters();
+}
+
+template <typename TImage>
+void BDSInpaintingRings<TImage>::CreateWorker(Worker* const worker,
+                                              const NeighborHistogramRatioAcceptanceTestType* const histogramTest)
+{
+  // Setup the patch distance functors. Propagation and random search get their own so that
+  // their evaluations are counted as their attempts, as in BDSInpainting.
+  worker->PatchDistanceFunctor.reset(new PatchDistanceFunctorType);
+  worker->PatchDistanceFunctor->SetImage(this->Image);
+  worker->PatchDistanceFunctor->SetStatisticsCollector(&this->Counters);
+
+  worker->PropagationPatchDistanceFunctor.reset(new PatchDistanceFunctorType);
+  worker->PropagationPatchDistanceFunctor->SetImage(this->Image);
+  worker->PropagationPatchDistanceFunctor->SetStatisticsCollector(&this->Counters,
+                                                                  &InpaintingStatistics::PropagationAttempts);
+
+  worker->RandomSearchPatchDistanceFunctor.reset(new PatchDistanceFunctorType);
+  worker->RandomSearchPatchDistanceFunctor->SetImage(this->Image);
+  worker->RandomSearchPatchDistanceFunctor->SetStatisticsCollector(&this->Counters,
+                                                                   &InpaintingStatistics::RandomSearchAttempts);
+
+  worker->SSDAcceptanceTest.reset(new AcceptanceTestSSDType);
+  worker->SSDAcceptanceTest->SetIncludeInScore(false);
+  worker->SSDAcceptanceTest->SetStatisticsCollector(&this->Counters, &InpaintingStatistics::SSDTests,
+                                                    nullptr, &InpaintingStatistics::SSDRejections);
+
+  worker->SourceRegionAcceptanceTest.reset(new AcceptanceTestSourceRegionType(this->SourceMask));
+  worker->SourceRegionAcceptanceTest->SetIncludeInScore(false);
+  worker->SourceRegionAcceptanceTest->SetStatisticsCollector(&this->Counters, &InpaintingStatistics::SourceRegionTests,
+                                                             nullptr, &InpaintingStatistics::SourceRegionRejections);
+
+  if(histogramTest)
+  {
+    // A copy shares the quantized image, integral histogram and neighbor difference cache
+    worker->NeighborHistogramRatioAcceptanceTest.reset(new NeighborHistogramRatioAcceptanceTestType(*histogramTest));
+  }
+  else
+  {
+    worker->NeighborHistogramRatioAcceptanceTest.reset(new NeighborHistogramRatioAcceptanceTestType);
+    worker->NeighborHistogramRatioAcceptanceTest->SetImage(this->HSVImage);
+    worker->NeighborHistogramRatioAcceptanceTest->SetRangeMin(0.0f); // (0,1) is the range of each channel of the HSV image
+    worker->NeighborHistogramRatioAcceptanceTest->SetRangeMax(1.0f); // (0,1) is the range of each channel of the HSV image
+    worker->NeighborHistogramRatioAcceptanceTest->SetPatchRadius(this->PatchRadius);
+    // The ratio is set in the ConstrainedPatchMatch loop
+    worker->NeighborHistogramRatioAcceptanceTest->SetNumberOfBinsPerDimension(30);
+    worker->NeighborHistogramRatioAcceptanceTest->SetIncludeInScore(true);
+    // Only the histograms of distant sources (outside of this region) are counted
+    worker->NeighborHistogramRatioAcceptanceTest->SetIntegralHistogramRegion(ComputeHistogramRegion());
+    // Quantize the HSV image and build the integral histogram. The per-query neighbor differences
+    // it caches stay valid for the whole run, since the HSV image does not change.
+    worker->NeighborHistogramRatioAcceptanceTest->Initialize();
+  }
+  worker->NeighborHistogramRatioAcceptanceTest->SetStatisticsCollector(&this->Counters,
+                                                                       &InpaintingStatistics::NeighborHistogramTests, nullptr,
+                                                                       &InpaintingStatistics::NeighborHistogramRejections);
+  worker->NeighborHistogramRatioAcceptanceTest->SetCandidateCache(&worker->Candidates);
+
+  const std::vector<std::string> testNames = {"SourceRegion", "SSD", "NeighborHistogram"};
+
+  worker->PropagationAcceptanceTest.reset(new AcceptanceTestType(worker->SourceRegionAcceptanceTest.get(),
+                                                                 worker->SSDAcceptanceTest.get(),
+                                                                 worker->NeighborHistogramRatioAcceptanceTest.get()));
+  worker->PropagationAcceptanceTest->SetTestNames(testNames);
+  worker->PropagationAcceptanceTest->SetAdaptive(this->AdaptiveTestOrder);
+  worker->PropagationAcceptanceTest->SetStatisticsCollector(&this->Counters, nullptr,
+                                                            &InpaintingStatistics::PropagationAcceptances, nullptr);
+
+  worker->RandomSearchAcceptanceTest.reset(new AcceptanceTestType(worker->SourceRegionAcceptanceTest.get(),
+                                                                   worker->SSDAcceptanceTest.get(),
+                                                                   worker->NeighborHistogramRatioAcceptanceTest.get()));
+  worker->RandomSearchAcceptanceTest->SetTestNames(testNames);
+  worker->RandomSearchAcceptanceTest->SetAdaptive(this->AdaptiveTestOrder);
+  worker->RandomSearchAcceptanceTest->SetStatisticsCollector(&this->Counters, nullptr,
+                                                             &InpaintingStatistics::RandomSearchAcceptances, nullptr);
+}
+
+template <typename TImage>
+itk::ImageRegion<2> BDSInpaintingRings<TImage>::ComputeHistogramRegion() const
+{
+  const itk::ImageRegion<2> fullRegion = this->TargetMask->GetLargestPossibleRegion();
+
+  itk::Index<2> minimumCorner = {{std::numeric_limits<itk::IndexValueType>::max(),
+                                  std::numeric_limits<itk::IndexValueType>::max()}};
+  itk::Index<2> maximumCorner = {{std::numeric_limits<itk::IndexValueType>::min(),
+                                  std::numeric_limits<itk::IndexValueType>::min()}};
+
+  itk::ImageRegionConstIteratorWithIndex<Mask> maskIterator(this->TargetMask, fullRegion);
+  while(!maskIterator.IsAtEnd())
+  {
+    if(this->TargetMask->IsValid(maskIterator.GetIndex()))
+    {
+      for(unsigned int dimension = 0; dimension < 2; ++dimension)
+      {
+        minimumCorner[dimension] = std::min(minimumCorner[dimension], maskIterator.GetIndex()[dimension]);
+        maximumCorner[dimension] = std::max(maximumCorner[dimension], maskIterator.GetIndex()[dimension]);
+      }
+    }
+    ++maskIterator;
+  }
+
+  if(minimumCorner[0] > maximumCorner[0])
+  {
+    return itk::ImageRegion<2>();
+  }
+
+  const itk::IndexValueType padding = this->PatchRadius + 1 + this->SourceBandRadius;
+
+  itk::Index<2> corner = {{minimumCorner[0] - padding, minimumCorner[1] - padding}};
+  itk::Size<2> size = {{static_cast<itk::SizeValueType>(maximumCorner[0] - minimumCorner[0] + 1 + 2 * padding),
+                        static_cast<itk::SizeValueType>(maximumCorner[1] - minimumCorner[1] + 1 + 2 * padding)}};
+  itk::ImageRegion<2> histogramRegion(corner, size);
+  histogramRegion.Crop(fullRegion);
+  return histogramRegion;
+}
+
+template <typename TImage>
+void BDSInpaintingRings<TImage>::ComputeSourcePatchCenters()
+{
+  BDS_TRACE_SCOPE("BDSInpaintingRings::ComputeSourcePatchCenters");
+
+  // validCount[(y + 1) * (width + 1) + (x + 1)] is the number of Valid source pixels in [0, x] x [0, y]
+  const itk::ImageRegion<2> fullRegion = this->SourceMask->GetLargestPossibleRegion();
+  const long width = static_cast<long>(fullRegion.GetSize()[0]);
+  const long height = static_cast<long>(fullRegion.GetSize()[1]);
+  std::vector<unsigned int> validCount((width + 1) * (height + 1), 0);
+
+  itk::ImageRegionConstIterator<Mask> maskIterator(this->SourceMask, fullRegion);
+  for(long y = 0; y < height; ++y)
+  {
+    unsigned int rowCount = 0;
+    for(long x = 0; x < width; ++x, ++maskIterator)
+    {
+      if(maskIterator.Get() == this->SourceMask->GetValidValue())
+      {
+        rowCount++;
+      }
+      validCount[(y + 1) * (width + 1) + (x + 1)] = validCount[y * (width + 1) + (x + 1)] + rowCount;
+    }
+  }
+
+  const long radius = static_cast<long>(this->PatchRadius);
+  const unsigned int patchPixels = (2 * radius + 1) * (2 * radius + 1);
+
+  this->SourcePatchCenters.clear();
+  for(long y = radius; y < height - radius; ++y)
+  {
+    for(long x = radius; x < width - radius; ++x)
+    {
+      const unsigned int patchCount = validCount[(y + radius + 1) * (width + 1) + (x + radius + 1)] -
+                                      validCount[(y - radius) * (width + 1) + (x + radius + 1)] -
+                                      validCount[(y + radius + 1) * (width + 1) + (x - radius)] +
+                                      validCount[(y - radius) * (width + 1) + (x - radius)];
+      if(patchCount == patchPixels)
+      {
+        itk::Index<2> center = {{fullRegion.GetIndex()[0] + x, fullRegion.GetIndex()[1] + y}};
+        this->SourcePatchCenters.push_back(center);
+      }
+    }
+  }
 }
 
 template <typename TImage>
 void BDSInpaintingRings<TImage>::GetSurroundingRingMask(Mask* surroundingMask)
 {
+  BDS_TRACE_SCOPE("BDSInpaintingRings::GetSurroundingRingMask");
+
   // Expand the hole (ShrinkHole is called because here we mark the "hole"
   // with "valid" pixels.
   Mask::Pointer expandedTargetMask = Mask::New();
   expandedTargetMask->DeepCopyFrom(this->TargetMask);
   expandedTargetMask->ShrinkHole(this->PatchRadius);
 
-  ITKHelpers::WriteImage(expandedTargetMask.GetPointer(), "BDSInpaintingRings_ExpandedTargetMask.png");
+  DebugSink::Instance().WriteImage(DebugSink::SUMMARY, expandedTargetMask.GetPointer(), "BDSInpaintingRings_ExpandedTargetMask.png");
 
   // Get the difference (XOR) between the original hole and the expanded hole
   ITKHelpers::XORImages(expandedTargetMask.GetPointer(), this->TargetMask.GetPointer(),
                         surroundingMask, this->TargetMask->GetValidValue());
   surroundingMask->CopyInformationFrom(this->TargetMask);
 
-  ITKHelpers::WriteImage(surroundingMask, "BDSInpaintingRings_surroundingMask.png");
+  DebugSink::Instance().WriteImage(DebugSink::SUMMARY, surroundingMask, "BDSInpaintingRings_surroundingMask.png");
 }
 
 template <typename TImage>
 void BDSInpaintingRings<TImage>::InitializeKnownRegion()
 {
+  BDS_TRACE_SCOPE("BDSInpaintingRings::InitializeKnownRegion");
+
   // Initialize the NNField in the known region
   InitializerKnownRegion initializerKnownRegion;
   initializerKnownRegion.SetSourceMask(this->SourceMask);
   initializerKnownRegion.SetPatchRadius(this->PatchRadius);
   initializerKnownRegion.Initialize(this->NNField);
 
-  PatchMatchHelpers::WriteNNField(this->NNField.GetPointer(), "BDSInpaintingRings_KnownRegionNNField.mha");
+  DebugSink::Instance().WriteNNField(DebugSink::SUMMARY, this->NNField.GetPointer(), "BDSInpaintingRings_KnownRegionNNField.mha");
 }
 
 template <typename TImage>
 void BDSInpaintingRings<TImage>::ProducePropagationBuffer()
 {
+  BDS_TRACE_SCOPE("BDSInpaintingRings::ProducePropagationBuffer");
+
   // Remove the boundary from the source mask, to give the propagation some breathing room.
   // We just remove a 1 pixel thick boundary around the image, then perform an ExpandHole operation.
   // ExpandHole() only operates on the boundary between Valid and Hole, so if we did not first remove the
@@ -131,68 +471,62 @@ void BDSInpaintingRings<TImage>::ProducePropagationBuffer()
     ITKHelpers::GetBoundaryPixels(this->SourceMask->GetLargestPossibleRegion(), 1);
   ITKHelpers::SetPixels(this->SourceMask.GetPointer(), boundaryPixels, this->SourceMask->GetHoleValue());
 
-  ITKHelpers::WriteImage(this->SourceMask.GetPointer(), "BDSInpaintingRings_BoundaryRemovedSourceMask.png");
+  DebugSink::Instance().WriteImage(DebugSink::SUMMARY, this->SourceMask.GetPointer(), "BDSInpaintingRings_BoundaryRemovedSourceMask.png");
 
   // Shrink the source region, around the border of the image and around the hole.
   this->SourceMask->ExpandHole(this->PatchRadius);
-  ITKHelpers::WriteImage(this->SourceMask.GetPointer(), "BDSInpaintingRings_FinalSourceMask.png");
+
+  // Only keep the sources whose patch centers are within the band around the hole. The hole is
+  // valid in the TargetMask, so ShrinkHole() grows it into the band.
+  if(this->SourceBandRadius > 0)
+  {
+    Mask::Pointer bandMask = Mask::New();
+    bandMask->DeepCopyFrom(this->TargetMask);
+    bandMask->ShrinkHole(this->SourceBandRadius + this->PatchRadius);
+
+    itk::ImageRegionConstIteratorWithIndex<Mask> bandIterator(bandMask, bandMask->GetLargestPossibleRegion());
+    itk::ImageRegionIterator<Mask> sourceIterator(this->SourceMask, this->SourceMask->GetLargestPossibleRegion());
+    while(!bandIterator.IsAtEnd())
+    {
+      if(!bandMask->IsValid(bandIterator.GetIndex()))
+      {
+        sourceIterator.Set(this->SourceMask->GetHoleValue());
+      }
+      ++bandIterator;
+      ++sourceIterator;
+    }
+  }
+
+  DebugSink::Instance().WriteImage(DebugSink::SUMMARY, this->SourceMask.GetPointer(), "BDSInpaintingRings_FinalSourceMask.png");
 }
 
 template <typename TImage>
-void BDSInpaintingRings<TImage>::ConstrainedPatchMatch(Mask* const targetMask,
+void BDSInpaintingRings<TImage>::ConstrainedPatchMatch(Worker* const worker, Mask* const targetMask,
+                                                       UnverifiedPixelWorklist* const worklist,
                                                        const float histogramRatioStart,
                                                        const float histogramRatioStep, const float maxHistogramRatio)
 {
-  // Create the HSV image
-  typedef itk::VectorImage<float, 2> HSVImageType;
-  HSVImageType::Pointer hsvImage = HSVImageType::New();
-  ITKHelpers::ITKImageToHSVImage(this->Image.GetPointer(), hsvImage.GetPointer());
-  ITKHelpers::WriteImage(hsvImage.GetPointer(), "HSV.mha");
-
-  // Setup the patch distance functor
-  typedef SSD<TImage> PatchDistanceFunctorType;
-  PatchDistanceFunctorType patchDistanceFunctor;
-  patchDistanceFunctor.SetImage(this->Image);
-
-  typedef AcceptanceTestSSD AcceptanceTestSSDType;
-  AcceptanceTestSSDType acceptanceTestSSD;
-  acceptanceTestSSD.SetIncludeInScore(false);
-
-  typedef AcceptanceTestSourceRegion AcceptanceTestSourceRegionType;
-  AcceptanceTestSourceRegion acceptanceTestSourceRegion(this->SourceMask);
-  acceptanceTestSourceRegion.SetIncludeInScore(false);
-
-  typedef AcceptanceTestNeighborHistogramRatio<HSVImageType> NeighborHistogramRatioAcceptanceTestType;
-  NeighborHistogramRatioAcceptanceTestType neighborHistogramRatioAcceptanceTest;
-  neighborHistogramRatioAcceptanceTest.SetImage(hsvImage);
-  neighborHistogramRatioAcceptanceTest.SetRangeMin(0.0f); // (0,1) is the range of each channel of the HSV image
-  neighborHistogramRatioAcceptanceTest.SetRangeMax(1.0f); // (0,1) is the range of each channel of the HSV image
-  neighborHistogramRatioAcceptanceTest.SetPatchRadius(this->PatchRadius);
-  //neighborHistogramRatioAcceptanceTest.SetNeighborHistogramMultiplier(2.0f); // this will be set in the loop
-  neighborHistogramRatioAcceptanceTest.SetNumberOfBinsPerDimension(30);
-  neighborHistogramRatioAcceptanceTest.SetIncludeInScore(true);
-
-  typedef AcceptanceTestComposite AcceptanceTestType;
-  AcceptanceTestComposite acceptanceTest;
-  acceptanceTest.AddAcceptanceTest(&acceptanceTestSourceRegion);
-  acceptanceTest.AddAcceptanceTest(&acceptanceTestSSD);
-  acceptanceTest.AddAcceptanceTest(&neighborHistogramRatioAcceptanceTest);
-
-  Process* processFunctor = new ProcessValidMaskPixels(targetMask);
+  BDS_TRACE_SCOPE("BDSInpaintingRings::ConstrainedPatchMatch");
+
+  // Pixels that were verified by an earlier (stricter) histogram ratio step are not revisited.
+  ProcessWorklistPixels worklistProcessFunctor(worklist);
+  Process* processFunctor = &worklistProcessFunctor;
 
   typedef PropagatorForwardBackward<PatchDistanceFunctorType,
           AcceptanceTestType> PropagatorType;
   PropagatorType propagationFunctor;
   propagationFunctor.SetPatchRadius(this->PatchRadius);
-  propagationFunctor.SetAcceptanceTest(&acceptanceTest);
-  propagationFunctor.SetPatchDistanceFunctor(&patchDistanceFunctor);
+  propagationFunctor.SetAcceptanceTest(worker->PropagationAcceptanceTest.get());
+  propagationFunctor.SetPatchDistanceFunctor(worker->PropagationPatchDistanceFunctor.get());
   propagationFunctor.SetProcessFunctor(processFunctor);
 
-  WritePatchPair<TImage> propagatedPatchPairWriter(this->Image, this->PatchRadius, "PropagatedPairs");
-
-  auto propagatedPairWriter = [&propagatedPatchPairWriter](const itk::Index<2>& queryCenter, const itk::Index<2>& matchCenter, const float score)
-                    {propagatedPatchPairWriter.Write(queryCenter, matchCenter, score);};
-//  propagationFunctor.AcceptedSignal.connect(propagatedPairWriter);
+  // Debug only: write every accepted pair on the debug writer thread
+  boost::signals2::scoped_connection propagatedPairConnection;
+  if(DebugSink::Instance().IsEnabled(DebugSink::CANDIDATES))
+  {
+    propagatedPairConnection = propagationFunctor.AcceptedSignal.connect(
+      PatchPairDebugSlot<TImage>(std::make_shared<WritePatchPair<TImage> >(this->Image, this->PatchRadius, "PropagatedPairs")));
+  }
 
   NeighborTestValidMask validMaskNeighborTest(targetMask);
 
@@ -210,32 +544,31 @@ void BDSInpaintingRings<TImage>::ConstrainedPatchMatch(Mask* const targetMask,
   backwardNeighbors.AddNeighborTest(&validMaskNeighborTest);
   propagationFunctor.SetBackwardNeighborFunctor(&backwardNeighbors);
 
-  typedef RandomSearch<TImage, PatchDistanceFunctorType, AcceptanceTestType>
-    RandomSearchType;
+  // The samples are drawn from the worker's generator, which is seeded for each segment, so the
+  // result does not depend on which thread computes which segment.
+  typedef SeededRandomSearch<PatchDistanceFunctorType, AcceptanceTestType> RandomSearchType;
   RandomSearchType randomSearcher;
-  randomSearcher.SetImage(this->Image);
   randomSearcher.SetPatchRadius(this->PatchRadius);
   randomSearcher.SetSourceMask(this->SourceMask);
-  randomSearcher.SetPatchDistanceFunctor(&patchDistanceFunctor);
+  randomSearcher.SetPatchDistanceFunctor(worker->RandomSearchPatchDistanceFunctor.get());
   randomSearcher.SetProcessFunctor(processFunctor);
-  randomSearcher.SetAcceptanceTest(&acceptanceTest);
-  randomSearcher.SetRandom(false);
+  randomSearcher.SetAcceptanceTest(worker->RandomSearchAcceptanceTest.get());
+  randomSearcher.SetRandomGenerator(&worker->RandomGenerator);
+  randomSearcher.SetMaximumDrawsPerRadius(this->RandomSearchDrawsPerRadius);
 
-  WritePatchPair<TImage> patchPairWriter(this->Image, this->PatchRadius, "RandomSearchPairs");
-
-  auto pairWriter = [&patchPairWriter](const itk::Index<2>& queryCenter, const itk::Index<2>& matchCenter, const float score)
-                    {patchPairWriter.Write(queryCenter, matchCenter, score);};
-//  randomSearcher.AcceptedSignal.connect(pairWriter);
+  // Debug only: write every accepted pair on the debug writer thread
+  boost::signals2::scoped_connection randomSearchPairConnection;
+  if(DebugSink::Instance().IsEnabled(DebugSink::CANDIDATES))
+  {
+    randomSearchPairConnection = randomSearcher.AcceptedSignal.connect(
+      PatchPairDebugSlot<TImage>(std::make_shared<WritePatchPair<TImage> >(this->Image, this->PatchRadius, "RandomSearchPairs")));
+  }
 
-  // Initialize the NNField in the PatchRadius thick ring outside of the target region
-  InitializerRandom<PatchDistanceFunctorType> initializer;
-  initializer.SetPatchDistanceFunctor(&patchDistanceFunctor);
-  initializer.SetTargetMask(targetMask);
-  initializer.SetSourceMask(this->SourceMask);
-  initializer.SetPatchRadius(this->PatchRadius);
-  initializer.Initialize(this->NNField);
+  // Initialize the NNField of the pixels that are still unverified
+  worklist->Update();
+  InitializeRandomMatches(worker, *worklist);
 
-  PatchMatchHelpers::WriteNNField(this->NNField.GetPointer(), "BDSInpaintingRings_RandomInit.mha");
+  DebugSink::Instance().WriteNNField(DebugSink::ITERATIONS, this->NNField.GetPointer(), "BDSInpaintingRings_RandomInit.mha");
 
   // Setup the PatchMatch functor
   PatchMatch patchMatchFunctor;
@@ -244,36 +577,52 @@ void BDSInpaintingRings<TImage>::ConstrainedPatchMatch(Mask* const targetMask,
   //patchMatchFunctor.SetIterations(1);
   //patchMatchFunctor.Compute(nnField, &propagationFunctor, &randomSearcher, processFunctor); // This will be done in the loop
 
-  PatchMatchHelpers::WriteNNField(this->NNField.GetPointer(), "BDSInpaintingRings_BeforeConstrainedPatchMatch.mha");
+  DebugSink::Instance().WriteNNField(DebugSink::ITERATIONS, this->NNField.GetPointer(), "BDSInpaintingRings_BeforeConstrainedPatchMatch.mha");
 
   float acceptableHistogramRatio = histogramRatioStart;
 
   unsigned int iteration = 0;
 
-  auto testNoVerifiedMatch = [](const MatchSet& queryMatchSet)
+  // Debug only: write the field after every PatchMatch iteration
+  boost::signals2::scoped_connection patchMatchUpdatedConnection;
+  if(DebugSink::Instance().IsEnabled(DebugSink::CANDIDATES))
   {
-    return !queryMatchSet.HasVerifiedMatch();
-  };
-
-  WriteSlot patchMatchWriter("BDS_Phase1");
-  auto pmWriter = [&patchMatchWriter](PatchMatchHelpers::NNFieldType* nnField){patchMatchWriter.Write(nnField);};
-//  patchMatchFunctor.UpdatedSignal.connect(pmWriter);
+    std::shared_ptr<WriteSlot> patchMatchWriter = std::make_shared<WriteSlot>("BDS_Phase1");
+    patchMatchUpdatedConnection = patchMatchFunctor.UpdatedSignal.connect(
+      [patchMatchWriter](PatchMatchHelpers::NNFieldType* nnField)
+      {
+        PatchMatchHelpers::NNFieldType::Pointer nnFieldCopy = PatchMatchHelpers::NNFieldType::New();
+        ITKHelpers::DeepCopy(nnField, nnFieldCopy.GetPointer());
+        DebugSink::Instance().Enqueue(DebugSink::CANDIDATES,
+                                      [patchMatchWriter, nnFieldCopy]() {patchMatchWriter->Write(nnFieldCopy);});
+      });
+  }
 
-  while((PatchMatchHelpers::CountTestedPixels(this->NNField.GetPointer(),
-          targetMask, testNoVerifiedMatch) > 0) &&
-        (acceptableHistogramRatio <= maxHistogramRatio))
+  while((worklist->Update() > 0) &&
+        (acceptableHistogramRatio <= maxHistogramRatio) &&
+        !this->ShouldStop("BDSInpaintingRings::ConstrainedPatchMatch", this->FractionFilled))
   {
-    std::cout << "There are "
-              << PatchMatchHelpers::CountTestedPixels(this->NNField.GetPointer(),
-                                                      targetMask, testNoVerifiedMatch)
+    std::cout << "There are " << worklist->GetNumberOfPixels()
               << " pixels without a verified match remaining." << std::endl;
 
-    neighborHistogramRatioAcceptanceTest.SetMaxNeighborHistogramRatio(acceptableHistogramRatio);
+    BDS_TRACE_SCOPE_ITERATION("BDSInpaintingRings::ConstrainedPatchMatch::Iteration", iteration);
+
+    this->Counters.Increment(&InpaintingStatistics::HistogramRelaxationSteps);
+
+    worker->NeighborHistogramRatioAcceptanceTest->SetMaxNeighborHistogramRatio(acceptableHistogramRatio);
 
-    patchMatchFunctor.Compute(this->NNField, &propagationFunctor, &randomSearcher,
-                              processFunctor);
+    // Candidates that only just failed the previous ratio are likely to pass this one, so
+    // search again only for the pixels that none of them verifies.
+    RetestCandidates(worker, *worklist);
 
-    PatchMatchHelpers::WriteNNField(this->NNField.GetPointer(),
+    if(worklist->Update() > 0)
+    {
+      BDS_PERF_SCOPE_ITERATION("PatchMatch::Compute", iteration);
+      patchMatchFunctor.Compute(this->NNField, &propagationFunctor, &randomSearcher,
+                                processFunctor);
+    }
+
+    DebugSink::Instance().WriteNNField(DebugSink::ITERATIONS, this->NNField.GetPointer(),
                                     Helpers::GetSequentialFileName("BDSInpaintingRings_PropagatedNNField",
                                                                    iteration, "mha"));
     acceptableHistogramRatio += histogramRatioStep;
@@ -284,311 +633,672 @@ void BDSInpaintingRings<TImage>::ConstrainedPatchMatch(Mask* const targetMask,
 }
 
 template <typename TImage>
-void BDSInpaintingRings<TImage>::ForcePropagation(Mask* const targetMask)
+void BDSInpaintingRings<TImage>::ForcePropagation(Worker* const worker, Mask* const targetMask,
+                                                  UnverifiedPixelWorklist* const worklist)
 {
-  std::cout << "Starting force propagation..." << std::endl;
-
-  ProcessUnverifiedValidMaskPixels unverifiedProcessFunctor(this->NNField, targetMask);
+  BDS_TRACE_SCOPE("BDSInpaintingRings::ForcePropagation");
 
-  // Create the HSV image
-  typedef itk::VectorImage<float, 2> HSVImageType;
-  HSVImageType::Pointer hsvImage = HSVImageType::New();
-  ITKHelpers::ITKImageToHSVImage(this->Image.GetPointer(), hsvImage.GetPointer());
-  ITKHelpers::WriteImage(hsvImage.GetPointer(), "HSV.mha");
-
-  // Setup the patch distance functor
-  typedef SSD<TImage> PatchDistanceFunctorType;
-  PatchDistanceFunctorType patchDistanceFunctor;
-  patchDistanceFunctor.SetImage(this->Image);
-
-  typedef AcceptanceTestSourceRegion AcceptanceTestSourceRegionType;
-  AcceptanceTestSourceRegion acceptanceTestSourceRegion(this->SourceMask);
-  acceptanceTestSourceRegion.SetIncludeInScore(false);
+  std::cout << "Starting force propagation..." << std::endl;
 
   // The only acceptance test we want to apply is to make sure the propagated
   // patch is actually valid (completely in the source region)
-  typedef PropagatorForwardBackward<PatchDistanceFunctorType,
+  typedef FrontierPropagator<PatchDistanceFunctorType,
           AcceptanceTestSourceRegionType> ForcePropagatorType;
   ForcePropagatorType forcePropagator;
   forcePropagator.SetPatchRadius(this->PatchRadius);
-  forcePropagator.SetAcceptanceTest(&acceptanceTestSourceRegion);
-  forcePropagator.SetPatchDistanceFunctor(&patchDistanceFunctor);
-  forcePropagator.SetProcessFunctor(&unverifiedProcessFunctor);
+  forcePropagator.SetAcceptanceTest(worker->SourceRegionAcceptanceTest.get());
+  forcePropagator.SetPatchDistanceFunctor(worker->PatchDistanceFunctor.get());
 
-  WritePatchPair<TImage> forcedPropagatedPatchPairWriter(this->Image, this->PatchRadius, "ForcedPropagatedPairs");
+  // Debug only: write every forced pair on the debug writer thread
+  boost::signals2::scoped_connection forcedPropagatedPairConnection;
+  if(DebugSink::Instance().IsEnabled(DebugSink::CANDIDATES))
+  {
+    forcedPropagatedPairConnection = forcePropagator.AcceptedSignal.connect(
+      PatchPairDebugSlot<TImage>(std::make_shared<WritePatchPair<TImage> >(this->Image, this->PatchRadius,
+                                                                   "ForcedPropagatedPairs")));
+  }
 
-  auto forcedPropagatedPairWriter = [&forcedPropagatedPatchPairWriter](const itk::Index<2>& queryCenter, const itk::Index<2>& matchCenter, const float score)
-                    {forcedPropagatedPatchPairWriter.Write(queryCenter, matchCenter, score);};
-//  forcePropagator.AcceptedSignal.connect(forcedPropagatedPairWriter);
+  worklist->Update();
+  forcePropagator.Initialize(this->NNField, targetMask, worklist->GetPixels());
 
-  OutputPixelSlot outputPixelFunctor;
-  auto outputPixelSlot = [&outputPixelFunctor](const itk::Index<2>& index)
-                    {outputPixelFunctor.OutputPixel(index);};
-//  forcePropagator.ProcessPixelSignal.connect(outputPixelSlot);
+  size_t numberOfRemainingPixels = worklist->GetNumberOfPixels();
 
-  NeighborTestVerified verifiedNeighborTest(this->NNField);
+  unsigned int iteration = 0;
 
-  NeighborTestValidMask validMaskNeighborTest(targetMask);
+  // Each iteration only visits the pixels next to those filled by the previous one.
+  while(numberOfRemainingPixels > 0 && !forcePropagator.IsFrontierEmpty() &&
+        !this->ShouldStop("BDSInpaintingRings::ForcePropagation", this->FractionFilled))
+  {
+    std::cout << "Phase 2: There are " << numberOfRemainingPixels
+              << " pixels without a verified match remaining." << std::endl;
 
-  Neighbors verifiedForwardNeighbors;
-  verifiedForwardNeighbors.SetRegion(this->NNField->GetLargestPossibleRegion());
-  verifiedForwardNeighbors.AddNeighborTest(&verifiedNeighborTest);
-  verifiedForwardNeighbors.AddNeighborTest(&validMaskNeighborTest);
-  NeighborTestForward forwardNeighborTest;
-  verifiedForwardNeighbors.AddNeighborTest(&forwardNeighborTest);
-  forcePropagator.SetForwardNeighborFunctor(&verifiedForwardNeighbors);
+    BDS_TRACE_SCOPE_ITERATION("BDSInpaintingRings::ForcePropagation::Iteration", iteration);
+    this->Counters.Increment(&InpaintingStatistics::ForcePropagationIterations);
 
-  Neighbors verifiedBackwardNeighbors;
-  verifiedBackwardNeighbors.SetRegion(this->NNField->GetLargestPossibleRegion());
-  verifiedBackwardNeighbors.AddNeighborTest(&verifiedNeighborTest);
-  verifiedBackwardNeighbors.AddNeighborTest(&validMaskNeighborTest);
-  NeighborTestBackward backwardNeighborTest;
-  verifiedBackwardNeighbors.AddNeighborTest(&backwardNeighborTest);
-  forcePropagator.SetBackwardNeighborFunctor(&verifiedBackwardNeighbors);
+    unsigned int numberOfPropagatedPixels = forcePropagator.Propagate();
+    numberOfRemainingPixels -= numberOfPropagatedPixels;
+
+    DebugSink::Instance().WriteNNField(DebugSink::ITERATIONS, this->NNField.GetPointer(),
+                                    Helpers::GetSequentialFileName("BDSRings_NNField_ForceProp",
+                                                                   iteration, "mha"));
 
-  auto testNoVerifiedMatch = [](const MatchSet& queryMatchSet)
+    iteration++;
+  }
+
+  if(numberOfRemainingPixels > 0 && forcePropagator.IsFrontierEmpty())
   {
-    return !queryMatchSet.HasVerifiedMatch();
-  };
+    std::cout << "Forced propagation cannot reach " << numberOfRemainingPixels
+              << " pixels, stopping." << std::endl;
+  }
 
-  unsigned int iteration = 0;
+  worklist->Update();
 
-  while(PatchMatchHelpers::CountTestedPixels(this->NNField.GetPointer(),
-          targetMask, testNoVerifiedMatch) > 0)
+  DebugSink::Instance().WriteNNField(DebugSink::ITERATIONS, this->NNField.GetPointer(),
+                                  "BDSInpaintingRings_BoundaryNNField.mha");
+}
+
+template <typename TImage>
+void BDSInpaintingRings<TImage>::InitializeRandomMatches(Worker* const worker,
+                                                         const UnverifiedPixelWorklist& worklist)
+{
+  BDS_TRACE_SCOPE("BDSInpaintingRings::InitializeRandomMatches");
+
+  if(this->SourcePatchCenters.empty())
   {
-    std::cout << "Phase 2: There are "
-              << PatchMatchHelpers::CountTestedPixels(this->NNField.GetPointer(),
-                                                      targetMask, testNoVerifiedMatch)
-              << " pixels without a verified match remaining." << std::endl;
+    return;
+  }
 
-    bool force = true;
-    unsigned int numberOfPropagatedPixels = forcePropagator.Propagate(this->NNField, force);
+  std::uniform_int_distribution<size_t> centerDistribution(0, this->SourcePatchCenters.size() - 1);
 
-    PatchMatchHelpers::WriteNNField(this->NNField.GetPointer(),
-                                    Helpers::GetSequentialFileName("BDSRings_NNField_ForceProp",
-                                                                   iteration, "mha"));
+  const std::vector<itk::Index<2> >& pixels = worklist.GetPixels();
+  for(size_t pixelId = 0; pixelId < pixels.size(); ++pixelId)
+  {
+    if(this->NNField->GetPixel(pixels[pixelId]).GetNumberOfMatches() > 0)
+    {
+      continue;
+    }
+
+    const itk::ImageRegion<2> queryRegion = ITKHelpers::GetRegionInRadiusAroundPixel(pixels[pixelId], this->PatchRadius);
+    const itk::ImageRegion<2> sourceRegion = ITKHelpers::GetRegionInRadiusAroundPixel(
+        this->SourcePatchCenters[centerDistribution(worker->RandomGenerator)], this->PatchRadius);
+
+    Match randomMatch;
+    randomMatch.SetRegion(sourceRegion);
+    randomMatch.SetScore(worker->PatchDistanceFunctor->Distance(sourceRegion, queryRegion));
+    randomMatch.SetVerified(false);
 
-    // Mark the pixels that were propagated to in the last iteration so that they can be used in the next iteration.
-    // Without this, we would only be able to forcefully propagate to 1 pixel away from verified pixels.
-    itk::ImageRegionIteratorWithIndex<PatchMatchHelpers::NNFieldType>
-       fieldIterator(this->NNField, this->NNField->GetLargestPossibleRegion());
+    MatchSet matchSet = this->NNField->GetPixel(pixels[pixelId]);
+    matchSet.Clear();
+    matchSet.AddMatch(randomMatch);
+    this->NNField->SetPixel(pixels[pixelId], matchSet);
+  }
+}
 
-    while(!fieldIterator.IsAtEnd())
+template <typename TImage>
+void BDSInpaintingRings<TImage>::RetestCandidates(Worker* const worker, const UnverifiedPixelWorklist& worklist)
+{
+  BDS_TRACE_SCOPE("BDSInpaintingRings::RetestCandidates");
+
+  InpaintingStatistics& statistics = this->Counters.Local();
+
+  const std::vector<itk::Index<2> >& pixels = worklist.GetPixels();
+  for(size_t pixelId = 0; pixelId < pixels.size(); ++pixelId)
+  {
+    const std::vector<Match>* cachedCandidates = worker->Candidates.GetCandidates(pixels[pixelId]);
+    if(!cachedCandidates)
     {
-      MatchSet matchSet = fieldIterator.Get();
-      if(matchSet.GetNumberOfMatches() > 0 && !matchSet.GetMatch(0).GetAllowPropagation())
-      {
-        matchSet.GetMatch(0).SetAllowPropagation(true);
-      }
-      ++fieldIterator;
+      continue;
     }
 
-    if(numberOfPropagatedPixels == 0)
+    // Copied, since a candidate that is rejected again is recorded again
+    const std::vector<Match> candidates = *cachedCandidates;
+
+    const itk::ImageRegion<2> queryRegion = ITKHelpers::GetRegionInRadiusAroundPixel(pixels[pixelId], this->PatchRadius);
+    MatchSet matchSet = this->NNField->GetPixel(pixels[pixelId]);
+    Match currentMatch;
+    if(matchSet.GetNumberOfMatches() > 0)
     {
-      //throw std::runtime_error("Forced propagated zero pixels!");
-      std::cout << "Forced propagated zero pixels, stopping." << std::endl;
-      break;
+      currentMatch = matchSet.GetMatch(0);
     }
 
-    iteration++;
+    // The current match may have improved since a candidate was recorded, so every candidate goes
+    // through the source region, SSD and neighbor histogram tests again. Its score is still its
+    // patch distance, which is what the SSD test compares.
+    for(size_t candidateId = 0; candidateId < candidates.size(); ++candidateId)
+    {
+      statistics.CachedCandidateRetests++;
+
+      float score = 0.0f;
+      if(worker->SourceRegionAcceptanceTest->IsBetterWithScore(queryRegion, currentMatch, candidates[candidateId], score) &&
+         worker->SSDAcceptanceTest->IsBetterWithScore(queryRegion, currentMatch, candidates[candidateId], score) &&
+         worker->NeighborHistogramRatioAcceptanceTest->IsBetterWithScore(queryRegion, currentMatch,
+                                                                         candidates[candidateId], score))
+      {
+        statistics.CachedCandidateAcceptances++;
+
+        Match acceptedMatch = candidates[candidateId];
+        acceptedMatch.SetVerified(true);
+        matchSet.Clear();
+        matchSet.AddMatch(acceptedMatch);
+        this->NNField->SetPixel(pixels[pixelId], matchSet);
+
+        worker->Candidates.RemoveCandidates(pixels[pixelId]);
+        break;
+      }
+    }
   }
-  PatchMatchHelpers::WriteNNField(this->NNField.GetPointer(),
-                                  "BDSInpaintingRings_BoundaryNNField.mha");
 }
 
 template <typename TImage>
 void BDSInpaintingRings<TImage>::ClearUnverifiedPixels()
 {
-
   // Clear all matches for patches that still do not have a good (verified) match
   // This means it remains from the random initialization.
-//    auto noVerifiedMatchFunctor = [NNField](const itk::Index<2>& index)
-//                                {
-//                                  // Don't process pixels that have a verified match
-//                                  if(NNField->GetPixel(index).HasVerifiedMatch())
-//                                  {
-//                                    return false;
-//                                  }
-//                                  return true;
-//                                };
-//    auto clearFunctor = [NNField](const itk::Index<2>& index)
-//                                {
-//                                  MatchSet matchSet = NNField->GetPixel(index);
-//                                  matchSet.Clear();
-//                                  NNField->SetPixel(index, matchSet);
-//                                };
+  const std::vector<itk::Index<2> >& holePixels = this->HoleLayers.GetPixels();
+  for(size_t pixelId = 0; pixelId < holePixels.size(); ++pixelId)
+  {
+    const MatchSet& matchSet = this->NNField->GetPixel(holePixels[pixelId]);
+    if(matchSet.GetNumberOfMatches() > 0 && !matchSet.HasVerifiedMatch())
+    {
+      MatchSet clearedMatchSet = matchSet;
+      clearedMatchSet.Clear();
+      this->NNField->SetPixel(holePixels[pixelId], clearedMatchSet);
+    }
+  }
+}
+
+template <typename TImage>
+bool BDSInpaintingRings<TImage>::IsKnown(const itk::Index<2>& pixel) const
+{
+  return this->HoleLayers.GetLayerOfPixel(pixel) < 0 || this->NNField->GetPixel(pixel).HasVerifiedMatch();
+}
+
+template <typename TImage>
+float BDSInpaintingRings<TImage>::ComputeFrontPriority(const itk::Index<2>& pixel) const
+{
+  if(this->FrontOrder == FRONT_DISTANCE)
+  {
+    // Outermost layer first
+    return -static_cast<float>(this->HoleLayers.GetLayerOfPixel(pixel));
+  }
 
-//   ITKHelpers::ApplyOperationToTestedPixels(nnField.GetPointer(),
-//                                            noVerifiedMatchFunctor, clearFunctor);
+  // The fraction of the patch that is known
+  itk::ImageRegion<2> patchRegion = ITKHelpers::GetRegionInRadiusAroundPixel(pixel, this->PatchRadius);
+  patchRegion.Crop(this->Image->GetLargestPossibleRegion());
 
-//   PatchMatchHelpers::WriteVerifiedPixels(nnField.GetPointer(), "VerifiedPixels.mha");
+  unsigned int numberOfKnownPixels = 0;
+  for(long y = patchRegion.GetIndex()[1]; y < patchRegion.GetIndex()[1] + static_cast<long>(patchRegion.GetSize()[1]); ++y)
+  {
+    for(long x = patchRegion.GetIndex()[0]; x < patchRegion.GetIndex()[0] + static_cast<long>(patchRegion.GetSize()[0]); ++x)
+    {
+      itk::Index<2> patchPixel = {{x, y}};
+      if(IsKnown(patchPixel))
+      {
+        numberOfKnownPixels++;
+      }
+    }
+  }
 
+  return static_cast<float>(numberOfKnownPixels) / static_cast<float>(patchRegion.GetNumberOfPixels());
 }
 
+template <typename TImage>
+bool BDSInpaintingRings<TImage>::FindSinglePixelMatch(const itk::Index<2>& queryPixel, Match& bestMatch)
+{
+  Worker* const worker = this->Workers[0].get();
+
+  const itk::ImageRegion<2> fullRegion = this->Image->GetLargestPossibleRegion();
+  const itk::ImageRegion<2> queryRegion = ITKHelpers::GetRegionInRadiusAroundPixel(queryPixel, this->PatchRadius);
+
+  // Hole pixels have no match yet, so the first candidate that passes the tests is better
+  Match acceptedMatch;
+  acceptedMatch.SetScore(std::numeric_limits<float>::max());
+  bool accepted = false;
+
+  // The best candidate in the source region, used if none passes the tests (as ForcePropagation()
+  // does for the thick rings)
+  Match forcedMatch;
+  forcedMatch.SetScore(std::numeric_limits<float>::max());
+  bool forced = false;
+
+  // Candidates go through the same tests (and counters) as those of propagation and random search
+  // in the thick rings. Returns false if the candidate is not in the source region.
+  auto testCandidate = [&](const itk::Index<2>& candidateCenter, PatchDistanceFunctorType* const patchDistanceFunctor,
+                           AcceptanceTestType* const acceptanceTest) -> bool
+  {
+    itk::ImageRegion<2> candidateRegion =
+        ITKHelpers::GetRegionInRadiusAroundPixel(candidateCenter, this->PatchRadius);
+    if(!fullRegion.IsInside(candidateRegion) || !this->SourceMask->IsValid(candidateRegion))
+    {
+      return false;
+    }
+
+    Match potentialMatch;
+    potentialMatch.SetRegion(candidateRegion);
+    potentialMatch.SetScore(patchDistanceFunctor->Distance(candidateRegion, queryRegion));
+
+    float score = 0.0f;
+    if(acceptanceTest->IsBetterWithScore(queryRegion, acceptedMatch, potentialMatch, score))
+    {
+      acceptedMatch = potentialMatch;
+      accepted = true;
+    }
+    else if(potentialMatch.GetScore() < forcedMatch.GetScore())
+    {
+      forcedMatch = potentialMatch;
+      forced = true;
+    }
+    return true;
+  };
+
+  // Propagation: the matches of the filled (or known) 8-neighbors, shifted by the offset to the neighbor
+  for(long offsetY = -1; offsetY <= 1; ++offsetY)
+  {
+    for(long offsetX = -1; offsetX <= 1; ++offsetX)
+    {
+      itk::Index<2> neighbor = {{queryPixel[0] + offsetX, queryPixel[1] + offsetY}};
+      if((offsetX == 0 && offsetY == 0) || !fullRegion.IsInside(neighbor))
+      {
+        continue;
+      }
+
+      const MatchSet& neighborMatchSet = this->NNField->GetPixel(neighbor);
+      if(neighborMatchSet.HasVerifiedMatch())
+      {
+        testCandidate(ITKHelpers::GetRegionCenter(neighborMatchSet.GetMatch(0).GetRegion()) + (queryPixel - neighbor),
+                      worker->PropagationPatchDistanceFunctor.get(), worker->PropagationAcceptanceTest.get());
+      }
+    }
+  }
+
+  // If no neighbor gave an acceptable patch, start the search from random source patches
+  if(!this->SourcePatchCenters.empty())
+  {
+    std::uniform_int_distribution<size_t> centerDistribution(0, this->SourcePatchCenters.size() - 1);
+    for(unsigned int sampleId = 0; sampleId < this->GlobalSearchSamples && !accepted; ++sampleId)
+    {
+      testCandidate(this->SourcePatchCenters[centerDistribution(this->RandomGenerator)],
+                    worker->RandomSearchPatchDistanceFunctor.get(), worker->RandomSearchAcceptanceTest.get());
+    }
+  }
+
+  if(!accepted && !forced)
+  {
+    return false;
+  }
+
+  // Random search in windows of halving size around the best match. Like the random search of the
+  // thick rings (which is given the SourceMask), every window gets a candidate in the source region:
+  // centers outside of it are redrawn, up to RandomSearchDrawsPerRadius times.
+  const long radius = static_cast<long>(this->PatchRadius);
+  const long minimumX = fullRegion.GetIndex()[0] + radius;
+  const long maximumX = fullRegion.GetIndex()[0] + static_cast<long>(fullRegion.GetSize()[0]) - 1 - radius;
+  const long minimumY = fullRegion.GetIndex()[1] + radius;
+  const long maximumY = fullRegion.GetIndex()[1] + static_cast<long>(fullRegion.GetSize()[1]) - 1 - radius;
+
+  long searchRadius = static_cast<long>(std::max(fullRegion.GetSize()[0], fullRegion.GetSize()[1]));
+  while(searchRadius >= 1 && minimumX <= maximumX && minimumY <= maximumY)
+  {
+    const itk::Index<2> bestCenter = ITKHelpers::GetRegionCenter((accepted ? acceptedMatch : forcedMatch).GetRegion());
+
+    // The window, clipped so that every patch in it is inside of the image
+    std::uniform_int_distribution<long> xDistribution(std::max(minimumX, bestCenter[0] - searchRadius),
+                                                      std::min(maximumX, bestCenter[0] + searchRadius));
+    std::uniform_int_distribution<long> yDistribution(std::max(minimumY, bestCenter[1] - searchRadius),
+                                                      std::min(maximumY, bestCenter[1] + searchRadius));
+
+    for(unsigned int drawId = 0; drawId < this->RandomSearchDrawsPerRadius; ++drawId)
+    {
+      itk::Index<2> candidateCenter = {{xDistribution(this->RandomGenerator), yDistribution(this->RandomGenerator)}};
+      if(testCandidate(candidateCenter, worker->RandomSearchPatchDistanceFunctor.get(),
+                       worker->RandomSearchAcceptanceTest.get()))
+      {
+        break;
+      }
+    }
+
+    searchRadius /= 2;
+  }
+
+  bestMatch = accepted ? acceptedMatch : forcedMatch;
+  bestMatch.SetVerified(true);
+  bestMatch.SetAllowPropagation(true);
+  return true;
+}
+
+template <typename TImage>
+void BDSInpaintingRings<TImage>::CompositeSinglePixel(const itk::Index<2>& pixel)
+{
+  const itk::ImageRegion<2> fullRegion = this->Image->GetLargestPossibleRegion();
+  itk::ImageRegion<2> patchRegion = ITKHelpers::GetRegionInRadiusAroundPixel(pixel, this->PatchRadius);
+  patchRegion.Crop(fullRegion);
+
+  std::vector<typename TImage::PixelType> contributingPixels;
+  std::vector<float> contributingScores;
+
+  // Every filled pixel q near 'pixel' maps 'pixel' to (match center of q) + (pixel - q)
+  for(long y = patchRegion.GetIndex()[1]; y < patchRegion.GetIndex()[1] + static_cast<long>(patchRegion.GetSize()[1]); ++y)
+  {
+    for(long x = patchRegion.GetIndex()[0]; x < patchRegion.GetIndex()[0] + static_cast<long>(patchRegion.GetSize()[0]); ++x)
+    {
+      itk::Index<2> contributor = {{x, y}};
+      const MatchSet& matchSet = this->NNField->GetPixel(contributor);
+      if(!matchSet.HasVerifiedMatch())
+      {
+        continue;
+      }
+
+      const Match& match = matchSet.GetMatch(0);
+      itk::Index<2> sourcePixel = ITKHelpers::GetRegionCenter(match.GetRegion()) + (pixel - contributor);
+      if(fullRegion.IsInside(sourcePixel))
+      {
+        contributingPixels.push_back(this->Image->GetPixel(sourcePixel));
+        contributingScores.push_back(match.GetScore());
+      }
+    }
+  }
+
+  if(!contributingPixels.empty())
+  {
+    this->Output->SetPixel(pixel, PixelCompositorAverage::Composite(contributingPixels, contributingScores));
+    this->Counters.Local().AddCompositedPixel(static_cast<unsigned int>(contributingPixels.size()));
+  }
+}
 
 template <typename TImage>
 void BDSInpaintingRings<TImage>::SinglePixelRings()
 {
-//  // Keep track of which ring we are on
-//  unsigned int ringCounter = 0;
+  BDS_TRACE_SCOPE("BDSInpaintingRings::SinglePixelRings");
+  BDS_PERF_SCOPE("BDSInpaintingRings::SinglePixelRings");
+
+  std::cout << "SinglePixelRings()" << std::endl;
 
-//  Mask::Pointer currentTargetMask = Mask::New();
-//  currentTargetMask->DeepCopyFrom(this->TargetMask);
+  // The neighbor histogram test uses the most relaxed ratio of the first ComputeNNField() iteration
+  // of the thick rings; candidates that fail it are only used if no candidate passes.
+  this->Workers[0]->NeighborHistogramRatioAcceptanceTest->SetMaxNeighborHistogramRatio(this->MaxHistogramRatio);
 
-//  // Perform ring-at-a-time inpainting
-//  while(currentTargetMask->HasValidPixels())
-//  {
-//    // Get the inside boundary of the target region
-//    Mask::BoundaryImageType::Pointer boundaryImage = Mask::BoundaryImageType::New();
-//    // In the resulting boundary image, the boundary will be 255.
-//    Mask::BoundaryImageType::PixelType boundaryValue = 255;
-//    currentTargetMask->FindBoundary(boundaryImage, Mask::VALID, boundaryValue);
+  // The ratio is never relaxed here, so the candidates it rejects would never be retested
+  this->Workers[0]->NeighborHistogramRatioAcceptanceTest->SetCandidateCache(nullptr);
 
-//    //ITKHelpers::WriteSequentialImage(boundaryImage.GetPointer(), "BDSRings_Boundary", ringCounter, 4, "png");
+  this->HoleLayers.Compute(this->TargetMask);
 
-//    // Create a mask of just the boundary
-//    Mask::Pointer boundaryMask = Mask::New();
-//    Mask::BoundaryImageType::PixelType holeValue = 0;
-//    Mask::BoundaryImageType::PixelType validValue = boundaryValue;
-//    boundaryMask->CreateFromImage(boundaryImage.GetPointer(), holeValue, validValue);
-//    //boundaryMask->Invert(); // Make the thin boundary the only valid pixels in the mask
+  const size_t numberOfHolePixels = this->HoleLayers.GetNumberOfPixels();
+  size_t numberOfFilledPixels = 0;
 
-//    //std::cout << "Boundary mask: " << std::endl; boundaryMask->OutputMembers(); // Debug only
-//    //ITKHelpers::WriteSequentialImage(boundaryMask.GetPointer(),
-//    //     "BDSRings_BoundaryMask", ringCounter, 4, "png");
+  // The front starts as the outermost layer of the hole. A pixel is added again each time one of
+  // its neighbors is filled (so that its confidence is current); stale entries are skipped.
+  std::priority_queue<FrontEntry> front;
+  uint64_t sequence = 0;
+
+  std::vector<itk::Index<2> > outerLayer = this->HoleLayers.GetLayer(0);
+  for(size_t pixelId = 0; pixelId < outerLayer.size(); ++pixelId)
+  {
+    FrontEntry entry = {ComputeFrontPriority(outerLayer[pixelId]), sequence++, outerLayer[pixelId]};
+    front.push(entry);
+  }
+
+  const unsigned int stopCheckInterval = 256;
+  unsigned int pixelsSinceStopCheck = 0;
+
+  while(!front.empty())
+  {
+    if(++pixelsSinceStopCheck == stopCheckInterval)
+    {
+      pixelsSinceStopCheck = 0;
+      this->FractionFilled = static_cast<float>(numberOfFilledPixels) / static_cast<float>(numberOfHolePixels);
+      if(this->ShouldStop("BDSInpaintingRings::SinglePixelRings", this->FractionFilled))
+      {
+        break;
+      }
+    }
 
-//    // Set the mask to use in the PatchMatch algorithm
-//    currentTargetMask->DeepCopyFrom(boundaryMask);
+    const itk::Index<2> pixel = front.top().Pixel;
+    front.pop();
 
-//    // We set these properties here, but this object is not used here but rather simply
-//    // passed along to the composition BDSInpainting object below
-//    BDSInpainting<TImage> internalBDSInpaintingFunctor;
-//    internalBDSInpaintingFunctor.SetImage(this->Image);
-//    internalBDSInpaintingFunctor.SetPatchRadius(this->PatchRadius);
-//    internalBDSInpaintingFunctor.SetTargetMask(boundaryMask);
-//    internalBDSInpaintingFunctor.SetSourceMask(this->SourceMask);
-//    Compositor<TImage, PixelCompositorAverage> compositor;
-//    internalBDSInpaintingFunctor.Inpaint(&patchMatchFunctor, &compositor);
+    if(IsKnown(pixel))
+    {
+      continue;
+    }
 
-//    ITKHelpers::WriteSequentialImage(internalBDSInpaintingFunctor.GetOutput(),
-//                                     "BDSRings_InpaintedRing", ringCounter, 4, "png");
+    Match match;
+    if(!FindSinglePixelMatch(pixel, match))
+    {
+      // Retried if another neighbor is filled
+      continue;
+    }
 
-//    // Copy the filled ring into the image for the next iteration
-//    ITKHelpers::DeepCopy(internalBDSInpaintingFunctor.GetOutput(), currentImage.GetPointer());
+    MatchSet matchSet = this->NNField->GetPixel(pixel);
+    matchSet.Clear();
+    matchSet.AddMatch(match);
+    this->NNField->SetPixel(pixel, matchSet);
 
-//    // Reduce the size of the target region (we "enlarge the hole", because
-//    // the "hole" is considered the valid part of the target mask)
-//    unsigned int kernelRadius = 1;
-//    currentTargetMask->ExpandHole(kernelRadius);
+    CompositeSinglePixel(pixel);
+    numberOfFilledPixels++;
 
-//    ringCounter++;
-//  }
+    for(long offsetY = -1; offsetY <= 1; ++offsetY)
+    {
+      for(long offsetX = -1; offsetX <= 1; ++offsetX)
+      {
+        itk::Index<2> neighbor = {{pixel[0] + offsetX, pixel[1] + offsetY}};
+        if(this->HoleLayers.GetLayerOfPixel(neighbor) >= 0 && !IsKnown(neighbor))
+        {
+          FrontEntry entry = {ComputeFrontPriority(neighbor), sequence++, neighbor};
+          front.push(entry);
+        }
+      }
+    }
+  }
 
-//  ITKHelpers::DeepCopy(currentImage.GetPointer(), this->Output.GetPointer());
+  this->FractionFilled = static_cast<float>(numberOfFilledPixels) / static_cast<float>(numberOfHolePixels);
+
+  this->Workers[0]->NeighborHistogramRatioAcceptanceTest->SetCandidateCache(&this->Workers[0]->Candidates);
+
+  ClearUnverifiedPixels();
+
+  DebugSink::Instance().WriteImage(DebugSink::SUMMARY, this->Output.GetPointer(), "BDS_SinglePixelRings.png");
+  DebugSink::Instance().WriteNNField(DebugSink::SUMMARY, this->NNField.GetPointer(), "BDS_SinglePixelRings.mha");
 }
 
 template <typename TImage>
-void BDSInpaintingRings<TImage>::FillHole(Mask* const targetMask)
+void BDSInpaintingRings<TImage>::FillHole(const std::vector<itk::Index<2> >& ringPixels)
 {
+  BDS_TRACE_SCOPE("BDSInpaintingRings::FillHole");
+
   Compositor<TImage, PixelCompositorAverage> compositor;
-  compositor.SetImage(this->Output); // We operate on the current intermediate image
   compositor.SetPatchRadius(this->PatchRadius);
-  compositor.SetTargetMask(targetMask);
   compositor.SetNearestNeighborField(this->NNField);
-  compositor.Composite();
-
-//  ITKHelpers::WriteSequentialImage(compositor.GetOutput(),
-//                                   "BDSRings_InpaintedRing", ringCounter, 4, "png");
-
-  // Copy the filled ring into the image for the next iteration
-  ITKHelpers::DeepCopy(compositor.GetOutput(), this->Output.GetPointer());
+  compositor.SetStatisticsCollector(&this->Counters);
 
+  // Every value of the ring is computed from the current intermediate image before any is written
+  compositor.CompositePixels(this->Output.GetPointer(), ringPixels, this->Output.GetPointer(), this->Pool.get());
 }
 
 template <typename TImage>
 void BDSInpaintingRings<TImage>::PatchRadiusThickRings()
 {
+  BDS_TRACE_SCOPE("BDSInpaintingRings::PatchRadiusThickRings");
+
   std::cout << "PatchRadiusThickRings()" << std::endl;
 
-  // Keep track of which ring we are on
-  unsigned int ringCounter = 0;
+  // Peel the hole once; each ring is then a list of pixels
+  this->HoleLayers.Compute(this->TargetMask);
 
-  Mask::Pointer remainingHoleMask = Mask::New();
-  remainingHoleMask->DeepCopyFrom(this->TargetMask);
+  const size_t numberOfHolePixels = this->HoleLayers.GetNumberOfPixels();
+  size_t numberOfFilledPixels = 0;
 
   // Perform patch-radius-thick-ring-at-a-time inpainting
-  while(remainingHoleMask->HasValidPixels())
+  const unsigned int numberOfRings = this->HoleLayers.GetNumberOfRings(this->PatchRadius);
+  for(unsigned int ringCounter = 0; ringCounter < numberOfRings; ++ringCounter)
   {
-    // Get the inside boundary of the target region
-    Mask::Pointer shrunkHole = Mask::New();
-    shrunkHole->DeepCopyFrom(remainingHoleMask);
-    shrunkHole->ExpandHole(this->PatchRadius);
+    BDS_TRACE_SCOPE_ITERATION("BDSInpaintingRings::Ring", ringCounter);
+    BDS_PERF_SCOPE_ITERATION("BDSInpaintingRings::Ring", ringCounter);
+    this->Counters.Increment(&InpaintingStatistics::Rings);
 
-    Mask::Pointer ringMask = Mask::New();
-    // Get the difference (XOR) between the original hole and the expanded hole
-    ITKHelpers::XORImages(remainingHoleMask.GetPointer(), shrunkHole.GetPointer(),
-                          ringMask.GetPointer(), this->TargetMask->GetValidValue());
-    ringMask->CopyInformationFrom(this->TargetMask);
+    std::vector<itk::Index<2> > ringPixels = this->HoleLayers.GetRing(ringCounter, this->PatchRadius);
 
-    ITKHelpers::WriteSequentialImage(ringMask.GetPointer(), "BDS_RingMask", ringCounter, 3, "png");
+    ComputeNNFieldInSegments(ringPixels);
 
-    ComputeNNField(ringMask);
+    if(DebugSink::Instance().IsEnabled(DebugSink::ITERATIONS))
+    {
+      ITKHelpers::SetPixels(this->WorkingTargetMask.GetPointer(), ringPixels, this->WorkingTargetMask->GetValidValue());
+      DebugSink::Instance().WriteSequentialImage(DebugSink::ITERATIONS, this->WorkingTargetMask.GetPointer(),
+                                                 "BDS_RingMask", ringCounter, 3, "png");
+      ITKHelpers::SetPixels(this->WorkingTargetMask.GetPointer(), ringPixels, this->WorkingTargetMask->GetHoleValue());
+    }
 
-    FillHole(ringMask);
+    FillHole(ringPixels);
 
-    remainingHoleMask->DeepCopyFrom(shrunkHole);
+    numberOfFilledPixels += ringPixels.size();
+    this->FractionFilled = static_cast<float>(numberOfFilledPixels) / static_cast<float>(numberOfHolePixels);
 
-    ITKHelpers::WriteSequentialImage(this->Output.GetPointer(), "BDS_PatchRadiusThickRings", ringCounter, 3, "png");
-    PatchMatchHelpers::WriteNNField(this->NNField.GetPointer(), Helpers::GetSequentialFileName("PatchRadiusThickRings", ringCounter, "mha, 3"));
-    //ITKHelpers::WriteImage(this->Output.GetPointer(), "BDS_PatchRadiusThickRings.png");
-    ringCounter++;
+    DebugSink::Instance().WriteSequentialImage(DebugSink::ITERATIONS, this->Output.GetPointer(),
+                                               "BDS_PatchRadiusThickRings", ringCounter, 3, "png");
+    DebugSink::Instance().WriteNNField(DebugSink::ITERATIONS, this->NNField.GetPointer(),
+                                       Helpers::GetSequentialFileName("PatchRadiusThickRings", ringCounter, "mha", 3));
   }
 }
 
 template <typename TImage>
-void BDSInpaintingRings<TImage>::ComputeNNField(Mask* const targetMaskInput)
+void BDSInpaintingRings<TImage>::ComputeNNField(Worker* const worker,
+                                                const std::vector<itk::Index<2> >& targetPixels,
+                                                const unsigned int seed)
 {
-  // Copy the mask, because we will potentially modify it in this function,
-  // but it needs to remain unchanged in the calling function
+  BDS_TRACE_SCOPE("BDSInpaintingRings::ComputeNNField");
 
-  Mask::Pointer targetMask = Mask::New();
-  targetMask->DeepCopyFrom(targetMaskInput);
+  // The target mask is the working mask with only the target pixels Valid. It is shrunk as
+  // pixels are verified, and the pixels that remain are set back to Hole at the end.
+  Mask* const targetMask = this->WorkingTargetMask.GetPointer();
+  ITKHelpers::SetPixels(targetMask, targetPixels, targetMask->GetValidValue());
 
-  unsigned int numberOfUnverifiedPixels =
-      PatchMatchHelpers::CountUnverifiedPixels(this->NNField.GetPointer(), targetMask.GetPointer());
+  UnverifiedPixelWorklist worklist;
+  worklist.Initialize(this->NNField.GetPointer(), targetPixels);
+
+  worker->RandomGenerator.seed(seed);
+  worker->Candidates.Clear();
 
-  assert(targetMask->CountValidPixels() == numberOfUnverifiedPixels);
+  assert(worklist.GetNumberOfPixels() == targetPixels.size());
+
+  size_t numberOfUnverifiedPixels = worklist.GetNumberOfPixels();
 
   float histogramRatioStart = 2.0f;
   float histogramRatioStep = 0.2f;
-  //float maxHistogramRatio = 5.0f;
-  float maxHistogramRatio = 3.2f;
+  float maxHistogramRatio = this->MaxHistogramRatio;
 
+  // If the run is stopped, the remaining pixels keep their current (unverified) matches and
+  // are composited from those.
   unsigned int iteration = 0;
   do
   {
-    ConstrainedPatchMatch(targetMask, histogramRatioStart, histogramRatioStep, maxHistogramRatio);
+    BDS_TRACE_SCOPE_ITERATION("BDSInpaintingRings::ComputeNNField::Iteration", iteration);
+    this->Counters.Increment(&InpaintingStatistics::ComputeNNFieldIterations);
+
+    ConstrainedPatchMatch(worker, targetMask, &worklist, histogramRatioStart, histogramRatioStep, maxHistogramRatio);
 
-    ForcePropagation(targetMask);
+    ForcePropagation(worker, targetMask, &worklist);
 
-    numberOfUnverifiedPixels =
-          PatchMatchHelpers::CountUnverifiedPixels(this->NNField.GetPointer(), targetMask.GetPointer());
+    numberOfUnverifiedPixels = worklist.Update();
     std::cout << "After iteration " << iteration << " of ComputeNNField(), there are "
               << numberOfUnverifiedPixels << " numberOfUnverifiedPixels." << std::endl;
     maxHistogramRatio += 1.0f;
     std::cout << "Increased maxHistogramRatio to " << maxHistogramRatio << std::endl;
 
-    // Create a targetMask of only the pixels which still remain to be propagated
-    std::vector<itk::Index<2> > remainingPixels = PatchMatchHelpers::GetUnverifiedPixels(this->NNField.GetPointer(), targetMask.GetPointer());
-    ITKHelpers::SetImageToConstant(targetMask.GetPointer(), targetMask->GetHoleValue());
-    ITKHelpers::SetPixels(targetMask.GetPointer(), remainingPixels, targetMask->GetValidValue());
+    // Reduce the targetMask to only the pixels which still remain to be propagated
+    worklist.RemoveVerifiedPixelsFromMask(targetMask);
 
-    PatchMatchHelpers::WriteNNField(this->NNField.GetPointer(), Helpers::GetSequentialFileName("BDS_ComputeNNField", iteration, "mha", 3));
+    DebugSink::Instance().WriteNNField(DebugSink::ITERATIONS, this->NNField.GetPointer(),
+                                       Helpers::GetSequentialFileName("BDS_ComputeNNField", iteration, "mha", 3));
 
     iteration++;
 
-  } while(numberOfUnverifiedPixels > 0);
+  } while(numberOfUnverifiedPixels > 0 &&
+          !this->ShouldStop("BDSInpaintingRings::ComputeNNField", this->FractionFilled));
+
+  worklist.RemoveVerifiedPixelsFromMask(targetMask);
+  ITKHelpers::SetPixels(targetMask, worklist.GetPixels(), targetMask->GetHoleValue());
+
+  worker->Candidates.Clear();
+}
+
+template <typename TImage>
+void BDSInpaintingRings<TImage>::ComputeNNFieldInSegments(const std::vector<itk::Index<2> >& targetPixels)
+{
+  BDS_TRACE_SCOPE("BDSInpaintingRings::ComputeNNFieldInSegments");
+
+  const unsigned int computation = this->NNFieldComputations++;
+
+  // Debug snapshots of the whole field would race with the segments being computed
+  if(this->Workers.size() == 1 || DebugSink::Instance().IsEnabled(DebugSink::ITERATIONS))
+  {
+    ComputeNNField(this->Workers[0].get(), targetPixels, computation);
+    return;
+  }
+
+  // Tiles much larger than a patch, so that few pixels are on the seams
+  const long tileSize = std::max(64L, 16L * static_cast<long>(this->PatchRadius));
+  const long margin = static_cast<long>(this->PatchRadius) + 1;
+  const itk::ImageRegion<2> fullRegion = this->NNField->GetLargestPossibleRegion();
+  const long tilesPerRow = (static_cast<long>(fullRegion.GetSize()[0]) + tileSize - 1) / tileSize;
+
+  std::map<long, std::vector<itk::Index<2> > > segments;
+  std::vector<itk::Index<2> > seamPixels;
+  for(size_t pixelId = 0; pixelId < targetPixels.size(); ++pixelId)
+  {
+    const long x = targetPixels[pixelId][0] - fullRegion.GetIndex()[0];
+    const long y = targetPixels[pixelId][1] - fullRegion.GetIndex()[1];
+    const long tileX = x % tileSize;
+    const long tileY = y % tileSize;
+    if(tileX >= margin && tileX < tileSize - margin && tileY >= margin && tileY < tileSize - margin)
+    {
+      segments[(y / tileSize) * tilesPerRow + (x / tileSize)].push_back(targetPixels[pixelId]);
+    }
+    else
+    {
+      seamPixels.push_back(targetPixels[pixelId]);
+    }
+  }
+
+  if(segments.size() <= 1)
+  {
+    ComputeNNField(this->Workers[0].get(), targetPixels, computation);
+    return;
+  }
+
+  std::vector<const std::vector<itk::Index<2> >*> segmentPixels;
+  std::vector<unsigned int> segmentSeeds;
+  for(typename std::map<long, std::vector<itk::Index<2> > >::const_iterator iterator = segments.begin();
+      iterator != segments.end(); ++iterator)
+  {
+    segmentPixels.push_back(&iterator->second);
+    std::seed_seq seedSequence = {computation, static_cast<unsigned int>(iterator->first)};
+    unsigned int seed = 0;
+    seedSequence.generate(&seed, &seed + 1);
+    segmentSeeds.push_back(seed);
+  }
 
+  // Largest segments first, so that a large one does not start last
+  std::vector<size_t> segmentOrder(segmentPixels.size());
+  for(size_t segmentId = 0; segmentId < segmentOrder.size(); ++segmentId)
+  {
+    segmentOrder[segmentId] = segmentId;
+  }
+  std::stable_sort(segmentOrder.begin(), segmentOrder.end(),
+                   [&segmentPixels](const size_t a, const size_t b)
+                   {return segmentPixels[a]->size() > segmentPixels[b]->size();});
+
+  // The counters are measured in each task, since they only count the thread that reads them
+  this->Pool->ParallelFor(segmentOrder.size(),
+    [this, &segmentOrder, &segmentPixels, &segmentSeeds](const size_t taskId, const unsigned int threadId)
+    {
+      BDS_PERF_SCOPE("BDSInpaintingRings::ComputeNNFieldInSegments::Segments");
+      const size_t segmentId = segmentOrder[taskId];
+      ComputeNNField(this->Workers[threadId].get(), *segmentPixels[segmentId], segmentSeeds[segmentId]);
+    });
+
+  // The seams propagate from the segments around them
+  if(!seamPixels.empty())
+  {
+    ComputeNNField(this->Workers[0].get(), seamPixels, computation);
+  }
 }
 
 #endif
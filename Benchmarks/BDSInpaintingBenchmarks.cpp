@@ -0,0 +1,531 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+// Benchmarks for the inpainting kernels. Most benchmarks sweep
+// (image side length, hole percentage, patch radius) so that regressions in
+// any of the three scaling dimensions show up. BM_ConvertRGBToHSV only sweeps
+// the side length and BM_NeighborHistogramRatioTest sweeps (side length,
+// patch radius, integral histograms). The BDSInpaintingRings modes are compared
+// on a smaller sweep if BDSInpainting_BuildRings is on, and a workload named by
+// BDSINPAINTING_WORKLOAD (see main()) is inpainted at two patch radii.
+// Run with e.g. --benchmark_filter=Composite to select a subset.
+
+// STL
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+// Google Benchmark
+#include <benchmark/benchmark.h>
+
+// ITK
+#include "itkImage.h"
+#include "itkCovariantVector.h"
+#include "itkImageFileReader.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+
+// Submodules
+#include <Mask/Mask.h>
+
+#include <ITKHelpers/ITKHelpers.h>
+
+#include <PatchComparison/SSD.h>
+
+#include <PatchMatch/PatchMatch.h>
+#include <PatchMatch/Propagator.h>
+#include <PatchMatch/RandomSearch.h>
+
+// Custom
+#include "AcceptanceTestIntegralHistogramRatio.h"
+#include "BDSInpainting.h"
+#include "Compositor.h"
+#include "HSVConversion.h"
+#include "PixelCompositors.h"
+#include "SyntheticWorkload.h"
+
+#ifdef BDSInpainting_BuildRings
+#include "BDSInpaintingRings.h"
+#endif
+
+typedef itk::Image<itk::CovariantVector<unsigned char, 3>, 2> ImageType;
+
+namespace
+{
+
+/** Expose the protected members of BDSInpainting that we want to time in isolation. */
+template <typename TImage>
+struct BDSInpaintingBenchmarkAccess : public BDSInpainting<TImage>
+{
+  using BDSInpainting<TImage>::ConstructValidPatchCentersImage;
+};
+
+/** Create a square fractal-textured image. */
+ImageType::Pointer CreateImage(const unsigned int sideLength)
+{
+  ImageType::Pointer image = ImageType::New();
+  itk::Size<2> size = {{sideLength, sideLength}};
+  SyntheticWorkload::CreateTexture(image.GetPointer(), size, SyntheticWorkload::FRACTAL, 0);
+  return image;
+}
+
+/** Create a mask with a single square hole covering 'holePercent' percent of the image. */
+Mask::Pointer CreateMask(const unsigned int sideLength, const unsigned int holePercent)
+{
+  itk::Size<2> size = {{sideLength, sideLength}};
+
+  SyntheticWorkload::MaskParameters maskParameters;
+  maskParameters.HoleCount = 1;
+  maskParameters.HoleShape = SyntheticWorkload::SQUARE;
+  maskParameters.HoleRadius = SyntheticWorkload::HoleRadiusForFraction(
+        size, static_cast<float>(holePercent) / 100.0f, maskParameters.HoleCount, maskParameters.HoleShape);
+
+  Mask::Pointer mask = Mask::New();
+  SyntheticWorkload::CreateMask(mask, size, maskParameters);
+  return mask;
+}
+
+/** Create an NNField in which every pixel whose patch touches the hole is matched to a
+  * patch that is entirely in the valid region. */
+NNFieldType::Pointer CreateNNField(Mask* const mask, const unsigned int patchRadius)
+{
+  NNFieldType::Pointer nnField = NNFieldType::New();
+  nnField->SetRegions(mask->GetLargestPossibleRegion());
+  nnField->Allocate();
+
+  // The top left patch is always valid because holes are kept away from the image boundary.
+  itk::Index<2> sourceCenter = {{static_cast<itk::Index<2>::IndexValueType>(patchRadius),
+                                 static_cast<itk::Index<2>::IndexValueType>(patchRadius)}};
+  Match match;
+  match.SetRegion(ITKHelpers::GetRegionInRadiusAroundPixel(sourceCenter, patchRadius));
+  match.SetScore(0.0f);
+  match.SetVerified(true);
+
+  MatchSet matchSet;
+  matchSet.SetMaximumMatches(1);
+  matchSet.AddMatch(match);
+
+  ITKHelpers::SetImageToConstant(nnField.GetPointer(), matchSet);
+
+  return nnField;
+}
+
+/** Apply the standard argument sweep: side length, hole percent, patch radius. */
+void InpaintingArguments(benchmark::internal::Benchmark* b)
+{
+  b->ArgNames({"side", "hole%", "radius"});
+  b->ArgsProduct({{128, 256, 512}, {5, 20}, {3, 7}});
+  b->Unit(benchmark::kMillisecond);
+}
+
+template <typename TPixelCompositor>
+void BM_Composite(benchmark::State& state)
+{
+  const unsigned int sideLength = state.range(0);
+  const unsigned int holePercent = state.range(1);
+  const unsigned int patchRadius = state.range(2);
+
+  ImageType::Pointer image = CreateImage(sideLength);
+  Mask::Pointer mask = CreateMask(sideLength, holePercent);
+  NNFieldType::Pointer nnField = CreateNNField(mask, patchRadius);
+
+  // The compositor fills the Valid pixels of its target mask.
+  Mask::Pointer targetMask = Mask::New();
+  targetMask->DeepCopyFrom(mask);
+  targetMask->InvertData();
+
+  Compositor<ImageType, TPixelCompositor> compositor;
+  compositor.SetPatchRadius(patchRadius);
+  compositor.SetImage(image);
+  compositor.SetTargetMask(targetMask);
+  compositor.SetNearestNeighborField(nnField);
+
+  for(auto _ : state)
+  {
+    compositor.Composite();
+    benchmark::DoNotOptimize(compositor.GetOutput());
+  }
+
+  state.SetItemsProcessed(state.iterations() * targetMask->CountValidPixels());
+}
+
+void BM_SSD(benchmark::State& state)
+{
+  const unsigned int sideLength = state.range(0);
+  const unsigned int holePercent = state.range(1);
+  const unsigned int patchRadius = state.range(2);
+
+  ImageType::Pointer image = CreateImage(sideLength);
+  Mask::Pointer mask = CreateMask(sideLength, holePercent);
+
+  SSD<ImageType> patchDistanceFunctor;
+  patchDistanceFunctor.SetImage(image);
+
+  // Compare every hole patch against a fixed source patch, which is the access
+  // pattern of the propagation step.
+  std::vector<itk::Index<2> > holePixels = mask->GetHolePixels();
+  itk::Index<2> sourceCenter = {{static_cast<itk::Index<2>::IndexValueType>(patchRadius),
+                                 static_cast<itk::Index<2>::IndexValueType>(patchRadius)}};
+  itk::ImageRegion<2> sourceRegion = ITKHelpers::GetRegionInRadiusAroundPixel(sourceCenter, patchRadius);
+
+  for(auto _ : state)
+  {
+    float total = 0.0f;
+    for(size_t pixelId = 0; pixelId < holePixels.size(); ++pixelId)
+    {
+      itk::ImageRegion<2> targetRegion =
+        ITKHelpers::GetRegionInRadiusAroundPixel(holePixels[pixelId], patchRadius);
+      total += patchDistanceFunctor.Distance(sourceRegion, targetRegion);
+    }
+    benchmark::DoNotOptimize(total);
+  }
+
+  state.SetItemsProcessed(state.iterations() * holePixels.size());
+}
+
+void BM_ConstructValidPatchCentersImage(benchmark::State& state)
+{
+  const unsigned int sideLength = state.range(0);
+  const unsigned int holePercent = state.range(1);
+  const unsigned int patchRadius = state.range(2);
+
+  ImageType::Pointer image = CreateImage(sideLength);
+  Mask::Pointer mask = CreateMask(sideLength, holePercent);
+
+  BDSInpaintingBenchmarkAccess<ImageType> bdsInpainting;
+  bdsInpainting.SetPatchRadius(patchRadius);
+  bdsInpainting.SetImage(image);
+  bdsInpainting.SetInpaintingMask(mask);
+
+  for(auto _ : state)
+  {
+    bdsInpainting.ConstructValidPatchCentersImage();
+  }
+
+  state.SetItemsProcessed(state.iterations() * sideLength * sideLength);
+}
+
+void BM_ConvertRGBToHSV(benchmark::State& state)
+{
+  const unsigned int sideLength = state.range(0);
+
+  ImageType::Pointer image = CreateImage(sideLength);
+  HSVConversion::HSVImageType::Pointer hsvImage = HSVConversion::HSVImageType::New();
+
+  for(auto _ : state)
+  {
+    HSVConversion::ConvertRGBToHSV(image.GetPointer(), hsvImage.GetPointer());
+    benchmark::DoNotOptimize(hsvImage->GetBufferPointer());
+  }
+
+  state.SetItemsProcessed(state.iterations() * sideLength * sideLength);
+}
+
+/** Test random (query, candidate) pairs, as propagation and random search do. Arguments are
+  * the side length, the patch radius and whether the integral histogram is used. */
+void BM_NeighborHistogramRatioTest(benchmark::State& state)
+{
+  const unsigned int sideLength = state.range(0);
+  const unsigned int patchRadius = state.range(1);
+  const bool useIntegralHistogram = state.range(2) != 0;
+
+  ImageType::Pointer image = CreateImage(sideLength);
+  HSVConversion::HSVImageType::Pointer hsvImage = HSVConversion::HSVImageType::New();
+  HSVConversion::ConvertRGBToHSV(image.GetPointer(), hsvImage.GetPointer());
+
+  AcceptanceTestIntegralHistogramRatio<HSVConversion::HSVImageType> acceptanceTest;
+  acceptanceTest.SetImage(hsvImage);
+  acceptanceTest.SetPatchRadius(patchRadius);
+  acceptanceTest.SetNumberOfBinsPerDimension(30);
+  acceptanceTest.SetMaxNeighborHistogramRatio(2.0f);
+  if(!useIntegralHistogram)
+  {
+    acceptanceTest.SetMemoryBudget(0);
+  }
+  acceptanceTest.Initialize();
+
+  SyntheticWorkload::Random random(0);
+  const int minimumCenter = patchRadius;
+  const int maximumCenter = sideLength - patchRadius - 1;
+
+  Match currentMatch;
+  Match potentialBetterMatch;
+  for(auto _ : state)
+  {
+    itk::Index<2> queryCenter = {{random.NextInteger(minimumCenter, maximumCenter),
+                                  random.NextInteger(minimumCenter, maximumCenter)}};
+    itk::Index<2> matchCenter = {{random.NextInteger(minimumCenter, maximumCenter),
+                                  random.NextInteger(minimumCenter, maximumCenter)}};
+    potentialBetterMatch.SetRegion(ITKHelpers::GetRegionInRadiusAroundPixel(matchCenter, patchRadius));
+
+    float score = 0.0f;
+    benchmark::DoNotOptimize(acceptanceTest.IsBetterWithScore(
+      ITKHelpers::GetRegionInRadiusAroundPixel(queryCenter, patchRadius), currentMatch, potentialBetterMatch, score));
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BM_ExpandHole(benchmark::State& state)
+{
+  const unsigned int sideLength = state.range(0);
+  const unsigned int holePercent = state.range(1);
+  const unsigned int patchRadius = state.range(2);
+
+  Mask::Pointer mask = CreateMask(sideLength, holePercent);
+  Mask::Pointer workingMask = Mask::New();
+
+  for(auto _ : state)
+  {
+    state.PauseTiming();
+    workingMask->DeepCopyFrom(mask);
+    state.ResumeTiming();
+
+    workingMask->ExpandHole(patchRadius);
+  }
+
+  state.SetItemsProcessed(state.iterations() * sideLength * sideLength);
+}
+
+void BM_ShrinkHole(benchmark::State& state)
+{
+  const unsigned int sideLength = state.range(0);
+  const unsigned int holePercent = state.range(1);
+  const unsigned int patchRadius = state.range(2);
+
+  Mask::Pointer mask = CreateMask(sideLength, holePercent);
+  Mask::Pointer workingMask = Mask::New();
+
+  for(auto _ : state)
+  {
+    state.PauseTiming();
+    workingMask->DeepCopyFrom(mask);
+    state.ResumeTiming();
+
+    workingMask->ShrinkHole(patchRadius);
+  }
+
+  state.SetItemsProcessed(state.iterations() * sideLength * sideLength);
+}
+
+/** Run BDSInpainting::Inpaint on 'image' and 'mask', configured as the BDSInpaintingDemo driver does. */
+void RunInpaint(benchmark::State& state, ImageType* const image, Mask* const mask,
+                const unsigned int patchRadius)
+{
+  typedef BDSInpainting<ImageType>::PatchDistanceFunctorType PatchDistanceFunctorType;
+
+  typedef Propagator<PatchDistanceFunctorType> PropagatorType;
+  PropagatorType propagator;
+
+  typedef RandomSearch<ImageType, PatchDistanceFunctorType> RandomSearchType;
+  RandomSearchType randomSearchFunctor;
+
+  PatchMatch<ImageType, PropagatorType, RandomSearchType> patchMatchFunctor;
+  patchMatchFunctor.SetPatchRadius(patchRadius);
+  patchMatchFunctor.SetIterations(5);
+  patchMatchFunctor.SetPropagationFunctor(&propagator);
+  patchMatchFunctor.SetRandomSearchFunctor(&randomSearchFunctor);
+  patchMatchFunctor.SetImage(image);
+
+  Compositor<ImageType, PixelCompositorAverage> compositor;
+
+  for(auto _ : state)
+  {
+    BDSInpainting<ImageType> bdsInpainting;
+    bdsInpainting.SetPatchRadius(patchRadius);
+    bdsInpainting.SetImage(image);
+    bdsInpainting.SetInpaintingMask(mask);
+    bdsInpainting.SetIterations(1);
+    bdsInpainting.Inpaint(&patchMatchFunctor, &compositor);
+    benchmark::DoNotOptimize(bdsInpainting.GetOutput());
+  }
+
+  state.SetItemsProcessed(state.iterations() * mask->CountHolePixels());
+}
+
+void BM_BDSInpaintingInpaint(benchmark::State& state)
+{
+  const unsigned int sideLength = state.range(0);
+  const unsigned int holePercent = state.range(1);
+  const unsigned int patchRadius = state.range(2);
+
+  ImageType::Pointer image = CreateImage(sideLength);
+  Mask::Pointer mask = CreateMask(sideLength, holePercent);
+
+  RunInpaint(state, image, mask, patchRadius);
+}
+
+#ifdef BDSInpainting_BuildRings
+typedef BDSInpaintingRings<ImageType> RingsType;
+
+/** The root mean squared error of 'output' against 'groundTruth' over the Valid pixels of 'targetMask'. */
+double ComputeHoleRMSE(const ImageType* const output, const ImageType* const groundTruth,
+                       const Mask* const targetMask)
+{
+  double sumOfSquaredErrors = 0.0;
+  unsigned int numberOfValues = 0;
+
+  itk::ImageRegionConstIteratorWithIndex<Mask> maskIterator(targetMask, targetMask->GetLargestPossibleRegion());
+  while(!maskIterator.IsAtEnd())
+  {
+    if(targetMask->IsValid(maskIterator.GetIndex()))
+    {
+      const ImageType::PixelType& outputPixel = output->GetPixel(maskIterator.GetIndex());
+      const ImageType::PixelType& truePixel = groundTruth->GetPixel(maskIterator.GetIndex());
+      for(unsigned int component = 0; component < 3; ++component)
+      {
+        double difference = static_cast<double>(outputPixel[component]) - static_cast<double>(truePixel[component]);
+        sumOfSquaredErrors += difference * difference;
+        numberOfValues++;
+      }
+    }
+    ++maskIterator;
+  }
+
+  return numberOfValues > 0 ? std::sqrt(sumOfSquaredErrors / numberOfValues) : 0.0;
+}
+
+/** Remove the texture from a square hole of 'hole%' percent and fill it with BDSInpaintingRings in
+  * 'ringMode' (and 'frontOrder' for SINGLE_PIXEL_RINGS). Besides the time, the "HoleRMSE" counter
+  * reports the error of the filled hole against the texture that was removed (lower is better). */
+void RunRings(benchmark::State& state, const RingsType::RingModeEnum ringMode,
+              const RingsType::FrontOrderEnum frontOrder)
+{
+  const unsigned int sideLength = state.range(0);
+  const unsigned int holePercent = state.range(1);
+  const unsigned int patchRadius = state.range(2);
+
+  ImageType::Pointer groundTruth = CreateImage(sideLength);
+
+  // The source is everything outside of the hole
+  Mask::Pointer sourceMask = CreateMask(sideLength, holePercent);
+
+  // The target is the hole, marked with Valid pixels
+  Mask::Pointer targetMask = Mask::New();
+  targetMask->DeepCopyFrom(sourceMask);
+  targetMask->InvertData();
+
+  // Remove the texture from the hole so that it cannot guide the matching
+  ImageType::Pointer image = ImageType::New();
+  ITKHelpers::DeepCopy(groundTruth.GetPointer(), image.GetPointer());
+  ImageType::PixelType zeroPixel;
+  zeroPixel.Fill(0);
+  ITKHelpers::SetPixels(image.GetPointer(), targetMask->GetValidPixels(), zeroPixel);
+
+  double holeRMSE = 0.0;
+  for(auto _ : state)
+  {
+    RingsType rings;
+    rings.SetPatchRadius(patchRadius);
+    rings.SetImage(image);
+    rings.SetSourceMask(sourceMask);
+    rings.SetTargetMask(targetMask);
+    rings.SetRingMode(ringMode);
+    rings.SetFrontOrder(frontOrder);
+    rings.Inpaint();
+
+    state.PauseTiming();
+    holeRMSE = ComputeHoleRMSE(rings.GetOutput(), groundTruth, targetMask);
+    state.ResumeTiming();
+  }
+
+  state.counters["HoleRMSE"] = holeRMSE;
+  state.SetItemsProcessed(state.iterations() * targetMask->CountValidPixels());
+}
+
+void BM_PatchRadiusThickRings(benchmark::State& state)
+{
+  RunRings(state, RingsType::PATCH_RADIUS_THICK_RINGS, RingsType::FRONT_DISTANCE);
+}
+
+void BM_SinglePixelRingsDistance(benchmark::State& state)
+{
+  RunRings(state, RingsType::SINGLE_PIXEL_RINGS, RingsType::FRONT_DISTANCE);
+}
+
+void BM_SinglePixelRingsConfidence(benchmark::State& state)
+{
+  RunRings(state, RingsType::SINGLE_PIXEL_RINGS, RingsType::FRONT_CONFIDENCE);
+}
+
+/** The sweep of the ring modes, smaller than InpaintingArguments since every run fills the whole hole. */
+void RingsArguments(benchmark::internal::Benchmark* b)
+{
+  b->ArgNames({"side", "hole%", "radius"});
+  b->ArgsProduct({{128, 256}, {5, 20}, {3, 7}});
+  b->Unit(benchmark::kMillisecond);
+}
+#endif
+
+/** Register a full inpainting benchmark on a workload written by GenerateSyntheticWorkload
+  * (<prefix>.png and <prefix>.mask). */
+void RegisterWorkloadBenchmark(const std::string& workloadPrefix)
+{
+  auto runWorkload = [workloadPrefix](benchmark::State& state)
+  {
+    typedef itk::ImageFileReader<ImageType> ImageReaderType;
+    ImageReaderType::Pointer imageReader = ImageReaderType::New();
+    imageReader->SetFileName(workloadPrefix + ".png");
+    imageReader->Update();
+
+    Mask::Pointer mask = Mask::New();
+    mask->Read(workloadPrefix + ".mask");
+
+    RunInpaint(state, imageReader->GetOutput(), mask, state.range(0));
+  };
+
+  benchmark::RegisterBenchmark(("BM_BDSInpaintingInpaint/" + workloadPrefix).c_str(), runWorkload)
+    ->ArgName("radius")->Arg(3)->Arg(7)->Unit(benchmark::kMillisecond);
+}
+
+} // end anonymous namespace
+
+BENCHMARK_TEMPLATE(BM_Composite, PixelCompositorAverage)->Apply(InpaintingArguments);
+BENCHMARK_TEMPLATE(BM_Composite, PixelCompositorWeightedAverage)->Apply(InpaintingArguments);
+BENCHMARK_TEMPLATE(BM_Composite, PixelCompositorClosestToAverage)->Apply(InpaintingArguments);
+BENCHMARK_TEMPLATE(BM_Composite, PixelCompositorBestPatch)->Apply(InpaintingArguments);
+BENCHMARK(BM_SSD)->Apply(InpaintingArguments);
+BENCHMARK(BM_ConstructValidPatchCentersImage)->Apply(InpaintingArguments);
+BENCHMARK(BM_ConvertRGBToHSV)->ArgName("side")->Arg(128)->Arg(256)->Arg(512)->Arg(2048)
+  ->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_NeighborHistogramRatioTest)->ArgNames({"side", "radius", "integral"})
+  ->ArgsProduct({{256, 512}, {3, 7}, {0, 1}});
+BENCHMARK(BM_ExpandHole)->Apply(InpaintingArguments);
+BENCHMARK(BM_ShrinkHole)->Apply(InpaintingArguments);
+BENCHMARK(BM_BDSInpaintingInpaint)->Apply(InpaintingArguments);
+#ifdef BDSInpainting_BuildRings
+BENCHMARK(BM_PatchRadiusThickRings)->Apply(RingsArguments);
+BENCHMARK(BM_SinglePixelRingsDistance)->Apply(RingsArguments);
+BENCHMARK(BM_SinglePixelRingsConfidence)->Apply(RingsArguments);
+#endif
+
+// Set BDSINPAINTING_WORKLOAD=<prefix> to additionally benchmark a workload produced by
+// the GenerateSyntheticWorkload driver, e.g. at 16 or 100 megapixels.
+int main(int argc, char** argv)
+{
+  benchmark::Initialize(&argc, argv);
+
+  const char* workloadPrefix = getenv("BDSINPAINTING_WORKLOAD");
+  if(workloadPrefix)
+  {
+    RegisterWorkloadBenchmark(workloadPrefix);
+  }
+
+  benchmark::RunSpecifiedBenchmarks();
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,109 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+
+#ifndef CandidateCache_H
+#define CandidateCache_H
+
+// ITK
+#include "itkImageRegion.h"
+#include "itkIndex.h"
+
+// Submodules
+#include <ITKHelpers/ITKHelpers.h>
+
+#include <PatchMatch/Match.h>
+
+// STL
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/** Keeps, for each query pixel, the MaximumCandidates lowest-distance candidate patches that were
+  * rejected by an acceptance test. When the test is relaxed (e.g. a larger neighbor histogram
+  * ratio) these can be tested again before searching from scratch. */
+class CandidateCache
+{
+public:
+
+  /** Set the number of candidates to keep per query pixel. */
+  void SetMaximumCandidates(const unsigned int maximumCandidates);
+
+  /** Forget every candidate. */
+  void Clear();
+
+  /** Record 'candidate', whose score must be its patch distance, for 'queryCenter'. It is kept if
+    * it is among the best MaximumCandidates; a candidate with the same region is kept only once. */
+  void AddCandidate(const itk::Index<2>& queryCenter, const Match& candidate);
+
+  /** The candidates of 'queryCenter', lowest score first, or null if there are none. */
+  const std::vector<Match>* GetCandidates(const itk::Index<2>& queryCenter) const;
+
+  /** Forget the candidates of 'queryCenter', e.g. once it has a verified match. */
+  void RemoveCandidates(const itk::Index<2>& queryCenter);
+
+  /** The number of query pixels with at least one candidate. */
+  size_t GetNumberOfQueries() const;
+
+private:
+
+  static uint64_t GetKey(const itk::Index<2>& queryCenter);
+
+  unsigned int MaximumCandidates = 4;
+
+  std::unordered_map<uint64_t, std::vector<Match> > Candidates;
+};
+
+/** An acceptance test that records every candidate it rejects in a CandidateCache. It can be used
+  * anywhere TAcceptanceTest can. */
+template <typename TAcceptanceTest>
+class AcceptanceTestRecordingCandidates : public TAcceptanceTest
+{
+public:
+
+  /** Forward all constructor arguments to the wrapped acceptance test. */
+  template <typename... TArguments>
+  AcceptanceTestRecordingCandidates(TArguments&&... arguments) :
+    TAcceptanceTest(std::forward<TArguments>(arguments)...) {}
+
+  /** Record the rejected candidates in 'cache' (null to not record them). */
+  void SetCandidateCache(CandidateCache* const cache)
+  {
+    this->Cache = cache;
+  }
+
+  bool IsBetterWithScore(const itk::ImageRegion<2>& queryRegion, const Match& currentMatch,
+                         const Match& potentialBetterMatch, float& score)
+  {
+    bool better = TAcceptanceTest::IsBetterWithScore(queryRegion, currentMatch,
+                                                     potentialBetterMatch, score);
+    if(!better && this->Cache)
+    {
+      this->Cache->AddCandidate(ITKHelpers::GetRegionCenter(queryRegion), potentialBetterMatch);
+    }
+    return better;
+  }
+
+private:
+  CandidateCache* Cache = nullptr;
+};
+
+#include "CandidateCache.hpp"
+
+#endif
@@ -0,0 +1,98 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+
+#ifndef CandidateCache_HPP
+#define CandidateCache_HPP
+
+#include "CandidateCache.h"
+
+// STL
+#include <algorithm>
+
+inline void CandidateCache::SetMaximumCandidates(const unsigned int maximumCandidates)
+{
+  this->MaximumCandidates = maximumCandidates;
+}
+
+inline void CandidateCache::Clear()
+{
+  this->Candidates.clear();
+}
+
+inline uint64_t CandidateCache::GetKey(const itk::Index<2>& queryCenter)
+{
+  return (static_cast<uint64_t>(static_cast<uint32_t>(queryCenter[1])) << 32) |
+         static_cast<uint32_t>(queryCenter[0]);
+}
+
+inline void CandidateCache::AddCandidate(const itk::Index<2>& queryCenter, const Match& candidate)
+{
+  if(this->MaximumCandidates == 0)
+  {
+    return;
+  }
+
+  std::vector<Match>& candidates = this->Candidates[GetKey(queryCenter)];
+
+  for(size_t candidateId = 0; candidateId < candidates.size(); ++candidateId)
+  {
+    if(candidates[candidateId].GetRegion() == candidate.GetRegion())
+    {
+      return;
+    }
+  }
+
+  if(candidates.size() == this->MaximumCandidates)
+  {
+    if(candidate.GetScore() >= candidates.back().GetScore())
+    {
+      return;
+    }
+    candidates.pop_back();
+  }
+
+  // Keep the candidates sorted by score
+  std::vector<Match>::iterator position =
+      std::upper_bound(candidates.begin(), candidates.end(), candidate,
+                       [](const Match& a, const Match& b) {return a.GetScore() < b.GetScore();});
+  candidates.insert(position, candidate);
+}
+
+inline const std::vector<Match>* CandidateCache::GetCandidates(const itk::Index<2>& queryCenter) const
+{
+  std::unordered_map<uint64_t, std::vector<Match> >::const_iterator iterator =
+      this->Candidates.find(GetKey(queryCenter));
+  if(iterator == this->Candidates.end())
+  {
+    return nullptr;
+  }
+  return &iterator->second;
+}
+
+inline void CandidateCache::RemoveCandidates(const itk::Index<2>& queryCenter)
+{
+  this->Candidates.erase(GetKey(queryCenter));
+}
+
+inline size_t CandidateCache::GetNumberOfQueries() const
+{
+  return this->Candidates.size();
+}
+
+#endif
@@ -31,6 +31,13 @@
 #include <PatchMatch/PatchMatchHelpers.h>
 #include <PatchMatch/NNField.h>
 
+// Custom
+#include "InpaintingStatistics.h"
+#include "ThreadPool.h"
+
+// STL
+#include <vector>
+
 class CompositorParent
 {
   virtual void Composite() = 0;
@@ -64,8 +71,30 @@ public:
   /** Perform the compositing where the TargetMask is valid.*/
   void Composite();
 
+  /** Composite the pixels [begin, end) of 'pixels' from 'image' into 'values' (one per pixel,
+    * indexed like 'pixels'), without writing to any image. This does not use the Image,
+    * TargetMask or Output, so nothing is copied, and it may be called concurrently for
+    * disjoint ranges. */
+  void ComputePixels(const TImage* const image, const std::vector<itk::Index<2> >& pixels,
+                     const size_t begin, const size_t end,
+                     std::vector<typename TImage::PixelType>* const values) const;
+
+  /** Composite 'pixels' from 'image' and write them straight into 'output', which may be
+    * 'image' itself. All of the values are computed before any is written, so only the
+    * listed pixels are staged rather than the whole image. If 'pool' is given, the values
+    * are computed on its threads. */
+  void CompositePixels(const TImage* const image, const std::vector<itk::Index<2> >& pixels,
+                       TImage* const output, ThreadPool* const pool = nullptr) const;
+
+  /** Count the composited pixels and their number of contributors in 'collector' (optional). */
+  void SetStatisticsCollector(StatisticsCollector* const collector);
+
 protected:
 
+  /** The composited value of 'pixel' from the patches of 'image' that the NN field maps onto it. */
+  typename TImage::PixelType ComputePixel(const TImage* const image, const itk::Index<2>& pixel,
+                                          InpaintingStatistics* const statistics) const;
+
   /** The radius of the patches to use for inpainting. */
   unsigned int PatchRadius = 0;
 
@@ -80,6 +109,9 @@ protected:
 
   /** The nearest neighbor field to use. */
   NNFieldType* NearestNeighborField = nullptr;
+
+  /** Where to count the composited pixels, or null to not count them. */
+  StatisticsCollector* Counters = nullptr;
 };
 
 #include "Compositor.hpp"
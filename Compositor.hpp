@@ -21,6 +21,10 @@
 
 #include "Compositor.h"
 
+// Custom
+#include "PerformanceCounters.h"
+#include "Trace.h"
+
 // Submodules
 #include <ITKHelpers/ITKHelpers.h>
 #include <Mask/MaskOperations.h>
@@ -29,6 +33,7 @@
 #include "itkImageRegionReverseIterator.h"
 
 // STL
+#include <algorithm>
 #include <ctime>
 
 template <typename TImage, typename TPixelCompositor>
@@ -71,6 +76,9 @@ void Compositor<TImage, TPixelCompositor>::Composite()
   // set to 0, and solve for T(q):
   // T(q) = \frac{1}{m} \sum_{i=1}^m S(p_i)
 
+  BDS_TRACE_SCOPE("Compositor::Composite");
+  BDS_PERF_SCOPE("Compositor::Composite");
+
   assert(this->NearestNeighborField);
   assert(this->TargetMask);
   assert(this->TargetMask->GetLargestPossibleRegion() == this->Image->GetLargestPossibleRegion());
@@ -79,105 +87,143 @@ void Compositor<TImage, TPixelCompositor>::Composite()
 //   ITKHelpers::WriteRGBImage(oldImage, "Compositor_Compute_OldImage.png");
 //   ITKHelpers::WriteImage(targetMask, "Compositor_Compute_TargetMask.png");
 
-  // This is done so in the algorithm we can use 'fullRegion', since it refers
-  // to the same region for the image and mask.
-  // (So there is no confusion such as "why is the mask's region used here instead of the image's?")
-  itk::ImageRegion<2> fullRegion = this->Image->GetLargestPossibleRegion();
-
   // We don't want to change pixels directly on the output image during the iteration,
   // but rather compute them all and then update them all simultaneously.
   typename TImage::Pointer updatedImage = TImage::New();
   ITKHelpers::DeepCopy(this->Image.GetPointer(), updatedImage.GetPointer());
 
-  // We must get a dummy pixel from the image and then fill it with zero to make sure the number
-  // of components of the pixel is correct.
-  itk::Index<2> zeroIndex = {{0,0}};
-  typename TImage::PixelType zeroPixel = this->Image->GetPixel(zeroIndex);
-  zeroPixel.Fill(0);
-
   std::vector<itk::Index<2> > targetPixels = this->TargetMask->GetValidPixels();
   std::cout << "Compositor::Compute(): There are : "
             << targetPixels.size() << " target pixels." << std::endl;
 
+  InpaintingStatistics* statistics = this->Counters ? &this->Counters->Local() : nullptr;
+
   for(size_t targetPixelId = 0; targetPixelId < targetPixels.size(); ++targetPixelId)
   {
-    //std::cout << "Processing " << targetPixelId << " of " << targetPixels.size() << std::endl;
     itk::Index<2> currentPixel = targetPixels[targetPixelId];
+    updatedImage->SetPixel(currentPixel, ComputePixel(this->Image.GetPointer(), currentPixel, statistics));
+  } // end loop over all target pixels
 
-    { // debug only
-    itk::ImageRegion<2> currentRegion =
-          ITKHelpers::GetRegionInRadiusAroundPixel(currentPixel, this->PatchRadius);
+  // Actually update the output (all at the same time)
+  ITKHelpers::DeepCopy(updatedImage.GetPointer(), this->Output.GetPointer());
+  std::cout << "Finished Compositor::Compute()." << std::endl;
+}
 
-    //ITKHelpers::WriteRegion(oldImage, currentRegion, "CurrentRegion.png");
-    }
+template <typename TImage, typename TPixelCompositor>
+void Compositor<TImage, TPixelCompositor>::ComputePixels(const TImage* const image,
+                                                         const std::vector<itk::Index<2> >& pixels,
+                                                         const size_t begin, const size_t end,
+                                                         std::vector<typename TImage::PixelType>* const values) const
+{
+  // Measured here rather than in CompositePixels(), since the counters only count the thread
+  // that reads them and the chunks may run on the threads of a pool
+  BDS_PERF_SCOPE("Compositor::CompositePixels");
 
-    // Get all patches containing the currentPixel
-    std::vector<itk::ImageRegion<2> > patchesContainingPixel =
-      ITKHelpers::GetAllPatchesContainingPixel(currentPixel,
-                                               this->PatchRadius,
-                                               fullRegion);
+  assert(this->NearestNeighborField);
+  assert(this->PatchRadius > 0);
+  assert(end <= pixels.size() && values->size() == pixels.size());
 
-    // Remove patches from the set if they have invalid NNField values
-//     patchesContainingPixel.erase(std::remove_if(patchesContainingPixel.begin(), patchesContainingPixel.end(),
-//                                  [NearestNeighborField](const itk::ImageRegion<2>& testRegion)
-//                                   {
-//                                     itk::Index<2> index = ITKHelpers::GetRegionCenter(testRegion);
-//                                     bool valid = NearestNeighborField->GetPixel(index).IsValid();
-//                                     return !valid;
-//                                   }),
-//                                  patchesContainingPixel.end());
+  InpaintingStatistics* statistics = this->Counters ? &this->Counters->Local() : nullptr;
 
-    assert(patchesContainingPixel.size() > 0);
+  for(size_t pixelId = begin; pixelId < end; ++pixelId)
+  {
+    (*values)[pixelId] = ComputePixel(image, pixels[pixelId], statistics);
+  }
+}
 
-    // Compute the list of pixels contributing to this patch and their associated patch scores
-    std::vector<typename TImage::PixelType> contributingPixels(patchesContainingPixel.size());
-    std::vector<float> contributingScores(patchesContainingPixel.size());
+template <typename TImage, typename TPixelCompositor>
+void Compositor<TImage, TPixelCompositor>::CompositePixels(const TImage* const image,
+                                                           const std::vector<itk::Index<2> >& pixels,
+                                                           TImage* const output, ThreadPool* const pool) const
+{
+  BDS_TRACE_SCOPE("Compositor::CompositePixels");
 
-    for(unsigned int containingPatchId = 0;
-        containingPatchId < patchesContainingPixel.size(); ++containingPatchId)
-    {
-      itk::Index<2> containingRegionCenter =
-                  ITKHelpers::GetRegionCenter(patchesContainingPixel[containingPatchId]);
-      Match bestMatch = this->NearestNeighborField->GetPixel(containingRegionCenter);
+  assert(output->GetLargestPossibleRegion() == image->GetLargestPossibleRegion());
 
-      itk::ImageRegion<2> bestMatchRegion = bestMatch.GetRegion();
+  // Stage the new values so that none of them is read back while compositing the others
+  std::vector<typename TImage::PixelType> values(pixels.size());
+  if(pool)
+  {
+    const size_t chunkSize = 1024;
+    const size_t numberOfChunks = (pixels.size() + chunkSize - 1) / chunkSize;
+    pool->ParallelFor(numberOfChunks,
+      [this, image, &pixels, &values, chunkSize](const size_t chunkId, const unsigned int)
+      {
+        ComputePixels(image, pixels, chunkId * chunkSize, std::min(pixels.size(), (chunkId + 1) * chunkSize), &values);
+      });
+  }
+  else
+  {
+    ComputePixels(image, pixels, 0, pixels.size(), &values);
+  }
 
-      assert(fullRegion.IsInside(bestMatchRegion));
+  for(size_t pixelId = 0; pixelId < pixels.size(); ++pixelId)
+  {
+    output->SetPixel(pixels[pixelId], values[pixelId]);
+  }
+}
 
-      itk::Index<2> bestMatchRegionCenter = ITKHelpers::GetRegionCenter(bestMatchRegion);
+template <typename TImage, typename TPixelCompositor>
+typename TImage::PixelType Compositor<TImage, TPixelCompositor>::ComputePixel(const TImage* const image,
+                                                                              const itk::Index<2>& currentPixel,
+                                                                              InpaintingStatistics* const statistics) const
+{
+  // This is done so in the algorithm we can use 'fullRegion', since it refers
+  // to the same region for the image and the NN field.
+  itk::ImageRegion<2> fullRegion = image->GetLargestPossibleRegion();
 
-      // Compute the offset of the pixel in question relative to the center of
-      // the current patch that contains the pixel
-      itk::Offset<2> offset = currentPixel - containingRegionCenter;
+  // Get all patches containing the currentPixel
+  std::vector<itk::ImageRegion<2> > patchesContainingPixel =
+    ITKHelpers::GetAllPatchesContainingPixel(currentPixel,
+                                             this->PatchRadius,
+                                             fullRegion);
 
-      // Compute the location of the pixel in the best matching patch that is the
-      // same position of the pixel in question relative to the containing patch
-      itk::Index<2> correspondingPixel = bestMatchRegionCenter + offset;
+  assert(patchesContainingPixel.size() > 0);
 
-      contributingPixels[containingPatchId] = this->Image->GetPixel(correspondingPixel);
+  // Compute the list of pixels contributing to this patch and their associated patch scores
+  std::vector<typename TImage::PixelType> contributingPixels(patchesContainingPixel.size());
+  std::vector<float> contributingScores(patchesContainingPixel.size());
 
-      contributingScores[containingPatchId] = bestMatch.GetScore();
+  for(unsigned int containingPatchId = 0;
+      containingPatchId < patchesContainingPixel.size(); ++containingPatchId)
+  {
+    itk::Index<2> containingRegionCenter =
+                ITKHelpers::GetRegionCenter(patchesContainingPixel[containingPatchId]);
+    Match bestMatch = this->NearestNeighborField->GetPixel(containingRegionCenter);
 
-    } // end loop over containing patches
+    itk::ImageRegion<2> bestMatchRegion = bestMatch.GetRegion();
 
-    //std::cout << "Collected contributing pixels and scores." << std::endl;
-    // Compute new pixel value
+    assert(fullRegion.IsInside(bestMatchRegion));
 
-    // Select a method to construct new pixel
-    //std::cout << "Compositing..." << std::endl;
-    typename TImage::PixelType newValue = TPixelCompositor::Composite(contributingPixels, contributingScores);
-    //std::cout << "Done compositing." << std::endl;
+    itk::Index<2> bestMatchRegionCenter = ITKHelpers::GetRegionCenter(bestMatchRegion);
 
-    updatedImage->SetPixel(currentPixel, newValue);
+    // Compute the offset of the pixel in question relative to the center of
+    // the current patch that contains the pixel
+    itk::Offset<2> offset = currentPixel - containingRegionCenter;
 
-//         std::cout << "Pixel was " << currentImage->GetPixel(currentPixel)
-//                   << " and is now " << updateImage->GetPixel(currentPixel) << std::endl;
+    // Compute the location of the pixel in the best matching patch that is the
+    // same position of the pixel in question relative to the containing patch
+    itk::Index<2> correspondingPixel = bestMatchRegionCenter + offset;
 
-  } // end loop over all target pixels
+    contributingPixels[containingPatchId] = image->GetPixel(correspondingPixel);
 
-  // Actually update the output (all at the same time)
-  ITKHelpers::DeepCopy(updatedImage.GetPointer(), this->Output.GetPointer());
-  std::cout << "Finished Compositor::Compute()." << std::endl;
+    contributingScores[containingPatchId] = bestMatch.GetScore();
+
+  } // end loop over containing patches
+
+  if(statistics)
+  {
+    statistics->AddCompositedPixel(contributingPixels.size());
+  }
+
+  // Select a method to construct new pixel
+  return TPixelCompositor::Composite(contributingPixels, contributingScores);
+}
+
+template <typename TImage, typename TPixelCompositor>
+void Compositor<TImage, TPixelCompositor>::SetStatisticsCollector(StatisticsCollector* const collector)
+{
+  this->Counters = collector;
 }
 
 template <typename TImage, typename TPixelCompositor>
@@ -0,0 +1,131 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef CountingFunctors_H
+#define CountingFunctors_H
+
+// ITK
+#include "itkImageRegion.h"
+
+// Submodules
+#include <PatchMatch/Match.h>
+
+// Custom
+#include "InpaintingStatistics.h"
+
+// STL
+#include <utility>
+
+/** A patch distance functor that counts its evaluations in a StatisticsCollector.
+  * Distance() hides (it does not override) TPatchDistanceFunctor::Distance(), so the
+  * functors using it must be declared with this type rather than TPatchDistanceFunctor. */
+template <typename TPatchDistanceFunctor>
+class PatchDistanceCounting : public TPatchDistanceFunctor
+{
+public:
+
+  /** Count every evaluation in 'collector'. If 'attemptsCounter' is given, also count
+    * each evaluation there (e.g. as a propagation or random search attempt). */
+  void SetStatisticsCollector(StatisticsCollector* const collector,
+                              const StatisticsCollector::CounterType attemptsCounter = nullptr)
+  {
+    this->Collector = collector;
+    this->AttemptsCounter = attemptsCounter;
+  }
+
+  float Distance(const itk::ImageRegion<2>& region1, const itk::ImageRegion<2>& region2)
+  {
+    if(this->Collector)
+    {
+      InpaintingStatistics& statistics = this->Collector->Local();
+      statistics.PatchDistanceEvaluations++;
+      if(this->AttemptsCounter)
+      {
+        statistics.*(this->AttemptsCounter) += 1;
+      }
+    }
+    return TPatchDistanceFunctor::Distance(region1, region2);
+  }
+
+private:
+  StatisticsCollector* Collector = nullptr;
+
+  StatisticsCollector::CounterType AttemptsCounter = nullptr;
+};
+
+/** An acceptance test that counts its calls, acceptances and rejections in a
+  * StatisticsCollector. It can be used anywhere TAcceptanceTest can. */
+template <typename TAcceptanceTest>
+class AcceptanceTestCounting : public TAcceptanceTest
+{
+public:
+
+  /** Forward all constructor arguments to the wrapped acceptance test. */
+  template <typename... TArguments>
+  AcceptanceTestCounting(TArguments&&... arguments) :
+    TAcceptanceTest(std::forward<TArguments>(arguments)...) {}
+
+  /** Count in 'collector'. Any of the counters may be null. */
+  void SetStatisticsCollector(StatisticsCollector* const collector,
+                              const StatisticsCollector::CounterType callsCounter,
+                              const StatisticsCollector::CounterType acceptancesCounter,
+                              const StatisticsCollector::CounterType rejectionsCounter)
+  {
+    this->Collector = collector;
+    this->CallsCounter = callsCounter;
+    this->AcceptancesCounter = acceptancesCounter;
+    this->RejectionsCounter = rejectionsCounter;
+  }
+
+  bool IsBetterWithScore(const itk::ImageRegion<2>& queryRegion, const Match& currentMatch,
+                         const Match& potentialBetterMatch, float& score)
+  {
+    bool better = TAcceptanceTest::IsBetterWithScore(queryRegion, currentMatch,
+                                                     potentialBetterMatch, score);
+
+    if(this->Collector)
+    {
+      InpaintingStatistics& statistics = this->Collector->Local();
+      if(this->CallsCounter)
+      {
+        statistics.*(this->CallsCounter) += 1;
+      }
+      if(better && this->AcceptancesCounter)
+      {
+        statistics.*(this->AcceptancesCounter) += 1;
+      }
+      if(!better && this->RejectionsCounter)
+      {
+        statistics.*(this->RejectionsCounter) += 1;
+      }
+    }
+
+    return better;
+  }
+
+private:
+  StatisticsCollector* Collector = nullptr;
+
+  StatisticsCollector::CounterType CallsCounter = nullptr;
+
+  StatisticsCollector::CounterType AcceptancesCounter = nullptr;
+
+  StatisticsCollector::CounterType RejectionsCounter = nullptr;
+};
+
+#endif
@@ -0,0 +1,140 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef DebugSink_H
+#define DebugSink_H
+
+// STL
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/** Writes debugging artifacts (intermediate images, masks and nearest neighbor fields) on a
+  * background thread. Nothing is written unless the verbosity is raised with SetVerbosity()
+  * or the BDSINPAINTING_DEBUG environment variable (e.g. BDSINPAINTING_DEBUG=2).
+  *
+  * The data to write is copied on the calling thread and the copy is queued; if the queue is
+  * full the write is dropped (and counted) before anything is copied, rather than blocking the
+  * computation. */
+class DebugSink
+{
+public:
+
+  /** How much to write. Each level includes the levels below it. */
+  enum LevelEnum {OFF = 0,
+                  SUMMARY = 1,    // Once per run: masks, initial and final fields.
+                  ITERATIONS = 2, // Once per iteration or ring.
+                  CANDIDATES = 3  // Once per accepted patch match candidate.
+                 };
+
+  /** Get the process-wide sink. */
+  static DebugSink& Instance();
+
+  /** Set the highest level that is written. */
+  void SetVerbosity(const unsigned int verbosity);
+
+  /** Get the highest level that is written. */
+  unsigned int GetVerbosity() const;
+
+  /** True if writes at 'level' are enabled. Check this before doing any work to prepare a write. */
+  bool IsEnabled(const LevelEnum level) const;
+
+  /** Set how many writes may be waiting at once. */
+  void SetQueueCapacity(const unsigned int queueCapacity);
+
+  /** Queue 'job' to be run on the writer thread. 'job' must not reference data that the caller
+    * will modify or destroy. Returns false if the level is disabled or the queue is full. */
+  bool Enqueue(const LevelEnum level, const std::function<void()>& job);
+
+  /** Copy 'image' and queue 'writer' to be called with the copy on the writer thread. */
+  template <typename TImage>
+  bool Write(const LevelEnum level, const TImage* const image,
+             const std::function<void(const TImage*)>& writer);
+
+  /** Copy 'image' and queue it to be written with ITKHelpers::WriteImage. */
+  template <typename TImage>
+  bool WriteImage(const LevelEnum level, const TImage* const image, const std::string& fileName);
+
+  /** Copy 'image' and queue it to be written with ITKHelpers::WriteSequentialImage. */
+  template <typename TImage>
+  bool WriteSequentialImage(const LevelEnum level, const TImage* const image, const std::string& prefix,
+                            const unsigned int iteration, const unsigned int padding,
+                            const std::string& extension);
+
+  /** Copy 'nnField' and queue it to be written with PatchMatchHelpers::WriteNNField. */
+  template <typename TNNField>
+  bool WriteNNField(const LevelEnum level, const TNNField* const nnField, const std::string& fileName);
+
+  /** Block until every queued write has finished. */
+  void Flush();
+
+  /** Get the number of writes that were dropped because the queue was full. */
+  uint64_t GetNumberOfDroppedWrites() const;
+
+  /** Finish the queued writes and stop the writer thread. */
+  ~DebugSink();
+
+private:
+  DebugSink();
+
+  /** The body of the writer thread. A job that throws is logged to std::cerr and skipped. */
+  void Run();
+
+  /** Reserve a place in the queue for a job at 'level'. Returns false (and counts the drop if
+    * the queue is full) if no place was reserved. */
+  bool ReserveSlot(const LevelEnum level);
+
+  /** Queue 'job' in a place reserved by ReserveSlot(). */
+  void EnqueueReserved(const std::function<void()>& job);
+
+  /** Atomic so that IsEnabled() can be called from the hot loops without the lock. */
+  std::atomic<unsigned int> Verbosity;
+
+  unsigned int QueueCapacity = 16;
+
+  std::deque<std::function<void()> > Queue;
+
+  /** The number of places reserved (see ReserveSlot()) whose jobs have not been queued yet. */
+  unsigned int ReservedSlots = 0;
+
+  /** The number of jobs that have been dequeued but not finished. */
+  unsigned int ActiveJobs = 0;
+
+  uint64_t DroppedWrites = 0;
+
+  bool Stopping = false;
+
+  std::thread WriterThread;
+
+  mutable std::mutex Mutex;
+
+  /** Signalled when a job is queued or the sink is stopping. */
+  std::condition_variable JobAvailable;
+
+  /** Signalled when the queue becomes empty and no job is reserved or running. */
+  std::condition_variable Idle;
+};
+
+#include "DebugSink.hpp"
+
+#endif
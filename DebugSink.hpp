@@ -0,0 +1,235 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef DebugSink_HPP
+#define DebugSink_HPP
+
+#include "DebugSink.h"
+
+// Submodules
+#include <ITKHelpers/ITKHelpers.h>
+#include <PatchMatch/PatchMatchHelpers.h>
+
+// STL
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+
+inline DebugSink& DebugSink::Instance()
+{
+  static DebugSink sink;
+  return sink;
+}
+
+inline DebugSink::DebugSink() : Verbosity(OFF)
+{
+  const char* verbosity = std::getenv("BDSINPAINTING_DEBUG");
+  if(verbosity)
+  {
+    this->Verbosity = static_cast<unsigned int>(std::atoi(verbosity));
+  }
+}
+
+inline DebugSink::~DebugSink()
+{
+  {
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    this->Stopping = true;
+  }
+  this->JobAvailable.notify_all();
+
+  if(this->WriterThread.joinable())
+  {
+    this->WriterThread.join();
+  }
+
+  if(this->DroppedWrites > 0)
+  {
+    std::cerr << "DebugSink: " << this->DroppedWrites
+              << " debug writes were dropped because the queue was full." << std::endl;
+  }
+}
+
+inline void DebugSink::SetVerbosity(const unsigned int verbosity)
+{
+  this->Verbosity = verbosity;
+}
+
+inline unsigned int DebugSink::GetVerbosity() const
+{
+  return this->Verbosity;
+}
+
+inline bool DebugSink::IsEnabled(const LevelEnum level) const
+{
+  return level != OFF && static_cast<unsigned int>(level) <= this->Verbosity.load(std::memory_order_relaxed);
+}
+
+inline void DebugSink::SetQueueCapacity(const unsigned int queueCapacity)
+{
+  std::lock_guard<std::mutex> lock(this->Mutex);
+  this->QueueCapacity = queueCapacity;
+}
+
+inline bool DebugSink::Enqueue(const LevelEnum level, const std::function<void()>& job)
+{
+  if(!ReserveSlot(level))
+  {
+    return false;
+  }
+
+  EnqueueReserved(job);
+  return true;
+}
+
+inline bool DebugSink::ReserveSlot(const LevelEnum level)
+{
+  if(!IsEnabled(level))
+  {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(this->Mutex);
+
+  if(this->Queue.size() + this->ReservedSlots >= this->QueueCapacity)
+  {
+    this->DroppedWrites++;
+    return false;
+  }
+
+  // Start the writer thread on first use, so that nothing is started when debugging is off.
+  if(!this->WriterThread.joinable())
+  {
+    this->WriterThread = std::thread(&DebugSink::Run, this);
+  }
+
+  this->ReservedSlots++;
+  return true;
+}
+
+inline void DebugSink::EnqueueReserved(const std::function<void()>& job)
+{
+  {
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    this->ReservedSlots--;
+    this->Queue.push_back(job);
+  }
+
+  this->JobAvailable.notify_one();
+}
+
+template <typename TImage>
+bool DebugSink::Write(const LevelEnum level, const TImage* const image,
+                      const std::function<void(const TImage*)>& writer)
+{
+  // Only copy the image once it has a place in the queue
+  if(!ReserveSlot(level))
+  {
+    return false;
+  }
+
+  typename TImage::Pointer copy = TImage::New();
+  ITKHelpers::DeepCopy(image, copy.GetPointer());
+
+  EnqueueReserved([copy, writer]() {writer(copy.GetPointer());});
+  return true;
+}
+
+template <typename TImage>
+bool DebugSink::WriteImage(const LevelEnum level, const TImage* const image, const std::string& fileName)
+{
+  return Write<TImage>(level, image,
+                       [fileName](const TImage* imageCopy) {ITKHelpers::WriteImage(imageCopy, fileName);});
+}
+
+template <typename TImage>
+bool DebugSink::WriteSequentialImage(const LevelEnum level, const TImage* const image, const std::string& prefix,
+                                     const unsigned int iteration, const unsigned int padding,
+                                     const std::string& extension)
+{
+  return Write<TImage>(level, image,
+                       [prefix, iteration, padding, extension](const TImage* imageCopy)
+                       {ITKHelpers::WriteSequentialImage(imageCopy, prefix, iteration, padding, extension);});
+}
+
+template <typename TNNField>
+bool DebugSink::WriteNNField(const LevelEnum level, const TNNField* const nnField, const std::string& fileName)
+{
+  return Write<TNNField>(level, nnField,
+                         [fileName](const TNNField* nnFieldCopy) {PatchMatchHelpers::WriteNNField(nnFieldCopy, fileName);});
+}
+
+inline void DebugSink::Flush()
+{
+  std::unique_lock<std::mutex> lock(this->Mutex);
+  this->Idle.wait(lock, [this]() {return this->Queue.empty() && this->ReservedSlots == 0 && this->ActiveJobs == 0;});
+}
+
+inline uint64_t DebugSink::GetNumberOfDroppedWrites() const
+{
+  std::lock_guard<std::mutex> lock(this->Mutex);
+  return this->DroppedWrites;
+}
+
+inline void DebugSink::Run()
+{
+  while(true)
+  {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(this->Mutex);
+      this->JobAvailable.wait(lock, [this]() {return this->Stopping || !this->Queue.empty();});
+
+      // Finish the queued writes before stopping.
+      if(this->Queue.empty())
+      {
+        return;
+      }
+
+      job = this->Queue.front();
+      this->Queue.pop_front();
+      this->ActiveJobs++;
+    }
+
+    // An exception escaping the writer thread would terminate the program, and a failed
+    // debug write should not stop the inpainting, so log it and continue with the next job.
+    try
+    {
+      job();
+    }
+    catch(const std::exception& e)
+    {
+      std::cerr << "DebugSink: a queued write failed: " << e.what() << std::endl;
+    }
+    catch(...)
+    {
+      std::cerr << "DebugSink: a queued write failed with an unknown exception." << std::endl;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(this->Mutex);
+      this->ActiveJobs--;
+      if(this->Queue.empty() && this->ReservedSlots == 0 && this->ActiveJobs == 0)
+      {
+        this->Idle.notify_all();
+      }
+    }
+  }
+}
+
+#endif
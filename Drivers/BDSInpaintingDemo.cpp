@@ -36,19 +36,22 @@
 #include <PatchMatch/Propagator.h>
 #include <PatchMatch/RandomSearch.h>
 
-#include <PoissonEditing/PoissonEditingWrappers.h>
-
 // Custom
 #include "BDSInpainting.h"
 #include "Compositor.h"
+#include "DebugSink.h"
+#include "HoleInitializer.h"
 #include "PixelCompositors.h"
+#include "PerformanceCounters.h"
+#include "Trace.h"
 
 int main(int argc, char*argv[])
 {
   // Parse the input
   if(argc < 5)
   {
-    std::cerr << "Required arguments: image mask.mask patchRadius outputImage" << std::endl;
+    std::cerr << "Required arguments: image mask.mask patchRadius outputImage [timeBudgetSeconds]"
+              << " [pullpush|multigrid|nearest]" << std::endl;
     return EXIT_FAILURE;
   }
 
@@ -62,14 +65,18 @@ int main(int argc, char*argv[])
   std::string maskFilename;
   unsigned int patchRadius; // The PatchMatch paper experiments mostly use 7x7 patches (radius=3)
   std::string outputFilename;
+  double timeBudget = 0.0; // Optional, 0 means no limit
+  std::string holeInitializerName = "pullpush"; // Optional
 
-  ss >> imageFilename >> maskFilename >> patchRadius >> outputFilename;
+  ss >> imageFilename >> maskFilename >> patchRadius >> outputFilename >> timeBudget >> holeInitializerName;
 
   // Output the parsed values
   std::cout << "imageFilename: " << imageFilename << std::endl
             << "maskFilename: " << maskFilename << std::endl
             << "patchRadius: " << patchRadius << std::endl
-            << "outputFilename: " << outputFilename << std::endl;
+            << "outputFilename: " << outputFilename << std::endl
+            << "timeBudget: " << timeBudget << std::endl
+            << "holeInitializer: " << holeInitializerName << std::endl;
 
   typedef itk::Image<itk::CovariantVector<unsigned char, 3>, 2> ImageType;
 
@@ -86,39 +93,35 @@ int main(int argc, char*argv[])
 
   //std::cout << "target mask has " << targetMask->CountHolePixels() << " hole pixels." << std::endl;
 
-  // Poisson fill the input image
-  typename PoissonEditingParent::GuidanceFieldType::Pointer zeroGuidanceField =
-            PoissonEditingParent::GuidanceFieldType::New();
-  zeroGuidanceField->SetRegions(image->GetLargestPossibleRegion());
-  zeroGuidanceField->Allocate();
-  typename PoissonEditingParent::GuidanceFieldType::PixelType zeroPixel;
-  zeroPixel.Fill(0);
-  ITKHelpers::SetImageToConstant(zeroGuidanceField.GetPointer(), zeroPixel);
-
   ImageType::Pointer filledImage = ImageType::New();
 
-  FillImage(image, mask.GetPointer(), zeroGuidanceField, filledImage.GetPointer(),
-            image->GetLargestPossibleRegion());
+  // Fill the hole with a smooth initial guess
+  HoleInitializer<ImageType> holeInitializer;
+  holeInitializer.SetMethod(HoleInitializer<ImageType>::GetMethodFromName(holeInitializerName));
+  holeInitializer.Initialize(image, mask.GetPointer(), filledImage.GetPointer());
 
-  ITKHelpers::WriteRGBImage(filledImage.GetPointer(), "PoissonFilled.png");
+  std::cout << "Hole initializer " << holeInitializerName << ": " << holeInitializer.GetNumberOfHolePixels()
+            << " hole pixels in a " << holeInitializer.GetWorkingRegion().GetSize() << " region, "
+            << holeInitializer.GetSeconds() << "s" << std::endl;
 
-  // Setup the patch distance functor
-  typedef SSD<ImageType> PatchDistanceFunctorType;
-  PatchDistanceFunctorType* patchDistanceFunctor = new PatchDistanceFunctorType;
-  patchDistanceFunctor->SetImage(filledImage);
+  ITKHelpers::WriteRGBImage(filledImage.GetPointer(), "HoleInitialized.png");
+
+  // Setup the propagation and random search functors. BDSInpainting gives them their patch
+  // distance functors.
+  typedef BDSInpainting<ImageType>::PatchDistanceFunctorType PatchDistanceFunctorType;
 
   typedef Propagator<PatchDistanceFunctorType> PropagatorType;
-  PropagatorType* propagator = new PropagatorType;
+  PropagatorType propagator;
 
   typedef RandomSearch<ImageType, PatchDistanceFunctorType> RandomSearchType;
-  RandomSearchType* randomSearchFunctor = new RandomSearchType;
+  RandomSearchType randomSearchFunctor;
 
   // Setup the PatchMatch functor
   PatchMatch<ImageType, PropagatorType, RandomSearchType> patchMatchFunctor;
   patchMatchFunctor.SetPatchRadius(patchRadius);
   patchMatchFunctor.SetIterations(5);
-  patchMatchFunctor.SetPropagationFunctor(propagator);
-  patchMatchFunctor.SetRandomSearchFunctor(randomSearchFunctor);
+  patchMatchFunctor.SetPropagationFunctor(&propagator);
+  patchMatchFunctor.SetRandomSearchFunctor(&randomSearchFunctor);
   patchMatchFunctor.SetImage(filledImage);
 
   Compositor<ImageType, PixelCompositorAverage> compositor;
@@ -132,9 +135,26 @@ int main(int argc, char*argv[])
   bdsInpainting.SetImage(filledImage);
   bdsInpainting.SetInpaintingMask(mask);
   bdsInpainting.SetIterations(1);
+  bdsInpainting.SetTimeBudget(timeBudget);
+  bdsInpainting.SetProgressCallback([](const InpaintingProgress& progress)
+    {
+      std::cout << progress.Phase << ": " << 100.0f * progress.FractionComplete << "% after "
+                << progress.ElapsedSeconds << "s" << std::endl;
+      return true;
+    });
   bdsInpainting.Inpaint(&patchMatchFunctor, &compositor);
 
   ITKHelpers::WriteRGBImage(bdsInpainting.GetOutput(), outputFilename);
 
+  std::cout << "Completeness: " << bdsInpainting.GetCompleteness() << std::endl;
+
+  bdsInpainting.GetStatistics().Print(std::cout);
+
+  BDS_TRACE_WRITE("trace.json");
+  BDS_PERF_REPORT(std::cout);
+
+  // Wait for any debug images (enabled with BDSINPAINTING_DEBUG) to be written.
+  DebugSink::Instance().Flush();
+
   return EXIT_SUCCESS;
 }
@@ -16,6 +16,7 @@
  *
  *=========================================================================*/
 
+
 // STL
 #include <iostream>
 
@@ -27,21 +28,31 @@
 
 // Submodules
 #include <Mask/Mask.h>
+
 #include <ITKHelpers/ITKHelpers.h>
+
 #include <PatchComparison/SSD.h>
+
 #include <PatchMatch/PatchMatch.h>
-#include <PatchMatch/InitializerRandom.h>
+#include <PatchMatch/Propagator.h>
+#include <PatchMatch/RandomSearch.h>
 
 // Custom
 #include "BDSInpaintingMultiRes.h"
 #include "Compositor.h"
+#include "DebugSink.h"
+#include "HoleInitializer.h"
+#include "PixelCompositors.h"
+#include "PerformanceCounters.h"
+#include "Trace.h"
 
 int main(int argc, char*argv[])
 {
   // Parse the input
-  if(argc < 6)
+  if(argc < 5)
   {
-    std::cerr << "Required arguments: image sourceMask.mask targetMask.mask patchRadius output" << std::endl;
+    std::cerr << "Required arguments: image mask.mask patchRadius outputImage [resolutionLevels] [timeBudgetSeconds]"
+              << " [fixed|auto] [sourceBandRadius] [sourceMask.mask|none] [pullpush|multigrid|nearest]" << std::endl;
     return EXIT_FAILURE;
   }
 
@@ -52,23 +63,34 @@ int main(int argc, char*argv[])
   }
 
   std::string imageFilename;
-  std::string sourceMaskFilename;
-  std::string targetMaskFilename;
+  std::string maskFilename;
   unsigned int patchRadius;
   std::string outputFilename;
+  unsigned int resolutionLevels = 3; // Optional
+  double timeBudget = 0.0; // Optional, 0 means no limit
+  std::string scheduleMode = "fixed"; // Optional
+  unsigned int sourceBandRadius = 0; // Optional, 0 means the whole image
+  std::string sourceMaskFilename = "none"; // Optional
+  std::string holeInitializerName = "pullpush"; // Optional
 
-  ss >> imageFilename >> sourceMaskFilename >> targetMaskFilename >> patchRadius >> outputFilename;
+  ss >> imageFilename >> maskFilename >> patchRadius >> outputFilename >> resolutionLevels >> timeBudget
+     >> scheduleMode >> sourceBandRadius >> sourceMaskFilename >> holeInitializerName;
 
   // Output the parsed values
   std::cout << "imageFilename: " << imageFilename << std::endl
-            << "sourceMaskFilename: " << sourceMaskFilename << std::endl
-            << "targetMaskFilename: " << targetMaskFilename << std::endl
+            << "maskFilename: " << maskFilename << std::endl
             << "patchRadius: " << patchRadius << std::endl
-            << "outputFilename: " << outputFilename << std::endl;
+            << "outputFilename: " << outputFilename << std::endl
+            << "resolutionLevels: " << resolutionLevels << std::endl
+            << "timeBudget: " << timeBudget << std::endl
+            << "scheduleMode: " << scheduleMode << std::endl
+            << "sourceBandRadius: " << sourceBandRadius << std::endl
+            << "sourceMaskFilename: " << sourceMaskFilename << std::endl
+            << "holeInitializer: " << holeInitializerName << std::endl;
 
   typedef itk::Image<itk::CovariantVector<unsigned char, 3>, 2> ImageType;
 
-  // Read the image and the masks
+  // Read the image and the mask
   typedef itk::ImageFileReader<ImageType> ImageReaderType;
   ImageReaderType::Pointer imageReader = ImageReaderType::New();
   imageReader->SetFileName(imageFilename);
@@ -76,76 +98,96 @@ int main(int argc, char*argv[])
 
   ImageType* image = imageReader->GetOutput();
 
-  Mask::Pointer sourceMask = Mask::New();
-  sourceMask->Read(sourceMaskFilename);
+  Mask::Pointer mask = Mask::New();
+  mask->Read(maskFilename);
 
-  Mask::Pointer targetMask = Mask::New();
-  targetMask->Read(targetMaskFilename);
-
-  //std::cout << "target mask has " << targetMask->CountHolePixels() << " hole pixels." << std::endl;
+  Mask::Pointer sourceMask;
+  if(sourceMaskFilename != "none")
+  {
+    sourceMask = Mask::New();
+    sourceMask->Read(sourceMaskFilename);
+  }
 
-  // Poisson fill the input image
-  typedef PoissonEditing<typename TypeTraits<ImageType::PixelType>::ComponentType> PoissonEditingType;
+  ImageType::Pointer filledImage = ImageType::New();
 
-  typename PoissonEditingType::GuidanceFieldType::Pointer zeroGuidanceField =
-            PoissonEditingType::GuidanceFieldType::New();
-  zeroGuidanceField->SetRegions(image->GetLargestPossibleRegion());
-  zeroGuidanceField->Allocate();
-  typename PoissonEditingType::GuidanceFieldType::PixelType zeroPixel;
-  zeroPixel.Fill(0);
-  ITKHelpers::SetImageToConstant(zeroGuidanceField.GetPointer(), zeroPixel);
+  // Fill the hole with a smooth initial guess
+  HoleInitializer<ImageType> holeInitializer;
+  holeInitializer.SetMethod(HoleInitializer<ImageType>::GetMethodFromName(holeInitializerName));
+  holeInitializer.Initialize(image, mask.GetPointer(), filledImage.GetPointer());
 
-  PoissonEditingType::FillImage(image, targetMask,
-                                zeroGuidanceField.GetPointer(), image);
+  std::cout << "Hole initializer " << holeInitializerName << ": " << holeInitializer.GetNumberOfHolePixels()
+            << " hole pixels in a " << holeInitializer.GetWorkingRegion().GetSize() << " region, "
+            << holeInitializer.GetSeconds() << "s" << std::endl;
 
-  ITKHelpers::WriteRGBImage(image, "PoissonFilled.png");
+  // Setup the PatchMatch functor. BDSInpaintingMultiRes gives it the image and the number of
+  // iterations of each level.
+  typedef BDSInpainting<ImageType>::PatchDistanceFunctorType PatchDistanceFunctorType;
 
-  // PatchMatch requires that the target region be specified by valid pixels
-  targetMask->InvertData();
+  typedef Propagator<PatchDistanceFunctorType> PropagatorType;
+  PropagatorType propagator;
 
-  // Setup the patch distance functor
-  SSD<ImageType> ssdFunctor;
-  ssdFunctor.SetImage(image);
+  typedef RandomSearch<ImageType, PatchDistanceFunctorType> RandomSearchType;
+  RandomSearchType randomSearchFunctor;
 
-  // Setup the PatchMatch functor
-  //PatchMatch<ImageType> patchMatchFunctor;
-  PatchMatchRings<ImageType> patchMatchFunctor;
+  PatchMatch<ImageType, PropagatorType, RandomSearchType> patchMatchFunctor;
   patchMatchFunctor.SetPatchRadius(patchRadius);
-  patchMatchFunctor.SetPatchDistanceFunctor(&ssdFunctor);
-  patchMatchFunctor.SetIterations(1);
-
-  InitializerRandom<ImageType> initializer;
-  initializer.SetImage(image);
-  initializer.SetTargetMask(targetMask);
-  initializer.SetSourceMask(sourceMask);
-  initializer.SetPatchDistanceFunctor(&ssdFunctor);
-  initializer.SetPatchRadius(patchRadius);
-  patchMatchFunctor.SetInitializer(&initializer);
-
-  // Test the result of PatchMatch here
-   patchMatchFunctor.SetRandom(false);
-
-  // Here, the source match and target match are the same, specifying the classicial
-  // "use pixels outside the hole to fill the pixels inside the hole".
-  // In an interactive algorith, the user could manually specify a source region,
-  // improving the resulting inpainting.
+  patchMatchFunctor.SetPropagationFunctor(&propagator);
+  patchMatchFunctor.SetRandomSearchFunctor(&randomSearchFunctor);
+
+  Compositor<ImageType, PixelCompositorAverage> compositor;
+
   BDSInpaintingMultiRes<ImageType> bdsInpainting;
   bdsInpainting.SetPatchRadius(patchRadius);
-  bdsInpainting.SetImage(image);
+  bdsInpainting.SetImage(filledImage);
+  bdsInpainting.SetInpaintingMask(mask);
   bdsInpainting.SetSourceMask(sourceMask);
-  bdsInpainting.SetTargetMask(targetMask);
-
+  bdsInpainting.SetSourceBandRadius(sourceBandRadius);
   bdsInpainting.SetIterations(1);
-  //bdsInpainting.SetIterations(4);
+  bdsInpainting.SetResolutionLevels(resolutionLevels);
+  bdsInpainting.SetDownsampleFactor(0.5f);
+  bdsInpainting.SetPatchMatchIterations(5);
+  bdsInpainting.SetRefinementPatchMatchIterations(2);
+  bdsInpainting.SetScheduleMode(scheduleMode == "auto" ?
+                                BDSInpaintingMultiRes<ImageType>::AUTOMATIC_SCHEDULE :
+                                BDSInpaintingMultiRes<ImageType>::FIXED_SCHEDULE);
+  bdsInpainting.SetTimeBudget(timeBudget);
+  bdsInpainting.SetProgressCallback([](const InpaintingProgress& progress)
+    {
+      std::cout << progress.Phase << ": " << 100.0f * progress.FractionComplete << "% after "
+                << progress.ElapsedSeconds << "s" << std::endl;
+      return true;
+    });
+  bdsInpainting.Inpaint(&patchMatchFunctor, &compositor);
 
-  Compositor<ImageType> compositor;
-  compositor.SetCompositingMethod(Compositor<ImageType>::AVERAGE);
-  bdsInpainting.SetCompositor(&compositor);
+  ITKHelpers::WriteRGBImage(bdsInpainting.GetOutput(), outputFilename);
 
-  bdsInpainting.SetPatchMatchFunctor(&patchMatchFunctor);
-  bdsInpainting.Inpaint();
+  std::cout << "Levels used: " << bdsInpainting.GetNumberOfLevelsUsed() << std::endl;
 
-  ITKHelpers::WriteRGBImage(bdsInpainting.GetOutput(), outputFilename);
+  typedef BDSInpaintingMultiRes<ImageType>::LevelReport LevelReportType;
+  const std::vector<LevelReportType>& levelReports = bdsInpainting.GetLevelReports();
+  double totalSeconds = 0.0;
+  for(size_t reportId = 0; reportId < levelReports.size(); ++reportId)
+  {
+    totalSeconds += levelReports[reportId].Seconds;
+  }
+  for(size_t reportId = 0; reportId < levelReports.size(); ++reportId)
+  {
+    const LevelReportType& report = levelReports[reportId];
+    std::cout << "Level " << report.Level << ": " << report.IterationsRun << "/" << report.Schedule.Iterations
+              << " iterations, " << report.Schedule.PatchMatchIterations << " PatchMatch iterations, search radius "
+              << report.Schedule.RandomSearchRadius << ", changed matches " << report.ChangedMatchFraction << ", "
+              << report.Seconds << "s (" << (totalSeconds > 0.0 ? 100.0 * report.Seconds / totalSeconds : 0.0)
+              << "%)" << std::endl;
+  }
+  std::cout << "Completeness: " << bdsInpainting.GetCompleteness() << std::endl;
+
+  bdsInpainting.GetStatistics().Print(std::cout);
+
+  BDS_TRACE_WRITE("trace.json");
+  BDS_PERF_REPORT(std::cout);
+
+  // Wait for any debug images (enabled with BDSINPAINTING_DEBUG) to be written.
+  DebugSink::Instance().Flush();
 
   return EXIT_SUCCESS;
 }
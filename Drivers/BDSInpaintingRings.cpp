@@ -30,28 +30,30 @@
 
 #include <ITKHelpers/ITKHelpers.h>
 
-#include <ITKVTKHelpers/ITKVTKHelpers.h>
-
 #include <PatchComparison/SSD.h>
 
 #include <PatchMatch/PatchMatch.h>
 
-#include <PoissonEditing/PoissonEditing.h>
-
 // Custom
 #include "BDSInpaintingRings.h"
 #include "AcceptanceTestNeighborHistogram.h"
 #include "InitializerRandom.h"
 #include "Propagator.h"
+#include "DebugSink.h"
+#include "HoleInitializer.h"
 #include "PixelCompositors.h"
+#include "PerformanceCounters.h"
 #include "RandomSearch.h"
+#include "Trace.h"
 
 int main(int argc, char*argv[])
 {
   // Parse the input
   if(argc < 6)
   {
-    std::cerr << "Required arguments: image sourceMask.mask targetMask.mask patchRadius output" << std::endl;
+    std::cerr << "Required arguments: image sourceMask.mask targetMask.mask patchRadius output "
+              << "[timeBudgetSeconds] [thick|single|single-confidence] [sourceBandRadius] "
+              << "[pullpush|multigrid|nearest]" << std::endl;
     return EXIT_FAILURE;
   }
 
@@ -66,15 +68,24 @@ int main(int argc, char*argv[])
   std::string targetMaskFilename;
   unsigned int patchRadius;
   std::string outputFilename;
+  double timeBudget = 0.0; // Optional, 0 means no limit
+  std::string ringMode = "thick"; // Optional
+  unsigned int sourceBandRadius = 0; // Optional, 0 means the whole source mask
+  std::string holeInitializerName = "pullpush"; // Optional
 
-  ss >> imageFilename >> sourceMaskFilename >> targetMaskFilename >> patchRadius >> outputFilename;
+  ss >> imageFilename >> sourceMaskFilename >> targetMaskFilename >> patchRadius >> outputFilename
+     >> timeBudget >> ringMode >> sourceBandRadius >> holeInitializerName;
 
   // Output the parsed values
   std::cout << "imageFilename: " << imageFilename << std::endl
             << "sourceMaskFilename: " << sourceMaskFilename << std::endl
             << "targetMaskFilename: " << targetMaskFilename << std::endl
             << "patchRadius: " << patchRadius << std::endl
-            << "outputFilename: " << outputFilename << std::endl;
+            << "outputFilename: " << outputFilename << std::endl
+            << "timeBudget: " << timeBudget << std::endl
+            << "ringMode: " << ringMode << std::endl
+            << "sourceBandRadius: " << sourceBandRadius << std::endl
+            << "holeInitializer: " << holeInitializerName << std::endl;
 
   typedef itk::Image<itk::CovariantVector<unsigned char, 3>, 2> ImageType;
 
@@ -92,31 +103,16 @@ int main(int argc, char*argv[])
   Mask::Pointer targetMask = Mask::New();
   targetMask->Read(targetMaskFilename);
 
-  // Poisson fill the input image in HSV space
-  typedef itk::Image<itk::CovariantVector<float, 3>, 2> HSVImageType;
-  HSVImageType::Pointer hsvImage = HSVImageType::New();
-  ITKVTKHelpers::ConvertRGBtoHSV(image, hsvImage.GetPointer());
-
-  ITKHelpers::WriteImage(image, "HSV.mha");
-
-  typedef PoissonEditing<typename TypeTraits<HSVImageType::PixelType>::ComponentType> PoissonEditingType;
-
-  typename PoissonEditingType::GuidanceFieldType::Pointer zeroGuidanceField =
-            PoissonEditingType::GuidanceFieldType::New();
-  zeroGuidanceField->SetRegions(hsvImage->GetLargestPossibleRegion());
-  zeroGuidanceField->Allocate();
-  typename PoissonEditingType::GuidanceFieldType::PixelType zeroPixel;
-  zeroPixel.Fill(0);
-  ITKHelpers::SetImageToConstant(zeroGuidanceField.GetPointer(), zeroPixel);
-
-  PoissonEditingType::FillImage(hsvImage.GetPointer(), targetMask,
-                                zeroGuidanceField.GetPointer(), hsvImage.GetPointer());
+  // Fill the hole with a smooth initial guess
+  HoleInitializer<ImageType> holeInitializer;
+  holeInitializer.SetMethod(HoleInitializer<ImageType>::GetMethodFromName(holeInitializerName));
+  holeInitializer.Initialize(image, targetMask.GetPointer(), image);
 
-  ITKHelpers::WriteImage(image, "PoissonFilled_HSV.mha");
+  std::cout << "Hole initializer " << holeInitializerName << ": " << holeInitializer.GetNumberOfHolePixels()
+            << " hole pixels in a " << holeInitializer.GetWorkingRegion().GetSize() << " region, "
+            << holeInitializer.GetSeconds() << "s" << std::endl;
 
-  ITKVTKHelpers::ConvertHSVtoRGB(hsvImage.GetPointer(), image);
-
-  ITKHelpers::WriteRGBImage(image, "PoissonFilled_HSV.png");
+  ITKHelpers::WriteRGBImage(image, "HoleInitialized.png");
 
   // PatchMatch requires that the target region be specified by valid pixels
   targetMask->InvertData();
@@ -130,14 +126,53 @@ int main(int argc, char*argv[])
   bdsInpainting.SetImage(image);
   bdsInpainting.SetSourceMask(sourceMask);
   bdsInpainting.SetTargetMask(targetMask);
+  bdsInpainting.SetSourceBandRadius(sourceBandRadius);
 
   bdsInpainting.SetIterations(1);
   //bdsInpainting.SetIterations(4);
 
+  if(ringMode == "single" || ringMode == "single-confidence")
+  {
+    bdsInpainting.SetRingMode(BDSInpaintingRings<ImageType>::SINGLE_PIXEL_RINGS);
+    if(ringMode == "single-confidence")
+    {
+      bdsInpainting.SetFrontOrder(BDSInpaintingRings<ImageType>::FRONT_CONFIDENCE);
+    }
+  }
+  else if(ringMode != "thick")
+  {
+    std::cerr << "Unknown ring mode " << ringMode << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  bdsInpainting.SetTimeBudget(timeBudget);
+  bdsInpainting.SetProgressCallback([](const InpaintingProgress& progress)
+    {
+      std::cout << progress.Phase << ": " << 100.0f * progress.FractionComplete << "% after "
+                << progress.ElapsedSeconds << "s" << std::endl;
+      return true;
+    });
+
   Compositor<ImageType, PixelCompositorAverage> compositor;
   bdsInpainting.Inpaint();
 
   ITKHelpers::WriteRGBImage(bdsInpainting.GetOutput(), outputFilename);
 
+  std::cout << "Completeness: " << bdsInpainting.GetCompleteness() << std::endl;
+
+  bdsInpainting.GetStatistics().Print(std::cout);
+
+  std::vector<std::string> acceptanceTestOrders = bdsInpainting.GetAcceptanceTestOrders();
+  for(size_t threadId = 0; threadId < acceptanceTestOrders.size(); ++threadId)
+  {
+    std::cout << "AcceptanceTestOrder (thread " << threadId << "): " << acceptanceTestOrders[threadId] << std::endl;
+  }
+
+  BDS_TRACE_WRITE("trace.json");
+  BDS_PERF_REPORT(std::cout);
+
+  // Wait for any debug images (enabled with BDSINPAINTING_DEBUG) to be written.
+  DebugSink::Instance().Flush();
+
   return EXIT_SUCCESS;
 }
@@ -0,0 +1,96 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+// Write a deterministic synthetic image and mask that can be fed directly to the
+// drivers, e.g.
+//   GenerateSyntheticWorkload 4096 4096 fractal 8 100 blob 1 Synthetic16MP
+//   BDSInpaintingDemo Synthetic16MP.png Synthetic16MP.mask 3 Output.png
+//   BDSInpaintingRings Synthetic16MP.png Synthetic16MP.mask Synthetic16MP.mask 3 Output.png
+
+// STL
+#include <iostream>
+#include <sstream>
+
+// ITK
+#include "itkImage.h"
+#include "itkCovariantVector.h"
+
+// Submodules
+#include <Mask/Mask.h>
+
+#include <ITKHelpers/ITKHelpers.h>
+
+// Custom
+#include "SyntheticWorkload.h"
+
+int main(int argc, char*argv[])
+{
+  // Parse the input
+  if(argc < 9)
+  {
+    std::cerr << "Required arguments: width height texture(noise|stripes|fractal) "
+              << "holeCount holeRadius holeShape(square|disc|blob) seed outputPrefix" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::stringstream ss;
+  for(int i = 1; i < argc; ++i)
+  {
+    ss << argv[i] << " ";
+  }
+
+  unsigned int width;
+  unsigned int height;
+  std::string textureName;
+  SyntheticWorkload::MaskParameters maskParameters;
+  std::string holeShapeName;
+  std::string outputPrefix;
+
+  ss >> width >> height >> textureName >> maskParameters.HoleCount >> maskParameters.HoleRadius
+     >> holeShapeName >> maskParameters.Seed >> outputPrefix;
+
+  // Output the parsed values
+  std::cout << "width: " << width << std::endl
+            << "height: " << height << std::endl
+            << "texture: " << textureName << std::endl
+            << "holeCount: " << maskParameters.HoleCount << std::endl
+            << "holeRadius: " << maskParameters.HoleRadius << std::endl
+            << "holeShape: " << holeShapeName << std::endl
+            << "seed: " << maskParameters.Seed << std::endl
+            << "outputPrefix: " << outputPrefix << std::endl;
+
+  SyntheticWorkload::TextureEnum texture = SyntheticWorkload::TextureFromString(textureName);
+  maskParameters.HoleShape = SyntheticWorkload::HoleShapeFromString(holeShapeName);
+
+  typedef itk::Image<itk::CovariantVector<unsigned char, 3>, 2> ImageType;
+
+  itk::Size<2> size = {{width, height}};
+
+  ImageType::Pointer image = ImageType::New();
+  SyntheticWorkload::CreateTexture(image.GetPointer(), size, texture, maskParameters.Seed);
+  ITKHelpers::WriteRGBImage(image.GetPointer(), outputPrefix + ".png");
+
+  Mask::Pointer mask = Mask::New();
+  SyntheticWorkload::CreateMask(mask, size, maskParameters);
+  SyntheticWorkload::WriteMask(mask, outputPrefix);
+
+  std::cout << "Wrote " << outputPrefix << ".png and " << outputPrefix << ".mask ("
+            << mask->CountHolePixels() << " hole pixels)." << std::endl;
+
+  return EXIT_SUCCESS;
+}
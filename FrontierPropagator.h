@@ -0,0 +1,93 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+
+#ifndef FrontierPropagator_H
+#define FrontierPropagator_H
+
+// ITK
+#include "itkImageRegion.h"
+
+// Submodules
+#include <Mask/Mask.h>
+#include <PatchMatch/Match.h>
+#include <PatchMatch/PatchMatchHelpers.h>
+
+// Boost
+#include <boost/signals2.hpp>
+
+// STL
+#include <vector>
+
+/** Forced propagation that only visits the frontier between verified and unverified pixels.
+  * Each call to Propagate() advances the frontier by one pixel: every unverified target pixel
+  * that is 4-adjacent to a verified pixel takes the best (lowest patch distance) of its
+  * verified neighbors' matches, shifted by the offset to that neighbor, that passes the
+  * acceptance test. Only the unverified neighbors of the pixels verified by a step are
+  * candidates for the next step, so the total cost of filling a region is proportional to
+  * its area rather than to the image size times the number of steps. */
+template <typename TPatchDistanceFunctor, typename TAcceptanceTest>
+class FrontierPropagator
+{
+public:
+  typedef PatchMatchHelpers::NNFieldType NNFieldType;
+
+  void SetPatchRadius(const unsigned int patchRadius);
+
+  void SetPatchDistanceFunctor(TPatchDistanceFunctor* const patchDistanceFunctor);
+
+  void SetAcceptanceTest(TAcceptanceTest* const acceptanceTest);
+
+  /** Set the initial frontier: the pixels of 'pixelsToFill' (the unverified target pixels)
+    * that are next to a verified pixel. Only Valid pixels of 'targetMask' are filled. */
+  void Initialize(NNFieldType* const nnField, const Mask* const targetMask,
+                  const std::vector<itk::Index<2> >& pixelsToFill);
+
+  /** Advance the frontier by one pixel. Returns the number of pixels that were filled. */
+  unsigned int Propagate();
+
+  /** True if no pixel can be filled by further calls to Propagate(). */
+  bool IsFrontierEmpty() const;
+
+  /** Emitted with (query center, match center, score) for every filled pixel. */
+  boost::signals2::signal<void(const itk::Index<2>&, const itk::Index<2>&, const float)> AcceptedSignal;
+
+private:
+  /** True if 'pixel' is a Valid target pixel without a verified match. */
+  bool NeedsFilling(const itk::Index<2>& pixel) const;
+
+  /** Add the unverified target pixels next to 'pixel' to the next frontier. */
+  void AddNeighborsToFrontier(const itk::Index<2>& pixel);
+
+  unsigned int PatchRadius = 0;
+
+  TPatchDistanceFunctor* PatchDistanceFunctor = nullptr;
+
+  TAcceptanceTest* AcceptanceTest = nullptr;
+
+  NNFieldType* NNField = nullptr;
+
+  const Mask* TargetMask = nullptr;
+
+  /** The unverified pixels to try in the next call to Propagate(). May contain duplicates. */
+  std::vector<itk::Index<2> > Frontier;
+};
+
+#include "FrontierPropagator.hpp"
+
+#endif
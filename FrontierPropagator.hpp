@@ -0,0 +1,230 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+
+#ifndef FrontierPropagator_HPP
+#define FrontierPropagator_HPP
+
+#include "FrontierPropagator.h"
+
+// Submodules
+#include <ITKHelpers/ITKHelpers.h>
+
+// STL
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <utility>
+
+/** Orders indices in raster order, so that each step fills its pixels in the same order as a
+  * forward scan would. */
+inline bool FrontierRasterOrder(const itk::Index<2>& a, const itk::Index<2>& b)
+{
+  return (a[1] < b[1]) || (a[1] == b[1] && a[0] < b[0]);
+}
+
+template <typename TPatchDistanceFunctor, typename TAcceptanceTest>
+void FrontierPropagator<TPatchDistanceFunctor, TAcceptanceTest>::SetPatchRadius(const unsigned int patchRadius)
+{
+  this->PatchRadius = patchRadius;
+}
+
+template <typename TPatchDistanceFunctor, typename TAcceptanceTest>
+void FrontierPropagator<TPatchDistanceFunctor, TAcceptanceTest>::SetPatchDistanceFunctor(
+    TPatchDistanceFunctor* const patchDistanceFunctor)
+{
+  this->PatchDistanceFunctor = patchDistanceFunctor;
+}
+
+template <typename TPatchDistanceFunctor, typename TAcceptanceTest>
+void FrontierPropagator<TPatchDistanceFunctor, TAcceptanceTest>::SetAcceptanceTest(TAcceptanceTest* const acceptanceTest)
+{
+  this->AcceptanceTest = acceptanceTest;
+}
+
+template <typename TPatchDistanceFunctor, typename TAcceptanceTest>
+void FrontierPropagator<TPatchDistanceFunctor, TAcceptanceTest>::Initialize(
+    NNFieldType* const nnField, const Mask* const targetMask, const std::vector<itk::Index<2> >& pixelsToFill)
+{
+  this->NNField = nnField;
+  this->TargetMask = targetMask;
+  this->Frontier.clear();
+
+  const itk::ImageRegion<2> region = this->NNField->GetLargestPossibleRegion();
+  const itk::Offset<2> neighborOffsets[4] = {{{-1, 0}}, {{1, 0}}, {{0, -1}}, {{0, 1}}};
+
+  for(size_t pixelId = 0; pixelId < pixelsToFill.size(); ++pixelId)
+  {
+    const itk::Index<2>& pixel = pixelsToFill[pixelId];
+    if(!NeedsFilling(pixel))
+    {
+      continue;
+    }
+
+    for(unsigned int neighborId = 0; neighborId < 4; ++neighborId)
+    {
+      itk::Index<2> neighbor = pixel + neighborOffsets[neighborId];
+      if(region.IsInside(neighbor) && this->NNField->GetPixel(neighbor).HasVerifiedMatch())
+      {
+        this->Frontier.push_back(pixel);
+        break;
+      }
+    }
+  }
+}
+
+template <typename TPatchDistanceFunctor, typename TAcceptanceTest>
+bool FrontierPropagator<TPatchDistanceFunctor, TAcceptanceTest>::NeedsFilling(const itk::Index<2>& pixel) const
+{
+  return this->NNField->GetLargestPossibleRegion().IsInside(pixel) &&
+         this->TargetMask->IsValid(pixel) &&
+         !this->NNField->GetPixel(pixel).HasVerifiedMatch();
+}
+
+template <typename TPatchDistanceFunctor, typename TAcceptanceTest>
+void FrontierPropagator<TPatchDistanceFunctor, TAcceptanceTest>::AddNeighborsToFrontier(const itk::Index<2>& pixel)
+{
+  const itk::Offset<2> neighborOffsets[4] = {{{-1, 0}}, {{1, 0}}, {{0, -1}}, {{0, 1}}};
+  for(unsigned int neighborId = 0; neighborId < 4; ++neighborId)
+  {
+    itk::Index<2> neighbor = pixel + neighborOffsets[neighborId];
+    if(NeedsFilling(neighbor))
+    {
+      this->Frontier.push_back(neighbor);
+    }
+  }
+}
+
+template <typename TPatchDistanceFunctor, typename TAcceptanceTest>
+unsigned int FrontierPropagator<TPatchDistanceFunctor, TAcceptanceTest>::Propagate()
+{
+  assert(this->NNField);
+  assert(this->TargetMask);
+  assert(this->PatchDistanceFunctor);
+  assert(this->AcceptanceTest);
+
+  // A pixel is added once per newly verified neighbor, so remove the duplicates
+  std::vector<itk::Index<2> > candidates;
+  candidates.swap(this->Frontier);
+  std::sort(candidates.begin(), candidates.end(), FrontierRasterOrder);
+  candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+  const itk::ImageRegion<2> region = this->NNField->GetLargestPossibleRegion();
+  const itk::Offset<2> neighborOffsets[4] = {{{-1, 0}}, {{1, 0}}, {{0, -1}}, {{0, 1}}};
+
+  // Choose all of the matches before writing any of them, so that a pixel filled in this step
+  // is not used as a source until the next step.
+  std::vector<std::pair<itk::Index<2>, Match> > acceptedMatches;
+  acceptedMatches.reserve(candidates.size());
+
+  for(size_t candidateId = 0; candidateId < candidates.size(); ++candidateId)
+  {
+    const itk::Index<2>& queryPixel = candidates[candidateId];
+    if(!NeedsFilling(queryPixel))
+    {
+      continue;
+    }
+
+    itk::ImageRegion<2> queryRegion = ITKHelpers::GetRegionInRadiusAroundPixel(queryPixel, this->PatchRadius);
+
+    const MatchSet& queryMatchSet = this->NNField->GetPixel(queryPixel);
+    Match currentMatch;
+    if(queryMatchSet.GetNumberOfMatches() > 0)
+    {
+      currentMatch = queryMatchSet.GetMatch(0);
+    }
+
+    Match bestMatch;
+    float bestDistance = std::numeric_limits<float>::max();
+    bool found = false;
+
+    for(unsigned int neighborId = 0; neighborId < 4; ++neighborId)
+    {
+      itk::Index<2> neighbor = queryPixel + neighborOffsets[neighborId];
+      if(!region.IsInside(neighbor))
+      {
+        continue;
+      }
+
+      const MatchSet& neighborMatchSet = this->NNField->GetPixel(neighbor);
+      if(!neighborMatchSet.HasVerifiedMatch())
+      {
+        continue;
+      }
+
+      // Shift the neighbor's match by the offset from the neighbor to the query pixel
+      itk::ImageRegion<2> potentialRegion = neighborMatchSet.GetMatch(0).GetRegion();
+      potentialRegion.SetIndex(potentialRegion.GetIndex() + (queryPixel - neighbor));
+      if(!region.IsInside(potentialRegion))
+      {
+        continue;
+      }
+
+      Match potentialMatch;
+      potentialMatch.SetRegion(potentialRegion);
+      potentialMatch.SetScore(this->PatchDistanceFunctor->Distance(potentialRegion, queryRegion));
+
+      float score = 0.0f;
+      if(potentialMatch.GetScore() < bestDistance &&
+         this->AcceptanceTest->IsBetterWithScore(queryRegion, currentMatch, potentialMatch, score))
+      {
+        bestMatch = potentialMatch;
+        bestDistance = potentialMatch.GetScore();
+        found = true;
+      }
+    }
+
+    if(found)
+    {
+      bestMatch.SetVerified(true);
+      bestMatch.SetAllowPropagation(true);
+      acceptedMatches.push_back(std::make_pair(queryPixel, bestMatch));
+    }
+  }
+
+  for(size_t acceptedId = 0; acceptedId < acceptedMatches.size(); ++acceptedId)
+  {
+    const itk::Index<2>& queryPixel = acceptedMatches[acceptedId].first;
+    const Match& match = acceptedMatches[acceptedId].second;
+
+    // The forced match replaces the unverified matches that were there
+    MatchSet matchSet = this->NNField->GetPixel(queryPixel);
+    matchSet.Clear();
+    matchSet.AddMatch(match);
+    this->NNField->SetPixel(queryPixel, matchSet);
+
+    this->AcceptedSignal(queryPixel, ITKHelpers::GetRegionCenter(match.GetRegion()), match.GetScore());
+  }
+
+  // The next frontier is the unverified neighbors of the pixels filled in this step. Pixels that
+  // could not be filled are only tried again once one of their neighbors changes.
+  for(size_t acceptedId = 0; acceptedId < acceptedMatches.size(); ++acceptedId)
+  {
+    AddNeighborsToFrontier(acceptedMatches[acceptedId].first);
+  }
+
+  return static_cast<unsigned int>(acceptedMatches.size());
+}
+
+template <typename TPatchDistanceFunctor, typename TAcceptanceTest>
+bool FrontierPropagator<TPatchDistanceFunctor, TAcceptanceTest>::IsFrontierEmpty() const
+{
+  return this->Frontier.empty();
+}
+
+#endif
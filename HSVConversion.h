@@ -0,0 +1,46 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef HSVConversion_H
+#define HSVConversion_H
+
+// ITK
+#include "itkVectorImage.h"
+
+// STL
+#include <vector>
+
+/** RGB to HSV conversion of whole images. All three output channels are in [0,1], matching
+  * vtkMath::RGBToHSV (and so ITKHelpers::ITKImageToHSVImage). */
+namespace HSVConversion
+{
+  typedef itk::VectorImage<float, 2> HSVImageType;
+
+  /** Convert 'numberOfPixels' interleaved RGB triplets in [0,1] to interleaved HSV triplets.
+    * This is written without branches so that the compiler can vectorize it. */
+  void ConvertRGBToHSV(const float* const rgb, const size_t numberOfPixels, float* const hsv);
+
+  /** Convert every pixel of 'image' (3 components, scaled to [0,1] by the maximum of its
+    * component type if that is an integer type) into 'hsvImage', which is (re)allocated. */
+  template <typename TImage>
+  void ConvertRGBToHSV(const TImage* const image, HSVImageType* const hsvImage);
+}
+
+#include "HSVConversion.hpp"
+
+#endif
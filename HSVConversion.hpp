@@ -0,0 +1,113 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef HSVConversion_HPP
+#define HSVConversion_HPP
+
+#include "HSVConversion.h"
+
+// STL
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+namespace HSVConversion
+{
+
+inline void ConvertRGBToHSV(const float* const rgb, const size_t numberOfPixels, float* const hsv)
+{
+  const float oneSixth = 1.0f / 6.0f;
+  const float oneThird = 1.0f / 3.0f;
+  const float twoThirds = 2.0f / 3.0f;
+
+  for(size_t pixelId = 0; pixelId < numberOfPixels; ++pixelId)
+  {
+    const float r = rgb[3 * pixelId];
+    const float g = rgb[3 * pixelId + 1];
+    const float b = rgb[3 * pixelId + 2];
+
+    const float maximum = std::max(r, std::max(g, b));
+    const float minimum = std::min(r, std::min(g, b));
+    const float delta = maximum - minimum;
+
+    // Avoid dividing by zero; the results of these lanes are masked out below.
+    const float inverseDelta = 1.0f / (delta > 0.0f ? delta : 1.0f);
+    const float inverseMaximum = 1.0f / (maximum > 0.0f ? maximum : 1.0f);
+
+    // The same case order as vtkMath::RGBToHSV: red is the maximum, then green, then blue.
+    const float hueRed = oneSixth * (g - b) * inverseDelta;
+    const float hueGreen = oneThird + oneSixth * (b - r) * inverseDelta;
+    const float hueBlue = twoThirds + oneSixth * (r - g) * inverseDelta;
+    float hue = (r == maximum) ? hueRed : ((g == maximum) ? hueGreen : hueBlue);
+    hue += (hue < 0.0f) ? 1.0f : 0.0f;
+
+    const float saturation = delta * inverseMaximum;
+
+    hsv[3 * pixelId] = (saturation > 0.0f) ? hue : 0.0f;
+    hsv[3 * pixelId + 1] = saturation;
+    hsv[3 * pixelId + 2] = maximum;
+  }
+}
+
+/** The scale that maps a component type to [0,1]. */
+template <typename TComponent>
+float GetComponentScale()
+{
+  return std::numeric_limits<TComponent>::is_integer ?
+        1.0f / static_cast<float>(std::numeric_limits<TComponent>::max()) : 1.0f;
+}
+
+template <typename TImage>
+void ConvertRGBToHSV(const TImage* const image, HSVImageType* const hsvImage)
+{
+  typedef typename TImage::PixelType PixelType;
+  typedef typename PixelType::ComponentType ComponentType;
+
+  hsvImage->SetRegions(image->GetLargestPossibleRegion());
+  hsvImage->SetNumberOfComponentsPerPixel(3);
+  hsvImage->Allocate();
+
+  const float scale = GetComponentScale<ComponentType>();
+
+  const PixelType* const imageBuffer = image->GetBufferPointer();
+  float* const hsvBuffer = hsvImage->GetBufferPointer();
+  const size_t numberOfPixels = image->GetLargestPossibleRegion().GetNumberOfPixels();
+
+  // Convert in blocks so that the scaled RGB values stay in the L1 cache.
+  const size_t blockSize = 1024;
+  std::vector<float> rgbBlock(3 * blockSize);
+
+  for(size_t blockStart = 0; blockStart < numberOfPixels; blockStart += blockSize)
+  {
+    const size_t blockPixels = std::min(blockSize, numberOfPixels - blockStart);
+
+    for(size_t pixelId = 0; pixelId < blockPixels; ++pixelId)
+    {
+      const PixelType& pixel = imageBuffer[blockStart + pixelId];
+      rgbBlock[3 * pixelId] = scale * static_cast<float>(pixel[0]);
+      rgbBlock[3 * pixelId + 1] = scale * static_cast<float>(pixel[1]);
+      rgbBlock[3 * pixelId + 2] = scale * static_cast<float>(pixel[2]);
+    }
+
+    ConvertRGBToHSV(rgbBlock.data(), blockPixels, hsvBuffer + 3 * blockStart);
+  }
+}
+
+} // end namespace HSVConversion
+
+#endif
@@ -0,0 +1,142 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+
+#ifndef HoleInitializer_H
+#define HoleInitializer_H
+
+// ITK
+#include "itkImage.h"
+#include "itkImageRegion.h"
+
+// Submodules
+#include <Mask/Mask.h>
+
+// STL
+#include <string>
+#include <vector>
+
+/** Fills the hole of an image with a smooth initial guess before it is inpainted. Only the
+  * bounding box of the hole (and a one pixel border around it, which holds the known values the
+  * fill is interpolated from) is worked on, so the cost grows with the hole, not the image.
+  *
+  * PULL_PUSH averages the known pixels down a pyramid (pull) and interpolates the averages back
+  * up into the unknown pixels (push). MULTIGRID approximates the membrane (Laplace) equation that
+  * a Poisson fill with a zero guidance field solves: each coarser level is filled first and
+  * interpolated into the next finer one, which is then relaxed with a fixed number of Gauss-Seidel
+  * sweeps (see SetMultigridSweeps()). It is not iterated to convergence, so it is close to, but not
+  * the same as, the Poisson fill; it is only a starting point for the inpainting.
+  * NEAREST_BOUNDARY copies the nearest known pixel into each hole pixel and smooths the seams
+  * with a few diffusion sweeps. */
+template <typename TImage>
+class HoleInitializer
+{
+public:
+
+  enum MethodEnum {PULL_PUSH, MULTIGRID, NEAREST_BOUNDARY};
+
+  /** Get the method called 'name' (pullpush, multigrid or nearest). Throws for any other name. */
+  static MethodEnum GetMethodFromName(const std::string& name);
+
+  /** Get the name of 'method', as accepted by GetMethodFromName(). */
+  static std::string GetMethodName(const MethodEnum method);
+
+  /** Choose how the hole is filled. The default is PULL_PUSH. */
+  void SetMethod(const MethodEnum method);
+
+  /** Set the number of Gauss-Seidel sweeps at each level of MULTIGRID (8 by default). More sweeps
+    * bring the fill closer to the solution of the membrane equation. */
+  void SetMultigridSweeps(const unsigned int multigridSweeps);
+
+  /** Set the number of smoothing sweeps of NEAREST_BOUNDARY. */
+  void SetDiffusionIterations(const unsigned int diffusionIterations);
+
+  /** Copy 'image' to 'output' (which may be 'image') and fill the hole of 'mask' in it. Every
+    * pixel of 'mask' must be the hole or the valid value (see PackedMask::SetFromMask()). */
+  void Initialize(const TImage* const image, const Mask* const mask, TImage* const output);
+
+  /** Get the wall clock time of the last Initialize(). */
+  double GetSeconds() const;
+
+  /** Get the number of hole pixels the last Initialize() filled. */
+  size_t GetNumberOfHolePixels() const;
+
+  /** Get the region the last Initialize() worked on. */
+  const itk::ImageRegion<2>& GetWorkingRegion() const;
+
+private:
+
+  /** The pixels of a working region as floats. */
+  struct Grid
+  {
+    itk::SizeValueType Width = 0;
+
+    itk::SizeValueType Height = 0;
+
+    unsigned int NumberOfComponents = 0;
+
+    /** NumberOfComponents values per pixel, row by row. */
+    std::vector<float> Values;
+
+    /** How much each pixel is known: 1 outside of the hole and 0 inside it. PULL_PUSH gives the
+      * coarser levels fractional weights. */
+    std::vector<float> Weights;
+  };
+
+  /** Make 'coarse' half the size of 'fine'. Each coarse pixel is the weighted mean of the
+    * (up to) four fine pixels it covers. Its weight is the sum of theirs (at most 1), or, if
+    * 'binary', 1 if any of them is known and 0 otherwise. */
+  static void Restrict(const Grid& fine, const bool binary, Grid* const coarse);
+
+  /** Blend the bilinear interpolation of 'coarse' into each pixel of 'fine' by how unknown it is. */
+  static void Prolong(const Grid& coarse, Grid* const fine);
+
+  /** Replace each unknown pixel by the mean of its neighbors, 'sweeps' times, in red-black order. */
+  static void Relax(const unsigned int sweeps, Grid* const grid);
+
+  /** Fill 'grid' by pulling the known pixels down a pyramid and pushing them back up. */
+  static void PullPush(Grid* const grid);
+
+  /** Fill 'grid' with the membrane solution, coarsest level first. */
+  void Multigrid(Grid* const grid) const;
+
+  /** Fill 'grid' with the nearest known pixels, then smooth it. */
+  void NearestBoundary(Grid* const grid) const;
+
+  /** How the hole is filled. */
+  MethodEnum Method = PULL_PUSH;
+
+  /** The number of Gauss-Seidel sweeps at each level of MULTIGRID. */
+  unsigned int MultigridSweeps = 8;
+
+  /** The number of smoothing sweeps of NEAREST_BOUNDARY. */
+  unsigned int DiffusionIterations = 8;
+
+  /** The wall clock time of the last Initialize(). */
+  double Seconds = 0.0;
+
+  /** The number of hole pixels the last Initialize() filled. */
+  size_t NumberOfHolePixels = 0;
+
+  /** The region the last Initialize() worked on. */
+  itk::ImageRegion<2> WorkingRegion;
+};
+
+#include "HoleInitializer.hpp"
+
+#endif
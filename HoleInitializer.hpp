@@ -0,0 +1,519 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+
+#ifndef HoleInitializer_HPP
+#define HoleInitializer_HPP
+
+#include "HoleInitializer.h"
+
+// Custom
+#include "PackedMask.h"
+#include "PerformanceCounters.h"
+#include "Trace.h"
+
+// Submodules
+#include <ITKHelpers/ITKHelpers.h>
+
+// STL
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <queue>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+template <typename TImage>
+typename HoleInitializer<TImage>::MethodEnum HoleInitializer<TImage>::GetMethodFromName(const std::string& name)
+{
+  if(name == "pullpush")
+  {
+    return PULL_PUSH;
+  }
+  else if(name == "multigrid")
+  {
+    return MULTIGRID;
+  }
+  else if(name == "nearest")
+  {
+    return NEAREST_BOUNDARY;
+  }
+
+  std::cerr << "Hole initializer: " << name << std::endl;
+  throw std::runtime_error("The hole initializer must be pullpush, multigrid or nearest!");
+}
+
+template <typename TImage>
+std::string HoleInitializer<TImage>::GetMethodName(const MethodEnum method)
+{
+  switch(method)
+  {
+    case PULL_PUSH:
+      return "pullpush";
+    case MULTIGRID:
+      return "multigrid";
+    case NEAREST_BOUNDARY:
+      return "nearest";
+  }
+
+  return "";
+}
+
+template <typename TImage>
+void HoleInitializer<TImage>::SetMethod(const MethodEnum method)
+{
+  this->Method = method;
+}
+
+template <typename TImage>
+void HoleInitializer<TImage>::SetMultigridSweeps(const unsigned int multigridSweeps)
+{
+  this->MultigridSweeps = multigridSweeps;
+}
+
+template <typename TImage>
+void HoleInitializer<TImage>::SetDiffusionIterations(const unsigned int diffusionIterations)
+{
+  this->DiffusionIterations = diffusionIterations;
+}
+
+template <typename TImage>
+double HoleInitializer<TImage>::GetSeconds() const
+{
+  return this->Seconds;
+}
+
+template <typename TImage>
+size_t HoleInitializer<TImage>::GetNumberOfHolePixels() const
+{
+  return this->NumberOfHolePixels;
+}
+
+template <typename TImage>
+const itk::ImageRegion<2>& HoleInitializer<TImage>::GetWorkingRegion() const
+{
+  return this->WorkingRegion;
+}
+
+template <typename TImage>
+void HoleInitializer<TImage>::Initialize(const TImage* const image, const Mask* const mask, TImage* const output)
+{
+  BDS_TRACE_SCOPE("HoleInitializer::Initialize");
+  BDS_PERF_SCOPE("HoleInitializer::Initialize");
+
+  typedef typename TImage::PixelType PixelType;
+  typedef typename std::remove_cv<typename std::remove_reference<
+    decltype(std::declval<PixelType&>()[0])>::type>::type ComponentType;
+
+  const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+  assert(mask->GetLargestPossibleRegion() == image->GetLargestPossibleRegion());
+
+  if(output != image)
+  {
+    ITKHelpers::DeepCopy(image, output);
+  }
+
+  PackedMask packedMask;
+  packedMask.SetFromMask(mask);
+
+  const std::vector<itk::Index<2> > holePixels = packedMask.GetHolePixels();
+  this->NumberOfHolePixels = holePixels.size();
+  this->WorkingRegion = itk::ImageRegion<2>();
+
+  if(!holePixels.empty())
+  {
+    // Work on the bounding box of the hole, with a border of known pixels around it
+    this->WorkingRegion = packedMask.GetHoleBoundingBox();
+    this->WorkingRegion.PadByRadius(1);
+    this->WorkingRegion.Crop(output->GetLargestPossibleRegion());
+
+    const itk::Index<2> corner = this->WorkingRegion.GetIndex();
+
+    Grid grid;
+    grid.Width = this->WorkingRegion.GetSize()[0];
+    grid.Height = this->WorkingRegion.GetSize()[1];
+    grid.NumberOfComponents = output->GetNumberOfComponentsPerPixel();
+    grid.Values.resize(grid.Width * grid.Height * grid.NumberOfComponents);
+    grid.Weights.resize(grid.Width * grid.Height);
+
+    for(itk::SizeValueType y = 0; y < grid.Height; ++y)
+    {
+      for(itk::SizeValueType x = 0; x < grid.Width; ++x)
+      {
+        const itk::Index<2> index = {{corner[0] + static_cast<itk::IndexValueType>(x),
+                                      corner[1] + static_cast<itk::IndexValueType>(y)}};
+        const size_t pixelId = y * grid.Width + x;
+        const PixelType pixel = output->GetPixel(index);
+        for(unsigned int component = 0; component < grid.NumberOfComponents; ++component)
+        {
+          grid.Values[pixelId * grid.NumberOfComponents + component] = static_cast<float>(pixel[component]);
+        }
+        grid.Weights[pixelId] = mask->IsValid(index) ? 1.0f : 0.0f;
+      }
+    }
+
+    switch(this->Method)
+    {
+      case PULL_PUSH:
+        PullPush(&grid);
+        break;
+      case MULTIGRID:
+        Multigrid(&grid);
+        break;
+      case NEAREST_BOUNDARY:
+        NearestBoundary(&grid);
+        break;
+    }
+
+    for(size_t pixelId = 0; pixelId < holePixels.size(); ++pixelId)
+    {
+      const itk::Index<2> index = holePixels[pixelId];
+      const size_t gridPixelId = (index[1] - corner[1]) * grid.Width + (index[0] - corner[0]);
+
+      // Start from the old pixel so that a VariableLengthVector has the right length
+      PixelType pixel = output->GetPixel(index);
+      for(unsigned int component = 0; component < grid.NumberOfComponents; ++component)
+      {
+        const float value = grid.Values[gridPixelId * grid.NumberOfComponents + component];
+        pixel[component] = std::is_integral<ComponentType>::value ?
+              static_cast<ComponentType>(std::round(value)) : static_cast<ComponentType>(value);
+      }
+      output->SetPixel(index, pixel);
+    }
+  }
+
+  this->Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+template <typename TImage>
+void HoleInitializer<TImage>::Restrict(const Grid& fine, const bool binary, Grid* const coarse)
+{
+  const unsigned int numberOfComponents = fine.NumberOfComponents;
+
+  coarse->Width = (fine.Width + 1) / 2;
+  coarse->Height = (fine.Height + 1) / 2;
+  coarse->NumberOfComponents = numberOfComponents;
+  coarse->Values.assign(coarse->Width * coarse->Height * numberOfComponents, 0.0f);
+  coarse->Weights.assign(coarse->Width * coarse->Height, 0.0f);
+
+  for(itk::SizeValueType y = 0; y < coarse->Height; ++y)
+  {
+    for(itk::SizeValueType x = 0; x < coarse->Width; ++x)
+    {
+      const size_t coarsePixelId = y * coarse->Width + x;
+      float* const coarseValue = &coarse->Values[coarsePixelId * numberOfComponents];
+
+      float weightSum = 0.0f;
+      unsigned int numberOfKnownChildren = 0;
+      for(itk::SizeValueType fineY = 2 * y; fineY < std::min(2 * y + 2, fine.Height); ++fineY)
+      {
+        for(itk::SizeValueType fineX = 2 * x; fineX < std::min(2 * x + 2, fine.Width); ++fineX)
+        {
+          const size_t finePixelId = fineY * fine.Width + fineX;
+          const float weight = fine.Weights[finePixelId];
+
+          if(weight >= 1.0f)
+          {
+            numberOfKnownChildren++;
+          }
+
+          weightSum += weight;
+          for(unsigned int component = 0; component < numberOfComponents; ++component)
+          {
+            coarseValue[component] += weight * fine.Values[finePixelId * numberOfComponents + component];
+          }
+        }
+      }
+
+      if(weightSum > 0.0f)
+      {
+        for(unsigned int component = 0; component < numberOfComponents; ++component)
+        {
+          coarseValue[component] /= weightSum;
+        }
+      }
+
+      if(binary)
+      {
+        coarse->Weights[coarsePixelId] = (numberOfKnownChildren > 0) ? 1.0f : 0.0f;
+      }
+      else
+      {
+        coarse->Weights[coarsePixelId] = std::min(weightSum, 1.0f);
+      }
+    }
+  }
+}
+
+template <typename TImage>
+void HoleInitializer<TImage>::Prolong(const Grid& coarse, Grid* const fine)
+{
+  const unsigned int numberOfComponents = fine->NumberOfComponents;
+
+  for(itk::SizeValueType y = 0; y < fine->Height; ++y)
+  {
+    // The center of fine pixel y is at (y + 0.5) / 2 - 0.5 in coarse pixels
+    const float coarseY = std::min(std::max((y + 0.5f) * 0.5f - 0.5f, 0.0f), static_cast<float>(coarse.Height - 1));
+    const itk::SizeValueType y0 = static_cast<itk::SizeValueType>(coarseY);
+    const itk::SizeValueType y1 = std::min(y0 + 1, coarse.Height - 1);
+    const float ty = coarseY - y0;
+
+    for(itk::SizeValueType x = 0; x < fine->Width; ++x)
+    {
+      const size_t finePixelId = y * fine->Width + x;
+      const float weight = fine->Weights[finePixelId];
+      if(weight >= 1.0f)
+      {
+        continue;
+      }
+
+      const float coarseX = std::min(std::max((x + 0.5f) * 0.5f - 0.5f, 0.0f), static_cast<float>(coarse.Width - 1));
+      const itk::SizeValueType x0 = static_cast<itk::SizeValueType>(coarseX);
+      const itk::SizeValueType x1 = std::min(x0 + 1, coarse.Width - 1);
+      const float tx = coarseX - x0;
+
+      const float* const value00 = &coarse.Values[(y0 * coarse.Width + x0) * numberOfComponents];
+      const float* const value10 = &coarse.Values[(y0 * coarse.Width + x1) * numberOfComponents];
+      const float* const value01 = &coarse.Values[(y1 * coarse.Width + x0) * numberOfComponents];
+      const float* const value11 = &coarse.Values[(y1 * coarse.Width + x1) * numberOfComponents];
+      float* const fineValue = &fine->Values[finePixelId * numberOfComponents];
+
+      for(unsigned int component = 0; component < numberOfComponents; ++component)
+      {
+        const float interpolated = (1.0f - ty) * ((1.0f - tx) * value00[component] + tx * value10[component]) +
+                                   ty * ((1.0f - tx) * value01[component] + tx * value11[component]);
+        fineValue[component] = weight * fineValue[component] + (1.0f - weight) * interpolated;
+      }
+    }
+  }
+}
+
+template <typename TImage>
+void HoleInitializer<TImage>::Relax(const unsigned int sweeps, Grid* const grid)
+{
+  const unsigned int numberOfComponents = grid->NumberOfComponents;
+  std::vector<float> sums(numberOfComponents);
+
+  for(unsigned int sweep = 0; sweep < sweeps; ++sweep)
+  {
+    // Red-black order, so that a sweep does not depend on the direction it runs in
+    for(unsigned int color = 0; color < 2; ++color)
+    {
+      for(itk::SizeValueType y = 0; y < grid->Height; ++y)
+      {
+        for(itk::SizeValueType x = (y + color) % 2; x < grid->Width; x += 2)
+        {
+          const size_t pixelId = y * grid->Width + x;
+          if(grid->Weights[pixelId] >= 1.0f)
+          {
+            continue;
+          }
+
+          // The edges of the grid have no neighbors beyond them (a zero normal derivative)
+          size_t neighborIds[4];
+          unsigned int numberOfNeighbors = 0;
+          if(x > 0)
+          {
+            neighborIds[numberOfNeighbors++] = pixelId - 1;
+          }
+          if(x + 1 < grid->Width)
+          {
+            neighborIds[numberOfNeighbors++] = pixelId + 1;
+          }
+          if(y > 0)
+          {
+            neighborIds[numberOfNeighbors++] = pixelId - grid->Width;
+          }
+          if(y + 1 < grid->Height)
+          {
+            neighborIds[numberOfNeighbors++] = pixelId + grid->Width;
+          }
+
+          if(numberOfNeighbors == 0)
+          {
+            continue;
+          }
+
+          std::fill(sums.begin(), sums.end(), 0.0f);
+          for(unsigned int neighborId = 0; neighborId < numberOfNeighbors; ++neighborId)
+          {
+            for(unsigned int component = 0; component < numberOfComponents; ++component)
+            {
+              sums[component] += grid->Values[neighborIds[neighborId] * numberOfComponents + component];
+            }
+          }
+
+          for(unsigned int component = 0; component < numberOfComponents; ++component)
+          {
+            grid->Values[pixelId * numberOfComponents + component] = sums[component] / numberOfNeighbors;
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename TImage>
+void HoleInitializer<TImage>::PullPush(Grid* const grid)
+{
+  BDS_TRACE_SCOPE("HoleInitializer::PullPush");
+
+  // Pull: average the known pixels down to a single pixel
+  std::vector<Grid> levels;
+  levels.push_back(std::move(*grid));
+  while(levels.back().Width > 1 || levels.back().Height > 1)
+  {
+    Grid coarse;
+    Restrict(levels.back(), false, &coarse);
+    levels.push_back(std::move(coarse));
+  }
+
+  // Push: fill the unknown part of each level from the level below it
+  for(size_t level = levels.size() - 1; level > 0; --level)
+  {
+    Prolong(levels[level], &levels[level - 1]);
+  }
+
+  *grid = std::move(levels[0]);
+}
+
+template <typename TImage>
+void HoleInitializer<TImage>::Multigrid(Grid* const grid) const
+{
+  if(std::max(grid->Width, grid->Height) > 4)
+  {
+    // A coarse pixel is fixed if any of the fine pixels it covers is known, so that the one pixel
+    // border of known pixels is kept at every level
+    Grid coarse;
+    Restrict(*grid, true, &coarse);
+    Multigrid(&coarse);
+
+    Prolong(coarse, grid);
+    Relax(this->MultigridSweeps, grid);
+    return;
+  }
+
+  // The coarsest level starts from the mean of its known pixels
+  const unsigned int numberOfComponents = grid->NumberOfComponents;
+  std::vector<float> means(numberOfComponents, 0.0f);
+  unsigned int numberOfKnownPixels = 0;
+  for(size_t pixelId = 0; pixelId < grid->Weights.size(); ++pixelId)
+  {
+    if(grid->Weights[pixelId] >= 1.0f)
+    {
+      numberOfKnownPixels++;
+      for(unsigned int component = 0; component < numberOfComponents; ++component)
+      {
+        means[component] += grid->Values[pixelId * numberOfComponents + component];
+      }
+    }
+  }
+
+  for(size_t pixelId = 0; pixelId < grid->Weights.size(); ++pixelId)
+  {
+    if(grid->Weights[pixelId] < 1.0f)
+    {
+      for(unsigned int component = 0; component < numberOfComponents; ++component)
+      {
+        grid->Values[pixelId * numberOfComponents + component] =
+          numberOfKnownPixels > 0 ? means[component] / numberOfKnownPixels : 0.0f;
+      }
+    }
+  }
+
+  // It is tiny, so relax it much further than the finer levels
+  Relax(4 * this->MultigridSweeps, grid);
+}
+
+template <typename TImage>
+void HoleInitializer<TImage>::NearestBoundary(Grid* const grid) const
+{
+  BDS_TRACE_SCOPE("HoleInitializer::NearestBoundary");
+
+  const unsigned int numberOfComponents = grid->NumberOfComponents;
+  const size_t numberOfPixels = grid->Weights.size();
+
+  // Grow the known pixels into the hole breadth first, so that each hole pixel finds the
+  // known pixel the fewest steps away.
+  std::vector<size_t> nearestKnownPixels(numberOfPixels, numberOfPixels);
+  std::queue<size_t> front;
+  for(size_t pixelId = 0; pixelId < numberOfPixels; ++pixelId)
+  {
+    if(grid->Weights[pixelId] >= 1.0f)
+    {
+      nearestKnownPixels[pixelId] = pixelId;
+      front.push(pixelId);
+    }
+  }
+
+  while(!front.empty())
+  {
+    const size_t pixelId = front.front();
+    front.pop();
+
+    const itk::SizeValueType x = pixelId % grid->Width;
+    const itk::SizeValueType y = pixelId / grid->Width;
+
+    size_t neighborIds[4];
+    unsigned int numberOfNeighbors = 0;
+    if(x > 0)
+    {
+      neighborIds[numberOfNeighbors++] = pixelId - 1;
+    }
+    if(x + 1 < grid->Width)
+    {
+      neighborIds[numberOfNeighbors++] = pixelId + 1;
+    }
+    if(y > 0)
+    {
+      neighborIds[numberOfNeighbors++] = pixelId - grid->Width;
+    }
+    if(y + 1 < grid->Height)
+    {
+      neighborIds[numberOfNeighbors++] = pixelId + grid->Width;
+    }
+
+    for(unsigned int neighborId = 0; neighborId < numberOfNeighbors; ++neighborId)
+    {
+      if(nearestKnownPixels[neighborIds[neighborId]] == numberOfPixels)
+      {
+        nearestKnownPixels[neighborIds[neighborId]] = nearestKnownPixels[pixelId];
+        front.push(neighborIds[neighborId]);
+      }
+    }
+  }
+
+  for(size_t pixelId = 0; pixelId < numberOfPixels; ++pixelId)
+  {
+    const size_t nearestKnownPixel = nearestKnownPixels[pixelId];
+    if(grid->Weights[pixelId] < 1.0f && nearestKnownPixel < numberOfPixels)
+    {
+      std::copy(grid->Values.begin() + nearestKnownPixel * numberOfComponents,
+                grid->Values.begin() + (nearestKnownPixel + 1) * numberOfComponents,
+                grid->Values.begin() + pixelId * numberOfComponents);
+    }
+  }
+
+  // Smooth the seams between the pixels that copied different known pixels
+  Relax(this->DiffusionIterations, grid);
+}
+
+#endif
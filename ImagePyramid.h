@@ -0,0 +1,143 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+
+#ifndef ImagePyramid_H
+#define ImagePyramid_H
+
+// ITK
+#include "itkImage.h"
+#include "itkImageRegion.h"
+
+// Submodules
+#include <Mask/Mask.h>
+
+// STL
+#include <vector>
+
+/** A resolution pyramid of an image and a mask. Level 0 is the original resolution and each
+  * further level is DownsampleFactor times the size of the one before it. The image levels are
+  * box filtered (each coarse pixel is the mean of the fine pixels it covers) so that they do not
+  * alias. The mask levels are conservative: a coarse pixel is a hole if any of the fine pixels it
+  * covers is not valid, so a valid coarse patch only ever covers valid fine pixels.
+  *
+  * All image levels share one contiguous buffer, as do all mask levels and all source mask
+  * levels. The image levels are only rebuilt by Update() when the image or the parameters have
+  * changed, so the same pyramid can be used for several masks of the same image. The levels are
+  * owned by the pyramid and must not be modified. */
+template <typename TImage>
+class ImagePyramid
+{
+public:
+
+  /** Set how much each level is downsampled from the one before it. */
+  void SetDownsampleFactor(const float downsampleFactor);
+
+  /** Set the number of levels to build, including the original resolution. */
+  void SetMaximumNumberOfLevels(const unsigned int maximumNumberOfLevels);
+
+  /** Set the smallest width or height a level may have. Levels that would be smaller are not built. */
+  void SetMinimumSize(const itk::SizeValueType minimumSize);
+
+  /** Set the image to build the pyramid of. The pyramid is rebuilt by the next Update(). */
+  void SetImage(const TImage* const image);
+
+  /** Build the image levels if the image or the parameters have changed since the last Update(). */
+  void Update();
+
+  /** Build the mask levels for the current image levels. Call this after Update(). */
+  void SetMask(const Mask* const mask);
+
+  /** Build the source mask levels for the current image levels, or clear them if 'sourceMask' is
+    * nullptr. Like the mask levels, they are conservative: a coarse pixel is only a valid source if
+    * all of the fine pixels it covers are. Call this after Update(). */
+  void SetSourceMask(const Mask* const sourceMask);
+
+  /** Get the number of levels that were built. */
+  unsigned int GetNumberOfLevels() const;
+
+  /** Get the image at 'level'. */
+  TImage* GetImage(const unsigned int level) const;
+
+  /** Get the mask at 'level'. */
+  Mask* GetMask(const unsigned int level) const;
+
+  /** Get the source mask at 'level', or nullptr if no source mask was set. */
+  Mask* GetSourceMask(const unsigned int level) const;
+
+  /** Get the number of bytes held by the image and mask buffers. */
+  size_t GetMemorySize() const;
+
+private:
+
+  /** For each pixel of a coarse line, find the range [begin, end) of the fine pixels it covers. */
+  static void ComputeFootprints(const itk::SizeValueType fineLength, const itk::SizeValueType coarseLength,
+                                std::vector<itk::IndexValueType>* const begins,
+                                std::vector<itk::IndexValueType>* const ends);
+
+  /** Set each pixel of 'coarseImage' to the mean of the pixels of 'fineImage' it covers. */
+  static void DownsampleImage(const TImage* const fineImage, TImage* const coarseImage);
+
+  /** Make each pixel of 'coarseMask' a hole if any pixel of 'fineMask' it covers is not valid. */
+  static void DownsampleMask(const Mask* const fineMask, Mask* const coarseMask);
+
+  /** Build the levels of 'mask' in 'buffer'. */
+  void BuildMaskLevels(const Mask* const mask, std::vector<Mask::PixelType>* const buffer,
+                       std::vector<Mask::Pointer>* const levels) const;
+
+  /** Make 'image' use 'numberOfElements' elements of 'buffer' as its pixels. */
+  template <typename TLevelImage, typename TElement>
+  static void ImportBuffer(TElement* const buffer, const size_t numberOfElements, TLevelImage* const image);
+
+  /** How much each level is downsampled from the one before it. */
+  float DownsampleFactor = 0.5f;
+
+  /** The number of levels to build. */
+  unsigned int MaximumNumberOfLevels = 3;
+
+  /** The smallest width or height of a level. */
+  itk::SizeValueType MinimumSize = 1;
+
+  /** The image to build the pyramid of. */
+  const TImage* Image = nullptr;
+
+  /** True if the image levels have to be rebuilt. */
+  bool Modified = true;
+
+  /** The pixels of every image level, finest first. */
+  std::vector<typename TImage::InternalPixelType> ImageBuffer;
+
+  /** The pixels of every mask level, finest first. */
+  std::vector<Mask::PixelType> MaskBuffer;
+
+  /** The pixels of every source mask level, finest first. */
+  std::vector<Mask::PixelType> SourceMaskBuffer;
+
+  /** The image levels, which use ImageBuffer. */
+  std::vector<typename TImage::Pointer> ImageLevels;
+
+  /** The mask levels, which use MaskBuffer. */
+  std::vector<Mask::Pointer> MaskLevels;
+
+  /** The source mask levels, which use SourceMaskBuffer. Empty if no source mask was set. */
+  std::vector<Mask::Pointer> SourceMaskLevels;
+};
+
+#include "ImagePyramid.hpp"
+
+#endif
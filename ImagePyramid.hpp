@@ -0,0 +1,383 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+
+#ifndef ImagePyramid_HPP
+#define ImagePyramid_HPP
+
+#include "ImagePyramid.h"
+
+// Custom
+#include "Trace.h"
+
+// STL
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+template <typename TImage>
+void ImagePyramid<TImage>::SetDownsampleFactor(const float downsampleFactor)
+{
+  if(downsampleFactor <= 0.0f || downsampleFactor >= 1.0f)
+  {
+    std::cerr << "DownsampleFactor: " << downsampleFactor << std::endl;
+    throw std::runtime_error("DownsampleFactor must be in (0, 1)!");
+  }
+
+  if(downsampleFactor != this->DownsampleFactor)
+  {
+    this->DownsampleFactor = downsampleFactor;
+    this->Modified = true;
+  }
+}
+
+template <typename TImage>
+void ImagePyramid<TImage>::SetMaximumNumberOfLevels(const unsigned int maximumNumberOfLevels)
+{
+  if(maximumNumberOfLevels < 1)
+  {
+    std::cerr << "MaximumNumberOfLevels: " << maximumNumberOfLevels << std::endl;
+    throw std::runtime_error("MaximumNumberOfLevels must be >= 1!");
+  }
+
+  if(maximumNumberOfLevels != this->MaximumNumberOfLevels)
+  {
+    this->MaximumNumberOfLevels = maximumNumberOfLevels;
+    this->Modified = true;
+  }
+}
+
+template <typename TImage>
+void ImagePyramid<TImage>::SetMinimumSize(const itk::SizeValueType minimumSize)
+{
+  // Every level must have at least one pixel
+  const itk::SizeValueType clampedMinimumSize = std::max<itk::SizeValueType>(minimumSize, 1);
+
+  if(clampedMinimumSize != this->MinimumSize)
+  {
+    this->MinimumSize = clampedMinimumSize;
+    this->Modified = true;
+  }
+}
+
+template <typename TImage>
+void ImagePyramid<TImage>::SetImage(const TImage* const image)
+{
+  this->Image = image;
+  this->Modified = true;
+}
+
+template <typename TImage>
+void ImagePyramid<TImage>::Update()
+{
+  if(!this->Modified)
+  {
+    return;
+  }
+
+  BDS_TRACE_SCOPE("ImagePyramid::Update");
+
+  assert(this->Image);
+
+  // Find the size of every level first, so that the buffer is allocated once
+  std::vector<itk::ImageRegion<2> > regions(1, this->Image->GetLargestPossibleRegion());
+  while(regions.size() < this->MaximumNumberOfLevels)
+  {
+    const itk::Size<2> previousSize = regions.back().GetSize();
+    itk::Size<2> size;
+    size[0] = static_cast<itk::SizeValueType>(previousSize[0] * this->DownsampleFactor);
+    size[1] = static_cast<itk::SizeValueType>(previousSize[1] * this->DownsampleFactor);
+
+    if(size[0] < this->MinimumSize || size[1] < this->MinimumSize)
+    {
+      break;
+    }
+
+    itk::Index<2> corner = {{0, 0}};
+    regions.push_back(itk::ImageRegion<2>(corner, size));
+  }
+
+  // A VectorImage has several buffer elements per pixel
+  const size_t numberOfPixels = regions[0].GetNumberOfPixels();
+  const size_t elementsPerPixel = numberOfPixels > 0 ?
+        this->Image->GetPixelContainer()->Size() / numberOfPixels : 1;
+
+  size_t numberOfElements = 0;
+  for(size_t level = 0; level < regions.size(); ++level)
+  {
+    numberOfElements += regions[level].GetNumberOfPixels() * elementsPerPixel;
+  }
+
+  // The old levels use the old buffer, so they go first
+  this->ImageLevels.clear();
+  this->MaskLevels.clear();
+  this->SourceMaskLevels.clear();
+  this->ImageBuffer.resize(numberOfElements);
+
+  size_t offset = 0;
+  for(size_t level = 0; level < regions.size(); ++level)
+  {
+    const size_t levelElements = regions[level].GetNumberOfPixels() * elementsPerPixel;
+
+    typename TImage::Pointer levelImage = TImage::New();
+    levelImage->SetRegions(regions[level]);
+    levelImage->SetNumberOfComponentsPerPixel(this->Image->GetNumberOfComponentsPerPixel());
+    ImportBuffer(this->ImageBuffer.data() + offset, levelElements, levelImage.GetPointer());
+
+    if(level == 0)
+    {
+      std::copy(this->Image->GetBufferPointer(), this->Image->GetBufferPointer() + levelElements,
+                this->ImageBuffer.data());
+    }
+    else
+    {
+      DownsampleImage(this->ImageLevels[level - 1].GetPointer(), levelImage.GetPointer());
+    }
+
+    this->ImageLevels.push_back(levelImage);
+    offset += levelElements;
+  }
+
+  this->Modified = false;
+}
+
+template <typename TImage>
+void ImagePyramid<TImage>::SetMask(const Mask* const mask)
+{
+  BDS_TRACE_SCOPE("ImagePyramid::SetMask");
+
+  BuildMaskLevels(mask, &this->MaskBuffer, &this->MaskLevels);
+}
+
+template <typename TImage>
+void ImagePyramid<TImage>::SetSourceMask(const Mask* const sourceMask)
+{
+  BDS_TRACE_SCOPE("ImagePyramid::SetSourceMask");
+
+  if(!sourceMask)
+  {
+    this->SourceMaskLevels.clear();
+    this->SourceMaskBuffer.clear();
+    return;
+  }
+
+  BuildMaskLevels(sourceMask, &this->SourceMaskBuffer, &this->SourceMaskLevels);
+}
+
+template <typename TImage>
+void ImagePyramid<TImage>::BuildMaskLevels(const Mask* const mask, std::vector<Mask::PixelType>* const buffer,
+                                           std::vector<Mask::Pointer>* const levels) const
+{
+  assert(!this->Modified);
+
+  if(this->ImageLevels.empty() ||
+     mask->GetLargestPossibleRegion() != this->ImageLevels[0]->GetLargestPossibleRegion())
+  {
+    throw std::runtime_error("ImagePyramid: the mask must have the region of the image!");
+  }
+
+  size_t numberOfPixels = 0;
+  for(size_t level = 0; level < this->ImageLevels.size(); ++level)
+  {
+    numberOfPixels += this->ImageLevels[level]->GetLargestPossibleRegion().GetNumberOfPixels();
+  }
+
+  levels->clear();
+  buffer->resize(numberOfPixels);
+
+  size_t offset = 0;
+  for(size_t level = 0; level < this->ImageLevels.size(); ++level)
+  {
+    const itk::ImageRegion<2> region = this->ImageLevels[level]->GetLargestPossibleRegion();
+
+    Mask::Pointer levelMask = Mask::New();
+    levelMask->SetRegions(region);
+    ImportBuffer(buffer->data() + offset, region.GetNumberOfPixels(), levelMask.GetPointer());
+    levelMask->CopyInformationFrom(mask);
+
+    if(level == 0)
+    {
+      std::copy(mask->GetBufferPointer(), mask->GetBufferPointer() + region.GetNumberOfPixels(),
+                buffer->data());
+    }
+    else
+    {
+      DownsampleMask((*levels)[level - 1].GetPointer(), levelMask.GetPointer());
+    }
+
+    levels->push_back(levelMask);
+    offset += region.GetNumberOfPixels();
+  }
+}
+
+template <typename TImage>
+unsigned int ImagePyramid<TImage>::GetNumberOfLevels() const
+{
+  return this->ImageLevels.size();
+}
+
+template <typename TImage>
+TImage* ImagePyramid<TImage>::GetImage(const unsigned int level) const
+{
+  return this->ImageLevels[level];
+}
+
+template <typename TImage>
+Mask* ImagePyramid<TImage>::GetMask(const unsigned int level) const
+{
+  return this->MaskLevels[level];
+}
+
+template <typename TImage>
+Mask* ImagePyramid<TImage>::GetSourceMask(const unsigned int level) const
+{
+  if(this->SourceMaskLevels.empty())
+  {
+    return nullptr;
+  }
+
+  return this->SourceMaskLevels[level];
+}
+
+template <typename TImage>
+size_t ImagePyramid<TImage>::GetMemorySize() const
+{
+  return this->ImageBuffer.size() * sizeof(typename TImage::InternalPixelType) +
+         (this->MaskBuffer.size() + this->SourceMaskBuffer.size()) * sizeof(Mask::PixelType);
+}
+
+template <typename TImage>
+void ImagePyramid<TImage>::ComputeFootprints(const itk::SizeValueType fineLength,
+                                             const itk::SizeValueType coarseLength,
+                                             std::vector<itk::IndexValueType>* const begins,
+                                             std::vector<itk::IndexValueType>* const ends)
+{
+  assert(coarseLength > 0 && coarseLength <= fineLength);
+
+  // The footprints tile the fine line exactly, so every fine pixel contributes to one coarse pixel
+  begins->resize(coarseLength);
+  ends->resize(coarseLength);
+  for(itk::SizeValueType coarse = 0; coarse < coarseLength; ++coarse)
+  {
+    (*begins)[coarse] = static_cast<itk::IndexValueType>(coarse * fineLength / coarseLength);
+    (*ends)[coarse] = static_cast<itk::IndexValueType>((coarse + 1) * fineLength / coarseLength);
+  }
+}
+
+template <typename TImage>
+void ImagePyramid<TImage>::DownsampleImage(const TImage* const fineImage, TImage* const coarseImage)
+{
+  typedef typename TImage::PixelType PixelType;
+  typedef typename std::remove_cv<typename std::remove_reference<
+    decltype(std::declval<PixelType&>()[0])>::type>::type ComponentType;
+
+  const itk::ImageRegion<2> fineRegion = fineImage->GetLargestPossibleRegion();
+  const itk::ImageRegion<2> coarseRegion = coarseImage->GetLargestPossibleRegion();
+
+  std::vector<itk::IndexValueType> xBegins, xEnds, yBegins, yEnds;
+  ComputeFootprints(fineRegion.GetSize()[0], coarseRegion.GetSize()[0], &xBegins, &xEnds);
+  ComputeFootprints(fineRegion.GetSize()[1], coarseRegion.GetSize()[1], &yBegins, &yEnds);
+
+  const unsigned int numberOfComponents = fineImage->GetNumberOfComponentsPerPixel();
+  std::vector<double> sums(numberOfComponents);
+
+  for(itk::SizeValueType y = 0; y < coarseRegion.GetSize()[1]; ++y)
+  {
+    for(itk::SizeValueType x = 0; x < coarseRegion.GetSize()[0]; ++x)
+    {
+      std::fill(sums.begin(), sums.end(), 0.0);
+
+      for(itk::IndexValueType fineY = yBegins[y]; fineY < yEnds[y]; ++fineY)
+      {
+        for(itk::IndexValueType fineX = xBegins[x]; fineX < xEnds[x]; ++fineX)
+        {
+          const itk::Index<2> fineIndex = {{fineRegion.GetIndex()[0] + fineX, fineRegion.GetIndex()[1] + fineY}};
+          const PixelType finePixel = fineImage->GetPixel(fineIndex);
+          for(unsigned int component = 0; component < numberOfComponents; ++component)
+          {
+            sums[component] += finePixel[component];
+          }
+        }
+      }
+
+      const double count = static_cast<double>((yEnds[y] - yBegins[y]) * (xEnds[x] - xBegins[x]));
+
+      // Start from a fine pixel so that a VariableLengthVector has the right length
+      const itk::Index<2> firstFineIndex = {{fineRegion.GetIndex()[0] + xBegins[x],
+                                             fineRegion.GetIndex()[1] + yBegins[y]}};
+      PixelType coarsePixel = fineImage->GetPixel(firstFineIndex);
+      for(unsigned int component = 0; component < numberOfComponents; ++component)
+      {
+        const double mean = sums[component] / count;
+        coarsePixel[component] = std::is_integral<ComponentType>::value ?
+              static_cast<ComponentType>(std::round(mean)) : static_cast<ComponentType>(mean);
+      }
+
+      const itk::Index<2> coarseIndex = {{coarseRegion.GetIndex()[0] + static_cast<itk::IndexValueType>(x),
+                                          coarseRegion.GetIndex()[1] + static_cast<itk::IndexValueType>(y)}};
+      coarseImage->SetPixel(coarseIndex, coarsePixel);
+    }
+  }
+}
+
+template <typename TImage>
+void ImagePyramid<TImage>::DownsampleMask(const Mask* const fineMask, Mask* const coarseMask)
+{
+  const itk::ImageRegion<2> fineRegion = fineMask->GetLargestPossibleRegion();
+  const itk::ImageRegion<2> coarseRegion = coarseMask->GetLargestPossibleRegion();
+
+  std::vector<itk::IndexValueType> xBegins, xEnds, yBegins, yEnds;
+  ComputeFootprints(fineRegion.GetSize()[0], coarseRegion.GetSize()[0], &xBegins, &xEnds);
+  ComputeFootprints(fineRegion.GetSize()[1], coarseRegion.GetSize()[1], &yBegins, &yEnds);
+
+  for(itk::SizeValueType y = 0; y < coarseRegion.GetSize()[1]; ++y)
+  {
+    for(itk::SizeValueType x = 0; x < coarseRegion.GetSize()[0]; ++x)
+    {
+      bool hole = false;
+      for(itk::IndexValueType fineY = yBegins[y]; fineY < yEnds[y] && !hole; ++fineY)
+      {
+        for(itk::IndexValueType fineX = xBegins[x]; fineX < xEnds[x] && !hole; ++fineX)
+        {
+          const itk::Index<2> fineIndex = {{fineRegion.GetIndex()[0] + fineX, fineRegion.GetIndex()[1] + fineY}};
+          hole = !fineMask->IsValid(fineIndex);
+        }
+      }
+
+      const itk::Index<2> coarseIndex = {{coarseRegion.GetIndex()[0] + static_cast<itk::IndexValueType>(x),
+                                          coarseRegion.GetIndex()[1] + static_cast<itk::IndexValueType>(y)}};
+      coarseMask->SetPixel(coarseIndex, hole ? coarseMask->GetHoleValue() : coarseMask->GetValidValue());
+    }
+  }
+}
+
+template <typename TImage>
+template <typename TLevelImage, typename TElement>
+void ImagePyramid<TImage>::ImportBuffer(TElement* const buffer, const size_t numberOfElements,
+                                        TLevelImage* const image)
+{
+  // The pyramid owns the memory, so the container must not free it
+  typename TLevelImage::PixelContainer::Pointer pixelContainer = TLevelImage::PixelContainer::New();
+  pixelContainer->SetImportPointer(buffer, numberOfElements, false);
+  image->SetPixelContainer(pixelContainer);
+}
+
+#endif
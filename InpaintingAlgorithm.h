@@ -32,6 +32,28 @@
 
 // Custom
 #include <Compositor.h>
+#include "InpaintingStatistics.h"
+#include "PackedMask.h"
+
+// STL
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/** Describes how far an Inpaint() call has progressed. This is passed to the progress callback. */
+struct InpaintingProgress
+{
+  /** The phase that is about to run, e.g. "BDSInpainting::Iteration". */
+  std::string Phase;
+
+  /** An estimate of the fraction [0,1] of the run that has been completed. */
+  float FractionComplete = 0.0f;
+
+  /** The wall clock time since Inpaint() started. */
+  double ElapsedSeconds = 0.0;
+};
 
 /** This class provides an interface which accepts and stores typical paramaters to an inpainting
   * algorithm (masks, image, patch radius, etc).
@@ -59,11 +81,71 @@ public:
   /** Set the image to fill. */
   void SetImage(TImage* const image);
 
-  /** Set the mask that indicates where to fill the image. Pixels in the Hole region should be filled.*/
+  /** Set the mask that indicates where to fill the image. Pixels in the Hole region should be filled.
+    * Every pixel must be either the hole value or the valid value (see PackedMask::SetFromMask()). */
   void SetInpaintingMask(Mask* const mask);
 
+  /** Get the counters (patch distance evaluations, acceptance rates, etc.) of the last Inpaint(). */
+  InpaintingStatistics GetStatistics() const;
+
+  /** Called between the steps of Inpaint(). Return false to cancel the run. */
+  typedef std::function<bool(const InpaintingProgress&)> ProgressCallbackType;
+
+  /** Set a function to be called between the steps of Inpaint(), e.g. to update a progress bar
+    * or to cancel the run from a user interface. It is only called on the thread that called
+    * Inpaint(), so it may use thread-affine (e.g. user interface) state. */
+  void SetProgressCallback(const ProgressCallbackType& progressCallback);
+
+  /** Set the wall clock time (in seconds) Inpaint() may take. When it is exceeded, the remaining
+    * steps are skipped and the output is composited from the current nearest neighbor field.
+    * The budget is checked between steps, so a run can exceed it by up to one step.
+    * Zero (the default) means no limit. */
+  void SetTimeBudget(const double seconds);
+
+  /** Why the last Inpaint() returned. */
+  enum StopReasonEnum {COMPLETED, CANCELLED, TIME_BUDGET_EXCEEDED};
+
+  /** Get why the last Inpaint() returned. */
+  StopReasonEnum GetStopReason() const;
+
+  /** Get how complete the output of the last Inpaint() is, in [0,1]. This is 1 if the run
+    * completed. For BDSInpainting it is the fraction of the iterations that were run; for
+    * BDSInpaintingRings it is the fraction of the hole that was filled from verified matches. */
+  float GetCompleteness() const;
+
 protected:
 
+  /** Start the clock and clear the stop reason. Call this at the beginning of Inpaint(). */
+  void StartRun();
+
+  /** Report progress to the callback and check the time budget. Returns true if the run
+    * should stop. Once this has returned true it keeps returning true until StartRun().
+    * It may be called from several threads at once. Only the thread that called StartRun()
+    * calls the callback; the others only check the time budget and whether the run has
+    * already been stopped. */
+  bool ShouldStop(const std::string& phase, const float fractionComplete);
+
+  /** The function to call between steps. */
+  ProgressCallbackType ProgressCallback;
+
+  /** The wall clock time Inpaint() may take, in seconds. Zero means no limit. */
+  double TimeBudget = 0.0;
+
+  /** When the current Inpaint() started. */
+  std::chrono::steady_clock::time_point StartTime;
+
+  /** Why the last Inpaint() returned. */
+  StopReasonEnum StopReason = COMPLETED;
+
+  /** Serializes ShouldStop(). */
+  std::mutex StopMutex;
+
+  /** The thread that called StartRun(), the only one that calls the ProgressCallback. */
+  std::thread::id RunThread;
+
+  /** How complete the output of the last Inpaint() is. */
+  float Completeness = 0.0f;
+
   /** The number of iterations to run. */
   unsigned int Iterations = 0;
 
@@ -79,6 +161,12 @@ protected:
   /** The mask describing the hole pixels to fill. */
   Mask::Pointer InpaintingMask = Mask::New();
 
+  /** The InpaintingMask packed into bits, which the queries of Inpaint() use. */
+  PackedMask PackedInpaintingMask;
+
+  /** The per-thread counters that GetStatistics() sums. */
+  StatisticsCollector Counters;
+
 };
 
 #include "InpaintingAlgorithm.hpp"
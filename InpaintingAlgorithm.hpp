@@ -33,6 +33,8 @@
 
 // STL
 #include <ctime>
+#include <iostream>
+#include <stdexcept>
 
 template <typename TImage>
 TImage* InpaintingAlgorithm<TImage>::GetOutput()
@@ -62,6 +64,86 @@ template <typename TImage>
 void InpaintingAlgorithm<TImage>::SetInpaintingMask(Mask* const mask)
 {
   ITKHelpers::DeepCopy(mask, this->InpaintingMask.GetPointer());
+  this->PackedInpaintingMask.SetFromMask(this->InpaintingMask);
+}
+
+template <typename TImage>
+InpaintingStatistics InpaintingAlgorithm<TImage>::GetStatistics() const
+{
+  return this->Counters.Collect();
+}
+
+template <typename TImage>
+void InpaintingAlgorithm<TImage>::SetProgressCallback(const ProgressCallbackType& progressCallback)
+{
+  this->ProgressCallback = progressCallback;
+}
+
+template <typename TImage>
+void InpaintingAlgorithm<TImage>::SetTimeBudget(const double seconds)
+{
+  if(seconds < 0.0)
+  {
+    std::cerr << "TimeBudget: " << seconds << std::endl;
+    throw std::runtime_error("TimeBudget must be >= 0!");
+  }
+  this->TimeBudget = seconds;
+}
+
+template <typename TImage>
+typename InpaintingAlgorithm<TImage>::StopReasonEnum InpaintingAlgorithm<TImage>::GetStopReason() const
+{
+  return this->StopReason;
+}
+
+template <typename TImage>
+float InpaintingAlgorithm<TImage>::GetCompleteness() const
+{
+  return this->Completeness;
+}
+
+template <typename TImage>
+void InpaintingAlgorithm<TImage>::StartRun()
+{
+  this->StartTime = std::chrono::steady_clock::now();
+  this->RunThread = std::this_thread::get_id();
+  this->StopReason = COMPLETED;
+  this->Completeness = 0.0f;
+}
+
+template <typename TImage>
+bool InpaintingAlgorithm<TImage>::ShouldStop(const std::string& phase, const float fractionComplete)
+{
+  std::lock_guard<std::mutex> lock(this->StopMutex);
+
+  if(this->StopReason != COMPLETED)
+  {
+    return true;
+  }
+
+  InpaintingProgress progress;
+  progress.Phase = phase;
+  progress.FractionComplete = fractionComplete;
+  progress.ElapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                                          this->StartTime).count();
+
+  if(this->ProgressCallback && std::this_thread::get_id() == this->RunThread &&
+     !this->ProgressCallback(progress))
+  {
+    std::cout << "Inpainting cancelled during " << phase << "." << std::endl;
+    this->StopReason = CANCELLED;
+    return true;
+  }
+
+  if(this->TimeBudget > 0.0 && progress.ElapsedSeconds > this->TimeBudget)
+  {
+    std::cout << "Inpainting time budget of " << this->TimeBudget << "s exceeded during "
+              << phase << "; finishing with the current result." << std::endl;
+    this->StopReason = TIME_BUDGET_EXCEEDED;
+    return true;
+  }
+
+  return false;
 }
 
 #endif
@@ -0,0 +1,139 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef InpaintingStatistics_H
+#define InpaintingStatistics_H
+
+// STL
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+/** Counters describing the work done by an inpainting run. Query them with
+  * InpaintingAlgorithm::GetStatistics() after Inpaint(). */
+struct InpaintingStatistics
+{
+  /** The number of patch distance (SSD) evaluations. */
+  uint64_t PatchDistanceEvaluations = 0;
+
+  /** The number of candidates tested by the propagation step, and how many were accepted.
+    * A candidate is tested when its patch distance is evaluated. */
+  uint64_t PropagationAttempts = 0;
+  uint64_t PropagationAcceptances = 0;
+
+  /** The number of candidates tested by the random search step, and how many were accepted.
+    * A candidate is tested when its patch distance is evaluated. */
+  uint64_t RandomSearchAttempts = 0;
+  uint64_t RandomSearchAcceptances = 0;
+
+  /** The number of calls to, and rejections by, each acceptance test. */
+  uint64_t SourceRegionTests = 0;
+  uint64_t SourceRegionRejections = 0;
+  uint64_t SSDTests = 0;
+  uint64_t SSDRejections = 0;
+  uint64_t NeighborHistogramTests = 0;
+  uint64_t NeighborHistogramRejections = 0;
+
+  /** The number of patch centers that sources could be taken from. */
+  uint64_t SourcePatchCenters = 0;
+
+  /** The number of pixels written by the compositor. */
+  uint64_t CompositedPixels = 0;
+
+  /** ContributorHistogram[n] is the number of composited pixels that had n contributing patches. */
+  std::vector<uint64_t> ContributorHistogram;
+
+  /** The number of rings filled by BDSInpaintingRings. */
+  uint64_t Rings = 0;
+
+  /** The number of outer iterations of BDSInpaintingRings::ComputeNNField. */
+  uint64_t ComputeNNFieldIterations = 0;
+
+  /** The number of histogram ratio relaxation steps of BDSInpaintingRings::ConstrainedPatchMatch. */
+  uint64_t HistogramRelaxationSteps = 0;
+
+  /** The number of forced propagation iterations of BDSInpaintingRings::ForcePropagation. */
+  uint64_t ForcePropagationIterations = 0;
+
+  /** The number of cached candidates tested again after the histogram ratio was relaxed, and how
+    * many were accepted. */
+  uint64_t CachedCandidateRetests = 0;
+  uint64_t CachedCandidateAcceptances = 0;
+
+  /** The number of times an adaptive composite acceptance test changed its order. */
+  uint64_t AcceptanceTestReorders = 0;
+
+  /** Fraction of propagation candidates that were accepted. */
+  float GetPropagationAcceptanceRate() const;
+
+  /** Fraction of random search candidates that were accepted. */
+  float GetRandomSearchAcceptanceRate() const;
+
+  /** The mean number of contributing patches per composited pixel. */
+  float GetMeanContributors() const;
+
+  /** Record that a pixel was composited from 'numberOfContributors' patches. */
+  void AddCompositedPixel(const unsigned int numberOfContributors);
+
+  /** Accumulate the counters of 'other' into this object. */
+  InpaintingStatistics& operator+=(const InpaintingStatistics& other);
+
+  /** Write all of the counters in a human readable form. */
+  void Print(std::ostream& stream) const;
+};
+
+/** Owns one InpaintingStatistics per thread, so that counting never needs a lock or an
+  * atomic operation. Get the calling thread's counters with Local() and the total over
+  * all threads with Collect(). */
+class StatisticsCollector
+{
+public:
+  StatisticsCollector();
+
+  /** A pointer to one of the counters, to be used with Increment(). */
+  typedef uint64_t InpaintingStatistics::*CounterType;
+
+  /** Get the counters of the calling thread. */
+  InpaintingStatistics& Local();
+
+  /** Add 'amount' to 'counter' of the calling thread. */
+  void Increment(const CounterType counter, const uint64_t amount = 1);
+
+  /** Sum the counters of all threads. */
+  InpaintingStatistics Collect() const;
+
+  /** Zero the counters of all threads. */
+  void Reset();
+
+private:
+  /** Uniquely identifies this collector for the thread-local lookup cache. */
+  uint64_t Id;
+
+  std::map<std::thread::id, std::unique_ptr<InpaintingStatistics> > PerThreadStatistics;
+
+  mutable std::mutex Mutex;
+};
+
+#include "InpaintingStatistics.hpp"
+
+#endif
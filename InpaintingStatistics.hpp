@@ -0,0 +1,192 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef InpaintingStatistics_HPP
+#define InpaintingStatistics_HPP
+
+#include "InpaintingStatistics.h"
+
+// STL
+#include <algorithm>
+
+inline float InpaintingStatistics::GetPropagationAcceptanceRate() const
+{
+  if(this->PropagationAttempts == 0)
+  {
+    return 0.0f;
+  }
+  return static_cast<float>(this->PropagationAcceptances) / static_cast<float>(this->PropagationAttempts);
+}
+
+inline float InpaintingStatistics::GetRandomSearchAcceptanceRate() const
+{
+  if(this->RandomSearchAttempts == 0)
+  {
+    return 0.0f;
+  }
+  return static_cast<float>(this->RandomSearchAcceptances) / static_cast<float>(this->RandomSearchAttempts);
+}
+
+inline float InpaintingStatistics::GetMeanContributors() const
+{
+  uint64_t totalContributors = 0;
+  for(size_t numberOfContributors = 0; numberOfContributors < this->ContributorHistogram.size();
+      ++numberOfContributors)
+  {
+    totalContributors += numberOfContributors * this->ContributorHistogram[numberOfContributors];
+  }
+
+  if(this->CompositedPixels == 0)
+  {
+    return 0.0f;
+  }
+  return static_cast<float>(totalContributors) / static_cast<float>(this->CompositedPixels);
+}
+
+inline void InpaintingStatistics::AddCompositedPixel(const unsigned int numberOfContributors)
+{
+  this->CompositedPixels++;
+  if(numberOfContributors >= this->ContributorHistogram.size())
+  {
+    this->ContributorHistogram.resize(numberOfContributors + 1, 0);
+  }
+  this->ContributorHistogram[numberOfContributors]++;
+}
+
+inline InpaintingStatistics& InpaintingStatistics::operator+=(const InpaintingStatistics& other)
+{
+  this->PatchDistanceEvaluations += other.PatchDistanceEvaluations;
+  this->PropagationAttempts += other.PropagationAttempts;
+  this->PropagationAcceptances += other.PropagationAcceptances;
+  this->RandomSearchAttempts += other.RandomSearchAttempts;
+  this->RandomSearchAcceptances += other.RandomSearchAcceptances;
+  this->SourceRegionTests += other.SourceRegionTests;
+  this->SourceRegionRejections += other.SourceRegionRejections;
+  this->SSDTests += other.SSDTests;
+  this->SSDRejections += other.SSDRejections;
+  this->NeighborHistogramTests += other.NeighborHistogramTests;
+  this->NeighborHistogramRejections += other.NeighborHistogramRejections;
+  this->SourcePatchCenters += other.SourcePatchCenters;
+  this->CompositedPixels += other.CompositedPixels;
+
+  if(other.ContributorHistogram.size() > this->ContributorHistogram.size())
+  {
+    this->ContributorHistogram.resize(other.ContributorHistogram.size(), 0);
+  }
+  for(size_t bin = 0; bin < other.ContributorHistogram.size(); ++bin)
+  {
+    this->ContributorHistogram[bin] += other.ContributorHistogram[bin];
+  }
+
+  this->Rings += other.Rings;
+  this->ComputeNNFieldIterations += other.ComputeNNFieldIterations;
+  this->HistogramRelaxationSteps += other.HistogramRelaxationSteps;
+  this->ForcePropagationIterations += other.ForcePropagationIterations;
+  this->CachedCandidateRetests += other.CachedCandidateRetests;
+  this->CachedCandidateAcceptances += other.CachedCandidateAcceptances;
+  this->AcceptanceTestReorders += other.AcceptanceTestReorders;
+
+  return *this;
+}
+
+inline void InpaintingStatistics::Print(std::ostream& stream) const
+{
+  stream << "PatchDistanceEvaluations: " << this->PatchDistanceEvaluations << std::endl
+         << "Propagation: " << this->PropagationAcceptances << " of " << this->PropagationAttempts
+         << " accepted (" << GetPropagationAcceptanceRate() << ")" << std::endl
+         << "RandomSearch: " << this->RandomSearchAcceptances << " of " << this->RandomSearchAttempts
+         << " accepted (" << GetRandomSearchAcceptanceRate() << ")" << std::endl
+         << "SourceRegion test: " << this->SourceRegionRejections << " of "
+         << this->SourceRegionTests << " rejected" << std::endl
+         << "SSD test: " << this->SSDRejections << " of " << this->SSDTests << " rejected" << std::endl
+         << "NeighborHistogram test: " << this->NeighborHistogramRejections << " of "
+         << this->NeighborHistogramTests << " rejected" << std::endl
+         << "SourcePatchCenters: " << this->SourcePatchCenters << std::endl
+         << "CompositedPixels: " << this->CompositedPixels
+         << " (mean contributors " << GetMeanContributors() << ")" << std::endl
+         << "Rings: " << this->Rings << std::endl
+         << "ComputeNNFieldIterations: " << this->ComputeNNFieldIterations << std::endl
+         << "HistogramRelaxationSteps: " << this->HistogramRelaxationSteps << std::endl
+         << "ForcePropagationIterations: " << this->ForcePropagationIterations << std::endl
+         << "CachedCandidates: " << this->CachedCandidateAcceptances << " of "
+         << this->CachedCandidateRetests << " accepted on retest" << std::endl
+         << "AcceptanceTestReorders: " << this->AcceptanceTestReorders << std::endl;
+}
+
+inline StatisticsCollector::StatisticsCollector()
+{
+  static std::atomic<uint64_t> nextId(1);
+  this->Id = nextId++;
+}
+
+inline InpaintingStatistics& StatisticsCollector::Local()
+{
+  // Cache the last collector used by this thread so that the common case is two comparisons.
+  thread_local uint64_t cachedId = 0;
+  thread_local InpaintingStatistics* cachedStatistics = nullptr;
+
+  if(cachedId != this->Id)
+  {
+    std::lock_guard<std::mutex> lock(this->Mutex);
+
+    std::thread::id threadId = std::this_thread::get_id();
+    std::map<std::thread::id, std::unique_ptr<InpaintingStatistics> >::iterator iterator =
+        this->PerThreadStatistics.find(threadId);
+    if(iterator == this->PerThreadStatistics.end())
+    {
+      iterator = this->PerThreadStatistics.insert(
+            std::make_pair(threadId, std::unique_ptr<InpaintingStatistics>(new InpaintingStatistics))).first;
+    }
+
+    cachedStatistics = iterator->second.get();
+    cachedId = this->Id;
+  }
+
+  return *cachedStatistics;
+}
+
+inline void StatisticsCollector::Increment(const CounterType counter, const uint64_t amount)
+{
+  Local().*counter += amount;
+}
+
+inline InpaintingStatistics StatisticsCollector::Collect() const
+{
+  std::lock_guard<std::mutex> lock(this->Mutex);
+
+  InpaintingStatistics total;
+  for(std::map<std::thread::id, std::unique_ptr<InpaintingStatistics> >::const_iterator iterator =
+      this->PerThreadStatistics.begin(); iterator != this->PerThreadStatistics.end(); ++iterator)
+  {
+    total += *iterator->second;
+  }
+  return total;
+}
+
+inline void StatisticsCollector::Reset()
+{
+  std::lock_guard<std::mutex> lock(this->Mutex);
+
+  for(std::map<std::thread::id, std::unique_ptr<InpaintingStatistics> >::iterator iterator =
+      this->PerThreadStatistics.begin(); iterator != this->PerThreadStatistics.end(); ++iterator)
+  {
+    *iterator->second = InpaintingStatistics();
+  }
+}
+
+#endif
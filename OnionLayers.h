@@ -0,0 +1,86 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+
+#ifndef OnionLayers_H
+#define OnionLayers_H
+
+// ITK
+#include "itkImageRegion.h"
+
+// Submodules
+#include <Mask/Mask.h>
+
+// STL
+#include <cstddef>
+#include <vector>
+
+/** The hole peeled into one-pixel-thick layers from the outside in. Compute() does a single
+  * breadth-first distance transform of the Valid (to be filled) pixels of a target mask: a pixel
+  * is in layer 1 if it is 8-adjacent to a non-target pixel, in layer 2 if it is 8-adjacent to
+  * layer 1, and so on (the chessboard distance to the nearest non-target pixel). The pixels are
+  * stored contiguously in layer order, so a single-pixel ring or a ring of any thickness is a
+  * range of one vector and extracting every ring costs O(hole) in total. */
+class OnionLayers
+{
+public:
+  /** Compute the layers of the Valid pixels of 'targetMask'. Target pixels that cannot be
+    * reached from a non-target pixel (e.g. if the whole image is the target) are put in one
+    * final layer. */
+  void Compute(const Mask* const targetMask);
+
+  /** The number of one-pixel-thick layers. */
+  unsigned int GetNumberOfLayers() const;
+
+  /** The pixels of one-pixel-thick layer 'layer', counting from 0 at the outside. */
+  std::vector<itk::Index<2> > GetLayer(const unsigned int layer) const;
+
+  /** The number of rings of 'thickness' layers each. The last ring may be thinner. */
+  unsigned int GetNumberOfRings(const unsigned int thickness) const;
+
+  /** The pixels of ring 'ring', made of layers [ring * thickness, (ring + 1) * thickness). */
+  std::vector<itk::Index<2> > GetRing(const unsigned int ring, const unsigned int thickness) const;
+
+  /** The layer of 'pixel' (0 at the outside), or -1 if it is not a target pixel. */
+  int GetLayerOfPixel(const itk::Index<2>& pixel) const;
+
+  /** All of the target pixels, in layer order. */
+  const std::vector<itk::Index<2> >& GetPixels() const;
+
+  size_t GetNumberOfPixels() const;
+
+private:
+  /** The pixels of layers [firstLayer, endLayer). */
+  std::vector<itk::Index<2> > GetLayers(const unsigned int firstLayer, unsigned int endLayer) const;
+
+  itk::ImageRegion<2> Region;
+
+  /** The target pixels, sorted by layer. */
+  std::vector<itk::Index<2> > Pixels;
+
+  /** LayerStarts[layer] is the position in Pixels of the first pixel of 'layer'. It has one
+    * extra entry, equal to Pixels.size(). */
+  std::vector<size_t> LayerStarts;
+
+  /** The layer of every pixel of Region in raster order, -1 outside the target. */
+  std::vector<int> LayerImage;
+};
+
+#include "OnionLayers.hpp"
+
+#endif
@@ -0,0 +1,205 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+
+#ifndef OnionLayers_HPP
+#define OnionLayers_HPP
+
+#include "OnionLayers.h"
+
+// ITK
+#include "itkImageRegionConstIteratorWithIndex.h"
+
+// STL
+#include <algorithm>
+#include <cassert>
+
+inline void OnionLayers::Compute(const Mask* const targetMask)
+{
+  this->Region = targetMask->GetLargestPossibleRegion();
+  this->Pixels.clear();
+  this->LayerStarts.clear();
+
+  const long width = static_cast<long>(this->Region.GetSize()[0]);
+  const long height = static_cast<long>(this->Region.GetSize()[1]);
+  const itk::Index<2> corner = this->Region.GetIndex();
+
+  // Mark the target pixels as unassigned (-2) and everything else as outside (-1)
+  this->LayerImage.assign(width * height, -1);
+
+  size_t numberOfTargetPixels = 0;
+  itk::ImageRegionConstIteratorWithIndex<Mask> maskIterator(targetMask, this->Region);
+  while(!maskIterator.IsAtEnd())
+  {
+    if(maskIterator.Get() == targetMask->GetValidValue())
+    {
+      const itk::Index<2> index = maskIterator.GetIndex();
+      this->LayerImage[(index[1] - corner[1]) * width + (index[0] - corner[0])] = -2;
+      numberOfTargetPixels++;
+    }
+    ++maskIterator;
+  }
+  this->Pixels.reserve(numberOfTargetPixels);
+
+  // Layer 0 is the target pixels that touch a non-target pixel
+  this->LayerStarts.push_back(0);
+  for(long y = 0; y < height; ++y)
+  {
+    for(long x = 0; x < width; ++x)
+    {
+      if(this->LayerImage[y * width + x] != -2)
+      {
+        continue;
+      }
+
+      bool touchesOutside = false;
+      for(long offsetY = -1; offsetY <= 1 && !touchesOutside; ++offsetY)
+      {
+        for(long offsetX = -1; offsetX <= 1; ++offsetX)
+        {
+          long neighborX = x + offsetX;
+          long neighborY = y + offsetY;
+          if(neighborX >= 0 && neighborX < width && neighborY >= 0 && neighborY < height &&
+             this->LayerImage[neighborY * width + neighborX] == -1)
+          {
+            touchesOutside = true;
+            break;
+          }
+        }
+      }
+
+      if(touchesOutside)
+      {
+        this->LayerImage[y * width + x] = 0;
+        itk::Index<2> pixel = {{corner[0] + x, corner[1] + y}};
+        this->Pixels.push_back(pixel);
+      }
+    }
+  }
+
+  // Breadth first: each layer is the unassigned target neighbors of the previous layer
+  size_t layerBegin = 0;
+  int layer = 0;
+  while(layerBegin < this->Pixels.size())
+  {
+    size_t layerEnd = this->Pixels.size();
+    this->LayerStarts.push_back(layerEnd);
+
+    for(size_t pixelId = layerBegin; pixelId < layerEnd; ++pixelId)
+    {
+      const long x = this->Pixels[pixelId][0] - corner[0];
+      const long y = this->Pixels[pixelId][1] - corner[1];
+      for(long offsetY = -1; offsetY <= 1; ++offsetY)
+      {
+        for(long offsetX = -1; offsetX <= 1; ++offsetX)
+        {
+          long neighborX = x + offsetX;
+          long neighborY = y + offsetY;
+          if(neighborX >= 0 && neighborX < width && neighborY >= 0 && neighborY < height &&
+             this->LayerImage[neighborY * width + neighborX] == -2)
+          {
+            this->LayerImage[neighborY * width + neighborX] = layer + 1;
+            itk::Index<2> neighbor = {{corner[0] + neighborX, corner[1] + neighborY}};
+            this->Pixels.push_back(neighbor);
+          }
+        }
+      }
+    }
+
+    layerBegin = layerEnd;
+    layer++;
+  }
+  // The last entry of LayerStarts is now the end of the last layer
+
+  // Target pixels that no layer reached form one final layer
+  if(this->Pixels.size() < numberOfTargetPixels)
+  {
+    const int finalLayer = static_cast<int>(this->LayerStarts.size()) - 1;
+    for(long y = 0; y < height; ++y)
+    {
+      for(long x = 0; x < width; ++x)
+      {
+        if(this->LayerImage[y * width + x] == -2)
+        {
+          this->LayerImage[y * width + x] = finalLayer;
+          itk::Index<2> pixel = {{corner[0] + x, corner[1] + y}};
+          this->Pixels.push_back(pixel);
+        }
+      }
+    }
+    this->LayerStarts.push_back(this->Pixels.size());
+  }
+}
+
+inline unsigned int OnionLayers::GetNumberOfLayers() const
+{
+  return static_cast<unsigned int>(this->LayerStarts.size()) - 1;
+}
+
+inline std::vector<itk::Index<2> > OnionLayers::GetLayers(const unsigned int firstLayer, unsigned int endLayer) const
+{
+  endLayer = std::min(endLayer, GetNumberOfLayers());
+  if(firstLayer >= endLayer)
+  {
+    return std::vector<itk::Index<2> >();
+  }
+
+  return std::vector<itk::Index<2> >(this->Pixels.begin() + this->LayerStarts[firstLayer],
+                                     this->Pixels.begin() + this->LayerStarts[endLayer]);
+}
+
+inline std::vector<itk::Index<2> > OnionLayers::GetLayer(const unsigned int layer) const
+{
+  return GetLayers(layer, layer + 1);
+}
+
+inline unsigned int OnionLayers::GetNumberOfRings(const unsigned int thickness) const
+{
+  assert(thickness > 0);
+  return (GetNumberOfLayers() + thickness - 1) / thickness;
+}
+
+inline std::vector<itk::Index<2> > OnionLayers::GetRing(const unsigned int ring, const unsigned int thickness) const
+{
+  assert(thickness > 0);
+  return GetLayers(ring * thickness, (ring + 1) * thickness);
+}
+
+inline int OnionLayers::GetLayerOfPixel(const itk::Index<2>& pixel) const
+{
+  if(!this->Region.IsInside(pixel))
+  {
+    return -1;
+  }
+
+  const long width = static_cast<long>(this->Region.GetSize()[0]);
+  return this->LayerImage[(pixel[1] - this->Region.GetIndex()[1]) * width +
+                          (pixel[0] - this->Region.GetIndex()[0])];
+}
+
+inline const std::vector<itk::Index<2> >& OnionLayers::GetPixels() const
+{
+  return this->Pixels;
+}
+
+inline size_t OnionLayers::GetNumberOfPixels() const
+{
+  return this->Pixels.size();
+}
+
+#endif
@@ -0,0 +1,131 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+
+#ifndef PackedMask_H
+#define PackedMask_H
+
+// ITK
+#include "itkImageRegion.h"
+
+// Submodules
+#include <Mask/Mask.h>
+
+// STL
+#include <cstdint>
+#include <vector>
+
+/** A bit-packed companion of Mask: one bit per pixel (set for valid pixels), 64 pixels per word.
+  * Each row starts at a new word and the bits past the end of a row are always clear, so that
+  * counts are popcounts and region queries test whole words at a time. Enumerating the valid (or
+  * hole) pixels skips empty words and jumps from one set bit to the next.
+  *
+  * A Mask is converted to and from a PackedMask only where it enters or leaves an algorithm
+  * (see InpaintingAlgorithm::SetInpaintingMask()); the queries in between use the packed bits. */
+class PackedMask
+{
+public:
+
+  /** Make the mask cover 'region', with every pixel a hole. */
+  void SetRegion(const itk::ImageRegion<2>& region);
+
+  /** Pack 'mask': its region, and which of its pixels are valid. Every pixel must be either the
+    * hole value or the valid value, so that a set bit agrees with both Mask::IsValid() and
+    * Mask::IsHole(); a std::runtime_error is thrown otherwise. */
+  void SetFromMask(const Mask* const mask);
+
+  /** Write the mask into 'mask', which is given the region of this mask. */
+  void WriteToMask(Mask* const mask) const;
+
+  /** Get the region the mask covers. */
+  const itk::ImageRegion<2>& GetRegion() const;
+
+  /** Set whether the pixel at 'index' is valid. */
+  void SetValid(const itk::Index<2>& index, const bool valid);
+
+  /** Check if the pixel at 'index' is valid. */
+  bool IsValid(const itk::Index<2>& index) const;
+
+  /** Check if every pixel of 'region' is valid. A region that is not entirely inside the mask
+    * is not valid. */
+  bool IsValid(const itk::ImageRegion<2>& region) const;
+
+  /** Check if any pixel is valid. */
+  bool HasValidPixels() const;
+
+  /** Count the valid pixels. */
+  size_t CountValidPixels() const;
+
+  /** Count the valid pixels of 'region', which must be inside the mask. */
+  size_t CountValidPixels(const itk::ImageRegion<2>& region) const;
+
+  /** Count the hole pixels. */
+  size_t CountHolePixels() const;
+
+  /** Get the valid pixels, row by row. */
+  std::vector<itk::Index<2> > GetValidPixels() const;
+
+  /** Get the hole pixels, row by row. */
+  std::vector<itk::Index<2> > GetHolePixels() const;
+
+  /** Get the smallest region that contains every hole pixel. The region is empty (its size is 0)
+    * if there are no hole pixels. */
+  itk::ImageRegion<2> GetHoleBoundingBox() const;
+
+  /** Call 'functor' with the index of every valid pixel, row by row. */
+  template <typename TFunctor>
+  void ForEachValidPixel(TFunctor functor) const;
+
+  /** Call 'functor' with the index of every hole pixel, row by row. */
+  template <typename TFunctor>
+  void ForEachHolePixel(TFunctor functor) const;
+
+private:
+
+  /** Count the set bits of 'word'. */
+  static unsigned int CountBits(const uint64_t word);
+
+  /** Get the position of the lowest set bit of 'word', which must not be 0. */
+  static unsigned int FindFirstBit(const uint64_t word);
+
+  /** Get the bits of word 'wordId' of a row that are in the columns [begin, end). */
+  static uint64_t GetColumnBits(const size_t wordId, const itk::SizeValueType begin, const itk::SizeValueType end);
+
+  /** Check that 'region' is entirely inside the mask. */
+  bool Contains(const itk::ImageRegion<2>& region) const;
+
+  /** Call 'functor' with every pixel whose bit is 'valid'. */
+  template <bool Valid, typename TFunctor>
+  void ForEachPixel(TFunctor functor) const;
+
+  /** The pixels the mask covers. */
+  itk::ImageRegion<2> Region;
+
+  /** The number of words of each row. */
+  size_t WordsPerRow = 0;
+
+  /** The bits of the last word of each row that are inside the row. */
+  uint64_t LastWordBits = 0;
+
+  /** The bits, row by row. */
+  std::vector<uint64_t> Words;
+};
+
+#include "PackedMask.hpp"
+
+#endif
@@ -0,0 +1,353 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+
+#ifndef PackedMask_HPP
+#define PackedMask_HPP
+
+#include "PackedMask.h"
+
+// STL
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <stdexcept>
+
+inline void PackedMask::SetRegion(const itk::ImageRegion<2>& region)
+{
+  this->Region = region;
+
+  const itk::SizeValueType width = region.GetSize()[0];
+  this->WordsPerRow = (width + 63) / 64;
+  this->LastWordBits = (width % 64 == 0) ? ~static_cast<uint64_t>(0) :
+                                           (static_cast<uint64_t>(1) << (width % 64)) - 1;
+  this->Words.assign(this->WordsPerRow * region.GetSize()[1], 0);
+}
+
+inline void PackedMask::SetFromMask(const Mask* const mask)
+{
+  SetRegion(mask->GetLargestPossibleRegion());
+
+  const itk::SizeValueType width = this->Region.GetSize()[0];
+  const itk::SizeValueType height = this->Region.GetSize()[1];
+  const Mask::PixelType holeValue = mask->GetHoleValue();
+  const Mask::PixelType validValue = mask->GetValidValue();
+  const Mask::PixelType* const pixels = mask->GetBufferPointer();
+
+  for(itk::SizeValueType y = 0; y < height; ++y)
+  {
+    const Mask::PixelType* const rowPixels = pixels + y * width;
+    uint64_t* const row = &this->Words[y * this->WordsPerRow];
+    for(itk::SizeValueType x = 0; x < width; ++x)
+    {
+      if(rowPixels[x] == validValue)
+      {
+        row[x / 64] |= static_cast<uint64_t>(1) << (x % 64);
+      }
+      else if(rowPixels[x] != holeValue)
+      {
+        std::cerr << "Mask pixel (" << x << ", " << y << ") is " << static_cast<int>(rowPixels[x])
+                  << ", which is neither the hole value " << static_cast<int>(holeValue)
+                  << " nor the valid value " << static_cast<int>(validValue) << "." << std::endl;
+        throw std::runtime_error("PackedMask::SetFromMask: the mask must only contain hole and valid pixels!");
+      }
+    }
+  }
+}
+
+inline void PackedMask::WriteToMask(Mask* const mask) const
+{
+  mask->SetRegions(this->Region);
+  mask->Allocate();
+
+  const itk::SizeValueType width = this->Region.GetSize()[0];
+  const itk::SizeValueType height = this->Region.GetSize()[1];
+  const Mask::PixelType validValue = mask->GetValidValue();
+  const Mask::PixelType holeValue = mask->GetHoleValue();
+  Mask::PixelType* const pixels = mask->GetBufferPointer();
+
+  for(itk::SizeValueType y = 0; y < height; ++y)
+  {
+    Mask::PixelType* const rowPixels = pixels + y * width;
+    const uint64_t* const row = &this->Words[y * this->WordsPerRow];
+    for(itk::SizeValueType x = 0; x < width; ++x)
+    {
+      rowPixels[x] = ((row[x / 64] >> (x % 64)) & 1) ? validValue : holeValue;
+    }
+  }
+}
+
+inline const itk::ImageRegion<2>& PackedMask::GetRegion() const
+{
+  return this->Region;
+}
+
+inline void PackedMask::SetValid(const itk::Index<2>& index, const bool valid)
+{
+  assert(this->Region.IsInside(index));
+
+  const itk::SizeValueType x = index[0] - this->Region.GetIndex()[0];
+  const itk::SizeValueType y = index[1] - this->Region.GetIndex()[1];
+  uint64_t& word = this->Words[y * this->WordsPerRow + x / 64];
+  const uint64_t bit = static_cast<uint64_t>(1) << (x % 64);
+  word = valid ? (word | bit) : (word & ~bit);
+}
+
+inline bool PackedMask::IsValid(const itk::Index<2>& index) const
+{
+  assert(this->Region.IsInside(index));
+
+  const itk::SizeValueType x = index[0] - this->Region.GetIndex()[0];
+  const itk::SizeValueType y = index[1] - this->Region.GetIndex()[1];
+  return (this->Words[y * this->WordsPerRow + x / 64] >> (x % 64)) & 1;
+}
+
+inline bool PackedMask::IsValid(const itk::ImageRegion<2>& region) const
+{
+  if(!Contains(region))
+  {
+    return false;
+  }
+
+  if(region.GetNumberOfPixels() == 0)
+  {
+    return true;
+  }
+
+  const itk::SizeValueType begin = region.GetIndex()[0] - this->Region.GetIndex()[0];
+  const itk::SizeValueType end = begin + region.GetSize()[0];
+  const itk::SizeValueType firstRow = region.GetIndex()[1] - this->Region.GetIndex()[1];
+  const itk::SizeValueType endRow = firstRow + region.GetSize()[1];
+
+  for(itk::SizeValueType y = firstRow; y < endRow; ++y)
+  {
+    const uint64_t* const row = &this->Words[y * this->WordsPerRow];
+    for(size_t wordId = begin / 64; wordId <= (end - 1) / 64; ++wordId)
+    {
+      const uint64_t bits = GetColumnBits(wordId, begin, end);
+      if((row[wordId] & bits) != bits)
+      {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+inline bool PackedMask::HasValidPixels() const
+{
+  for(size_t wordId = 0; wordId < this->Words.size(); ++wordId)
+  {
+    if(this->Words[wordId])
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+inline size_t PackedMask::CountValidPixels() const
+{
+  size_t numberOfValidPixels = 0;
+  for(size_t wordId = 0; wordId < this->Words.size(); ++wordId)
+  {
+    numberOfValidPixels += CountBits(this->Words[wordId]);
+  }
+
+  return numberOfValidPixels;
+}
+
+inline size_t PackedMask::CountValidPixels(const itk::ImageRegion<2>& region) const
+{
+  assert(Contains(region));
+
+  if(region.GetNumberOfPixels() == 0)
+  {
+    return 0;
+  }
+
+  const itk::SizeValueType begin = region.GetIndex()[0] - this->Region.GetIndex()[0];
+  const itk::SizeValueType end = begin + region.GetSize()[0];
+  const itk::SizeValueType firstRow = region.GetIndex()[1] - this->Region.GetIndex()[1];
+  const itk::SizeValueType endRow = firstRow + region.GetSize()[1];
+
+  size_t numberOfValidPixels = 0;
+  for(itk::SizeValueType y = firstRow; y < endRow; ++y)
+  {
+    const uint64_t* const row = &this->Words[y * this->WordsPerRow];
+    for(size_t wordId = begin / 64; wordId <= (end - 1) / 64; ++wordId)
+    {
+      numberOfValidPixels += CountBits(row[wordId] & GetColumnBits(wordId, begin, end));
+    }
+  }
+
+  return numberOfValidPixels;
+}
+
+inline size_t PackedMask::CountHolePixels() const
+{
+  return this->Region.GetNumberOfPixels() - CountValidPixels();
+}
+
+inline std::vector<itk::Index<2> > PackedMask::GetValidPixels() const
+{
+  std::vector<itk::Index<2> > validPixels;
+  validPixels.reserve(CountValidPixels());
+  ForEachValidPixel([&validPixels](const itk::Index<2>& index) {validPixels.push_back(index);});
+  return validPixels;
+}
+
+inline std::vector<itk::Index<2> > PackedMask::GetHolePixels() const
+{
+  std::vector<itk::Index<2> > holePixels;
+  holePixels.reserve(CountHolePixels());
+  ForEachHolePixel([&holePixels](const itk::Index<2>& index) {holePixels.push_back(index);});
+  return holePixels;
+}
+
+inline itk::ImageRegion<2> PackedMask::GetHoleBoundingBox() const
+{
+  bool hasHolePixels = false;
+  itk::Index<2> lowerCorner = this->Region.GetIndex();
+  itk::Index<2> upperCorner = this->Region.GetIndex();
+  ForEachHolePixel([&hasHolePixels, &lowerCorner, &upperCorner](const itk::Index<2>& index)
+  {
+    if(!hasHolePixels)
+    {
+      lowerCorner = index;
+      upperCorner = index;
+      hasHolePixels = true;
+      return;
+    }
+
+    for(unsigned int dimension = 0; dimension < 2; ++dimension)
+    {
+      lowerCorner[dimension] = std::min(lowerCorner[dimension], index[dimension]);
+      upperCorner[dimension] = std::max(upperCorner[dimension], index[dimension]);
+    }
+  });
+
+  if(!hasHolePixels)
+  {
+    return itk::ImageRegion<2>();
+  }
+
+  itk::Size<2> boundingBoxSize;
+  boundingBoxSize[0] = upperCorner[0] - lowerCorner[0] + 1;
+  boundingBoxSize[1] = upperCorner[1] - lowerCorner[1] + 1;
+  return itk::ImageRegion<2>(lowerCorner, boundingBoxSize);
+}
+
+template <typename TFunctor>
+void PackedMask::ForEachValidPixel(TFunctor functor) const
+{
+  ForEachPixel<true>(functor);
+}
+
+template <typename TFunctor>
+void PackedMask::ForEachHolePixel(TFunctor functor) const
+{
+  ForEachPixel<false>(functor);
+}
+
+template <bool Valid, typename TFunctor>
+void PackedMask::ForEachPixel(TFunctor functor) const
+{
+  const itk::Index<2> corner = this->Region.GetIndex();
+  const itk::SizeValueType height = this->Region.GetSize()[1];
+
+  for(itk::SizeValueType y = 0; y < height; ++y)
+  {
+    const uint64_t* const row = &this->Words[y * this->WordsPerRow];
+    for(size_t wordId = 0; wordId < this->WordsPerRow; ++wordId)
+    {
+      uint64_t word = Valid ? row[wordId] : ~row[wordId];
+      // The bits past the end of the row are clear, so they would read as holes
+      if(!Valid && wordId + 1 == this->WordsPerRow)
+      {
+        word &= this->LastWordBits;
+      }
+
+      // Visit the set bits from lowest to highest, clearing each one
+      while(word)
+      {
+        const itk::Index<2> index = {{corner[0] + static_cast<itk::IndexValueType>(wordId * 64 + FindFirstBit(word)),
+                                      corner[1] + static_cast<itk::IndexValueType>(y)}};
+        functor(index);
+        word &= word - 1;
+      }
+    }
+  }
+}
+
+inline unsigned int PackedMask::CountBits(const uint64_t word)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_popcountll(word);
+#else
+  uint64_t count = word - ((word >> 1) & 0x5555555555555555ULL);
+  count = (count & 0x3333333333333333ULL) + ((count >> 2) & 0x3333333333333333ULL);
+  count = (count + (count >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+  return static_cast<unsigned int>((count * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+inline unsigned int PackedMask::FindFirstBit(const uint64_t word)
+{
+  assert(word != 0);
+
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_ctzll(word);
+#else
+  // The bits below the lowest set bit
+  return CountBits((word & (~word + 1)) - 1);
+#endif
+}
+
+inline uint64_t PackedMask::GetColumnBits(const size_t wordId, const itk::SizeValueType begin,
+                                          const itk::SizeValueType end)
+{
+  const itk::SizeValueType wordBegin = wordId * 64;
+  const itk::SizeValueType first = std::max(begin, wordBegin) - wordBegin;
+  const itk::SizeValueType last = std::min(end, wordBegin + 64) - wordBegin;
+
+  const uint64_t belowLast = (last == 64) ? ~static_cast<uint64_t>(0) : (static_cast<uint64_t>(1) << last) - 1;
+  const uint64_t belowFirst = (static_cast<uint64_t>(1) << first) - 1;
+  return belowLast & ~belowFirst;
+}
+
+inline bool PackedMask::Contains(const itk::ImageRegion<2>& region) const
+{
+  for(unsigned int dimension = 0; dimension < 2; ++dimension)
+  {
+    const itk::IndexValueType maskBegin = this->Region.GetIndex()[dimension];
+    const itk::IndexValueType maskEnd = maskBegin + static_cast<itk::IndexValueType>(this->Region.GetSize()[dimension]);
+    const itk::IndexValueType regionBegin = region.GetIndex()[dimension];
+    const itk::IndexValueType regionEnd = regionBegin + static_cast<itk::IndexValueType>(region.GetSize()[dimension]);
+    if(regionBegin < maskBegin || regionEnd > maskEnd)
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+#endif
@@ -0,0 +1,77 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+
+#ifndef PatchDistanceSearchWindow_H
+#define PatchDistanceSearchWindow_H
+
+// ITK
+#include "itkImage.h"
+#include "itkImageRegion.h"
+
+// Submodules
+#include <ITKHelpers/ITKHelpers.h>
+
+// STL
+#include <limits>
+
+/** A patch distance functor that only scores source patches within a window around a center
+  * given for each query pixel. Sources outside of the window get the largest distance without
+  * evaluating TPatchDistanceFunctor, so they are never better than the current match.
+  * Distance(sourceRegion, queryRegion) takes the source first, as PatchMatch calls it.
+  * Like PatchDistanceCounting, Distance() hides (it does not override) the wrapped Distance(). */
+template <typename TPatchDistanceFunctor>
+class PatchDistanceSearchWindow : public TPatchDistanceFunctor
+{
+public:
+
+  typedef itk::Image<itk::Index<2>, 2> WindowCenterImageType;
+
+  /** Only score sources whose centers are within 'radius' pixels of the pixel of 'windowCenters'
+    * at the query center. Query pixels whose window center is negative are not restricted.
+    * nullptr (the default) does not restrict any query. */
+  void SetSearchWindows(const WindowCenterImageType* const windowCenters, const unsigned int radius)
+  {
+    this->WindowCenters = windowCenters;
+    this->SquaredRadius = static_cast<itk::OffsetValueType>(radius) * radius;
+  }
+
+  float Distance(const itk::ImageRegion<2>& sourceRegion, const itk::ImageRegion<2>& queryRegion)
+  {
+    if(this->WindowCenters)
+    {
+      const itk::Index<2> windowCenter = this->WindowCenters->GetPixel(ITKHelpers::GetRegionCenter(queryRegion));
+      if(windowCenter[0] >= 0)
+      {
+        const itk::Offset<2> offset = ITKHelpers::GetRegionCenter(sourceRegion) - windowCenter;
+        if(offset[0] * offset[0] + offset[1] * offset[1] > this->SquaredRadius)
+        {
+          return std::numeric_limits<float>::max();
+        }
+      }
+    }
+    return TPatchDistanceFunctor::Distance(sourceRegion, queryRegion);
+  }
+
+private:
+  const WindowCenterImageType* WindowCenters = nullptr;
+
+  itk::OffsetValueType SquaredRadius = 0;
+};
+
+#endif
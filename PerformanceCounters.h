@@ -0,0 +1,135 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef PerformanceCounters_H
+#define PerformanceCounters_H
+
+// STL
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/** The hardware events counted around each instrumented phase. */
+struct PerformanceCounterValues
+{
+  uint64_t Cycles = 0;
+  uint64_t Instructions = 0;
+  uint64_t LastLevelCacheMisses = 0;
+  uint64_t BranchMisses = 0;
+
+  PerformanceCounterValues& operator+=(const PerformanceCounterValues& other);
+  PerformanceCounterValues operator-(const PerformanceCounterValues& other) const;
+};
+
+/** A group of hardware counters (cycles, instructions, LLC misses, branch misses) for the
+  * calling thread, opened with Linux perf_event_open. If perf events are not available
+  * (not Linux, no PMU in a VM, or perf_event_paranoid forbids it) IsAvailable() is false
+  * and Read() returns zeros. */
+class PerformanceCounterGroup
+{
+public:
+  PerformanceCounterGroup();
+
+  ~PerformanceCounterGroup();
+
+  /** Get the counter group of the calling thread, opening it on first use. */
+  static PerformanceCounterGroup& ThreadLocal();
+
+  /** True if the counters could be opened. */
+  bool IsAvailable() const;
+
+  /** Read the current (running total) value of each counter. */
+  PerformanceCounterValues Read() const;
+
+private:
+  /** The file descriptors of the counters; the first is the group leader. -1 if not open. */
+  int FileDescriptors[4];
+};
+
+/** Collects the counter deltas of every instrumented phase and iteration. */
+class PerformanceCounterRecorder
+{
+public:
+
+  /** One measured scope. */
+  struct Sample
+  {
+    std::string Name;
+    int Iteration;
+    PerformanceCounterValues Values;
+  };
+
+  /** Get the process-wide recorder. */
+  static PerformanceCounterRecorder& Instance();
+
+  /** Record a measured scope. This is thread safe. */
+  void AddSample(const std::string& name, const int iteration, const PerformanceCounterValues& values);
+
+  /** Forget all samples. */
+  void Clear();
+
+  /** Write the per-phase totals followed by each per-iteration sample, with derived
+    * instructions per cycle and misses per thousand instructions. */
+  void WriteReport(std::ostream& stream) const;
+
+private:
+  std::vector<Sample> Samples;
+
+  mutable std::mutex Mutex;
+};
+
+/** Measures the hardware counters over the enclosing scope. */
+class ScopedPerformanceCounters
+{
+public:
+  ScopedPerformanceCounters(const std::string& name, const int iteration = -1);
+
+  ~ScopedPerformanceCounters();
+
+private:
+  std::string Name;
+
+  int Iteration;
+
+  PerformanceCounterValues Start;
+};
+
+#define BDS_PERF_CONCATENATE_DETAIL(a, b) a##b
+#define BDS_PERF_CONCATENATE(a, b) BDS_PERF_CONCATENATE_DETAIL(a, b)
+
+#ifdef BDSInpainting_EnablePerformanceCounters
+  /** Count hardware events over the rest of the enclosing scope as phase 'name'. Only the events
+    * of the calling thread are counted, so work run on a ThreadPool is measured in its tasks. */
+  #define BDS_PERF_SCOPE(name) \
+    ScopedPerformanceCounters BDS_PERF_CONCATENATE(bdsPerformanceCounters, __LINE__)(name)
+  /** Count hardware events over the rest of the enclosing scope as phase 'name' of iteration 'iteration'. */
+  #define BDS_PERF_SCOPE_ITERATION(name, iteration) \
+    ScopedPerformanceCounters BDS_PERF_CONCATENATE(bdsPerformanceCounters, __LINE__)(name, static_cast<int>(iteration))
+  /** Write the per-phase and per-iteration report to 'stream'. */
+  #define BDS_PERF_REPORT(stream) PerformanceCounterRecorder::Instance().WriteReport(stream)
+#else
+  #define BDS_PERF_SCOPE(name)
+  #define BDS_PERF_SCOPE_ITERATION(name, iteration)
+  #define BDS_PERF_REPORT(stream)
+#endif
+
+#include "PerformanceCounters.hpp"
+
+#endif
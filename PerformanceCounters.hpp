@@ -0,0 +1,259 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef PerformanceCounters_HPP
+#define PerformanceCounters_HPP
+
+#include "PerformanceCounters.h"
+
+// STL
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+#ifdef __linux__
+  #include <linux/perf_event.h>
+  #include <sys/ioctl.h>
+  #include <sys/syscall.h>
+  #include <unistd.h>
+#endif
+
+inline PerformanceCounterValues& PerformanceCounterValues::operator+=(const PerformanceCounterValues& other)
+{
+  this->Cycles += other.Cycles;
+  this->Instructions += other.Instructions;
+  this->LastLevelCacheMisses += other.LastLevelCacheMisses;
+  this->BranchMisses += other.BranchMisses;
+  return *this;
+}
+
+inline PerformanceCounterValues PerformanceCounterValues::operator-(const PerformanceCounterValues& other) const
+{
+  PerformanceCounterValues difference;
+  difference.Cycles = this->Cycles - other.Cycles;
+  difference.Instructions = this->Instructions - other.Instructions;
+  difference.LastLevelCacheMisses = this->LastLevelCacheMisses - other.LastLevelCacheMisses;
+  difference.BranchMisses = this->BranchMisses - other.BranchMisses;
+  return difference;
+}
+
+inline PerformanceCounterGroup::PerformanceCounterGroup()
+{
+  for(unsigned int counterId = 0; counterId < 4; ++counterId)
+  {
+    this->FileDescriptors[counterId] = -1;
+  }
+
+#ifdef __linux__
+  const uint64_t configs[4] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                               PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+
+  for(unsigned int counterId = 0; counterId < 4; ++counterId)
+  {
+    struct perf_event_attr attributes;
+    memset(&attributes, 0, sizeof(attributes));
+    attributes.type = PERF_TYPE_HARDWARE;
+    attributes.size = sizeof(attributes);
+    attributes.config = configs[counterId];
+    attributes.disabled = (counterId == 0) ? 1 : 0; // The leader starts the whole group
+    attributes.exclude_kernel = 1;
+    attributes.exclude_hv = 1;
+    attributes.read_format = PERF_FORMAT_GROUP;
+
+    int groupFileDescriptor = (counterId == 0) ? -1 : this->FileDescriptors[0];
+    // Count the calling thread (pid 0) on any cpu (-1).
+    long fileDescriptor = syscall(__NR_perf_event_open, &attributes, 0, -1, groupFileDescriptor, 0);
+    if(fileDescriptor < 0)
+    {
+      for(unsigned int openedId = 0; openedId < counterId; ++openedId)
+      {
+        close(this->FileDescriptors[openedId]);
+        this->FileDescriptors[openedId] = -1;
+      }
+
+      static std::once_flag warnOnce;
+      std::call_once(warnOnce, []()
+        {
+          std::cerr << "PerformanceCounterGroup: perf events are not available "
+                    << "(check /proc/sys/kernel/perf_event_paranoid); hardware counters will read 0."
+                    << std::endl;
+        });
+      return;
+    }
+    this->FileDescriptors[counterId] = static_cast<int>(fileDescriptor);
+  }
+
+  ioctl(this->FileDescriptors[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(this->FileDescriptors[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+}
+
+inline PerformanceCounterGroup::~PerformanceCounterGroup()
+{
+#ifdef __linux__
+  for(unsigned int counterId = 0; counterId < 4; ++counterId)
+  {
+    if(this->FileDescriptors[counterId] >= 0)
+    {
+      close(this->FileDescriptors[counterId]);
+    }
+  }
+#endif
+}
+
+inline PerformanceCounterGroup& PerformanceCounterGroup::ThreadLocal()
+{
+  thread_local PerformanceCounterGroup group;
+  return group;
+}
+
+inline bool PerformanceCounterGroup::IsAvailable() const
+{
+  return this->FileDescriptors[0] >= 0;
+}
+
+inline PerformanceCounterValues PerformanceCounterGroup::Read() const
+{
+  PerformanceCounterValues values;
+
+#ifdef __linux__
+  if(!IsAvailable())
+  {
+    return values;
+  }
+
+  // With PERF_FORMAT_GROUP the layout is {number of counters, value 0, value 1, ...}
+  uint64_t buffer[5] = {0, 0, 0, 0, 0};
+  if(read(this->FileDescriptors[0], buffer, sizeof(buffer)) < static_cast<ssize_t>(sizeof(buffer)))
+  {
+    return values;
+  }
+
+  values.Cycles = buffer[1];
+  values.Instructions = buffer[2];
+  values.LastLevelCacheMisses = buffer[3];
+  values.BranchMisses = buffer[4];
+#endif
+
+  return values;
+}
+
+inline PerformanceCounterRecorder& PerformanceCounterRecorder::Instance()
+{
+  static PerformanceCounterRecorder recorder;
+  return recorder;
+}
+
+inline void PerformanceCounterRecorder::AddSample(const std::string& name, const int iteration,
+                                                  const PerformanceCounterValues& values)
+{
+  Sample sample;
+  sample.Name = name;
+  sample.Iteration = iteration;
+  sample.Values = values;
+
+  std::lock_guard<std::mutex> lock(this->Mutex);
+  this->Samples.push_back(sample);
+}
+
+inline void PerformanceCounterRecorder::Clear()
+{
+  std::lock_guard<std::mutex> lock(this->Mutex);
+  this->Samples.clear();
+}
+
+/** Write one row of the performance counter report. */
+inline void WritePerformanceCounterRow(std::ostream& stream, const std::string& name,
+                                       const std::string& iteration,
+                                       const PerformanceCounterValues& values)
+{
+  double instructionsPerCycle = values.Cycles > 0 ?
+        static_cast<double>(values.Instructions) / values.Cycles : 0.0;
+  double kiloInstructions = values.Instructions / 1000.0;
+  double cacheMissesPerKiloInstruction = kiloInstructions > 0.0 ?
+        values.LastLevelCacheMisses / kiloInstructions : 0.0;
+  double branchMissesPerKiloInstruction = kiloInstructions > 0.0 ?
+        values.BranchMisses / kiloInstructions : 0.0;
+
+  stream << std::left << std::setw(44) << name << std::setw(6) << iteration << std::right
+         << std::setw(16) << values.Cycles << std::setw(16) << values.Instructions
+         << std::setw(8) << std::fixed << std::setprecision(2) << instructionsPerCycle
+         << std::setw(14) << values.LastLevelCacheMisses << std::setw(8) << cacheMissesPerKiloInstruction
+         << std::setw(14) << values.BranchMisses << std::setw(8) << branchMissesPerKiloInstruction
+         << std::endl;
+}
+
+inline void PerformanceCounterRecorder::WriteReport(std::ostream& stream) const
+{
+  std::vector<Sample> samples;
+  {
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    samples = this->Samples;
+  }
+
+  if(!PerformanceCounterGroup::ThreadLocal().IsAvailable())
+  {
+    stream << "Hardware performance counters were not available; no report." << std::endl;
+    return;
+  }
+
+  stream << std::left << std::setw(44) << "Phase" << std::setw(6) << "Iter" << std::right
+         << std::setw(16) << "Cycles" << std::setw(16) << "Instructions" << std::setw(8) << "IPC"
+         << std::setw(14) << "LLC misses" << std::setw(8) << "MPKI"
+         << std::setw(14) << "Branch misses" << std::setw(8) << "BMPKI" << std::endl;
+
+  // Per-phase totals
+  std::map<std::string, PerformanceCounterValues> totals;
+  for(size_t sampleId = 0; sampleId < samples.size(); ++sampleId)
+  {
+    totals[samples[sampleId].Name] += samples[sampleId].Values;
+  }
+  for(std::map<std::string, PerformanceCounterValues>::const_iterator iterator = totals.begin();
+      iterator != totals.end(); ++iterator)
+  {
+    WritePerformanceCounterRow(stream, iterator->first, "all", iterator->second);
+  }
+
+  // Per-iteration samples
+  stream << std::endl;
+  for(size_t sampleId = 0; sampleId < samples.size(); ++sampleId)
+  {
+    if(samples[sampleId].Iteration >= 0)
+    {
+      std::stringstream ssIteration;
+      ssIteration << samples[sampleId].Iteration;
+      WritePerformanceCounterRow(stream, samples[sampleId].Name, ssIteration.str(), samples[sampleId].Values);
+    }
+  }
+}
+
+inline ScopedPerformanceCounters::ScopedPerformanceCounters(const std::string& name, const int iteration) :
+  Name(name), Iteration(iteration)
+{
+  this->Start = PerformanceCounterGroup::ThreadLocal().Read();
+}
+
+inline ScopedPerformanceCounters::~ScopedPerformanceCounters()
+{
+  PerformanceCounterValues end = PerformanceCounterGroup::ThreadLocal().Read();
+  PerformanceCounterRecorder::Instance().AddSample(this->Name, this->Iteration, end - this->Start);
+}
+
+#endif
@@ -0,0 +1,94 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+
+#ifndef SeededRandomSearch_H
+#define SeededRandomSearch_H
+
+// ITK
+#include "itkImageRegion.h"
+
+// Submodules
+#include <Mask/Mask.h>
+#include <PatchMatch/Match.h>
+#include <PatchMatch/PatchMatchHelpers.h>
+#include <PatchMatch/Process.h>
+
+// Boost
+#include <boost/signals2.hpp>
+
+// STL
+#include <random>
+
+/** The random search step of PatchMatch, drawing its samples from a generator it is given rather
+  * than from a process-wide one. Each pixel of the process functor searches windows of halving
+  * size around its current match; every window gets a candidate in the source mask (centers
+  * outside of it are redrawn, up to MaximumDrawsPerRadius times). A candidate that passes the
+  * acceptance test replaces the current match and is verified. Threads that each own a
+  * generator (seeded by the work they are given) then get the same result whichever thread
+  * runs which work. It has the same Search() as RandomSearch, so PatchMatch::Compute() runs it. */
+template <typename TPatchDistanceFunctor, typename TAcceptanceTest>
+class SeededRandomSearch
+{
+public:
+  typedef PatchMatchHelpers::NNFieldType NNFieldType;
+
+  void SetPatchRadius(const unsigned int patchRadius);
+
+  void SetPatchDistanceFunctor(TPatchDistanceFunctor* const patchDistanceFunctor);
+
+  void SetAcceptanceTest(TAcceptanceTest* const acceptanceTest);
+
+  /** Set the functor that gives the pixels to search for. */
+  void SetProcessFunctor(Process* const processFunctor);
+
+  /** Only draw candidates whose patches are entirely Valid in 'sourceMask'. */
+  void SetSourceMask(const Mask* const sourceMask);
+
+  /** Set the generator the samples are drawn from. It is not owned. */
+  void SetRandomGenerator(std::mt19937* const randomGenerator);
+
+  /** Set how many centers are drawn in a window before giving up on finding one in the source
+    * mask. The default is 16. */
+  void SetMaximumDrawsPerRadius(const unsigned int maximumDrawsPerRadius);
+
+  /** Search around the current match of every pixel of the process functor that has one. */
+  void Search(NNFieldType* const nnField);
+
+  /** Emitted with (query center, match center, score) for every accepted candidate. */
+  boost::signals2::signal<void(const itk::Index<2>&, const itk::Index<2>&, const float)> AcceptedSignal;
+
+private:
+  unsigned int PatchRadius = 0;
+
+  TPatchDistanceFunctor* PatchDistanceFunctor = nullptr;
+
+  TAcceptanceTest* AcceptanceTest = nullptr;
+
+  Process* ProcessFunctor = nullptr;
+
+  const Mask* SourceMask = nullptr;
+
+  std::mt19937* RandomGenerator = nullptr;
+
+  unsigned int MaximumDrawsPerRadius = 16;
+};
+
+#include "SeededRandomSearch.hpp"
+
+#endif
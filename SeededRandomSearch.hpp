@@ -0,0 +1,163 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+
+#ifndef SeededRandomSearch_HPP
+#define SeededRandomSearch_HPP
+
+#include "SeededRandomSearch.h"
+
+// Submodules
+#include <ITKHelpers/ITKHelpers.h>
+
+// STL
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+template <typename TPatchDistanceFunctor, typename TAcceptanceTest>
+void SeededRandomSearch<TPatchDistanceFunctor, TAcceptanceTest>::SetPatchRadius(const unsigned int patchRadius)
+{
+  this->PatchRadius = patchRadius;
+}
+
+template <typename TPatchDistanceFunctor, typename TAcceptanceTest>
+void SeededRandomSearch<TPatchDistanceFunctor, TAcceptanceTest>::SetPatchDistanceFunctor(
+    TPatchDistanceFunctor* const patchDistanceFunctor)
+{
+  this->PatchDistanceFunctor = patchDistanceFunctor;
+}
+
+template <typename TPatchDistanceFunctor, typename TAcceptanceTest>
+void SeededRandomSearch<TPatchDistanceFunctor, TAcceptanceTest>::SetAcceptanceTest(TAcceptanceTest* const acceptanceTest)
+{
+  this->AcceptanceTest = acceptanceTest;
+}
+
+template <typename TPatchDistanceFunctor, typename TAcceptanceTest>
+void SeededRandomSearch<TPatchDistanceFunctor, TAcceptanceTest>::SetProcessFunctor(Process* const processFunctor)
+{
+  this->ProcessFunctor = processFunctor;
+}
+
+template <typename TPatchDistanceFunctor, typename TAcceptanceTest>
+void SeededRandomSearch<TPatchDistanceFunctor, TAcceptanceTest>::SetSourceMask(const Mask* const sourceMask)
+{
+  this->SourceMask = sourceMask;
+}
+
+template <typename TPatchDistanceFunctor, typename TAcceptanceTest>
+void SeededRandomSearch<TPatchDistanceFunctor, TAcceptanceTest>::SetRandomGenerator(std::mt19937* const randomGenerator)
+{
+  this->RandomGenerator = randomGenerator;
+}
+
+template <typename TPatchDistanceFunctor, typename TAcceptanceTest>
+void SeededRandomSearch<TPatchDistanceFunctor, TAcceptanceTest>::SetMaximumDrawsPerRadius(
+    const unsigned int maximumDrawsPerRadius)
+{
+  this->MaximumDrawsPerRadius = maximumDrawsPerRadius;
+}
+
+template <typename TPatchDistanceFunctor, typename TAcceptanceTest>
+void SeededRandomSearch<TPatchDistanceFunctor, TAcceptanceTest>::Search(NNFieldType* const nnField)
+{
+  assert(this->PatchDistanceFunctor);
+  assert(this->AcceptanceTest);
+  assert(this->ProcessFunctor);
+  assert(this->SourceMask);
+  assert(this->RandomGenerator);
+
+  // The centers of the patches that are inside of the image
+  const itk::ImageRegion<2> fullRegion = nnField->GetLargestPossibleRegion();
+  const long radius = static_cast<long>(this->PatchRadius);
+  const long minimumX = fullRegion.GetIndex()[0] + radius;
+  const long maximumX = fullRegion.GetIndex()[0] + static_cast<long>(fullRegion.GetSize()[0]) - 1 - radius;
+  const long minimumY = fullRegion.GetIndex()[1] + radius;
+  const long maximumY = fullRegion.GetIndex()[1] + static_cast<long>(fullRegion.GetSize()[1]) - 1 - radius;
+  if(minimumX > maximumX || minimumY > maximumY)
+  {
+    return;
+  }
+
+  const long maximumSearchRadius = static_cast<long>(std::max(fullRegion.GetSize()[0], fullRegion.GetSize()[1]));
+
+  const std::vector<itk::Index<2> > pixels = this->ProcessFunctor->GetPixelsToProcess();
+  for(size_t pixelId = 0; pixelId < pixels.size(); ++pixelId)
+  {
+    MatchSet matchSet = nnField->GetPixel(pixels[pixelId]);
+    if(matchSet.GetNumberOfMatches() == 0)
+    {
+      continue;
+    }
+
+    const itk::ImageRegion<2> queryRegion = ITKHelpers::GetRegionInRadiusAroundPixel(pixels[pixelId], this->PatchRadius);
+
+    Match bestMatch = matchSet.GetMatch(0);
+    bool accepted = false;
+
+    for(long searchRadius = maximumSearchRadius; searchRadius >= 1; searchRadius /= 2)
+    {
+      const itk::Index<2> bestCenter = ITKHelpers::GetRegionCenter(bestMatch.GetRegion());
+
+      // The window, clipped so that every patch in it is inside of the image
+      std::uniform_int_distribution<long> xDistribution(std::max(minimumX, bestCenter[0] - searchRadius),
+                                                        std::min(maximumX, bestCenter[0] + searchRadius));
+      std::uniform_int_distribution<long> yDistribution(std::max(minimumY, bestCenter[1] - searchRadius),
+                                                        std::min(maximumY, bestCenter[1] + searchRadius));
+
+      for(unsigned int drawId = 0; drawId < this->MaximumDrawsPerRadius; ++drawId)
+      {
+        const itk::Index<2> candidateCenter = {{xDistribution(*this->RandomGenerator),
+                                                yDistribution(*this->RandomGenerator)}};
+        const itk::ImageRegion<2> candidateRegion =
+          ITKHelpers::GetRegionInRadiusAroundPixel(candidateCenter, this->PatchRadius);
+        if(!this->SourceMask->IsValid(candidateRegion))
+        {
+          continue;
+        }
+
+        Match potentialMatch;
+        potentialMatch.SetRegion(candidateRegion);
+        potentialMatch.SetScore(this->PatchDistanceFunctor->Distance(candidateRegion, queryRegion));
+
+        float score = 0.0f;
+        if(this->AcceptanceTest->IsBetterWithScore(queryRegion, bestMatch, potentialMatch, score))
+        {
+          bestMatch = potentialMatch;
+          accepted = true;
+        }
+        break;
+      }
+    }
+
+    if(accepted)
+    {
+      bestMatch.SetVerified(true);
+      bestMatch.SetAllowPropagation(true);
+      matchSet.Clear();
+      matchSet.AddMatch(bestMatch);
+      nnField->SetPixel(pixels[pixelId], matchSet);
+
+      this->AcceptedSignal(pixels[pixelId], ITKHelpers::GetRegionCenter(bestMatch.GetRegion()),
+                           bestMatch.GetScore());
+    }
+  }
+}
+
+#endif
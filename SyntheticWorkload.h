@@ -0,0 +1,111 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef SyntheticWorkload_H
+#define SyntheticWorkload_H
+
+// ITK
+#include "itkImage.h"
+#include "itkImageRegion.h"
+
+// Submodules
+#include <Mask/Mask.h>
+
+// STL
+#include <cstdint>
+#include <string>
+
+/** Deterministic generation of textured images and hole masks for benchmarking and
+  * scaling tests. All randomness comes from a fixed integer generator (not from the
+  * implementation-defined std:: distributions), so the same parameters produce
+  * bit-identical images and masks on every platform. */
+namespace SyntheticWorkload
+{
+
+enum TextureEnum {NOISE, STRIPES, FRACTAL};
+
+enum HoleShapeEnum {SQUARE, DISC, BLOB};
+
+/** A small, fast, platform-independent random number generator (SplitMix64). */
+class Random
+{
+public:
+  explicit Random(const uint64_t seed) : State(seed) {}
+
+  /** Get the next 64 random bits. */
+  uint64_t Next();
+
+  /** Get a float uniformly distributed in [0, 1). */
+  float NextFloat();
+
+  /** Get an integer uniformly distributed in [minimum, maximum]. */
+  int NextInteger(const int minimum, const int maximum);
+
+private:
+  uint64_t State;
+};
+
+/** Parameters that describe the holes of a mask. */
+struct MaskParameters
+{
+  /** The number of holes to place. */
+  unsigned int HoleCount = 1;
+
+  /** The radius (half of the side length for SQUARE) of each hole, in pixels. */
+  unsigned int HoleRadius = 32;
+
+  /** The shape of each hole. */
+  HoleShapeEnum HoleShape = SQUARE;
+
+  /** Holes are kept at least this far away from the image boundary. */
+  unsigned int BorderWidth = 16;
+
+  /** The seed of the random hole placement (and of the BLOB outlines). */
+  uint64_t Seed = 0;
+};
+
+/** Fill 'image' (of size 'size') with the specified texture. The pixel type must be
+  * a 3 component vector of unsigned char. */
+template <typename TImage>
+void CreateTexture(TImage* const image, const itk::Size<2>& size,
+                   const TextureEnum texture, const uint64_t seed);
+
+/** Create a mask of size 'size' according to 'parameters'. Hole pixels are set to the
+  * mask's hole value, all other pixels are set to its valid value. */
+void CreateMask(Mask* const mask, const itk::Size<2>& size, const MaskParameters& parameters);
+
+/** Compute the radius for 'holeCount' holes of 'holeShape' so that together they
+  * cover approximately 'holeFraction' (0,1) of an image of size 'size'. */
+unsigned int HoleRadiusForFraction(const itk::Size<2>& size, const float holeFraction,
+                                   const unsigned int holeCount, const HoleShapeEnum holeShape);
+
+/** Write the mask as <prefix>_mask.png along with the <prefix>.mask file that
+  * Mask::Read() (and therefore every driver) expects. */
+void WriteMask(Mask* const mask, const std::string& prefix);
+
+/** Parse a texture name ("noise", "stripes", "fractal"). Throws if the name is unknown. */
+TextureEnum TextureFromString(const std::string& textureName);
+
+/** Parse a hole shape name ("square", "disc", "blob"). Throws if the name is unknown. */
+HoleShapeEnum HoleShapeFromString(const std::string& holeShapeName);
+
+} // end SyntheticWorkload namespace
+
+#include "SyntheticWorkload.hpp"
+
+#endif
@@ -0,0 +1,321 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef SyntheticWorkload_HPP
+#define SyntheticWorkload_HPP
+
+#include "SyntheticWorkload.h"
+
+// Submodules
+#include <ITKHelpers/ITKHelpers.h>
+
+// ITK
+#include "itkImageRegionIterator.h"
+#include "itkImageRegionIteratorWithIndex.h"
+
+// STL
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+
+namespace SyntheticWorkload
+{
+
+inline uint64_t Random::Next()
+{
+  this->State += 0x9E3779B97F4A7C15ULL;
+  uint64_t z = this->State;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+inline float Random::NextFloat()
+{
+  // Use the top 24 bits so that every value is exactly representable.
+  return static_cast<float>(Next() >> 40) / static_cast<float>(1 << 24);
+}
+
+inline int Random::NextInteger(const int minimum, const int maximum)
+{
+  assert(maximum >= minimum);
+  uint64_t range = static_cast<uint64_t>(maximum - minimum) + 1;
+  return minimum + static_cast<int>(Next() % range);
+}
+
+/** Hash a lattice position to 64 random bits. */
+inline uint64_t HashLattice(const uint64_t seed, const int64_t x, const int64_t y)
+{
+  Random random(seed ^ (static_cast<uint64_t>(x) * 0x9E3779B97F4A7C15ULL) ^
+                (static_cast<uint64_t>(y) * 0xC2B2AE3D27D4EB4FULL));
+  return random.Next();
+}
+
+/** Bilinearly interpolated lattice ("value") noise in [0,255] with lattice spacing
+  * 'spacing'. Integer arithmetic only, so it is bit-identical everywhere. */
+inline unsigned int ValueNoise(const uint64_t seed, const int64_t x, const int64_t y,
+                               const int64_t spacing)
+{
+  int64_t cellX = x / spacing;
+  int64_t cellY = y / spacing;
+  // Weights in [0, 256]
+  int64_t weightX = ((x % spacing) << 8) / spacing;
+  int64_t weightY = ((y % spacing) << 8) / spacing;
+
+  int64_t v00 = HashLattice(seed, cellX, cellY) & 0xFF;
+  int64_t v10 = HashLattice(seed, cellX + 1, cellY) & 0xFF;
+  int64_t v01 = HashLattice(seed, cellX, cellY + 1) & 0xFF;
+  int64_t v11 = HashLattice(seed, cellX + 1, cellY + 1) & 0xFF;
+
+  int64_t top = v00 * (256 - weightX) + v10 * weightX;
+  int64_t bottom = v01 * (256 - weightX) + v11 * weightX;
+  return static_cast<unsigned int>((top * (256 - weightY) + bottom * weightY) >> 16);
+}
+
+template <typename TImage>
+void CreateTexture(TImage* const image, const itk::Size<2>& size,
+                   const TextureEnum texture, const uint64_t seed)
+{
+  itk::Index<2> corner = {{0,0}};
+  image->SetRegions(itk::ImageRegion<2>(corner, size));
+  image->Allocate();
+
+  // Per-channel stripe directions and periods, drawn once from the seed.
+  Random random(seed);
+  int64_t stripeDirection[3][2];
+  int64_t stripePeriod[3];
+  for(unsigned int channel = 0; channel < 3; ++channel)
+  {
+    do
+    {
+      stripeDirection[channel][0] = random.NextInteger(-3, 3);
+      stripeDirection[channel][1] = random.NextInteger(-3, 3);
+    } while(stripeDirection[channel][0] == 0 && stripeDirection[channel][1] == 0);
+    stripePeriod[channel] = random.NextInteger(16, 96);
+  }
+
+  itk::ImageRegionIteratorWithIndex<TImage> imageIterator(image, image->GetLargestPossibleRegion());
+  while(!imageIterator.IsAtEnd())
+  {
+    itk::Index<2> index = imageIterator.GetIndex();
+    typename TImage::PixelType pixel;
+
+    for(unsigned int channel = 0; channel < 3; ++channel)
+    {
+      uint64_t channelSeed = seed + channel;
+      unsigned int value = 0;
+
+      if(texture == NOISE)
+      {
+        value = HashLattice(channelSeed, index[0], index[1]) & 0xFF;
+      }
+      else if(texture == STRIPES)
+      {
+        // A triangle wave along an integer direction, so no trigonometry is needed.
+        int64_t t = index[0] * stripeDirection[channel][0] + index[1] * stripeDirection[channel][1];
+        int64_t period = stripePeriod[channel];
+        int64_t phase = ((t % period) + period) % period;
+        int64_t halfPeriod = period / 2;
+        int64_t triangle = (phase < halfPeriod) ? phase : period - phase;
+        value = static_cast<unsigned int>((triangle * 255) / halfPeriod);
+      }
+      else if(texture == FRACTAL)
+      {
+        // Sum of octaves of value noise with halving amplitude (fractal Brownian motion).
+        unsigned int sum = 0;
+        unsigned int totalAmplitude = 0;
+        unsigned int amplitude = 128;
+        for(int64_t spacing = 128; spacing >= 2; spacing /= 2)
+        {
+          sum += amplitude * ValueNoise(channelSeed + spacing, index[0], index[1], spacing);
+          totalAmplitude += amplitude;
+          amplitude /= 2;
+        }
+        value = sum / totalAmplitude;
+      }
+      else
+      {
+        throw std::runtime_error("SyntheticWorkload::CreateTexture: invalid texture!");
+      }
+
+      pixel[channel] = static_cast<unsigned char>(std::min(value, 255u));
+    }
+
+    imageIterator.Set(pixel);
+    ++imageIterator;
+  }
+}
+
+/** Mark the pixels of a single hole centered at 'center' in 'mask'. */
+inline void MarkHole(Mask* const mask, const itk::Index<2>& center, const int radius,
+                     const HoleShapeEnum holeShape, Random& random)
+{
+  itk::Size<2> holeBoxSize = {{static_cast<itk::SizeValueType>(2 * radius + 1),
+                               static_cast<itk::SizeValueType>(2 * radius + 1)}};
+  itk::Index<2> holeBoxCorner = {{center[0] - radius, center[1] - radius}};
+  itk::ImageRegion<2> holeBox(holeBoxCorner, holeBoxSize);
+  holeBox.Crop(mask->GetLargestPossibleRegion());
+
+  // A BLOB is the union of a few overlapping discs around the hole center.
+  const unsigned int numberOfLobes = 5;
+  int64_t lobeCenters[numberOfLobes][2] = {};
+  int64_t lobeRadii[numberOfLobes] = {};
+  if(holeShape == BLOB)
+  {
+    for(unsigned int lobeId = 0; lobeId < numberOfLobes; ++lobeId)
+    {
+      lobeRadii[lobeId] = random.NextInteger(radius / 2, radius);
+      int offsetRange = radius - lobeRadii[lobeId];
+      lobeCenters[lobeId][0] = center[0] + random.NextInteger(-offsetRange, offsetRange);
+      lobeCenters[lobeId][1] = center[1] + random.NextInteger(-offsetRange, offsetRange);
+    }
+  }
+
+  itk::ImageRegionIteratorWithIndex<Mask> maskIterator(mask, holeBox);
+  while(!maskIterator.IsAtEnd())
+  {
+    itk::Index<2> index = maskIterator.GetIndex();
+    int64_t dx = index[0] - center[0];
+    int64_t dy = index[1] - center[1];
+
+    bool inHole = false;
+    if(holeShape == SQUARE)
+    {
+      inHole = true; // The box is the hole
+    }
+    else if(holeShape == DISC)
+    {
+      inHole = (dx * dx + dy * dy <= static_cast<int64_t>(radius) * radius);
+    }
+    else if(holeShape == BLOB)
+    {
+      for(unsigned int lobeId = 0; lobeId < numberOfLobes && !inHole; ++lobeId)
+      {
+        int64_t lx = index[0] - lobeCenters[lobeId][0];
+        int64_t ly = index[1] - lobeCenters[lobeId][1];
+        inHole = (lx * lx + ly * ly <= lobeRadii[lobeId] * lobeRadii[lobeId]);
+      }
+    }
+
+    if(inHole)
+    {
+      maskIterator.Set(mask->GetHoleValue());
+    }
+    ++maskIterator;
+  }
+}
+
+inline void CreateMask(Mask* const mask, const itk::Size<2>& size, const MaskParameters& parameters)
+{
+  itk::Index<2> corner = {{0,0}};
+  mask->SetRegions(itk::ImageRegion<2>(corner, size));
+  mask->Allocate();
+  ITKHelpers::SetImageToConstant(mask, mask->GetValidValue());
+
+  const int radius = static_cast<int>(parameters.HoleRadius);
+  const int margin = radius + static_cast<int>(parameters.BorderWidth);
+  if(2 * margin >= static_cast<int>(size[0]) || 2 * margin >= static_cast<int>(size[1]))
+  {
+    throw std::runtime_error("SyntheticWorkload::CreateMask: the holes do not fit in the image!");
+  }
+
+  Random random(parameters.Seed);
+  for(unsigned int holeId = 0; holeId < parameters.HoleCount; ++holeId)
+  {
+    itk::Index<2> center = {{random.NextInteger(margin, static_cast<int>(size[0]) - 1 - margin),
+                             random.NextInteger(margin, static_cast<int>(size[1]) - 1 - margin)}};
+    MarkHole(mask, center, radius, parameters.HoleShape, random);
+  }
+}
+
+inline unsigned int HoleRadiusForFraction(const itk::Size<2>& size, const float holeFraction,
+                                          const unsigned int holeCount, const HoleShapeEnum holeShape)
+{
+  assert(holeCount > 0);
+  float holeArea = holeFraction * static_cast<float>(size[0]) * static_cast<float>(size[1]) /
+                   static_cast<float>(holeCount);
+  float radius = 0.0f;
+  if(holeShape == SQUARE)
+  {
+    radius = (sqrt(holeArea) - 1.0f) / 2.0f;
+  }
+  else // DISC and BLOB are approximately discs
+  {
+    radius = sqrt(holeArea / static_cast<float>(M_PI));
+  }
+  return static_cast<unsigned int>(std::max(radius, 1.0f));
+}
+
+inline void WriteMask(Mask* const mask, const std::string& prefix)
+{
+  std::string imageFileName = prefix + "_mask.png";
+  ITKHelpers::WriteImage(mask, imageFileName);
+
+  // The image file name in the .mask file is relative to the .mask file.
+  std::string::size_type lastSlash = imageFileName.find_last_of("/\\");
+  std::string relativeImageFileName = (lastSlash == std::string::npos) ?
+                                      imageFileName : imageFileName.substr(lastSlash + 1);
+
+  std::ofstream fout((prefix + ".mask").c_str());
+  fout << "hole " << static_cast<int>(mask->GetHoleValue()) << std::endl
+       << "valid " << static_cast<int>(mask->GetValidValue()) << std::endl
+       << relativeImageFileName;
+  fout.close();
+}
+
+inline TextureEnum TextureFromString(const std::string& textureName)
+{
+  if(textureName == "noise")
+  {
+    return NOISE;
+  }
+  else if(textureName == "stripes")
+  {
+    return STRIPES;
+  }
+  else if(textureName == "fractal")
+  {
+    return FRACTAL;
+  }
+
+  throw std::runtime_error("Unknown texture '" + textureName + "' (use noise, stripes or fractal)!");
+}
+
+inline HoleShapeEnum HoleShapeFromString(const std::string& holeShapeName)
+{
+  if(holeShapeName == "square")
+  {
+    return SQUARE;
+  }
+  else if(holeShapeName == "disc")
+  {
+    return DISC;
+  }
+  else if(holeShapeName == "blob")
+  {
+    return BLOB;
+  }
+
+  throw std::runtime_error("Unknown hole shape '" + holeShapeName + "' (use square, disc or blob)!");
+}
+
+} // end SyntheticWorkload namespace
+
+#endif
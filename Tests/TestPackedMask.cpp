@@ -0,0 +1,277 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+
+// Compare a PackedMask with the Mask it was packed from. The widths put the end of the rows
+// before, at and after the word boundaries, so that the bits of partial words (GetColumnBits(),
+// LastWordBits and the inverted words of the hole enumeration) are checked.
+
+// STL
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+// ITK
+#include "itkImageRegion.h"
+
+// Submodules
+#include <Mask/Mask.h>
+
+// Custom
+#include "PackedMask.h"
+
+namespace
+{
+
+/** Create a mask covering 'region' in which each pixel is valid with probability 'validFraction'. */
+Mask::Pointer CreateMask(const itk::ImageRegion<2>& region, const float validFraction, std::mt19937& randomGenerator)
+{
+  Mask::Pointer mask = Mask::New();
+  mask->SetRegions(region);
+  mask->Allocate();
+
+  std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+  for(itk::IndexValueType y = region.GetIndex()[1]; y < region.GetIndex()[1] + static_cast<itk::IndexValueType>(region.GetSize()[1]); ++y)
+  {
+    for(itk::IndexValueType x = region.GetIndex()[0]; x < region.GetIndex()[0] + static_cast<itk::IndexValueType>(region.GetSize()[0]); ++x)
+    {
+      itk::Index<2> index = {{x, y}};
+      mask->SetPixel(index, distribution(randomGenerator) < validFraction ? mask->GetValidValue() : mask->GetHoleValue());
+    }
+  }
+
+  return mask;
+}
+
+/** Check the pixel queries and the enumerations. */
+bool TestPixels(const Mask* const mask, const PackedMask& packedMask)
+{
+  const itk::ImageRegion<2> region = mask->GetLargestPossibleRegion();
+
+  std::vector<itk::Index<2> > validPixels;
+  std::vector<itk::Index<2> > holePixels;
+  for(itk::IndexValueType y = region.GetIndex()[1]; y < region.GetIndex()[1] + static_cast<itk::IndexValueType>(region.GetSize()[1]); ++y)
+  {
+    for(itk::IndexValueType x = region.GetIndex()[0]; x < region.GetIndex()[0] + static_cast<itk::IndexValueType>(region.GetSize()[0]); ++x)
+    {
+      itk::Index<2> index = {{x, y}};
+      if(packedMask.IsValid(index) != mask->IsValid(index))
+      {
+        std::cerr << "IsValid(" << x << ", " << y << ") differs." << std::endl;
+        return false;
+      }
+      if(mask->IsValid(index))
+      {
+        validPixels.push_back(index);
+      }
+      else
+      {
+        holePixels.push_back(index);
+      }
+    }
+  }
+
+  if(packedMask.CountValidPixels() != validPixels.size() || packedMask.CountHolePixels() != holePixels.size() ||
+     packedMask.HasValidPixels() != !validPixels.empty())
+  {
+    std::cerr << "The pixel counts differ." << std::endl;
+    return false;
+  }
+
+  if(!holePixels.empty())
+  {
+    itk::Index<2> lowerCorner = holePixels[0];
+    itk::Index<2> upperCorner = holePixels[0];
+    for(size_t pixelId = 1; pixelId < holePixels.size(); ++pixelId)
+    {
+      for(unsigned int dimension = 0; dimension < 2; ++dimension)
+      {
+        lowerCorner[dimension] = std::min(lowerCorner[dimension], holePixels[pixelId][dimension]);
+        upperCorner[dimension] = std::max(upperCorner[dimension], holePixels[pixelId][dimension]);
+      }
+    }
+
+    const itk::ImageRegion<2> boundingBox = packedMask.GetHoleBoundingBox();
+    if(boundingBox.GetIndex() != lowerCorner ||
+       boundingBox.GetSize()[0] != static_cast<itk::SizeValueType>(upperCorner[0] - lowerCorner[0] + 1) ||
+       boundingBox.GetSize()[1] != static_cast<itk::SizeValueType>(upperCorner[1] - lowerCorner[1] + 1))
+    {
+      std::cerr << "The bounding box of the hole differs." << std::endl;
+      return false;
+    }
+  }
+  else if(packedMask.GetHoleBoundingBox().GetNumberOfPixels() != 0)
+  {
+    std::cerr << "The bounding box of a mask without hole pixels is not empty." << std::endl;
+    return false;
+  }
+
+  const std::vector<itk::Index<2> > packedValidPixels = packedMask.GetValidPixels();
+  const std::vector<itk::Index<2> > packedHolePixels = packedMask.GetHolePixels();
+  if(packedValidPixels != validPixels || packedHolePixels != holePixels)
+  {
+    std::cerr << "The enumerated valid or hole pixels differ." << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+/** Check IsValid() and CountValidPixels() of every horizontal extent, over one and over all rows. */
+bool TestRegions(const Mask* const mask, const PackedMask& packedMask)
+{
+  const itk::ImageRegion<2> region = mask->GetLargestPossibleRegion();
+  const itk::SizeValueType width = region.GetSize()[0];
+  const itk::SizeValueType height = region.GetSize()[1];
+
+  for(itk::SizeValueType begin = 0; begin < width; ++begin)
+  {
+    for(itk::SizeValueType end = begin + 1; end <= width; ++end)
+    {
+      for(itk::SizeValueType firstRow = 0; firstRow < height; firstRow += std::max<itk::SizeValueType>(height - 1, 1))
+      {
+        const itk::SizeValueType numberOfRows = (firstRow == 0) ? height : 1;
+        itk::Index<2> corner = {{region.GetIndex()[0] + static_cast<itk::IndexValueType>(begin),
+                                 region.GetIndex()[1] + static_cast<itk::IndexValueType>(firstRow)}};
+        itk::Size<2> size = {{end - begin, numberOfRows}};
+        itk::ImageRegion<2> queryRegion(corner, size);
+
+        size_t numberOfValidPixels = 0;
+        for(itk::IndexValueType y = corner[1]; y < corner[1] + static_cast<itk::IndexValueType>(size[1]); ++y)
+        {
+          for(itk::IndexValueType x = corner[0]; x < corner[0] + static_cast<itk::IndexValueType>(size[0]); ++x)
+          {
+            itk::Index<2> index = {{x, y}};
+            if(mask->IsValid(index))
+            {
+              numberOfValidPixels++;
+            }
+          }
+        }
+
+        if(packedMask.CountValidPixels(queryRegion) != numberOfValidPixels ||
+           packedMask.IsValid(queryRegion) != (numberOfValidPixels == queryRegion.GetNumberOfPixels()))
+        {
+          std::cerr << "The region of columns [" << begin << ", " << end << ") and rows [" << firstRow << ", "
+                    << firstRow + numberOfRows << ") differs." << std::endl;
+          return false;
+        }
+      }
+    }
+  }
+
+  // A region that is not entirely inside the mask is not valid
+  itk::Index<2> outsideCorner = {{region.GetIndex()[0] - 1, region.GetIndex()[1]}};
+  itk::Size<2> outsideSize = {{1, 1}};
+  if(packedMask.IsValid(itk::ImageRegion<2>(outsideCorner, outsideSize)))
+  {
+    std::cerr << "A region outside of the mask is valid." << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+/** Check that WriteToMask() gives back the mask, and that SetValid() only changes its own pixel. */
+bool TestWriteAndSet(const Mask* const mask, PackedMask packedMask)
+{
+  const itk::ImageRegion<2> region = mask->GetLargestPossibleRegion();
+
+  Mask::Pointer writtenMask = Mask::New();
+  packedMask.WriteToMask(writtenMask);
+  for(size_t pixelId = 0; pixelId < region.GetNumberOfPixels(); ++pixelId)
+  {
+    if(writtenMask->GetBufferPointer()[pixelId] != mask->GetBufferPointer()[pixelId])
+    {
+      std::cerr << "WriteToMask() differs at pixel " << pixelId << "." << std::endl;
+      return false;
+    }
+  }
+
+  // The last pixel of the first row is in the partial word, next to the first pixel of the second row
+  itk::Index<2> lastPixel = {{region.GetIndex()[0] + static_cast<itk::IndexValueType>(region.GetSize()[0]) - 1,
+                              region.GetIndex()[1]}};
+  const size_t numberOfValidPixels = packedMask.CountValidPixels();
+  const bool wasValid = packedMask.IsValid(lastPixel);
+
+  packedMask.SetValid(lastPixel, !wasValid);
+  if(packedMask.IsValid(lastPixel) == wasValid ||
+     packedMask.CountValidPixels() != (wasValid ? numberOfValidPixels - 1 : numberOfValidPixels + 1))
+  {
+    std::cerr << "SetValid() did not change only the last pixel of the first row." << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+} // end anonymous namespace
+
+int main(int, char*[])
+{
+  std::mt19937 randomGenerator(0);
+
+  const itk::SizeValueType widths[] = {1, 2, 63, 64, 65, 127, 128, 129, 150};
+  const itk::SizeValueType heights[] = {1, 3};
+  const float validFractions[] = {0.0f, 0.5f, 0.95f, 1.0f};
+
+  for(const itk::SizeValueType width : widths)
+  {
+    for(const itk::SizeValueType height : heights)
+    {
+      for(const float validFraction : validFractions)
+      {
+        // A corner away from the origin checks that the indices are relative to the region
+        itk::Index<2> corner = {{-3, 5}};
+        itk::Size<2> size = {{width, height}};
+        Mask::Pointer mask = CreateMask(itk::ImageRegion<2>(corner, size), validFraction, randomGenerator);
+
+        PackedMask packedMask;
+        packedMask.SetFromMask(mask);
+
+        if(!TestPixels(mask, packedMask) || !TestRegions(mask, packedMask) || !TestWriteAndSet(mask, packedMask))
+        {
+          std::cerr << "Failed for a " << width << "x" << height << " mask with valid fraction "
+                    << validFraction << "." << std::endl;
+          return EXIT_FAILURE;
+        }
+      }
+    }
+  }
+
+  // A pixel that is neither a hole nor valid is rejected
+  itk::Index<2> corner = {{0, 0}};
+  itk::Size<2> size = {{4, 4}};
+  Mask::Pointer mask = CreateMask(itk::ImageRegion<2>(corner, size), 1.0f, randomGenerator);
+  mask->SetPixel(corner, static_cast<Mask::PixelType>(mask->GetValidValue() / 2));
+  try
+  {
+    PackedMask packedMask;
+    packedMask.SetFromMask(mask);
+    std::cerr << "A mask with a pixel that is neither a hole nor valid was packed." << std::endl;
+    return EXIT_FAILURE;
+  }
+  catch(const std::runtime_error&)
+  {
+  }
+
+  return EXIT_SUCCESS;
+}
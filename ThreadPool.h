@@ -0,0 +1,82 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+
+#ifndef ThreadPool_H
+#define ThreadPool_H
+
+// STL
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** A fixed set of threads that run the iterations of ParallelFor(). The calling thread takes part,
+  * so a pool of N threads starts N - 1 of its own, and a pool of 1 thread runs everything on the
+  * caller. */
+class ThreadPool
+{
+public:
+  /** The function run by ParallelFor(), called with the task id and the id (in [0, GetNumberOfThreads()))
+    * of the thread that runs it. No two tasks run at the same time with the same thread id. */
+  typedef std::function<void(const size_t taskId, const unsigned int threadId)> TaskFunctionType;
+
+  /** Create a pool of 'numberOfThreads' threads, or one per hardware thread if it is 0. */
+  explicit ThreadPool(const unsigned int numberOfThreads = 0);
+
+  ~ThreadPool();
+
+  unsigned int GetNumberOfThreads() const;
+
+  /** Run 'function' for every task id in [0, numberOfTasks) and wait for all of them to finish.
+    * If a task throws, the remaining tasks are skipped and the first exception is rethrown here. */
+  void ParallelFor(const size_t numberOfTasks, const TaskFunctionType& function);
+
+private:
+  /** Take tasks of the current ParallelFor() until there are none left. */
+  void RunTasks(const unsigned int threadId);
+
+  /** The loop of each of the pool's own threads. */
+  void WorkerLoop(const unsigned int threadId);
+
+  std::vector<std::thread> Threads;
+
+  std::mutex Mutex;
+
+  /** Signalled when a ParallelFor() starts or the pool is destroyed. */
+  std::condition_variable StartCondition;
+
+  /** Signalled when a pool thread finishes its share of a ParallelFor(). */
+  std::condition_variable DoneCondition;
+
+  /** The state of the current ParallelFor(), guarded by Mutex. */
+  const TaskFunctionType* Function = nullptr;
+  size_t NumberOfTasks = 0;
+  size_t NextTask = 0;
+  unsigned int Generation = 0;
+  unsigned int NumberOfBusyThreads = 0;
+  std::exception_ptr Exception;
+  bool Stopping = false;
+};
+
+#include "ThreadPool.hpp"
+
+#endif
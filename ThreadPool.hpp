@@ -0,0 +1,153 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+
+#ifndef ThreadPool_HPP
+#define ThreadPool_HPP
+
+#include "ThreadPool.h"
+
+// STL
+#include <algorithm>
+
+inline ThreadPool::ThreadPool(const unsigned int numberOfThreads)
+{
+  unsigned int totalThreads = numberOfThreads;
+  if(totalThreads == 0)
+  {
+    totalThreads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  for(unsigned int threadId = 1; threadId < totalThreads; ++threadId)
+  {
+    this->Threads.push_back(std::thread(&ThreadPool::WorkerLoop, this, threadId));
+  }
+}
+
+inline ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    this->Stopping = true;
+  }
+  this->StartCondition.notify_all();
+
+  for(size_t threadId = 0; threadId < this->Threads.size(); ++threadId)
+  {
+    this->Threads[threadId].join();
+  }
+}
+
+inline unsigned int ThreadPool::GetNumberOfThreads() const
+{
+  return static_cast<unsigned int>(this->Threads.size()) + 1;
+}
+
+inline void ThreadPool::ParallelFor(const size_t numberOfTasks, const TaskFunctionType& function)
+{
+  if(numberOfTasks == 0)
+  {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    this->Function = &function;
+    this->NumberOfTasks = numberOfTasks;
+    this->NextTask = 0;
+    this->Exception = nullptr;
+    this->NumberOfBusyThreads = static_cast<unsigned int>(this->Threads.size());
+    this->Generation++;
+  }
+  this->StartCondition.notify_all();
+
+  RunTasks(0);
+
+  std::exception_ptr exception;
+  {
+    std::unique_lock<std::mutex> lock(this->Mutex);
+    this->DoneCondition.wait(lock, [this]() {return this->NumberOfBusyThreads == 0;});
+    this->Function = nullptr;
+    exception = this->Exception;
+  }
+
+  if(exception)
+  {
+    std::rethrow_exception(exception);
+  }
+}
+
+inline void ThreadPool::RunTasks(const unsigned int threadId)
+{
+  while(true)
+  {
+    size_t taskId = 0;
+    const TaskFunctionType* function = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(this->Mutex);
+      if(this->NextTask >= this->NumberOfTasks)
+      {
+        return;
+      }
+      taskId = this->NextTask++;
+      function = this->Function;
+    }
+
+    try
+    {
+      (*function)(taskId, threadId);
+    }
+    catch(...)
+    {
+      std::lock_guard<std::mutex> lock(this->Mutex);
+      if(!this->Exception)
+      {
+        this->Exception = std::current_exception();
+      }
+      this->NextTask = this->NumberOfTasks; // Skip the remaining tasks
+    }
+  }
+}
+
+inline void ThreadPool::WorkerLoop(const unsigned int threadId)
+{
+  unsigned int lastGeneration = 0;
+  while(true)
+  {
+    {
+      std::unique_lock<std::mutex> lock(this->Mutex);
+      this->StartCondition.wait(lock, [this, lastGeneration]()
+                                {return this->Stopping || this->Generation != lastGeneration;});
+      if(this->Stopping)
+      {
+        return;
+      }
+      lastGeneration = this->Generation;
+    }
+
+    RunTasks(threadId);
+
+    {
+      std::lock_guard<std::mutex> lock(this->Mutex);
+      this->NumberOfBusyThreads--;
+    }
+    this->DoneCondition.notify_all();
+  }
+}
+
+#endif
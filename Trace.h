@@ -0,0 +1,128 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef Trace_H
+#define Trace_H
+
+// STL
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** Records timed scopes ("phases") and writes them as a Chrome/Perfetto trace
+  * (load trace.json in chrome://tracing or ui.perfetto.dev) and as a summary table.
+  * Use the BDS_TRACE_* macros below rather than this class directly, so that the
+  * instrumentation compiles to nothing unless BDSInpainting_EnableTracing is defined. */
+class TraceRecorder
+{
+public:
+  typedef std::chrono::steady_clock ClockType;
+
+  /** A single completed scope. */
+  struct Event
+  {
+    std::string Name;
+    /** The iteration (or ring) this event belongs to, or -1 if none. */
+    int Iteration;
+    /** Start time in microseconds since the recorder was created. */
+    double Start;
+    /** Duration in microseconds. */
+    double Duration;
+    unsigned int ThreadId;
+  };
+
+  /** Get the process-wide recorder. */
+  static TraceRecorder& Instance();
+
+  /** Record a completed scope. This is thread safe. */
+  void AddEvent(const std::string& name, const int iteration,
+                const ClockType::time_point& start, const ClockType::time_point& end);
+
+  /** Get a copy of all of the events recorded so far. */
+  std::vector<Event> GetEvents() const;
+
+  /** Forget all recorded events. */
+  void Clear();
+
+  /** Write the events in the Chrome trace event format. */
+  void WriteChromeTrace(const std::string& fileName) const;
+
+  /** Write a table of count, total, mean and max time per phase name, sorted by total time. */
+  void WriteSummary(std::ostream& stream) const;
+
+private:
+  TraceRecorder();
+
+  /** Map the calling thread to a small, stable id. Must be called with the mutex held. */
+  unsigned int GetThreadId();
+
+  ClockType::time_point Origin;
+
+  std::vector<Event> Events;
+
+  std::map<std::thread::id, unsigned int> ThreadIds;
+
+  mutable std::mutex Mutex;
+};
+
+/** Times the enclosing scope and records it with the TraceRecorder on destruction. */
+class ScopedTrace
+{
+public:
+  ScopedTrace(const std::string& name, const int iteration = -1);
+
+  ~ScopedTrace();
+
+private:
+  std::string Name;
+
+  int Iteration;
+
+  TraceRecorder::ClockType::time_point Start;
+};
+
+#define BDS_TRACE_CONCATENATE_DETAIL(a, b) a##b
+#define BDS_TRACE_CONCATENATE(a, b) BDS_TRACE_CONCATENATE_DETAIL(a, b)
+
+#ifdef BDSInpainting_EnableTracing
+  /** Time the rest of the enclosing scope as phase 'name'. */
+  #define BDS_TRACE_SCOPE(name) \
+    ScopedTrace BDS_TRACE_CONCATENATE(bdsScopedTrace, __LINE__)(name)
+  /** Time the rest of the enclosing scope as phase 'name' of iteration 'iteration'. */
+  #define BDS_TRACE_SCOPE_ITERATION(name, iteration) \
+    ScopedTrace BDS_TRACE_CONCATENATE(bdsScopedTrace, __LINE__)(name, static_cast<int>(iteration))
+  /** Write 'fileName' in the Chrome trace format and print the summary table. */
+  #define BDS_TRACE_WRITE(fileName) \
+    do \
+    { \
+      TraceRecorder::Instance().WriteChromeTrace(fileName); \
+      TraceRecorder::Instance().WriteSummary(std::cout); \
+    } while(0)
+#else
+  #define BDS_TRACE_SCOPE(name)
+  #define BDS_TRACE_SCOPE_ITERATION(name, iteration)
+  #define BDS_TRACE_WRITE(fileName)
+#endif
+
+#include "Trace.hpp"
+
+#endif
@@ -0,0 +1,173 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef Trace_HPP
+#define Trace_HPP
+
+#include "Trace.h"
+
+// STL
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+inline TraceRecorder::TraceRecorder() : Origin(ClockType::now())
+{
+
+}
+
+inline TraceRecorder& TraceRecorder::Instance()
+{
+  static TraceRecorder recorder;
+  return recorder;
+}
+
+inline unsigned int TraceRecorder::GetThreadId()
+{
+  std::thread::id id = std::this_thread::get_id();
+  std::map<std::thread::id, unsigned int>::const_iterator iterator = this->ThreadIds.find(id);
+  if(iterator != this->ThreadIds.end())
+  {
+    return iterator->second;
+  }
+
+  unsigned int newId = static_cast<unsigned int>(this->ThreadIds.size());
+  this->ThreadIds[id] = newId;
+  return newId;
+}
+
+inline void TraceRecorder::AddEvent(const std::string& name, const int iteration,
+                                    const ClockType::time_point& start,
+                                    const ClockType::time_point& end)
+{
+  typedef std::chrono::duration<double, std::micro> MicrosecondsType;
+
+  Event event;
+  event.Name = name;
+  event.Iteration = iteration;
+  event.Start = std::chrono::duration_cast<MicrosecondsType>(start - this->Origin).count();
+  event.Duration = std::chrono::duration_cast<MicrosecondsType>(end - start).count();
+
+  std::lock_guard<std::mutex> lock(this->Mutex);
+  event.ThreadId = GetThreadId();
+  this->Events.push_back(event);
+}
+
+inline std::vector<TraceRecorder::Event> TraceRecorder::GetEvents() const
+{
+  std::lock_guard<std::mutex> lock(this->Mutex);
+  return this->Events;
+}
+
+inline void TraceRecorder::Clear()
+{
+  std::lock_guard<std::mutex> lock(this->Mutex);
+  this->Events.clear();
+}
+
+inline void TraceRecorder::WriteChromeTrace(const std::string& fileName) const
+{
+  std::vector<Event> events = GetEvents();
+
+  std::ofstream fout(fileName.c_str());
+  fout << "{\"traceEvents\":[" << std::endl;
+  fout << std::fixed << std::setprecision(3);
+  for(size_t eventId = 0; eventId < events.size(); ++eventId)
+  {
+    const Event& event = events[eventId];
+    // Phase names are generated by this library, so they never need JSON escaping.
+    fout << "{\"name\":\"" << event.Name << "\",\"cat\":\"BDSInpainting\",\"ph\":\"X\""
+         << ",\"ts\":" << event.Start << ",\"dur\":" << event.Duration
+         << ",\"pid\":1,\"tid\":" << event.ThreadId;
+    if(event.Iteration >= 0)
+    {
+      fout << ",\"args\":{\"iteration\":" << event.Iteration << "}";
+    }
+    fout << "}";
+    if(eventId + 1 < events.size())
+    {
+      fout << ",";
+    }
+    fout << std::endl;
+  }
+  fout << "],\"displayTimeUnit\":\"ms\"}" << std::endl;
+  fout.close();
+}
+
+inline void TraceRecorder::WriteSummary(std::ostream& stream) const
+{
+  struct PhaseSummary
+  {
+    std::string Name;
+    unsigned int Count = 0;
+    double Total = 0.0;
+    double Max = 0.0;
+  };
+
+  std::vector<Event> events = GetEvents();
+
+  std::map<std::string, PhaseSummary> summaries;
+  for(size_t eventId = 0; eventId < events.size(); ++eventId)
+  {
+    PhaseSummary& summary = summaries[events[eventId].Name];
+    summary.Name = events[eventId].Name;
+    summary.Count++;
+    summary.Total += events[eventId].Duration;
+    summary.Max = std::max(summary.Max, events[eventId].Duration);
+  }
+
+  std::vector<PhaseSummary> sortedSummaries;
+  for(std::map<std::string, PhaseSummary>::const_iterator iterator = summaries.begin();
+      iterator != summaries.end(); ++iterator)
+  {
+    sortedSummaries.push_back(iterator->second);
+  }
+  std::sort(sortedSummaries.begin(), sortedSummaries.end(),
+            [](const PhaseSummary& a, const PhaseSummary& b) {return a.Total > b.Total;});
+
+  stream << std::left << std::setw(40) << "Phase" << std::right
+         << std::setw(10) << "Count" << std::setw(14) << "Total (ms)"
+         << std::setw(14) << "Mean (ms)" << std::setw(14) << "Max (ms)" << std::endl;
+  stream << std::fixed << std::setprecision(3);
+  for(size_t summaryId = 0; summaryId < sortedSummaries.size(); ++summaryId)
+  {
+    const PhaseSummary& summary = sortedSummaries[summaryId];
+    stream << std::left << std::setw(40) << summary.Name << std::right
+           << std::setw(10) << summary.Count
+           << std::setw(14) << summary.Total / 1000.0
+           << std::setw(14) << summary.Total / 1000.0 / summary.Count
+           << std::setw(14) << summary.Max / 1000.0 << std::endl;
+  }
+}
+
+inline ScopedTrace::ScopedTrace(const std::string& name, const int iteration) :
+  Name(name), Iteration(iteration)
+{
+  // Make sure the recorder (and therefore its time origin) exists before we start timing.
+  TraceRecorder::Instance();
+  this->Start = TraceRecorder::ClockType::now();
+}
+
+inline ScopedTrace::~ScopedTrace()
+{
+  TraceRecorder::Instance().AddEvent(this->Name, this->Iteration, this->Start,
+                                     TraceRecorder::ClockType::now());
+}
+
+#endif
@@ -0,0 +1,92 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+
+#ifndef UnverifiedPixelWorklist_H
+#define UnverifiedPixelWorklist_H
+
+// ITK
+#include "itkIndex.h"
+
+// Submodules
+#include <Mask/Mask.h>
+#include <PatchMatch/PatchMatchHelpers.h>
+#include <PatchMatch/Process.h>
+
+// STL
+#include <cstddef>
+#include <vector>
+
+/** The target pixels that do not yet have a verified match. The list is built by one pass over
+  * the target pixels, after which Update() drops the pixels that have since been verified by
+  * looking only at the pixels that are still in the list. Loops that previously counted the
+  * unverified pixels of the whole field each iteration can then cost O(remaining) instead of
+  * O(image). */
+class UnverifiedPixelWorklist
+{
+public:
+  typedef PatchMatchHelpers::NNFieldType NNFieldType;
+
+  /** Track the Valid pixels of 'targetMask' that do not have a verified match in 'nnField'. */
+  void Initialize(NNFieldType* const nnField, const Mask* const targetMask);
+
+  /** Track the pixels of 'pixels' that do not have a verified match in 'nnField'. */
+  void Initialize(NNFieldType* const nnField, const std::vector<itk::Index<2> >& pixels);
+
+  /** Remove the pixels that now have a verified match. Returns the number of pixels remaining. */
+  size_t Update();
+
+  /** Set the pixels that Update() has removed since the last call to Hole in 'mask'. If 'mask'
+    * had exactly the tracked pixels Valid, it again has exactly the remaining pixels Valid. */
+  void RemoveVerifiedPixelsFromMask(Mask* const mask);
+
+  /** The pixels that did not have a verified match at the last Initialize() or Update(). */
+  const std::vector<itk::Index<2> >& GetPixels() const;
+
+  size_t GetNumberOfPixels() const;
+
+  bool IsEmpty() const;
+
+private:
+  NNFieldType* NNField = nullptr;
+
+  /** The pixels without a verified match. */
+  std::vector<itk::Index<2> > Pixels;
+
+  /** The pixels removed by Update() that have not yet been passed to RemoveVerifiedPixelsFromMask(). */
+  std::vector<itk::Index<2> > VerifiedPixels;
+};
+
+/** Process the pixels of an UnverifiedPixelWorklist. This replaces ProcessUnverifiedValidMaskPixels,
+  * which scans the whole mask and field every time the pixels are requested. */
+struct ProcessWorklistPixels : public Process
+{
+  ProcessWorklistPixels(const UnverifiedPixelWorklist* const worklist) : Worklist(worklist) {}
+
+  std::vector<itk::Index<2> > GetPixelsToProcess()
+  {
+    return this->Worklist->GetPixels();
+  }
+
+private:
+  const UnverifiedPixelWorklist* Worklist;
+};
+
+#include "UnverifiedPixelWorklist.hpp"
+
+#endif
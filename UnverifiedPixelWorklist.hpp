@@ -0,0 +1,118 @@
+/*=========================================================================
+ *
+ *  Copyright David Doria 2012 daviddoria@gmail.com
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+
+#ifndef UnverifiedPixelWorklist_HPP
+#define UnverifiedPixelWorklist_HPP
+
+#include "UnverifiedPixelWorklist.h"
+
+// ITK
+#include "itkImageRegionConstIteratorWithIndex.h"
+
+inline void UnverifiedPixelWorklist::Initialize(NNFieldType* const nnField, const Mask* const targetMask)
+{
+  this->NNField = nnField;
+  this->Pixels.clear();
+  this->VerifiedPixels.clear();
+
+  itk::ImageRegionConstIteratorWithIndex<Mask> maskIterator(targetMask, targetMask->GetLargestPossibleRegion());
+  while(!maskIterator.IsAtEnd())
+  {
+    if(maskIterator.Get() == targetMask->GetValidValue())
+    {
+      if(this->NNField->GetPixel(maskIterator.GetIndex()).HasVerifiedMatch())
+      {
+        this->VerifiedPixels.push_back(maskIterator.GetIndex());
+      }
+      else
+      {
+        this->Pixels.push_back(maskIterator.GetIndex());
+      }
+    }
+    ++maskIterator;
+  }
+}
+
+inline void UnverifiedPixelWorklist::Initialize(NNFieldType* const nnField,
+                                                const std::vector<itk::Index<2> >& pixels)
+{
+  this->NNField = nnField;
+  this->Pixels.clear();
+  this->VerifiedPixels.clear();
+
+  for(size_t pixelId = 0; pixelId < pixels.size(); ++pixelId)
+  {
+    if(this->NNField->GetPixel(pixels[pixelId]).HasVerifiedMatch())
+    {
+      this->VerifiedPixels.push_back(pixels[pixelId]);
+    }
+    else
+    {
+      this->Pixels.push_back(pixels[pixelId]);
+    }
+  }
+}
+
+inline size_t UnverifiedPixelWorklist::Update()
+{
+  // Compact in place, preserving the (raster) order of the remaining pixels
+  size_t numberOfRemainingPixels = 0;
+  for(size_t pixelId = 0; pixelId < this->Pixels.size(); ++pixelId)
+  {
+    const itk::Index<2>& pixel = this->Pixels[pixelId];
+    if(this->NNField->GetPixel(pixel).HasVerifiedMatch())
+    {
+      this->VerifiedPixels.push_back(pixel);
+    }
+    else
+    {
+      this->Pixels[numberOfRemainingPixels] = pixel;
+      numberOfRemainingPixels++;
+    }
+  }
+  this->Pixels.resize(numberOfRemainingPixels);
+
+  return numberOfRemainingPixels;
+}
+
+inline void UnverifiedPixelWorklist::RemoveVerifiedPixelsFromMask(Mask* const mask)
+{
+  for(size_t pixelId = 0; pixelId < this->VerifiedPixels.size(); ++pixelId)
+  {
+    mask->SetPixel(this->VerifiedPixels[pixelId], mask->GetHoleValue());
+  }
+  this->VerifiedPixels.clear();
+}
+
+inline const std::vector<itk::Index<2> >& UnverifiedPixelWorklist::GetPixels() const
+{
+  return this->Pixels;
+}
+
+inline size_t UnverifiedPixelWorklist::GetNumberOfPixels() const
+{
+  return this->Pixels.size();
+}
+
+inline bool UnverifiedPixelWorklist::IsEmpty() const
+{
+  return this->Pixels.empty();
+}
+
+#endif